@@ -0,0 +1,347 @@
+#include "batch.h"
+#include "msg.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BATCH_DELIMS " \t\r\n"
+
+typedef struct {
+  unsigned int nfiles;
+  char** files;
+  Hvme* vm;  /* Never runs itself. Jobs run clones of it. */
+} BatchProg;
+
+typedef struct {
+  char* input;
+  char* output;
+  size_t prog;  /* Index into the batch's programs. */
+  unsigned int line;  /* Line of the job in the jobs file. */
+  int failed;
+} Job;
+
+/* Jobs `[next, end)` which are left to a worker. Other
+ * workers steal from the end once they run out of jobs. */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t next;
+  size_t end;
+} Range;
+
+typedef struct {
+  const char* jobs_fn;
+  Job* jobs;
+  size_t njobs;
+  BatchProg* progs;
+  size_t nprogs;
+  Range* ranges;
+  unsigned int nthreads;
+} Batch;
+
+typedef struct {
+  Batch* batch;
+  unsigned int id;
+} Worker;
+
+/* I/O of a single job. The callbacks run while the job's
+ * sink is in use, so they write to the streams directly. */
+typedef struct {
+  FILE* in;
+  FILE* out;
+  char last;  /* Last character written to `out`. */
+  char* err;  /* Messages, printed once the job is done. */
+  size_t err_len;
+} JobIo;
+
+static void job_out(void* data, const char* s) {
+  JobIo* io = (JobIo*) data;
+  size_t len = strlen(s);
+  if (len == 0) return;
+  fwrite(s, sizeof(char), len, io->out);
+  io->last = s[len - 1];
+}
+
+static void job_err(void* data, const char* s) {
+  JobIo* io = (JobIo*) data;
+  size_t len = strlen(s);
+  io->err = (char*) realloc (io->err, io->err_len + len + 1);
+  assert(io->err != NULL);
+  memcpy(io->err + io->err_len, s, len + 1);
+  io->err_len += len;
+}
+
+static int job_in(void* data) {
+  return fgetc(((JobIo*) data)->in);
+}
+
+/* Messages while making the programs go to stderr as usual. */
+static void print_err(void* data, const char* s) {
+  (void) data;
+  fputs(s, stderr);
+}
+
+/* Print `msg` about `job` in one piece. */
+static void report(const Batch* batch, const Job* job, const char* msg) {
+  flockfile(stderr);
+  hvme_fprintf(stderr, "%s:%u: ", batch->jobs_fn, job->line);
+  hvme_fputs(msg, stderr);
+  funlockfile(stderr);
+}
+
+/* Find the program made from `files` or add it. */
+static size_t find_prog(Batch* batch, unsigned int nfiles, char** files) {
+  for (size_t i = batch->nprogs; i-- > 0;) {
+    const BatchProg* prog = &batch->progs[i];
+    if (prog->nfiles != nfiles) continue;
+    unsigned int j = 0;
+    while (j < nfiles && strcmp(prog->files[j], files[j]) == 0) j++;
+    if (j == nfiles) {
+      for (j = 0; j < nfiles; j++) free(files[j]);
+      free(files);
+      return i;
+    }
+  }
+
+  batch->progs = (BatchProg*) realloc (batch->progs,
+    (batch->nprogs + 1) * sizeof(BatchProg));
+  assert(batch->progs != NULL);
+  batch->progs[batch->nprogs] = (BatchProg) { .nfiles=nfiles, .files=files, .vm=NULL };
+  return batch->nprogs ++;
+}
+
+static char* copy_str(const char* s) {
+  char* copy = (char*) calloc (strlen(s) + 1, sizeof(char));
+  assert(copy != NULL);
+  strcpy(copy, s);
+  return copy;
+}
+
+/* Read the jobs of `batch->jobs_fn`. Returns `0` and prints
+ * an error if it can't be read or has an invalid line. */
+static int read_jobs(Batch* batch) {
+  FILE* f = fopen(batch->jobs_fn, "r");
+  if (f == NULL) {
+    char msg[FILENAME_MAX + 32];
+    snprintf(msg, sizeof(msg), "Can't read the jobs in `%s`", batch->jobs_fn);
+    err(msg);
+    return 0;
+  }
+
+  char* line = NULL;
+  size_t len = 0;
+  unsigned int ln = 0;
+  size_t cap = 0;
+  while (getline(&line, &len, f) != -1) {
+    ln ++;
+    char* save;
+    char* input = strtok_r(line, BATCH_DELIMS, &save);
+    if (input == NULL || input[0] == '#') continue;
+
+    char* output = strtok_r(NULL, BATCH_DELIMS, &save);
+    unsigned int nfiles = 0;
+    char** files = NULL;
+    for (char* fn; (fn = strtok_r(NULL, BATCH_DELIMS, &save)) != NULL;) {
+      files = (char**) realloc (files, (nfiles + 1) * sizeof(char*));
+      assert(files != NULL);
+      files[nfiles ++] = copy_str(fn);
+    }
+
+    if (nfiles == 0) {
+      char msg[FILENAME_MAX + 64];
+      snprintf(msg, sizeof(msg), "Invalid job in `%s` on line %u", batch->jobs_fn, ln);
+      err(msg);
+      free(files);
+      free(line);
+      fclose(f);
+      return 0;
+    }
+
+    if (batch->njobs == cap) {
+      cap = cap == 0 ? 64 : cap * 2;
+      batch->jobs = (Job*) realloc (batch->jobs, cap * sizeof(Job));
+      assert(batch->jobs != NULL);
+    }
+    batch->jobs[batch->njobs ++] = (Job) {
+      .input=copy_str(input),
+      .output=copy_str(output),
+      .prog=find_prog(batch, nfiles, files),
+      .line=ln,
+      .failed=0,
+    };
+  }
+
+  free(line);
+  fclose(f);
+  return 1;
+}
+
+static void run_job(const Batch* batch, Job* job) {
+  const BatchProg* prog = &batch->progs[job->prog];
+  /* Its errors were printed when it was made. */
+  if (hvme_status(prog->vm) == HVME_ERROR) {
+    job->failed = 1;
+    return;
+  }
+
+  JobIo io = { .in=fopen(job->input, "r"), .out=NULL, .last='\0', .err=NULL, .err_len=0 };
+  if (io.in != NULL) io.out = fopen(job->output, "w");
+  if (io.in == NULL || io.out == NULL) {
+    char msg[FILENAME_MAX + 32];
+    snprintf(msg, sizeof(msg), "Can't open `%s`\n", io.in == NULL ? job->input : job->output);
+    report(batch, job, msg);
+    if (io.in != NULL) fclose(io.in);
+    job->failed = 1;
+    return;
+  }
+
+  HvmeIo hvme_io = { .data=&io, .out=job_out, .err=job_err, .in=job_in };
+  Hvme* vm = hvme_clone(prog->vm, &hvme_io);
+  job->failed = hvme_run(vm, HVME_UNLIMITED) != HVME_FINISHED;
+  hvme_del(vm);
+
+  /* Like `clean_stdout` at the end of a single run. */
+  if (io.last != '\n' && io.last != '\0') fputc('\n', io.out);
+  fclose(io.in);
+  fclose(io.out);
+
+  if (io.err != NULL) report(batch, job, io.err);
+  free(io.err);
+}
+
+/* Take the next job of worker `id`. If it has none left, it
+ * steals half of the jobs left to another worker. Returns
+ * `0` once all jobs are taken. */
+static int take_job(Batch* batch, unsigned int id, size_t* job) {
+  Range* own = &batch->ranges[id];
+  pthread_mutex_lock(&own->lock);
+  int found = own->next < own->end;
+  if (found) *job = own->next ++;
+  pthread_mutex_unlock(&own->lock);
+  if (found) return 1;
+
+  for (unsigned int i = 1; i < batch->nthreads; i++) {
+    Range* victim = &batch->ranges[(id + i) % batch->nthreads];
+    pthread_mutex_lock(&victim->lock);
+    size_t nleft = victim->end - victim->next;
+    size_t start = victim->end - (nleft + 1) / 2;
+    size_t end = victim->end;
+    victim->end = start;
+    pthread_mutex_unlock(&victim->lock);
+    if (start == end) continue;
+
+    *job = start;
+    pthread_mutex_lock(&own->lock);
+    own->next = start + 1;
+    own->end = end;
+    pthread_mutex_unlock(&own->lock);
+    return 1;
+  }
+  return 0;
+}
+
+static void* run_worker(void* arg) {
+  Worker* worker = (Worker*) arg;
+  size_t job;
+  while (take_job(worker->batch, worker->id, &job))
+    run_job(worker->batch, &worker->batch->jobs[job]);
+  return NULL;
+}
+
+static void del_batch(Batch* batch) {
+  for (size_t i = 0; i < batch->njobs; i++) {
+    free(batch->jobs[i].input);
+    free(batch->jobs[i].output);
+  }
+  free(batch->jobs);
+  for (size_t i = 0; i < batch->nprogs; i++) {
+    for (unsigned int j = 0; j < batch->progs[i].nfiles; j++)
+      free(batch->progs[i].files[j]);
+    free(batch->progs[i].files);
+    hvme_del(batch->progs[i].vm);
+  }
+  free(batch->progs);
+  free(batch->ranges);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int run_batch(const char* jobs, unsigned int nthreads, const HvmeConfig* config, int stats) {
+  assert(jobs != NULL);
+
+  Batch batch;
+  memset(&batch, 0, sizeof(batch));
+  batch.jobs_fn = jobs;
+  if (!read_jobs(&batch)) {
+    del_batch(&batch);
+    return 1;
+  }
+
+  /* Each program is made once, before any job runs. */
+  HvmeConfig prog_config = config != NULL ? *config : hvme_config();
+  prog_config.io = (HvmeIo) { .data=NULL, .out=NULL, .err=print_err, .in=NULL };
+  for (size_t i = 0; i < batch.nprogs; i++) {
+    BatchProg* prog = &batch.progs[i];
+    prog->vm = hvme_new(prog->nfiles, (const char**) prog->files, &prog_config);
+  }
+
+  if (nthreads == 0) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = ncpus > 0 ? (unsigned int) ncpus : 1;
+  }
+  if (nthreads > batch.njobs) nthreads = batch.njobs > 0 ? batch.njobs : 1;
+  batch.nthreads = nthreads;
+
+  /* Every worker starts with its own share of the jobs. */
+  batch.ranges = (Range*) calloc (nthreads, sizeof(Range));
+  assert(batch.ranges != NULL);
+  for (unsigned int i = 0; i < nthreads; i++) {
+    pthread_mutex_init(&batch.ranges[i].lock, NULL);
+    batch.ranges[i].next = batch.njobs * i / nthreads;
+    batch.ranges[i].end = batch.njobs * (i + 1) / nthreads;
+  }
+
+  double start = now();
+  pthread_t* threads = (pthread_t*) calloc (nthreads, sizeof(pthread_t));
+  Worker* workers = (Worker*) calloc (nthreads, sizeof(Worker));
+  assert(threads != NULL && workers != NULL);
+  for (unsigned int i = 0; i < nthreads; i++) {
+    workers[i] = (Worker) { .batch=&batch, .id=i };
+    int res = pthread_create(&threads[i], NULL, run_worker, &workers[i]);
+    assert(res == 0);
+    (void) res;
+  }
+  for (unsigned int i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  double secs = now() - start;
+
+  for (unsigned int i = 0; i < nthreads; i++)
+    pthread_mutex_destroy(&batch.ranges[i].lock);
+  free(threads);
+  free(workers);
+
+  size_t nfailed = 0;
+  for (size_t i = 0; i < batch.njobs; i++)
+    nfailed += batch.jobs[i].failed;
+
+  if (stats) {
+    hvme_fprintf(stderr, "Ran %lu jobs of %lu programs on %u threads in %.3fs (%.0f jobs/s)\n",
+      batch.njobs, batch.nprogs, nthreads, secs, secs > 0 ? batch.njobs / secs : 0.0);
+  }
+  if (nfailed > 0) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%lu of %lu jobs failed", nfailed, batch.njobs);
+    err(msg);
+  }
+
+  del_batch(&batch);
+  return nfailed > 0 ? 1 : 0;
+}
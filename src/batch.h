@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "libhvme.h"
+
+/* Batch runs (`--batch`).
+ *
+ * A jobs file has one job per line: the file the program
+ * reads its input from, the file its output is written to
+ * and the program's source files, e.g.
+ *
+ *   in/1.txt out/1.txt main.vm lib.vm
+ *
+ * Empty lines and lines starting with `#` are skipped. Each
+ * distinct list of source files is made into a program once.
+ * The jobs are then run on `nthreads` threads, each one with
+ * its own copy of the program's memory (see `hvme_clone`).
+ * Errors are printed to stderr with the line of their job. */
+
+/* Run the jobs in `jobs` with the programs made with `config`.
+ * Returns `0` if all of them finished and `1` otherwise. */
+int run_batch(const char* jobs, unsigned int nthreads, const HvmeConfig* config, int stats);
+
+#endif  // _BATCH_H_
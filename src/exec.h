@@ -4,12 +4,39 @@
 #define _EXEC_H_
 
 #include "prog.h"
+#include "reg.h"
 
 #define EXEC_ERR -1
+#define EXEC_BUDGET 1
 
 // Execute the program. Returns
 // `0` on success and `EXEC_ERR` if
 // an error arises during execution.
 int exec_prog(Program* program);
 
+// Execute the program using its register
+// bytecode `regs` (see `make_regs`). Errors
+// and results are the same as `exec_prog`'s.
+int exec_regs(Program* program, const Regs* regs);
+
+// Like `exec_prog` and `exec_regs`, but without checking for
+// stack underflows, segment overflows and arithmetic overflows.
+// Arithmetic wraps around instead. Only for programs which are
+// known to be correct.
+int exec_prog_unchecked(Program* program);
+int exec_regs_unchecked(Program* program, const Regs* regs);
+
+// Execute at most `*budget` instructions, starting where
+// the previous call stopped, and subtract the number of
+// instructions which ran from `*budget`. Returns `0` if the
+// program finished, `EXEC_BUDGET` if the budget ran out
+// first and `EXEC_ERR` like `exec_prog`.
+int exec_budget(Program* program, size_t* budget);
+int exec_budget_unchecked(Program* program, size_t* budget);
+
+// The program which runs on this thread in the stack
+// interpreter (`exec_prog` or `exec_budget`) or `NULL`.
+// Natives which need more than the heap use it.
+Program* running_prog(void);
+
 #endif  // _EXEC_H_
@@ -0,0 +1,926 @@
+/* Instruction handlers, included twice by `exec.c`.
+ *
+ * `CHECKED` selects the variant which is compiled: `1` reports
+ * stack underflows, segment overflows and arithmetic overflows
+ * as errors. `0` skips these checks and arithmetic wraps around
+ * like on the Hack platform. `VARIANT(name)` gives the names of
+ * the variant's functions.
+ *
+ * There is no include guard on purpose. */
+
+#if !defined(CHECKED) || !defined(VARIANT)
+#error "`exec_impl.h` must be included by `exec.c`"
+#endif
+
+/* Run `fail` if `cond` doesn't hold. Nothing is checked in the
+ * unchecked variant. */
+#if CHECKED
+#define CHECK(cond, fail) { if (!(cond)) { fail; } }
+#else
+#define CHECK(cond, fail)
+#endif
+
+/* Pop into `valp` or report a stack underflow. */
+#if CHECKED
+#define SPOP(stack, valp, loc) { \
+  if (!spop((stack), (valp)))    \
+    STACK_UNDERFLOW_ERROR(loc);  \
+}
+#else
+#define SPOP(stack, valp, loc) { *(valp) = (stack)->ops[-- (stack)->sp]; }
+#endif
+
+/* Accessing `this` and `that` only needs a check outside of the
+ * unified RAM. The RAM is followed by guard pages, so any address
+ * beyond it faults and `EXEC` reports the error. */
+
+static inline void VARIANT(pop_heap)(Program* prog, const Inst* inst, Loc loc, size_t addr) {
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+  (void) inst;
+  (void) loc;
+#if CHECKED
+  if (heap->mask == 0 && !in_heap(heap, addr))
+    HEAP_ADDR_OVERFLOW_ERROR(inst, loc, addr);
+  /* Fault before the stack changes. */
+  (void) *(volatile Word*) &heap->mem[addr];
+#else
+  addr = (Addr) addr;
+#endif
+
+  Word val;
+  SPOP(stack, &val, loc);
+  heap->mem[addr] = val;
+}
+
+static inline void VARIANT(push_heap)(Program* prog, const Inst* inst, Loc loc, size_t addr) {
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+  (void) inst;
+  (void) loc;
+#if CHECKED
+  if (heap->mask == 0 && !in_heap(heap, addr))
+    HEAP_ADDR_OVERFLOW_ERROR(inst, loc, addr);
+#else
+  addr = (Addr) addr;
+#endif
+  spush(stack, heap->mem[addr]);
+}
+
+static void VARIANT(exec_pop)(Program* prog, Inst inst, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+  Memory* mem = &active_file(prog).mem;
+  (void) loc;
+
+  size_t offset = inst.mem.offset;
+
+  switch(inst.mem.seg) {
+    case ARG: {
+        // `offset < stack->arg_len` implicitly
+        // means that `offset + stack->arg < stack->sp`
+        // (same with loc).
+        CHECK(offset < stack->arg_len,
+          SEG_OVERFLOW_ERROR(&inst, loc, stack->arg_len));
+        CHECK(offset + stack->arg < stack->sp,
+          STACK_ADDR_OVERFLOW_ERROR(&inst, loc, offset + stack->arg, stack->sp));
+        Word arg_buf;
+        SPOP(stack, &arg_buf, loc);
+        stack->ops[offset + stack->arg] = arg_buf;
+      }
+      break;
+    case LOC: {
+        CHECK(offset < stack->lcl_len,
+          SEG_OVERFLOW_ERROR(&inst, loc, stack->lcl_len));
+        CHECK(offset + stack->lcl < stack->sp,
+          STACK_ADDR_OVERFLOW_ERROR(&inst, loc, offset + stack->arg, stack->sp));
+        Word lcl_buf;
+        SPOP(stack, &lcl_buf, loc);
+        stack->ops[offset + stack->lcl] = lcl_buf;
+      }
+      break;
+    case STAT:
+      CHECK(offset < MEM_STAT_SIZE, SEG_OVERFLOW_ERROR(&inst, loc, MEM_STAT_SIZE));
+      SPOP(stack, &mem->_static[offset], loc);
+      break;
+    case CONST: {
+        // `pop`ping to constant deletes the value.
+        Word val;
+        SPOP(stack, &val, loc);
+      }
+      break;
+    case THIS:
+      VARIANT(pop_heap)(prog, &inst, loc, offset + *heap->_this);
+      break;
+    case THAT:
+      VARIANT(pop_heap)(prog, &inst, loc, offset + *heap->that);
+      break;
+    case PTR:
+      CHECK(offset <= 1, POINTER_SEGMENT_ERROR(offset, loc));
+      if (offset == 0) {
+        SPOP(stack, heap->_this, loc);
+      } else {
+        SPOP(stack, heap->that, loc);
+      }
+      return;
+    case TMP:
+      CHECK(offset < MEM_TEMP_SIZE, SEG_OVERFLOW_ERROR(&inst, loc, MEM_TEMP_SIZE));
+      SPOP(stack, &mem->tmp[offset], loc);
+      break;
+  }
+}
+
+static void VARIANT(exec_push)(Program* prog, Inst inst, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+  Memory* mem = &active_file(prog).mem;
+  (void) loc;
+
+  size_t offset = inst.mem.offset;
+
+  switch(inst.mem.seg) {
+    case ARG:
+      CHECK(offset < stack->arg_len,
+        SEG_OVERFLOW_ERROR(&inst, loc, stack->arg_len));
+      CHECK(offset + stack->arg < stack->sp,
+        STACK_ADDR_OVERFLOW_ERROR(&inst, loc, offset + stack->arg, stack->sp));
+      spush(stack, stack->ops[offset + stack->arg]);
+      break;
+    case LOC:
+      CHECK(offset < stack->lcl_len,
+        SEG_OVERFLOW_ERROR(&inst, loc, stack->lcl_len));
+      CHECK(offset + stack->lcl < stack->sp,
+        STACK_ADDR_OVERFLOW_ERROR(&inst, loc, offset + stack->arg, stack->sp));
+      spush(stack, stack->ops[offset + stack->lcl]);
+      break;
+    case STAT:
+      CHECK(offset < MEM_STAT_SIZE, SEG_OVERFLOW_ERROR(&inst, loc, MEM_STAT_SIZE));
+      spush(stack, mem->_static[offset]);
+      break;
+    case CONST:
+      // The `constant` segment is a pseudo segment
+      // used to get the constant value of `offset`.
+      spush(stack, (Word) inst.mem.offset);  // `Word` is `uint16_t`.
+      return;
+    case THIS:
+      VARIANT(push_heap)(prog, &inst, loc, offset + *heap->_this);
+      break;
+    case THAT:
+      VARIANT(push_heap)(prog, &inst, loc, offset + *heap->that);
+      break;
+    case PTR:
+      // `pointer` isn't  really a segment but is instead
+      // used to the the addresses of the `this` and `that`
+      // segments.
+      // The pointers can be anywhere in RAM (`pop pointer`
+      // accepts any word), only accessing `this` and `that`
+      // outside of the heap fails.
+      CHECK(offset <= 1, POINTER_SEGMENT_ERROR(offset, loc));
+      if (offset == 0) {
+        spush(stack, *heap->_this);
+      } else {
+        spush(stack, *heap->that);
+      }
+      return;
+    case TMP:
+      CHECK(offset < MEM_TEMP_SIZE, SEG_OVERFLOW_ERROR(&inst, loc, MEM_TEMP_SIZE));
+      spush(stack, mem->tmp[offset]);
+      break;
+  }
+}
+
+static inline void VARIANT(exec_add)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  Word x;
+  SPOP(stack, &x, loc);
+  Wordbuf sum = (Wordbuf) x + (Wordbuf) y;
+
+  // Since `spop` doesn't delete anything,
+  // this resets the stack to the state
+  // before attempting the add.
+  CHECK(sum <= BIT16_LIMIT, {
+    stack->sp += 2;
+    ADD_OVERFLOW_ERROR(x, y, sum, loc);
+  });
+  spush(stack, (Word) sum);
+}
+
+static inline void VARIANT(exec_sub)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  Word x;
+  SPOP(stack, &x, loc);
+
+  CHECK(x >= y, {
+    stack->sp += 2;  // Restore `x` and `y`.
+    SUB_UNDERFLOW_ERROR(x, y, loc);
+  });
+  spush(stack, x - y);
+}
+
+static inline void VARIANT(exec_neg)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  // Two's complement negation.
+  y = ~y;
+  y += 1;
+  spush(stack, y);
+}
+
+static inline void VARIANT(exec_and)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  Word x;
+  SPOP(stack, &x, loc);
+
+  spush(stack, x & y);
+}
+
+static inline void VARIANT(exec_or)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  Word x;
+  SPOP(stack, &x, loc);
+
+  spush(stack, x | y);
+}
+
+static inline void VARIANT(exec_not)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  spush(stack, ~y);
+}
+
+static inline void VARIANT(exec_eq)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  Word x;
+  SPOP(stack, &x, loc);
+
+  spush(stack, x == y ? TRUE : FALSE);
+}
+
+static inline void VARIANT(exec_lt)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  Word x;
+  SPOP(stack, &x, loc);
+
+  spush(stack, x < y ? TRUE : FALSE);
+}
+
+static inline void VARIANT(exec_gt)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  Stack* stack = &prog->stack;
+  (void) loc;
+
+  Word y;
+  SPOP(stack, &y, loc);
+  Word x;
+  SPOP(stack, &x, loc);
+
+  spush(stack, x > y ? TRUE : FALSE);
+}
+
+/* Jump if the topmost value is true (`if_true` is set)
+ * or if it is false (`if_true` isn't set). */
+static inline void VARIANT(exec_if_goto)(Program* prog, Loc loc, int if_true) {
+  assert(prog != NULL);
+
+  Word val;
+  SPOP(&prog->stack, &val, loc);
+
+  if ((val != FALSE) == if_true) {
+    SymVal val;
+    SymKey key = mk_key(
+      active_file(prog).insts.cell[active_file(prog).ei].ident,
+      SBT_LABEL
+    );
+
+    /* `val` is restored on error. */
+    switch (jump_to(prog, key, &val)) {
+      case JMP_ERR:
+        prog->stack.sp ++;
+        CTRL_FLOW_ERROR(key.ident, loc);
+        break;
+      case JMP_MULT_DEF:
+        prog->stack.sp ++;
+        DEF_ERR(key, loc);
+        break;
+      default:
+        /* Else: everything went well. */
+        break;
+    }
+  }
+}
+
+static inline void VARIANT(exec_call)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+
+  const char* ident = active_file(prog).insts.cell[active_file(prog).ei].ident;
+  Word nargs = active_file(prog).insts.cell[active_file(prog).ei].nargs;
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+
+  Addr ret_ei = active_file(prog).ei;
+  Addr ret_fi = prog->fi;
+
+  CHECK(nargs <= stack->sp, NARGS_ERROR(nargs, stack->sp, loc));
+
+  SymVal val;
+  SymKey key = mk_key(ident, SBT_FUNC);
+  switch (jump_to(prog, key, &val)) {
+    case JMP_ERR:
+      CTRL_FLOW_ERROR(key.ident, loc);
+      break;
+    case JMP_MULT_DEF:
+      DEF_ERR(key, loc);
+      break;
+    default:
+      /* Else: everything went well. */
+      break;
+  }
+
+  // Push return execution index on the stack.
+  spush(stack, (Word) ret_ei);
+  // Push the return file index on the stack.
+  spush(stack, (Word) ret_fi);
+  // Push caller's `LCL` on stack.
+  spush(stack, (Word) stack->lcl);
+  spush(stack, (Word) stack->lcl_len);
+  // Push caller's `ARG` on stack.
+  spush(stack, (Word) stack->arg);
+  spush(stack, (Word) stack->arg_len);
+  // Push caller's `THIS` on stack.
+  spush(stack, *heap->_this);
+  // Push caller's `THAT` on stack.
+  spush(stack, *heap->that);
+
+  /* Set `ARG` for new function.
+   * `8` accounts for the return address etc. on stack.
+   * `nargs` is the number of arguments assumed are
+   * on stack right now (according to the `call` invocation).
+   * `nargs` is checked at the beginning of this function to
+   * avoid underflows here.
+   */
+  stack->arg = stack->sp - 8 - nargs;
+  stack->arg_len = nargs;
+
+  // Set `LCL` for new function and allocate locals.
+  stack->lcl = stack->sp;
+  stack->lcl_len = val.nlocals;
+  for (size_t i = 0; i < stack->lcl_len; i++)
+    spush(stack, 0);
+
+  // Now we're ready to jump to the start of the function.
+  active_file(prog).ei = val.inst_addr - 1;
+}
+
+static void VARIANT(exec_ret)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  (void) loc;
+
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+
+  // `LCL` always points to the stack position
+  // right after all of the caller's segments
+  // etc. have been pushed.
+  Addr frame = stack->lcl;
+  // Execution index and file index were pushed
+  // first in this sequence.
+  Addr ret_ei = stack->ops[frame - 8];
+  Addr ret_fi = stack->ops[frame - 7];
+
+  // `ARG` always points to the first argument
+  // pushed on the stack by the caller. This is
+  // where the caller will expect the return value.
+  // We need to get the return value as a two step
+  // operation because `spop` might change the location
+  // of `stack->ops` which would result in a use after
+  // free error if a pointer to a value on the stack
+  // were passed to `spop` as `val`.
+  Word ret_val;
+  SPOP(stack, &ret_val, loc);
+  // Insert the return value at the position
+  // where the caller will expect it.
+  stack->ops[stack->arg] = ret_val;
+
+  stack->sp = stack->arg + 1;
+  // Restore the rest of the registers which
+  // have been pushed on stack.
+  *heap->that = stack->ops[frame - 1];
+  *heap->_this = stack->ops[frame - 2];
+  stack->arg_len = stack->ops[frame - 3];
+  stack->arg     = stack->ops[frame - 4];
+  stack->lcl_len = stack->ops[frame - 5];
+  stack->lcl     = stack->ops[frame - 6];
+
+  /* Jump ! */
+
+  prog->fi = ret_fi;
+  // Don't subtract here (see `exec_call` and `exec_goto`)!
+  prog->files[prog->fi].ei = ret_ei;
+}
+
+static inline void VARIANT(exec_tail_call)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+
+  const char* ident = active_file(prog).insts.cell[active_file(prog).ei].ident;
+  Word nargs = active_file(prog).insts.cell[active_file(prog).ei].nargs;
+
+  if (!can_reuse_frame(&prog->stack, nargs)) {
+    /* The `return` after this runs once the callee returns. */
+    VARIANT(exec_call)(prog, loc);
+    return;
+  }
+
+  SymVal val;
+  SymKey key = mk_key(ident, SBT_FUNC);
+  switch (jump_to(prog, key, &val)) {
+    case JMP_ERR:
+      CTRL_FLOW_ERROR(key.ident, loc);
+      break;
+    case JMP_MULT_DEF:
+      DEF_ERR(key, loc);
+      break;
+    default:
+      /* Else: everything went well. */
+      break;
+  }
+
+  reuse_frame(&prog->stack, nargs, val.nlocals);
+  active_file(prog).ei = val.inst_addr - 1;
+}
+
+/* Pop the arguments of the active `BUILTIN` and push its result. */
+static inline void VARIANT(exec_builtin)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+
+  unsigned int index = active_inst(prog).builtin.index;
+  uint16_t nargs = get_native(index)->nargs;
+  Word args[NATIVE_MAX_ARGS];
+  for (uint16_t i = nargs; i-- > 0;)
+    SPOP(&prog->stack, &args[i], loc);
+
+  spush(&prog->stack, run_native(prog, index, args, loc));
+}
+
+/* Run a native like its wrapper function in the system file
+ * does, but directly on the caller's stack. The result replaces
+ * the arguments like after `return`. Errors of the native still
+ * point to the `BUILTIN` instruction in the system file. */
+static inline void VARIANT(exec_call_builtin)(Program* prog, Loc loc) {
+  assert(prog != NULL);
+  (void) loc;
+
+  const Inst* inst = &active_inst(prog);
+  Stack* stack = &prog->stack;
+  Word nargs = inst->nargs;
+
+  CHECK(nargs <= stack->sp, NARGS_ERROR(nargs, stack->sp, loc));
+
+  size_t arg = stack->sp - nargs;
+  /* Make room for the result. */
+  if (nargs == 0) spush(stack, 0);
+
+  Loc builtin_loc = { prog->files[0].insts.src, inst->builtin.off };
+  stack->ops[arg] = run_native(prog, inst->builtin.index, &stack->ops[arg], builtin_loc);
+  stack->sp = arg + 1;
+}
+
+/* Execute the active instruction. */
+static inline void VARIANT(exec_inst)(Program* prog) {
+  switch(active_inst(prog).code) {
+    case POP:
+      VARIANT(exec_pop)(prog, active_inst(prog), active_loc(prog));
+      break;
+    case PUSH:
+      VARIANT(exec_push)(prog, active_inst(prog), active_loc(prog));
+      break;
+    case ADD:
+      VARIANT(exec_add)(prog, active_loc(prog));
+      break;
+    case SUB:
+      VARIANT(exec_sub)(prog, active_loc(prog));
+      break;
+    case NEG:
+      VARIANT(exec_neg)(prog, active_loc(prog));
+      break;
+    case AND:
+      VARIANT(exec_and)(prog, active_loc(prog));
+      break;
+    case OR:
+      VARIANT(exec_or)(prog, active_loc(prog));
+      break;
+    case NOT:
+      VARIANT(exec_not)(prog, active_loc(prog));
+      break;
+    case EQ:
+      VARIANT(exec_eq)(prog, active_loc(prog));
+      break;
+    case LT:
+      VARIANT(exec_lt)(prog, active_loc(prog));
+      break;
+    case GT:
+      VARIANT(exec_gt)(prog, active_loc(prog));
+      break;
+    case GOTO:
+      exec_goto(prog, active_loc(prog));
+      break;
+    case IF_GOTO:
+      VARIANT(exec_if_goto)(prog, active_loc(prog), 1);
+      break;
+    case IF_NOT_GOTO:
+      VARIANT(exec_if_goto)(prog, active_loc(prog), 0);
+      break;
+    case CALL:
+      VARIANT(exec_call)(prog, active_loc(prog));
+      break;
+    case TAIL_CALL:
+      VARIANT(exec_tail_call)(prog, active_loc(prog));
+      break;
+    case CALL_BUILTIN:
+      VARIANT(exec_call_builtin)(prog, active_loc(prog));
+      break;
+    case RET:
+      VARIANT(exec_ret)(prog, active_loc(prog));
+      break;
+    case BUILTIN:
+      VARIANT(exec_builtin)(prog, active_loc(prog));
+      break;
+    default: {
+      INST_STR(str, &active_inst(prog));
+      perrf(LOC_POS(active_loc(prog)),
+        "invalid inststruction `%s`; programmer mistake", str);
+      longjmp(prog->env, EXEC_ERR);
+    }
+  }
+}
+
+static int VARIANT(run_prog)(Program* prog) {
+  /* Reaching the end of any file is enough to end execution.
+   * `insts.idx` points to the next unused instruction field
+   * in the instruction buffer from parsing. Thus it can be
+   * used here as the number of instructions in the buffer. */
+
+  for (; active_file(prog).ei < active_file(prog).insts.idx; active_file(prog).ei ++)
+    VARIANT(exec_inst)(prog);
+  return 0;
+}
+
+/* Like `run_prog`, but stop before the next instruction once
+ * `*budget` instructions ran. `ei` then still points to it, so
+ * the next call continues there. */
+static int VARIANT(run_budget)(Program* prog, size_t* budget) {
+  for (; active_file(prog).ei < active_file(prog).insts.idx; active_file(prog).ei ++) {
+    if (*budget == 0) return EXEC_BUDGET;
+    -- *budget;
+    VARIANT(exec_inst)(prog);
+  }
+  return 0;
+}
+
+/* Register bytecode (see `reg.h`).
+ *
+ * The fast paths below compute everything in local variables
+ * and only commit the result once it's clear that none of the
+ * covered stack instructions fails. Otherwise `exec_covered`
+ * runs the stack instructions to report the error. */
+
+/* Read `opd` like `push` would with the stack pointer at `sp`. */
+static inline int VARIANT(reg_load)(Program* prog, Opd opd, size_t sp, Word* val) {
+  const Stack* stack = &prog->stack;
+  const Heap* heap = &prog->heap;
+  size_t index = opd.index;
+  (void) sp;
+
+  switch (opd.kind) {
+    case OPD_CONST:
+      *val = opd.index;
+      return 1;
+    case OPD_LOC:
+      CHECK(index < stack->lcl_len && index + stack->lcl < sp, return 0);
+      *val = stack->ops[index + stack->lcl];
+      return 1;
+    case OPD_ARG:
+      CHECK(index < stack->arg_len && index + stack->arg < sp, return 0);
+      *val = stack->ops[index + stack->arg];
+      return 1;
+    case OPD_STAT:
+      CHECK(index < MEM_STAT_SIZE, return 0);
+      *val = active_file(prog).mem._static[index];
+      return 1;
+    case OPD_TMP:
+      CHECK(index < MEM_TEMP_SIZE, return 0);
+      *val = active_file(prog).mem.tmp[index];
+      return 1;
+    case OPD_THIS:
+      CHECK(in_heap(heap, index + *heap->_this), return 0);
+      *val = heap->mem[(Addr)(index + *heap->_this)];
+      return 1;
+    case OPD_THAT:
+      CHECK(in_heap(heap, index + *heap->that), return 0);
+      *val = heap->mem[(Addr)(index + *heap->that)];
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Pop a value like `spop` would with the stack pointer at `sp`. */
+static inline int VARIANT(reg_pop)(const Stack* stack, size_t* sp, Word* val) {
+  CHECK(*sp > stack->lcl + stack->lcl_len, return 0);
+  *val = stack->ops[-- *sp];
+  return 1;
+}
+
+/* Get the operand `opd` of an operation. Operands which aren't
+ * on the stack are pushed first, so this must be called in the
+ * order the values would be pushed. */
+static inline int VARIANT(reg_push_opd)(Program* prog, Opd opd, size_t* sp, Word* val) {
+  if (opd.kind == OPD_STACK) return 1;
+  if (!VARIANT(reg_load)(prog, opd, *sp, val)) return 0;
+  (*sp) ++;
+  return 1;
+}
+
+/* Pop the operand `opd` of an operation. */
+static inline int VARIANT(reg_pop_opd)(const Stack* stack, Opd opd, size_t* sp, Word* val) {
+  CHECK(*sp > stack->lcl + stack->lcl_len, return 0);
+  (*sp) --;
+  if (opd.kind == OPD_STACK) *val = stack->ops[*sp];
+  return 1;
+}
+
+/* Write `val` to `opd` like a `push` of the value followed
+ * by `pop` would with the stack pointer at `sp`. */
+static inline int VARIANT(reg_store)(Program* prog, Opd opd, size_t* sp, Word val) {
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+  size_t index = opd.index;
+
+  if (opd.kind == OPD_STACK) {
+    reg_reserve(stack, *sp, 1);
+    stack->ops[(*sp) ++] = val;
+    return 1;
+  }
+
+  /* `pop` sees the pushed value on top of the stack. */
+  size_t top = *sp + 1;
+  (void) top;
+  CHECK(top > stack->lcl + stack->lcl_len, return 0);
+
+  switch (opd.kind) {
+    case OPD_NONE:
+      return 1;
+    case OPD_LOC:
+      CHECK(index < stack->lcl_len && index + stack->lcl < top, return 0);
+      stack->ops[index + stack->lcl] = val;
+      return 1;
+    case OPD_ARG:
+      CHECK(index < stack->arg_len && index + stack->arg < top, return 0);
+      stack->ops[index + stack->arg] = val;
+      return 1;
+    case OPD_STAT:
+      CHECK(index < MEM_STAT_SIZE, return 0);
+      active_file(prog).mem._static[index] = val;
+      return 1;
+    case OPD_TMP:
+      CHECK(index < MEM_TEMP_SIZE, return 0);
+      active_file(prog).mem.tmp[index] = val;
+      return 1;
+    case OPD_THIS:
+      CHECK(in_heap(heap, index + *heap->_this), return 0);
+      heap->mem[(Addr)(index + *heap->_this)] = val;
+      return 1;
+    case OPD_THAT:
+      CHECK(in_heap(heap, index + *heap->that), return 0);
+      heap->mem[(Addr)(index + *heap->that)] = val;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Evaluate `x <op> y`. Returns `0` if the operation fails. */
+static inline int VARIANT(reg_binary)(enum InstCode op, Word x, Word y, Word* res) {
+  switch (op) {
+    case ADD:
+      CHECK((Wordbuf) x + (Wordbuf) y <= BIT16_LIMIT, return 0);
+      *res = x + y;
+      return 1;
+    case SUB:
+      CHECK(x >= y, return 0);
+      *res = x - y;
+      return 1;
+    case AND: *res = x & y; return 1;
+    case OR: *res = x | y; return 1;
+    case EQ: *res = x == y ? TRUE : FALSE; return 1;
+    case LT: *res = x < y ? TRUE : FALSE; return 1;
+    case GT: *res = x > y ? TRUE : FALSE; return 1;
+    default: return 0;
+  }
+}
+
+/* Compute the value of a move or operation. */
+static inline int VARIANT(reg_value)(Program* prog, const RegInst* ri, size_t* sp, Word* res) {
+  const Stack* stack = &prog->stack;
+  Word x = 0;
+  Word y = 0;
+
+  switch (ri->code == REG_BRANCH && ri->op == IC_NONE ? REG_MOVE : ri->code) {
+    case REG_MOVE:
+      if (ri->a.kind == OPD_STACK)
+        return VARIANT(reg_pop)(stack, sp, res);
+      return VARIANT(reg_load)(prog, ri->a, *sp, res);
+    case REG_UNARY:
+      if (!VARIANT(reg_push_opd)(prog, ri->a, sp, &y)) return 0;
+      if (!VARIANT(reg_pop_opd)(stack, ri->a, sp, &y)) return 0;
+      *res = ri->op == NEG ? (Word) (~y + 1) : (Word) ~y;
+      return 1;
+    default:
+      if (!VARIANT(reg_push_opd)(prog, ri->a, sp, &x)) return 0;
+      if (!VARIANT(reg_push_opd)(prog, ri->b, sp, &y)) return 0;
+      if (!VARIANT(reg_pop_opd)(stack, ri->b, sp, &y)) return 0;
+      if (!VARIANT(reg_pop_opd)(stack, ri->a, sp, &x)) return 0;
+      return VARIANT(reg_binary)(ri->op, x, y, res);
+  }
+}
+
+/* Find the register instruction to continue with after
+ * the position in the active file changed. Instructions
+ * which don't start a register instruction are run one
+ * by one. Returns `NULL` if the program ends. */
+static const RegInst* VARIANT(reg_resync)(Program* prog, const Regs* regs) {
+  for (;;) {
+    const File* file = &active_file(prog);
+    if (file->ei >= file->insts.idx) return NULL;
+
+    size_t ri = regs->files[prog->fi].map[file->ei];
+    if (ri != NO_REG) return &regs->files[prog->fi].insts[ri];
+
+    VARIANT(exec_inst)(prog);
+    active_file(prog).ei ++;
+  }
+}
+
+/* Run the stack instructions covered by `ri`. */
+static const RegInst* VARIANT(exec_covered)(Program* prog, const Regs* regs, const RegInst* ri) {
+  active_file(prog).ei = ri->ei;
+  for (unsigned int i = 0; i < ri->n; i++) {
+    VARIANT(exec_inst)(prog);
+    active_file(prog).ei ++;
+  }
+  return VARIANT(reg_resync)(prog, regs);
+}
+
+static inline int VARIANT(reg_call)(Program* prog, const RegInst* ri) {
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+
+  CHECK(ri->nargs <= stack->sp, return 0);
+
+  size_t sp = stack->sp;
+  reg_reserve(stack, sp, 8 + ri->nlocals);
+  Word* frame = &stack->ops[sp];
+  /* Same layout as in `exec_call`. */
+  frame[0] = (Word) ri->ei;
+  frame[1] = (Word) prog->fi;
+  frame[2] = (Word) stack->lcl;
+  frame[3] = (Word) stack->lcl_len;
+  frame[4] = (Word) stack->arg;
+  frame[5] = (Word) stack->arg_len;
+  frame[6] = *heap->_this;
+  frame[7] = *heap->that;
+  sp += 8;
+
+  stack->arg = sp - 8 - ri->nargs;
+  stack->arg_len = ri->nargs;
+  stack->lcl = sp;
+  stack->lcl_len = ri->nlocals;
+  memset(&stack->ops[sp], 0, ri->nlocals * sizeof(Word));
+  stack->sp = sp + ri->nlocals;
+  return 1;
+}
+
+static inline int VARIANT(reg_ret)(Program* prog, const RegInst* ri) {
+  Stack* stack = &prog->stack;
+  Heap* heap = &prog->heap;
+
+  Addr frame = stack->lcl;
+  CHECK(frame >= 8 && stack->sp > stack->lcl + stack->lcl_len, return 0);
+
+  /* Same as `exec_ret`. */
+  Addr ret_ei = stack->ops[frame - 8];
+  Addr ret_fi = stack->ops[frame - 7];
+  stack->ops[stack->arg] = stack->ops[stack->sp - 1];
+  stack->sp = stack->arg + 1;
+  *heap->that = stack->ops[frame - 1];
+  *heap->_this = stack->ops[frame - 2];
+  stack->arg_len = stack->ops[frame - 3];
+  stack->arg     = stack->ops[frame - 4];
+  stack->lcl_len = stack->ops[frame - 5];
+  stack->lcl     = stack->ops[frame - 6];
+
+  active_file(prog).ei = ri->ei;
+  prog->fi = ret_fi;
+  prog->files[prog->fi].ei = ret_ei + 1;
+  return 1;
+}
+
+static int VARIANT(run_regs)(Program* prog, const Regs* regs) {
+  const RegInst* ri = VARIANT(reg_resync)(prog, regs);
+
+  while (ri != NULL) {
+    size_t sp = prog->stack.sp;
+    Word val;
+
+    switch (ri->code) {
+      case REG_MOVE:
+      case REG_UNARY:
+      case REG_BINARY:
+        if (
+          !VARIANT(reg_value)(prog, ri, &sp, &val) ||
+          !VARIANT(reg_store)(prog, ri->dst, &sp, val)
+        ) goto slow;
+        prog->stack.sp = sp;
+        ri ++;
+        break;
+      case REG_BRANCH:
+        /* `if-goto` pops the value again. */
+        if (
+          !VARIANT(reg_value)(prog, ri, &sp, &val) ||
+          !VARIANT(reg_store)(prog, (Opd) { .kind=OPD_NONE }, &sp, val)
+        ) goto slow;
+        prog->stack.sp = sp;
+        if ((val != FALSE) == ri->if_true)
+          ri = reg_jump(prog, regs, ri);
+        else
+          ri ++;
+        break;
+      case REG_GOTO:
+        ri = reg_jump(prog, regs, ri);
+        break;
+      case REG_CALL:
+        if (!VARIANT(reg_call)(prog, ri)) goto slow;
+        ri = reg_jump(prog, regs, ri);
+        break;
+      case REG_TAIL_CALL:
+        if (!can_reuse_frame(&prog->stack, ri->nargs)) goto slow;
+        reuse_frame(&prog->stack, ri->nargs, ri->nlocals);
+        ri = reg_jump(prog, regs, ri);
+        break;
+      case REG_RET:
+        if (!VARIANT(reg_ret)(prog, ri)) goto slow;
+        ri = VARIANT(reg_resync)(prog, regs);
+        break;
+      case REG_HALT:
+        active_file(prog).ei = ri->ei;
+        return 0;
+      default:
+      slow:
+        ri = VARIANT(exec_covered)(prog, regs, ri);
+        break;
+    }
+  }
+  return 0;
+}
+
+#undef CHECK
+#undef SPOP
@@ -0,0 +1,119 @@
+#include "fork_server.h"
+#include "msg.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FORK_DELIMS " \t\r\n"
+
+/* Open the files of a request. `fds[2]` is `-1` if the
+ * errors stay on stderr. Prints an error if a file can't be
+ * opened. */
+static int open_files(char* const files[3], int fds[3]) {
+  const int flags[3] = { O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_TRUNC };
+  for (int i = 0; i < 3; i++) fds[i] = -1;
+  for (int i = 0; i < 3 && files[i] != NULL; i++) {
+    fds[i] = open(files[i], flags[i] | O_CLOEXEC, 0644);
+    if (fds[i] < 0) {
+      char msg[FILENAME_MAX + 32];
+      snprintf(msg, sizeof(msg), "Can't open `%s`", files[i]);
+      err(msg);
+      for (int j = 0; j < i; j++) close(fds[j]);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Fork a process for the request and wait for it. */
+static int run_request(char* const files[3], ForkRun run, void* data) {
+  int fds[3];
+  if (!open_files(files, fds)) return -1;
+
+  /* Buffered output would be written by both processes. */
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid == 0) {
+    for (int i = 0; i < 3; i++) {
+      if (fds[i] >= 0 && dup2(fds[i], i) < 0) _exit(127);
+    }
+    int ret = run(data);
+    fflush(NULL);
+    /* The server cleans up after itself. */
+    _exit(ret);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    if (fds[i] >= 0) close(fds[i]);
+  }
+  if (pid < 0) {
+    err("Can't fork a process for the request");
+    return -1;
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) return -1;
+  }
+  if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
+
+/* Read a line of `fd` into `line` without reading past it.
+ * Returns `0` if `fd` ended before the line. */
+static int read_line(int fd, char** line, size_t* cap) {
+  size_t len = 0;
+  for (;;) {
+    char c;
+    ssize_t n = read(fd, &c, 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0 && len == 0) return 0;
+
+    if (len + 1 >= *cap) {
+      *cap = *cap == 0 ? 256 : 2 * *cap;
+      *line = (char*) realloc (*line, *cap);
+      assert(*line != NULL);
+    }
+    if (n <= 0 || c == '\n') break;
+    (*line)[len ++] = c;
+  }
+  (*line)[len] = '\0';
+  return 1;
+}
+
+int run_fork_server(int ctl, FILE* reply, ForkRun run, void* data) {
+  assert(reply != NULL && run != NULL);
+
+  char* line = NULL;
+  size_t cap = 0;
+  int failed = 0;
+  while (read_line(ctl, &line, &cap)) {
+    char* save;
+    char* files[4] = { NULL, NULL, NULL, NULL };
+    unsigned int nfiles = 0;
+    for (char* fn = strtok_r(line, FORK_DELIMS, &save);
+         fn != NULL && nfiles < 4; fn = strtok_r(NULL, FORK_DELIMS, &save)) {
+      files[nfiles ++] = fn;
+    }
+    if (nfiles == 0) continue;
+
+    int ret = -1;
+    if (nfiles < 2 || nfiles > 3) {
+      err("Invalid request: expected an input, an output and optionally an error file");
+    } else {
+      ret = run_request(files, run, data);
+    }
+    failed |= ret != 0;
+
+    fprintf(reply, "%d\n", ret);
+    fflush(reply);
+  }
+
+  free(line);
+  return failed;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#ifndef _FORK_SERVER_H_
+#define _FORK_SERVER_H_
+
+#include <stdio.h>
+
+/* Fork server (`--fork-server`).
+ *
+ * The program is made once. Each request then runs in its own
+ * process which is forked from the server, so it starts with
+ * the program ready to run and shares its code with the server
+ * until it's written to. A request is a line on the control
+ * stream with the file the run reads its input from, the file
+ * its output is written to and optionally the file its errors
+ * are written to (stderr of the server by default), e.g.
+ *
+ *   in/1.txt out/1.txt
+ *
+ * The server waits for the run and answers with a line with
+ * its exit status (`128 + n` if it was killed by signal `n`
+ * and `-1` if it couldn't be started). */
+
+/* Run one request in the forked process, with its files as
+ * stdin, stdout and stderr. Returns its exit status. */
+typedef int (*ForkRun)(void* data);
+
+/* Serve the requests on the file descriptor `ctl` until it
+ * ends and answer them on `reply`. `ctl` isn't buffered, so
+ * it can be stdin without the runs reading requests. Returns
+ * `0` if all runs returned `0` and `1` otherwise. */
+int run_fork_server(int ctl, FILE* reply, ForkRun run, void* data);
+
+#endif  // _FORK_SERVER_H_
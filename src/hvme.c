@@ -1,30 +1,424 @@
 #include "hvme.h"
 #include "msg.h"
 #include "prog.h"
+#include "link.h"
+#include "opt.h"
+#include "inline.h"
+#include "ir.h"
+#include "reg.h"
 #include "exec.h"
+#include "native.h"
+#include "jack.h"
+#include "batch.h"
+#include "serve.h"
+#include "fork_server.h"
+#include "snapshot.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+
+#define OPTS_ERR 0
+#define OPTS_OK 1
+
+typedef struct {
+  int stats;  /* Print statistics about the loaded program. */
+  int opt;  /* Optimization level. */
+  int registers;  /* Run the register bytecode. */
+  int unchecked;  /* Run without checks. */
+  unsigned long ram;  /* Size of the unified RAM (`0` if it's not used). */
+  unsigned long heap_base;  /* Start of the region used by `Memory.alloc`. */
+  unsigned long heap_size;  /* Size of that region (`0` for the rest of the heap). */
+  const char* screen;  /* File the screen is written to at exit. */
+  int text;  /* Also print the text of `Output` to stdout. */
+  const char* keys;  /* Script of keyboard events. */
+  int keyboard;  /* Feed the keyboard from stdin. */
+  const char* batch;  /* Jobs file of a batch run. */
+  unsigned long nthreads;  /* Threads of a batch run or server (`0` for one per core). */
+  const char* serve;  /* Socket to serve requests on. */
+  unsigned long cache_size;  /* Bytes of programs the server keeps. */
+  const char* connect;  /* Socket of the server to run the program on. */
+  const char* program;  /* Id of a program on the server. */
+  unsigned long budget;  /* Instructions the server may run. */
+  int fork_server;  /* Run the program for each request on stdin. */
+  const char* snapshot;  /* File snapshots are written to. */
+  unsigned long snapshot_at;  /* Instruction count of a snapshot (`0` for none). */
+  const char* restore;  /* Snapshot the program starts from. */
+  unsigned int nfiles;  /* Number of source files. */
+  const char** files;  /* Source files (not options). */
+} Options;
+
+/* Parse the number after the option `argv[*i]`. */
+static int parse_num(int argc, const char* argv[], int* i, unsigned long* num) {
+  const char* opt = argv[*i];
+  char msg[64];
+  if (*i + 1 == argc) {
+    snprintf(msg, sizeof(msg), "Missing number after `%s`", opt);
+    err(msg);
+    return OPTS_ERR;
+  }
+
+  char* end;
+  *num = strtoul(argv[++ *i], &end, 0);
+  if (argv[*i][0] == '\0' || argv[*i][0] == '-' || *end != '\0') {
+    snprintf(msg, sizeof(msg), "Invalid number after `%s`", opt);
+    err(msg);
+    return OPTS_ERR;
+  }
+  return OPTS_OK;
+}
+
+static int parse_opts(int argc, const char* argv[], Options* opts) {
+  opts->stats = 0;
+  opts->opt = OPT_PEEPHOLE;
+  opts->registers = 0;
+  opts->unchecked = 0;
+  opts->ram = 0;
+  opts->heap_base = ALLOC_BASE;
+  opts->heap_size = 0;
+  opts->screen = NULL;
+  opts->text = 0;
+  opts->keys = NULL;
+  opts->keyboard = 0;
+  opts->batch = NULL;
+  opts->nthreads = 0;
+  opts->serve = NULL;
+  opts->cache_size = SERVE_CACHE_SIZE;
+  opts->connect = NULL;
+  opts->program = NULL;
+  opts->budget = HVME_UNLIMITED;
+  opts->fork_server = 0;
+  opts->snapshot = NULL;
+  opts->snapshot_at = 0;
+  opts->restore = NULL;
+  opts->nfiles = 0;
+  opts->files = (const char**) calloc (argc, sizeof(const char*));
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-') {
+      opts->files[opts->nfiles ++] = argv[i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      opts->stats = 1;
+    } else if (strcmp(argv[i], "--text") == 0) {
+      opts->text = 1;
+    } else if (strcmp(argv[i], "--registers") == 0) {
+      opts->registers = 1;
+    } else if (strcmp(argv[i], "--unchecked") == 0) {
+      opts->unchecked = 1;
+    } else if (strcmp(argv[i], "--plugin") == 0) {
+      /* Natives must be known before the system file is made. */
+      if (i + 1 == argc) {
+        err("Missing plugin after `--plugin`");
+        return OPTS_ERR;
+      }
+      if (load_plugin(argv[++ i]) == NATIVE_ERR) return OPTS_ERR;
+    } else if (strcmp(argv[i], "--screen") == 0) {
+      if (i + 1 == argc) {
+        err("Missing file after `--screen`");
+        return OPTS_ERR;
+      }
+      opts->screen = argv[++ i];
+    } else if (strcmp(argv[i], "--keys") == 0) {
+      if (i + 1 == argc) {
+        err("Missing file after `--keys`");
+        return OPTS_ERR;
+      }
+      opts->keys = argv[++ i];
+    } else if (strcmp(argv[i], "--fork-server") == 0) {
+      opts->fork_server = 1;
+    } else if (strcmp(argv[i], "--snapshot") == 0) {
+      if (i + 1 == argc) {
+        err("Missing file after `--snapshot`");
+        return OPTS_ERR;
+      }
+      opts->snapshot = argv[++ i];
+    } else if (strcmp(argv[i], "--snapshot-at") == 0) {
+      if (parse_num(argc, argv, &i, &opts->snapshot_at) == OPTS_ERR) return OPTS_ERR;
+    } else if (strcmp(argv[i], "--restore") == 0) {
+      if (i + 1 == argc) {
+        err("Missing file after `--restore`");
+        return OPTS_ERR;
+      }
+      opts->restore = argv[++ i];
+    } else if (strcmp(argv[i], "--keyboard") == 0) {
+      opts->keyboard = 1;
+    } else if (strcmp(argv[i], "--batch") == 0) {
+      if (i + 1 == argc) {
+        err("Missing file after `--batch`");
+        return OPTS_ERR;
+      }
+      opts->batch = argv[++ i];
+    } else if (strcmp(argv[i], "--serve") == 0) {
+      if (i + 1 == argc) {
+        err("Missing socket after `--serve`");
+        return OPTS_ERR;
+      }
+      opts->serve = argv[++ i];
+    } else if (strcmp(argv[i], "--cache-size") == 0) {
+      if (parse_num(argc, argv, &i, &opts->cache_size) == OPTS_ERR) return OPTS_ERR;
+    } else if (strcmp(argv[i], "--connect") == 0) {
+      if (i + 1 == argc) {
+        err("Missing socket after `--connect`");
+        return OPTS_ERR;
+      }
+      opts->connect = argv[++ i];
+    } else if (strcmp(argv[i], "--program") == 0) {
+      if (i + 1 == argc) {
+        err("Missing id after `--program`");
+        return OPTS_ERR;
+      }
+      opts->program = argv[++ i];
+    } else if (strcmp(argv[i], "--budget") == 0) {
+      if (parse_num(argc, argv, &i, &opts->budget) == OPTS_ERR) return OPTS_ERR;
+    } else if (strcmp(argv[i], "-j") == 0) {
+      if (parse_num(argc, argv, &i, &opts->nthreads) == OPTS_ERR) return OPTS_ERR;
+    } else if (strcmp(argv[i], "--ram") == 0) {
+      if (parse_num(argc, argv, &i, &opts->ram) == OPTS_ERR) return OPTS_ERR;
+      if (opts->ram != 0x8000 && opts->ram != 0x10000) {
+        err("The RAM must have 32768 or 65536 words");
+        return OPTS_ERR;
+      }
+    } else if (strcmp(argv[i], "--heap-base") == 0) {
+      if (parse_num(argc, argv, &i, &opts->heap_base) == OPTS_ERR) return OPTS_ERR;
+    } else if (strcmp(argv[i], "--heap-size") == 0) {
+      if (parse_num(argc, argv, &i, &opts->heap_size) == OPTS_ERR) return OPTS_ERR;
+    } else if (strcmp(argv[i], "-O0") == 0) {
+      opts->opt = OPT_NONE;
+    } else if (strcmp(argv[i], "-O1") == 0) {
+      opts->opt = OPT_PEEPHOLE;
+    } else if (strcmp(argv[i], "-O2") == 0) {
+      opts->opt = OPT_SSA;
+    } else {
+      char msg[64];
+      snprintf(msg, sizeof(msg), "Unknown option `%s`", argv[i]);
+      err(msg);
+      return OPTS_ERR;
+    }
+  }
+
+  size_t heap_end = opts->ram != 0 ? RAM_HEAP_END : MEM_HEAP_SIZE;
+  if (
+    opts->heap_base >= heap_end ||
+    set_alloc_region((Addr) opts->heap_base, opts->heap_size, heap_end) == NATIVE_ERR
+  ) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Invalid heap region: %lu words at %lu",
+      opts->heap_size, opts->heap_base);
+    err(msg);
+    return OPTS_ERR;
+  }
+
+  if (opts->snapshot_at != 0 && opts->snapshot == NULL) {
+    err("`--snapshot-at` needs a file given with `--snapshot`");
+    return OPTS_ERR;
+  }
+  if (opts->registers && (opts->snapshot != NULL || opts->restore != NULL)) {
+    err("Snapshots need the stack interpreter (no `--registers`)");
+    return OPTS_ERR;
+  }
+
+  set_screen_file(opts->screen);
+  set_snapshot_file(opts->snapshot);
+  set_output_mirror(opts->text);
+
+  unsigned int line;
+  if (set_keyboard(opts->keys, opts->keyboard, &line) == NATIVE_ERR) {
+    char msg[FILENAME_MAX + 64];
+    if (line == 0) {
+      snprintf(msg, sizeof(msg), "Can't read the keys in `%s`", opts->keys);
+    } else {
+      snprintf(msg, sizeof(msg), "Invalid key event in `%s` on line %u", opts->keys, line);
+    }
+    err(msg);
+    return OPTS_ERR;
+  }
+  return OPTS_OK;
+}
+
+/* Make the program of `opts` ready to run. Returns `NULL`
+ * and prints an error if it can't be made. */
+static Program* load_prog(const Options* opts) {
+  Program* prog = make_prog(opts->nfiles, opts->files);
+  if (prog == NULL) {
+    hvme_fputs("Failed to compile source.", stderr);
+    return NULL;
+  }
+
+  /* Builtins run directly at their call sites. */
+  size_t nbound = bind_builtins(prog);
+  if (opts->stats)
+    hvme_fprintf(stderr, "Bound %lu calls to builtins\n", nbound);
+
+  /* Only keep code which can actually run. */
+  LinkStats stats;
+  strip_prog(prog, &stats);
+  if (opts->stats) print_link_stats(&stats);
+
+  /* The statics are placed in the RAM by the code which is left. */
+  if (opts->ram != 0 && !use_ram(prog, opts->ram)) {
+    del_prog(prog);
+    return NULL;
+  }
+
+  if (opts->opt >= OPT_PEEPHOLE) {
+    unsigned int ninlined = inline_prog(prog);
+    if (opts->stats)
+      hvme_fprintf(stderr, "Inlined %u calls\n", ninlined);
+  }
+
+  if (opts->opt >= OPT_SSA) {
+    unsigned int nfuncs = ir_prog(prog);
+    if (opts->stats)
+      hvme_fprintf(stderr, "Rewrote %u functions using the SSA IR\n", nfuncs);
+  }
+
+  size_t nopt = opt_prog(prog, opts->opt);
+  if (opts->stats) {
+    hvme_fprintf(stderr,
+      "Optimized away %lu instructions (-O%d)\n", nopt, opts->opt);
+  }
+  return prog;
+}
+
+typedef struct {
+  Program* prog;
+  Regs* regs;  /* `NULL` unless the registers run. */
+  const Options* opts;
+} Loaded;
+
+/* Run a loaded program from its start (see `ForkRun`). */
+static int run_loaded(void* data) {
+  Loaded* loaded = (Loaded*) data;
+  const Options* opts = loaded->opts;
+  Program* prog = loaded->prog;
+
+  if (start_keyboard(&prog->heap) == NATIVE_ERR) {
+    err("Can't start reading the keyboard");
+    return 1;
+  }
+
+  int ret;
+  if (loaded->regs != NULL) {
+    ret = opts->unchecked
+      ? exec_regs_unchecked(prog, loaded->regs)
+      : exec_regs(prog, loaded->regs);
+  } else {
+    ret = EXEC_BUDGET;
+    if (opts->snapshot_at != 0) {
+      /* Stop to write the snapshot and continue from there. */
+      size_t budget = opts->snapshot_at;
+      ret = opts->unchecked ? exec_budget_unchecked(prog, &budget) : exec_budget(prog, &budget);
+      int res = ret == EXEC_BUDGET ? save_snapshot(prog, opts->snapshot) : SNAP_OK;
+      if (res != SNAP_OK) {
+        char msg[FILENAME_MAX + 64];
+        snprintf(msg, sizeof(msg), "Can't write the snapshot to `%s`: %s",
+          opts->snapshot, snapshot_error(res));
+        err(msg);
+        ret = 1;
+      } else if (ret == 0) {
+        warn_no_snapshot(opts->snapshot_at);
+      }
+    }
+    if (ret == EXEC_BUDGET)
+      ret = opts->unchecked ? exec_prog_unchecked(prog) : exec_prog(prog);
+  }
+  stop_keyboard();
+  if (opts->stats) print_alloc_stats(&prog->heap);
+  if (write_screen(&prog->heap) == NATIVE_ERR) {
+    char msg[FILENAME_MAX + 32];
+    snprintf(msg, sizeof(msg), "Can't write the screen to `%s`", opts->screen);
+    err(msg);
+  }
+
+  /* If `ret != 0` we have an error and
+   * the output will already be formatted
+   * correctly. */
+  if (ret == 0) clean_stdout();
+
+  return ret;
+}
 
 int run_hvme(int argc, const char* argv[]) {
-  if (argc <= 1) {
+  Options opts;
+  if (parse_opts(argc, argv, &opts) == OPTS_ERR) {
+    free(opts.files);
+    reset_natives();
+    return 1;
+  }
+
+  if (opts.batch != NULL) {
+    int ret = 1;
+    if (opts.nfiles != 0) {
+      err("The source files of a batch run are given in its jobs file");
+    } else {
+      HvmeConfig config = hvme_config();
+      config.opt = opts.opt;
+      config.unchecked = opts.unchecked;
+      config.ram = opts.ram;
+      ret = run_batch(opts.batch, opts.nthreads, &config, opts.stats);
+    }
+    free(opts.files);
+    reset_natives();
+    return ret;
+  } else if (opts.serve != NULL) {
+    int ret = 1;
+    if (opts.nfiles != 0) {
+      err("The source files of a server are sent by its clients");
+    } else {
+      HvmeConfig config = hvme_config();
+      config.opt = opts.opt;
+      config.unchecked = opts.unchecked;
+      config.ram = opts.ram;
+      ret = run_server(opts.serve, opts.nthreads, opts.cache_size, &config, opts.stats);
+    }
+    free(opts.files);
+    reset_natives();
+    return ret;
+  } else if (opts.connect != NULL) {
+    int ret = run_client(opts.connect, opts.nfiles, opts.files,
+      opts.program, opts.budget, opts.stats);
+    free(opts.files);
+    reset_natives();
+    return ret;
+  } else if (opts.nfiles == 0) {
     err("Can't execute 0 files!");
+    free(opts.files);
+    reset_natives();
     return 1;
   } else {
-    Program* prog = make_prog(argc - 1, argv + 1);
+    Program* prog = load_prog(&opts);
+    free(opts.files);
     if (prog == NULL) {
-      hvme_fputs("Failed to compile source.", stderr);
+      reset_natives();
       return 1;
     }
 
-    int ret = exec_prog(prog);
-    del_prog(prog);
+    /* Runs continue from the snapshot instead of starting at `Sys.init`. */
+    int res = opts.restore != NULL ? load_snapshot(prog, opts.restore) : SNAP_OK;
+    if (res != SNAP_OK) {
+      char msg[FILENAME_MAX + 64];
+      snprintf(msg, sizeof(msg), "Can't restore the snapshot `%s`: %s",
+        opts.restore, snapshot_error(res));
+      err(msg);
+      del_prog(prog);
+      reset_natives();
+      return 1;
+    }
 
-    /* If `ret != 0` we have an error and
-     * the output will already be formatted
-     * correctly. */
-    if (ret == 0) clean_stdout();
-    
+    /* The registers are made once, even for a fork server. */
+    Loaded loaded = { .prog=prog, .regs=NULL, .opts=&opts };
+    if (opts.registers) {
+      loaded.regs = make_regs(prog);
+      if (opts.stats) print_reg_stats(loaded.regs);
+    }
+
+    int ret = opts.fork_server
+      ? run_fork_server(STDIN_FILENO, stdout, run_loaded, &loaded)
+      : run_loaded(&loaded);
+    if (loaded.regs != NULL) del_regs(loaded.regs);
+    del_prog(prog);
+    reset_natives();
     return ret;
   }
 }
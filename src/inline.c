@@ -0,0 +1,463 @@
+#include "inline.h"
+#include "link.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Straight-line function body which can replace a call. */
+typedef struct {
+  unsigned int fi;  /* File of the callee. */
+  size_t start;  /* First instruction of the body. */
+  size_t size;  /* Number of instructions before `return`. */
+  uint16_t nargs;  /* Number of arguments it accesses. */
+  uint16_t nlocals;  /* Number of locals of the callee. */
+  int uses_mem;  /* Accesses `static` or `temp` (they're per file). */
+} Body;
+
+/* Function of a caller file. */
+typedef struct {
+  size_t start;
+  size_t end;
+  uint16_t nlocals;
+  int ok;  /* The stack depth is known everywhere. */
+  uint16_t nextra;  /* Locals added for inlined calls. */
+} Func;
+
+/* Per file state. The program isn't changed until all
+ * files are done, so bodies are always copied from the
+ * original instructions. */
+typedef struct {
+  Func* funcs;
+  size_t nfuncs;
+  int* depth;  /* Stack depth before each instruction (`-1` if unknown). */
+  size_t* nsites;  /* Number of call sites of the function at each address. */
+  Insts out;
+  size_t* map;  /* New address of each instruction. */
+  unsigned int ninlined;
+} FileState;
+
+static int is_binary(enum InstCode code) {
+  switch (code) {
+    case ADD: case SUB: case AND: case OR:
+    case EQ: case LT: case GT:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Get how many values `inst` pops and pushes. Returns
+ * `0` for instructions which this pass doesn't know. */
+static int stack_effect(const Inst* inst, int* npops, int* npushes) {
+  *npops = 0;
+  *npushes = 0;
+  switch (inst->code) {
+    case PUSH: *npushes = 1; return 1;
+    case POP: *npops = 1; return 1;
+    case NEG: case NOT: *npops = *npushes = 1; return 1;
+    case GOTO: return 1;
+    case IF_GOTO: case IF_NOT_GOTO: *npops = 1; return 1;
+    case CALL: case CALL_BUILTIN: *npops = inst->nargs; *npushes = 1; return 1;
+    case RET: *npops = 1; return 1;
+    default:
+      if (!is_binary(inst->code)) return 0;
+      *npops = 2;
+      *npushes = 1;
+      return 1;
+  }
+}
+
+static int is_mem(const Inst* inst, Segment seg) {
+  return (inst->code == PUSH || inst->code == POP) && inst->mem.seg == seg;
+}
+
+/* Get the body of the function at `addr` in file `fi`
+ * if it can be inlined. */
+static int get_body(const Program* prog, unsigned int fi, size_t addr, uint16_t nlocals, Body* body) {
+  const Insts* insts = &prog->files[fi].insts;
+  *body = (Body) { .fi=fi, .start=addr, .nlocals=nlocals };
+
+  int depth = 0;
+  for (size_t i = addr; i < insts->idx && i - addr <= INLINE_MAX_SIZE; i++) {
+    const Inst* inst = &insts->cell[i];
+    int npops, npushes;
+
+    if (inst->code == RET) {
+      /* `return` discards everything below the result. */
+      body->size = i - addr;
+      return depth == 1;
+    }
+    if (
+      inst->code != PUSH && inst->code != POP &&
+      inst->code != NEG && inst->code != NOT && !is_binary(inst->code)
+    ) return 0;
+
+    if (is_mem(inst, ARG) && inst->mem.offset >= body->nargs)
+      body->nargs = inst->mem.offset + 1;
+    if (is_mem(inst, LOC) && inst->mem.offset >= nlocals)
+      return 0;
+    if (is_mem(inst, STAT) || is_mem(inst, TMP))
+      body->uses_mem = 1;
+
+    stack_effect(inst, &npops, &npushes);
+    if (depth < npops) return 0;
+    depth += npushes - npops;
+  }
+
+  return 0;
+}
+
+static int cmp_funcs(const void* a, const void* b) {
+  const Func* x = (const Func*) a;
+  const Func* y = (const Func*) b;
+  return (x->start > y->start) - (x->start < y->start);
+}
+
+/* Find the function containing `addr` in the sorted `funcs`. */
+static int func_of(const Func* funcs, size_t nfuncs, size_t addr) {
+  size_t lo = 0, hi = nfuncs;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (funcs[mid].start <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0 || addr >= funcs[lo - 1].end) return -1;
+  return (int) (lo - 1);
+}
+
+/* Set the depth before `addr` to `d`. Returns `0` if
+ * it was already set to something else. */
+static int set_depth(int* depth, size_t* work, size_t* nwork, size_t addr, int d) {
+  if (depth[addr] == -1) {
+    depth[addr] = d;
+    work[(*nwork) ++] = addr;
+    return 1;
+  }
+  return depth[addr] == d;
+}
+
+/* Compute the stack depth before each instruction of `func`.
+ * Fails if it differs between paths, if the function pops
+ * values it didn't push, if execution can leave the function
+ * other than by returning or if it accesses locals it doesn't
+ * have (this must still fail once locals are added). */
+static int func_depths(const File* file, const Func* func, int* depth) {
+  const Inst* cell = file->insts.cell;
+  size_t* work = (size_t*) malloc ((func->end - func->start) * sizeof(size_t));
+  assert(work != NULL);
+  size_t nwork = 0;
+  int ok = set_depth(depth, work, &nwork, func->start, 0);
+
+  while (ok && nwork > 0) {
+    size_t i = work[-- nwork];
+    const Inst* inst = &cell[i];
+    int npops, npushes;
+
+    if (
+      !stack_effect(inst, &npops, &npushes) || depth[i] < npops ||
+      (is_mem(inst, LOC) && inst->mem.offset >= func->nlocals)
+    ) {
+      ok = 0;
+      break;
+    }
+    int d = depth[i] - npops + npushes;
+
+    if (inst->code == GOTO || inst->code == IF_GOTO || inst->code == IF_NOT_GOTO) {
+      /* Labels in other files are resolved at runtime. */
+      SymKey key = mk_key(inst->ident, SBT_LABEL);
+      SymVal val;
+      ok = get_st(file->st, &key, &val) == GTRES_OK
+        && val.inst_addr >= func->start && val.inst_addr < func->end
+        && set_depth(depth, work, &nwork, val.inst_addr, d);
+    }
+    if (ok && inst->code != GOTO && inst->code != RET) {
+      ok = i + 1 < func->end && set_depth(depth, work, &nwork, i + 1, d);
+    }
+  }
+
+  free(work);
+  return ok;
+}
+
+/* Find the functions in file `fi` which calls can be inlined into. */
+static void find_callers(const Program* prog, unsigned int fi, FileState* fs) {
+  const File* file = &prog->files[fi];
+  size_t n = file->insts.idx;
+
+  fs->funcs = (Func*) malloc ((file->st.len + 1) * sizeof(Func));
+  assert(fs->funcs != NULL);
+  fs->nfuncs = 0;
+  for (size_t i = 0; i < file->st.len; i++) {
+    const Symbol* sym = &file->st.cell[i];
+    if (sym->key.type != SBT_FUNC) continue;
+    fs->funcs[fs->nfuncs ++] = (Func) {
+      .start=sym->val.inst_addr,
+      .nlocals=sym->val.nlocals,
+      .ok=1,
+    };
+  }
+  qsort(fs->funcs, fs->nfuncs, sizeof(Func), cmp_funcs);
+
+  for (size_t f = 0; f < fs->nfuncs; f++) {
+    Func* func = &fs->funcs[f];
+    func->end = f + 1 < fs->nfuncs ? fs->funcs[f + 1].start : n;
+    if (func->start >= func->end) {
+      /* Multiple functions start at the same instruction. */
+      func->ok = 0;
+      if (f + 1 < fs->nfuncs) fs->funcs[f + 1].ok = 0;
+    } else if (func->start > 0) {
+      /* Execution must not continue from the previous function. */
+      enum InstCode code = file->insts.cell[func->start - 1].code;
+      if (code != RET && code != GOTO) func->ok = 0;
+    }
+  }
+
+  /* Functions can only be entered through calls. */
+  for (unsigned int fj = 0; fj < prog->nfiles; fj++) {
+    const Insts* from = &prog->files[fj].insts;
+    for (size_t i = 0; i < from->idx; i++) {
+      const Inst* inst = &from->cell[i];
+      unsigned int target_fi;
+      SymVal val;
+      if (inst->code != GOTO && inst->code != IF_GOTO && inst->code != IF_NOT_GOTO)
+        continue;
+      if (!resolve_symbol(prog, fj, mk_key(inst->ident, SBT_LABEL), &target_fi, &val) || target_fi != fi)
+        continue;
+      int f = func_of(fs->funcs, fs->nfuncs, val.inst_addr);
+      if (f >= 0 && !(fj == fi && func_of(fs->funcs, fs->nfuncs, i) == f))
+        fs->funcs[f].ok = 0;
+    }
+  }
+
+  fs->depth = (int*) malloc ((n + 1) * sizeof(int));
+  assert(fs->depth != NULL);
+  for (size_t i = 0; i <= n; i++) fs->depth[i] = -1;
+
+  for (size_t f = 0; f < fs->nfuncs; f++) {
+    Func* func = &fs->funcs[f];
+    if (func->ok && !func_depths(file, func, fs->depth)) {
+      func->ok = 0;
+      for (size_t i = func->start; i < func->end; i++) fs->depth[i] = -1;
+    }
+  }
+}
+
+/* Get the body which replaces the call at `addr` in file `fi`. */
+static int site_body(const Program* prog, const FileState* states, unsigned int fi, size_t addr, Body* body) {
+  const Inst* call = &prog->files[fi].insts.cell[addr];
+  if (call->code != CALL || states[fi].depth[addr] < call->nargs) return 0;
+
+  unsigned int target_fi;
+  SymVal val;
+  if (!resolve_symbol(prog, fi, mk_key(call->ident, SBT_FUNC), &target_fi, &val)) return 0;
+  if (!get_body(prog, target_fi, val.inst_addr, val.nlocals, body)) return 0;
+
+  /* Missing arguments must still fail at runtime. */
+  return body->nargs <= call->nargs && (target_fi == fi || !body->uses_mem);
+}
+
+static void emit(Insts* out, Inst inst) {
+  if (out->idx == out->len) {
+    out->len = out->len == 0 ? INST_BLOCK_SIZE : out->len * 2;
+    out->cell = (Inst*) realloc (out->cell, out->len * sizeof(Inst));
+    assert(out->cell != NULL);
+  }
+  out->cell[out->idx ++] = inst;
+}
+
+#define NO_SLOT ((uint16_t) -1)
+
+static Inst mem_inst(const Inst* call, enum InstCode code, Segment seg, uint16_t offset) {
+  Inst inst = { .code=code, .off=call->off, .src=call->src };
+  inst.mem.seg = seg;
+  inst.mem.offset = offset;
+  return inst;
+}
+
+/* Replace `call` by `body`. Arguments and locals of the callee
+ * are stored in locals starting at `base`. Returns the number
+ * of locals which were used. */
+static uint16_t emit_body(const Program* prog, unsigned int fi, const Inst* call,
+    const Body* body, uint16_t base, Insts* out) {
+  const File* callee = &prog->files[body->fi];
+  const Inst* cell = &callee->insts.cell[body->start];
+  uint16_t nargs = call->nargs;
+
+  /* The arguments are on top of the stack. */
+  for (uint16_t i = nargs; i-- > 0;)
+    emit(out, mem_inst(call, POP, LOC, base + i));
+  uint16_t next = base + nargs;
+
+  /* Assign locals in the order the body uses them. Each call
+   * starts with zeroed locals, so locals which are read before
+   * they're written must be reset. */
+  uint16_t* slot = (uint16_t*) malloc ((body->nlocals + 1) * sizeof(uint16_t));
+  assert(slot != NULL);
+  for (uint16_t j = 0; j < body->nlocals; j++) slot[j] = NO_SLOT;
+  int sets_ptr[2] = { 0, 0 };
+
+  for (size_t i = 0; i < body->size; i++) {
+    if (is_mem(&cell[i], LOC) && slot[cell[i].mem.offset] == NO_SLOT) {
+      slot[cell[i].mem.offset] = next ++;
+      if (cell[i].code == PUSH) {
+        emit(out, mem_inst(call, PUSH, CONST, 0));
+        emit(out, mem_inst(call, POP, LOC, next - 1));
+      }
+    }
+    if (cell[i].code == POP && cell[i].mem.seg == PTR && cell[i].mem.offset <= 1)
+      sets_ptr[cell[i].mem.offset] = 1;
+  }
+
+  /* `return` would restore the pointers. */
+  uint16_t saved[2];
+  for (int p = 0; p < 2; p++) {
+    if (!sets_ptr[p]) continue;
+    saved[p] = next ++;
+    emit(out, mem_inst(call, PUSH, PTR, p));
+    emit(out, mem_inst(call, POP, LOC, saved[p]));
+  }
+
+  for (size_t i = 0; i < body->size; i++) {
+    Inst inst = cell[i];
+    /* Errors in the body point into the callee's source. */
+    if (body->fi != fi && inst.src == NULL)
+      inst.src = callee->insts.src;
+    if (is_mem(&inst, ARG)) {
+      inst.mem.seg = LOC;
+      inst.mem.offset = base + inst.mem.offset;
+    } else if (is_mem(&inst, LOC)) {
+      inst.mem.offset = slot[inst.mem.offset];
+    }
+    emit(out, inst);
+  }
+
+  for (int p = 0; p < 2; p++) {
+    if (!sets_ptr[p]) continue;
+    emit(out, mem_inst(call, PUSH, LOC, saved[p]));
+    emit(out, mem_inst(call, POP, PTR, p));
+  }
+
+  free(slot);
+  return next - base;
+}
+
+/* Should the call at `addr` in file `fi` be inlined? */
+static int should_inline(const Program* prog, FileState* states, unsigned int fi, size_t addr, Body* body) {
+  if (!site_body(prog, states, fi, addr, body)) return 0;
+  if (body->size <= INLINE_CALL_SIZE) return 1;
+  return body->size * states[body->fi].nsites[body->start] <= INLINE_MAX_GROWTH;
+}
+
+static void inline_file(const Program* prog, FileState* states, unsigned int fi) {
+  const Insts* insts = &prog->files[fi].insts;
+  FileState* fs = &states[fi];
+
+  fs->out = (Insts) { .idx=0, .len=0, .cell=NULL, .src=insts->src };
+  fs->map = (size_t*) malloc ((insts->idx + 1) * sizeof(size_t));
+  assert(fs->map != NULL);
+
+  for (size_t f = 0, i = 0; i < insts->idx; i++) {
+    while (f < fs->nfuncs && fs->funcs[f].end <= i) f++;
+    Func* func = f < fs->nfuncs && fs->funcs[f].start <= i ? &fs->funcs[f] : NULL;
+    const Inst* inst = &insts->cell[i];
+    Body body;
+    fs->map[i] = fs->out.idx;
+
+    if (
+      func != NULL && func->ok && should_inline(prog, states, fi, i, &body) &&
+      (size_t) func->nlocals + inst->nargs + body.nlocals + 2 <= UINT16_MAX
+    ) {
+      uint16_t n = emit_body(prog, fi, inst, &body, func->nlocals, &fs->out);
+      if (n > func->nextra) func->nextra = n;
+      fs->ninlined ++;
+    } else {
+      emit(&fs->out, *inst);
+    }
+  }
+  fs->map[insts->idx] = fs->out.idx;
+}
+
+/* Replace the instructions of `file` by the inlined ones. */
+static void install_file(File* file, FileState* fs) {
+  SymbolTable st = new_st();
+  for (size_t i = 0; i < file->st.len; i++) {
+    const Symbol* sym = &file->st.cell[i];
+    if (sym->key.type == SBT_UNUSED) continue;
+
+    SymVal val = sym->val;
+    if (sym->key.type == SBT_FUNC) {
+      int f = func_of(fs->funcs, fs->nfuncs, val.inst_addr);
+      if (f >= 0 && fs->funcs[f].start == val.inst_addr)
+        val.nlocals += fs->funcs[f].nextra;
+    }
+    val.inst_addr = fs->map[val.inst_addr];
+    insert_st(&st, sym->key, val);
+  }
+  st.num_inst = fs->out.idx;
+  del_st(file->st);
+  file->st = st;
+
+  file->ei = fs->map[file->ei];
+  free(file->insts.cell);
+  file->insts = fs->out;
+  fs->out.cell = NULL;
+}
+
+/* Count the call sites of each function which can be inlined. */
+static void count_sites(const Program* prog, FileState* states) {
+  for (unsigned int fi = 1; fi < prog->nfiles; fi++) {
+    const FileState* fs = &states[fi];
+    for (size_t f = 0; f < fs->nfuncs; f++) {
+      const Func* func = &fs->funcs[f];
+      if (!func->ok) continue;
+      for (size_t i = func->start; i < func->end; i++) {
+        Body body;
+        if (site_body(prog, states, fi, i, &body))
+          states[body.fi].nsites[body.start] ++;
+      }
+    }
+  }
+}
+
+unsigned int inline_prog(Program* prog) {
+  assert(prog != NULL);
+
+  FileState* states = (FileState*) calloc (prog->nfiles, sizeof(FileState));
+  assert(states != NULL);
+
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    size_t n = prog->files[fi].insts.idx;
+    states[fi].nsites = (size_t*) calloc (n + 1, sizeof(size_t));
+    assert(states[fi].nsites != NULL);
+    /* Nothing is inlined into the system file. */
+    if (fi > 0) {
+      find_callers(prog, fi, &states[fi]);
+    } else {
+      states[fi].depth = (int*) malloc ((n + 1) * sizeof(int));
+      assert(states[fi].depth != NULL);
+      for (size_t i = 0; i <= n; i++) states[fi].depth[i] = -1;
+    }
+  }
+
+  count_sites(prog, states);
+  for (unsigned int fi = 1; fi < prog->nfiles; fi++)
+    inline_file(prog, states, fi);
+
+  unsigned int ninlined = 0;
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    FileState* fs = &states[fi];
+    if (fs->ninlined > 0) install_file(&prog->files[fi], fs);
+    ninlined += fs->ninlined;
+    free(fs->out.cell);
+    free(fs->map);
+    free(fs->funcs);
+    free(fs->depth);
+    free(fs->nsites);
+  }
+  free(states);
+
+  /* Functions might not be called anymore. */
+  if (ninlined > 0) strip_prog(prog, NULL);
+  return ninlined;
+}
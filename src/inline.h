@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef _INLINE_H_
+#define _INLINE_H_
+
+#include "prog.h"
+
+/* Functions are only inlined if their body (without
+ * the final `return`) has at most this many instructions. */
+#ifndef INLINE_MAX_SIZE
+#define INLINE_MAX_SIZE 16
+#endif  // INLINE_MAX_SIZE
+
+/* Bodies up to this size are cheaper than the call
+ * itself so they're inlined at every call site. */
+#ifndef INLINE_CALL_SIZE
+#define INLINE_CALL_SIZE 6
+#endif  // INLINE_CALL_SIZE
+
+/* Larger bodies are only inlined if the copies add at
+ * most this many instructions over all call sites. */
+#ifndef INLINE_MAX_GROWTH
+#define INLINE_MAX_GROWTH 64
+#endif  // INLINE_MAX_GROWTH
+
+/* Replace calls to small functions by their bodies.
+ *
+ * Only functions whose body is a straight sequence of
+ * `push`, `pop` and arithmetic instructions followed by
+ * `return` are inlined. The arguments and locals of the
+ * callee become additional locals of the caller. If the
+ * callee changes `pointer`, `this` and `that` are saved
+ * in locals as well and restored afterwards.
+ *
+ * Callers must only be entered through calls and their
+ * stack depth must be known everywhere, so that the
+ * additional locals and the removed frame can't change
+ * what the program does. Inlined instructions keep their
+ * position in the callee's source so runtime errors
+ * still point there.
+ *
+ * Returns the number of inlined calls. */
+unsigned int inline_prog(Program* prog);
+
+#endif  // _INLINE_H_
@@ -0,0 +1,1552 @@
+#include "ir.h"
+#include "opt.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef IR_BLOCK_SIZE
+#define IR_BLOCK_SIZE 0x40
+#endif  // IR_BLOCK_SIZE
+
+/* An instruction inside a loop is assumed to run
+ * `IR_LOOP_WEIGHT` times as often as one outside. */
+#define IR_LOOP_WEIGHT 10
+#define IR_MAX_LOOP_DEPTH 4
+
+/* Hoisted values are loaded from a local inside the loop. Only
+ * computations of at least this many instructions are worth it. */
+#define IR_MIN_HOIST 3
+
+#define IR_MAX_LOCALS 0xFFFF
+
+static void* grow(void* cell, size_t* len, size_t need, size_t size) {
+  if (need <= *len) return cell;
+  while (*len < need) *len += IR_BLOCK_SIZE;
+  cell = realloc (cell, *len * size);
+  assert(cell != NULL);
+  return cell;
+}
+
+static Val new_val(IrFunc* fn, IrOp op, Inst inst, unsigned int nops) {
+  fn->insts = (IrInst*) grow(fn->insts, &fn->cap, fn->ninsts + 1, sizeof(IrInst));
+  fn->pool = (Val*) grow(fn->pool, &fn->poolcap, fn->npool + nops, sizeof(Val));
+
+  fn->insts[fn->ninsts] = (IrInst) {
+    .op=op,
+    .inst=inst,
+    .ops=fn->npool,
+    .nops=nops,
+    .target=-1,
+    .repl=NO_VAL,
+  };
+  fn->npool += nops;
+
+  return (Val) fn->ninsts ++;
+}
+
+/* The returned pointer is invalid after the next `new_val`. */
+static inline Val* ops_of(const IrFunc* fn, Val v) {
+  return &fn->pool[fn->insts[v].ops];
+}
+
+static void append(IrBlock* blk, Val v) {
+  blk->insts = (Val*) grow(blk->insts, &blk->cap, blk->ninsts + 1, sizeof(Val));
+  blk->insts[blk->ninsts ++] = v;
+}
+
+static inline int is_term(enum InstCode code) {
+  return code == GOTO || code == IF_GOTO || code == IF_NOT_GOTO || code == RET;
+}
+
+/* Values which can be removed or recomputed
+ * because they can't fail and have no effect. */
+static inline int is_pure(const IrInst* inst) {
+  switch (inst->op) {
+    case IR_CONST: return 1;
+    case IR_LOAD: return inst->safe;
+    case IR_UNARY: return 1;
+    /* `add` and `sub` fail on overflow. */
+    case IR_BINARY: return inst->inst.code != ADD && inst->inst.code != SUB;
+    default: return 0;
+  }
+}
+
+static inline int has_val(const IrInst* inst) {
+  switch (inst->op) {
+    case IR_CONST:
+    case IR_PARAM:
+    case IR_LOAD:
+    case IR_UNARY:
+    case IR_BINARY:
+    case IR_CALL:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Check the segment access of `inst`. Returns `0` if it would always
+ * fail. Otherwise `safe` is set if the access can't fail at all.
+ * `argument`, `this` and `that` depend on the caller and the
+ * pointers so they might fail. */
+static int check_mem(const Inst* inst, uint16_t nlocals, int* safe) {
+  size_t offset = inst->mem.offset;
+  *safe = 1;
+  switch (inst->mem.seg) {
+    case LOC: return offset < nlocals;
+    case STAT: return offset < MEM_STAT_SIZE;
+    case TMP: return offset < MEM_TEMP_SIZE;
+    case PTR: return offset <= 1;
+    case CONST: return 1;
+    default:
+      *safe = 0;
+      return 1;
+  }
+}
+
+static int label_block(
+  const File* file, const int* bmap, size_t start, size_t end,
+  const char* label, int* block
+) {
+  SymKey key = mk_key(label, SBT_LABEL);
+  SymVal val;
+  if (get_st(file->st, &key, &val) != GTRES_OK) return 0;
+  if (val.inst_addr < start || val.inst_addr >= end) return 0;
+  *block = bmap[val.inst_addr - start];
+  return *block >= 0;
+}
+
+/* Translate block `b` which is entered with `depth`
+ * values on the operand stack. */
+static int build_block(IrFunc* fn, const File* file, int b, unsigned int depth) {
+  IrBlock* blk = &fn->blocks[b];
+  Val* stack = (Val*) malloc ((depth + (blk->end - blk->start) + 1) * sizeof(Val));
+  assert(stack != NULL);
+  size_t sp = 0;
+
+  blk->nparams = depth;
+  blk->params = (Val*) malloc ((depth + 1) * sizeof(Val));
+  assert(blk->params != NULL);
+  for (unsigned int i = 0; i < depth; i++) {
+    Val v = new_val(fn, IR_PARAM, (Inst) { .code=IC_NONE }, 0);
+    blk->params[i] = stack[sp ++] = v;
+  }
+
+  blk->term = NO_VAL;
+  int ok = 1;
+
+  for (size_t addr = blk->start; ok && addr < blk->end; addr++) {
+    const Inst* inst = &file->insts.cell[addr];
+    Val v;
+    int safe;
+
+    switch (inst->code) {
+      case PUSH:
+        if (!check_mem(inst, fn->nlocals, &safe)) {
+          ok = 0;
+        } else if (inst->mem.seg == CONST) {
+          v = new_val(fn, IR_CONST, *inst, 0);
+          fn->insts[v].c = inst->mem.offset;
+          append(blk, stack[sp ++] = v);
+        } else {
+          v = new_val(fn, IR_LOAD, *inst, 0);
+          fn->insts[v].safe = safe;
+          append(blk, stack[sp ++] = v);
+        }
+        break;
+      case POP:
+        if (sp < 1 || !check_mem(inst, fn->nlocals, &safe)) {
+          ok = 0;
+        } else {
+          v = new_val(fn, inst->mem.seg == CONST ? IR_DROP : IR_STORE, *inst, 1);
+          fn->insts[v].safe = safe;
+          ops_of(fn, v)[0] = stack[-- sp];
+          append(blk, v);
+        }
+        break;
+      case NEG:
+      case NOT:
+        if (sp < 1) {
+          ok = 0;
+        } else {
+          v = new_val(fn, IR_UNARY, *inst, 1);
+          ops_of(fn, v)[0] = stack[-- sp];
+          append(blk, stack[sp ++] = v);
+        }
+        break;
+      case ADD:
+      case SUB:
+      case AND:
+      case OR:
+      case EQ:
+      case LT:
+      case GT:
+        if (sp < 2) {
+          ok = 0;
+        } else {
+          v = new_val(fn, IR_BINARY, *inst, 2);
+          sp -= 2;
+          ops_of(fn, v)[0] = stack[sp];
+          ops_of(fn, v)[1] = stack[sp + 1];
+          append(blk, stack[sp ++] = v);
+        }
+        break;
+      case CALL:
+      case CALL_BUILTIN:
+        if (sp < inst->nargs) {
+          ok = 0;
+        } else {
+          v = new_val(fn, IR_CALL, *inst, inst->nargs);
+          sp -= inst->nargs;
+          for (unsigned int i = 0; i < inst->nargs; i++)
+            ops_of(fn, v)[i] = stack[sp + i];
+          append(blk, stack[sp ++] = v);
+        }
+        break;
+      case RET:
+        if (sp < 1) {
+          ok = 0;
+        } else {
+          v = new_val(fn, IR_RET, *inst, 1);
+          ops_of(fn, v)[0] = stack[-- sp];
+          blk->term = v;
+        }
+        break;
+      case GOTO:
+        blk->term = new_val(fn, IR_GOTO, *inst, 0);
+        fn->insts[blk->term].target = blk->succ[0];
+        break;
+      case IF_GOTO:
+      case IF_NOT_GOTO:
+        if (sp < 1) {
+          ok = 0;
+        } else {
+          v = new_val(fn, IR_BRANCH, *inst, 1);
+          ops_of(fn, v)[0] = stack[-- sp];
+          fn->insts[v].target = blk->succ[0];
+          blk->term = v;
+        }
+        break;
+      default:
+        /* Builtins aren't part of normal functions. */
+        ok = 0;
+        break;
+    }
+  }
+
+  blk->nexit = sp;
+  blk->exit = stack;
+  blk->built = 1;
+
+  return ok;
+}
+
+/* `dom[b * nblocks + d]` is set if `d` dominates `b`. */
+static char* dominators(const IrFunc* fn, int** preds, unsigned int* npreds) {
+  unsigned int nb = fn->nblocks;
+  char* dom = (char*) malloc (nb * nb);
+  assert(dom != NULL);
+
+  memset(dom, 1, nb * nb);
+  memset(dom, 0, nb);
+  dom[0] = 1;
+
+  int changed;
+  do {
+    changed = 0;
+    for (unsigned int b = 1; b < nb; b++) {
+      for (unsigned int d = 0; d < nb; d++) {
+        char is_dom = d == b || npreds[b] > 0;
+        for (unsigned int i = 0; i < npreds[b] && is_dom; i++)
+          is_dom = dom[preds[b][i] * nb + d];
+        if (d != b && !is_dom && dom[b * nb + d]) {
+          dom[b * nb + d] = 0;
+          changed = 1;
+        }
+      }
+    }
+  } while (changed);
+
+  return dom;
+}
+
+static int** pred_lists(const IrFunc* fn, unsigned int** npreds) {
+  int** preds = (int**) calloc (fn->nblocks, sizeof(int*));
+  *npreds = (unsigned int*) calloc (fn->nblocks, sizeof(unsigned int));
+  assert(preds != NULL && *npreds != NULL);
+
+  for (unsigned int b = 0; b < fn->nblocks; b++) {
+    preds[b] = (int*) malloc ((fn->blocks[b].npreds + 1) * sizeof(int));
+    assert(preds[b] != NULL);
+  }
+  for (unsigned int b = 0; b < fn->nblocks; b++) {
+    for (unsigned int i = 0; i < fn->blocks[b].nsucc; i++) {
+      int s = fn->blocks[b].succ[i];
+      preds[s][(*npreds)[s] ++] = b;
+    }
+  }
+
+  return preds;
+}
+
+static void del_pred_lists(const IrFunc* fn, int** preds, unsigned int* npreds) {
+  for (unsigned int b = 0; b < fn->nblocks; b++) free(preds[b]);
+  free(preds);
+  free(npreds);
+}
+
+/* Mark the blocks of the loop closed by the back edge `u -> h`. */
+static void loop_body(
+  const IrFunc* fn, int** preds, const unsigned int* npreds,
+  int u, int h, char* inloop
+) {
+  int* work = (int*) malloc ((fn->nblocks + 1) * sizeof(int));
+  assert(work != NULL);
+  size_t nwork = 0;
+
+  memset(inloop, 0, fn->nblocks);
+  inloop[h] = 1;
+  if (!inloop[u]) {
+    inloop[u] = 1;
+    work[nwork ++] = u;
+  }
+
+  while (nwork > 0) {
+    int b = work[-- nwork];
+    for (unsigned int i = 0; i < npreds[b]; i++) {
+      int p = preds[b][i];
+      if (!inloop[p]) {
+        inloop[p] = 1;
+        work[nwork ++] = p;
+      }
+    }
+  }
+
+  free(work);
+}
+
+static void loop_depths(IrFunc* fn) {
+  unsigned int* npreds;
+  int** preds = pred_lists(fn, &npreds);
+  char* dom = dominators(fn, preds, npreds);
+  char* inloop = (char*) malloc (fn->nblocks);
+  assert(inloop != NULL);
+
+  for (unsigned int u = 0; u < fn->nblocks; u++) {
+    for (unsigned int i = 0; i < fn->blocks[u].nsucc; i++) {
+      int h = fn->blocks[u].succ[i];
+      if (!dom[u * fn->nblocks + h]) continue;
+      loop_body(fn, preds, npreds, u, h, inloop);
+      for (unsigned int b = 0; b < fn->nblocks; b++)
+        fn->blocks[b].depth += inloop[b];
+    }
+  }
+
+  free(inloop);
+  free(dom);
+  del_pred_lists(fn, preds, npreds);
+}
+
+int build_ir(const File* file, size_t start, size_t end, uint16_t nlocals, IrFunc* fn) {
+  assert(file != NULL);
+  assert(fn != NULL);
+
+  memset(fn, 0, sizeof(IrFunc));
+  fn->nlocals = nlocals;
+
+  if (start >= end || end > file->insts.idx) return IR_ERR;
+  size_t n = end - start;
+
+  /* Blocks start at labels and after jumps and returns. */
+  char* leader = (char*) calloc (n, sizeof(char));
+  int* bmap = (int*) malloc (n * sizeof(int));
+  assert(leader != NULL && bmap != NULL);
+
+  leader[0] = 1;
+  for (size_t i = 0; i < file->st.len; i++) {
+    const Symbol* sym = &file->st.cell[i];
+    size_t addr = sym->val.inst_addr;
+    if (sym->key.type == SBT_LABEL && addr >= start && addr < end)
+      leader[addr - start] = 1;
+  }
+  for (size_t i = start; i + 1 < end; i++) {
+    if (is_term(file->insts.cell[i].code)) leader[i + 1 - start] = 1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    bmap[i] = leader[i] ? (int) fn->nblocks ++ : -1;
+  }
+
+  fn->blocks = (IrBlock*) calloc (fn->nblocks, sizeof(IrBlock));
+  assert(fn->blocks != NULL);
+  for (size_t i = 0, b = 0; i < n; i++) {
+    if (!leader[i]) continue;
+    if (b > 0) fn->blocks[b - 1].end = start + i;
+    fn->blocks[b ++].start = start + i;
+  }
+  fn->blocks[fn->nblocks - 1].end = end;
+
+  int ok = 1;
+
+  /* Control flow must stay inside the function. */
+  for (unsigned int b = 0; ok && b < fn->nblocks; b++) {
+    IrBlock* blk = &fn->blocks[b];
+    const Inst* last = &file->insts.cell[blk->end - 1];
+    int next = b + 1 < fn->nblocks ? (int) b + 1 : -1;
+
+    switch (last->code) {
+      case GOTO:
+        ok = label_block(file, bmap, start, end, last->ident, &blk->succ[0]);
+        blk->nsucc = 1;
+        break;
+      case IF_GOTO:
+      case IF_NOT_GOTO:
+        ok = next >= 0
+          && label_block(file, bmap, start, end, last->ident, &blk->succ[0]);
+        blk->succ[1] = next;
+        blk->nsucc = 2;
+        break;
+      case RET:
+        blk->nsucc = 0;
+        break;
+      default:
+        ok = next >= 0;
+        blk->succ[0] = next;
+        blk->nsucc = 1;
+        break;
+    }
+    for (unsigned int i = 0; ok && i < blk->nsucc; i++)
+      fn->blocks[blk->succ[i]].npreds ++;
+  }
+
+  /* The function starts with an empty operand stack. Each
+   * block must be entered with the same stack depth. */
+  unsigned int* depth = (unsigned int*) malloc (fn->nblocks * sizeof(unsigned int));
+  int* work = (int*) malloc ((fn->nblocks + 1) * sizeof(int));
+  char* queued = (char*) calloc (fn->nblocks, sizeof(char));
+  assert(depth != NULL && work != NULL && queued != NULL);
+  size_t nwork = 0;
+
+  if (ok) {
+    depth[0] = 0;
+    queued[0] = 1;
+    work[nwork ++] = 0;
+  }
+
+  while (ok && nwork > 0) {
+    int b = work[-- nwork];
+    ok = build_block(fn, file, b, depth[b]);
+
+    const IrBlock* blk = &fn->blocks[b];
+    for (unsigned int i = 0; ok && i < blk->nsucc; i++) {
+      int s = blk->succ[i];
+      if (!queued[s]) {
+        depth[s] = blk->nexit;
+        queued[s] = 1;
+        work[nwork ++] = s;
+      } else if (depth[s] != blk->nexit) {
+        ok = 0;
+      }
+    }
+  }
+
+  for (unsigned int b = 0; ok && b < fn->nblocks; b++) {
+    /* Unreachable code is removed by `strip_prog`. */
+    ok = fn->blocks[b].built;
+  }
+
+  if (ok) loop_depths(fn);
+
+  free(queued);
+  free(work);
+  free(depth);
+  free(bmap);
+  free(leader);
+
+  return ok ? IR_OK : IR_ERR;
+}
+
+void del_ir(IrFunc* fn) {
+  assert(fn != NULL);
+
+  for (unsigned int b = 0; b < fn->nblocks; b++) {
+    free(fn->blocks[b].insts);
+    free(fn->blocks[b].params);
+    free(fn->blocks[b].exit);
+  }
+  free(fn->blocks);
+  free(fn->insts);
+  free(fn->pool);
+}
+
+static Val find(const IrFunc* fn, Val v) {
+  while (fn->insts[v].repl != NO_VAL) v = fn->insts[v].repl;
+  return v;
+}
+
+static void replace(IrFunc* fn, Val v, Val by) {
+  fn->insts[v].op = IR_NOP;
+  fn->insts[v].repl = by;
+}
+
+/* Make `v` the constant `c`. */
+static void make_const(IrFunc* fn, Val v, Word c) {
+  IrInst* inst = &fn->insts[v];
+  Offset off = inst->inst.off;
+  inst->op = IR_CONST;
+  inst->inst = (Inst) { .code=PUSH, .mem={ .seg=CONST, .offset=c }, .off=off };
+  inst->c = c;
+  inst->nops = 0;
+}
+
+/* Turn a store into `pop constant 0`. */
+static void make_drop(IrInst* inst) {
+  inst->op = IR_DROP;
+  inst->inst = (Inst) { .code=POP, .mem={ .seg=CONST, .offset=0 }, .off=inst->inst.off };
+}
+
+/* Known contents of a segment entry. */
+typedef struct {
+  Segment seg;
+  uint16_t offset;
+  Val val;
+} Slot;
+
+typedef struct {
+  Slot* cell;
+  size_t idx;
+  size_t len;
+} Slots;
+
+static Slot* find_slot(Slots* slots, Segment seg, uint16_t offset) {
+  for (size_t i = 0; i < slots->idx; i++) {
+    if (slots->cell[i].seg == seg && slots->cell[i].offset == offset)
+      return &slots->cell[i];
+  }
+  return NULL;
+}
+
+static void set_slot(Slots* slots, Segment seg, uint16_t offset, Val val) {
+  Slot* slot = find_slot(slots, seg, offset);
+  if (slot == NULL) {
+    slots->cell = (Slot*) grow(slots->cell, &slots->len, slots->idx + 1, sizeof(Slot));
+    slot = &slots->cell[slots->idx ++];
+  }
+  *slot = (Slot) { .seg=seg, .offset=offset, .val=val };
+}
+
+/* Forget entries which a called function might change. */
+static void forget_slots(Slots* slots) {
+  size_t n = 0;
+  for (size_t i = 0; i < slots->idx; i++) {
+    Segment seg = slots->cell[i].seg;
+    if (seg != STAT && seg != TMP) slots->cell[n ++] = slots->cell[i];
+  }
+  slots->idx = n;
+}
+
+/* Might `inst` access the `static`, `temp` or `pointer` entries
+ * through `this` or `that`? Only in the unified RAM. */
+static inline int aliases_ram(const IrFunc* fn, const IrInst* inst) {
+  Segment seg = inst->inst.mem.seg;
+  return fn->ram && !inst->safe && (seg == THIS || seg == THAT);
+}
+
+/* Forget entries which a store through `this` or `that` might
+ * change. Only the locals are outside of the unified RAM. */
+static void forget_ram(Slots* slots) {
+  size_t n = 0;
+  for (size_t i = 0; i < slots->idx; i++) {
+    if (slots->cell[i].seg == LOC) slots->cell[n ++] = slots->cell[i];
+  }
+  slots->idx = n;
+}
+
+static void resolve_ops(IrFunc* fn, Val v) {
+  Val* ops = ops_of(fn, v);
+  for (unsigned int i = 0; i < fn->insts[v].nops; i++)
+    ops[i] = find(fn, ops[i]);
+}
+
+static int same_op(const IrFunc* fn, Val a, Val b) {
+  const IrInst* x = &fn->insts[a];
+  const IrInst* y = &fn->insts[b];
+  if (x->op != y->op || x->inst.code != y->inst.code || x->nops != y->nops)
+    return 0;
+  return memcmp(ops_of(fn, a), ops_of(fn, b), x->nops * sizeof(Val)) == 0;
+}
+
+static int same_val(const IrFunc* fn, Val a, Val b) {
+  if (a == b) return 1;
+  return fn->insts[a].op == IR_CONST && fn->insts[b].op == IR_CONST
+    && fn->insts[a].c == fn->insts[b].c;
+}
+
+static void gvn_block(IrFunc* fn, int b) {
+  IrBlock* blk = &fn->blocks[b];
+  Slots slots = { .cell=NULL, .idx=0, .len=0 };
+
+  /* Locals are zero when a function is called. */
+  Val zero = NO_VAL;
+  if (b == 0 && blk->npreds == 0 && fn->nlocals > 0 && blk->ninsts > 0) {
+    Inst inst = { .code=PUSH, .mem={ .seg=CONST, .offset=0 },
+      .off=fn->insts[blk->insts[0]].inst.off };
+    zero = new_val(fn, IR_CONST, inst, 0);
+    append(blk, zero);
+    memmove(blk->insts + 1, blk->insts, (blk->ninsts - 1) * sizeof(Val));
+    blk->insts[0] = zero;
+  }
+
+  for (size_t i = 0; i < blk->ninsts; i++) {
+    Val v = blk->insts[i];
+    resolve_ops(fn, v);
+    IrInst* inst = &fn->insts[v];
+    const Val* ops = ops_of(fn, v);
+    Word res;
+
+    switch (inst->op) {
+      case IR_LOAD:
+        if (inst->safe) {
+          Slot* slot = find_slot(&slots, inst->inst.mem.seg, inst->inst.mem.offset);
+          if (slot != NULL) {
+            replace(fn, v, slot->val);
+          } else if (zero != NO_VAL && inst->inst.mem.seg == LOC) {
+            replace(fn, v, zero);
+          } else {
+            set_slot(&slots, inst->inst.mem.seg, inst->inst.mem.offset, v);
+          }
+        }
+        break;
+      case IR_STORE:
+        if (inst->safe) {
+          Segment seg = inst->inst.mem.seg;
+          Slot* slot = find_slot(&slots, seg, inst->inst.mem.offset);
+          Val known = slot != NULL ? slot->val : seg == LOC ? zero : NO_VAL;
+          if (known != NO_VAL && same_val(fn, known, ops[0])) {
+            /* The entry already has this value. */
+            make_drop(inst);
+          } else {
+            set_slot(&slots, seg, inst->inst.mem.offset, ops[0]);
+          }
+        } else if (aliases_ram(fn, inst)) {
+          forget_ram(&slots);
+        }
+        break;
+      case IR_CALL:
+        forget_slots(&slots);
+        break;
+      case IR_UNARY:
+        if (fn->insts[ops[0]].op == IR_CONST
+            && fold_unary(inst->inst.code, fn->insts[ops[0]].c, &res)) {
+          make_const(fn, v, res);
+          break;
+        }
+        /* Fallthrough */
+      case IR_BINARY:
+        if (inst->op == IR_BINARY && fn->insts[ops[0]].op == IR_CONST
+            && fn->insts[ops[1]].op == IR_CONST
+            && fold_binary(inst->inst.code,
+              fn->insts[ops[0]].c, fn->insts[ops[1]].c, &res)) {
+          make_const(fn, v, res);
+          break;
+        }
+        if (!is_pure(inst)) break;
+        for (size_t j = 0; j < i; j++) {
+          if (same_op(fn, blk->insts[j], v)) {
+            replace(fn, v, blk->insts[j]);
+            break;
+          }
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  for (unsigned int i = 0; i < blk->nexit; i++)
+    blk->exit[i] = find(fn, blk->exit[i]);
+  if (blk->term != NO_VAL) resolve_ops(fn, blk->term);
+
+  free(slots.cell);
+}
+
+void ir_gvn(IrFunc* fn) {
+  assert(fn != NULL);
+  for (unsigned int b = 0; b < fn->nblocks; b++) gvn_block(fn, b);
+}
+
+static inline int is_local(const IrInst* inst, uint16_t nlocals) {
+  return inst->inst.mem.seg == LOC && inst->inst.mem.offset < nlocals;
+}
+
+static void unset_slot(Slots* slots, Segment seg, uint16_t offset) {
+  Slot* slot = find_slot(slots, seg, offset);
+  if (slot != NULL) *slot = slots->cell[-- slots->idx];
+}
+
+/* Entry of `pointer` which is read when accessing `seg`. */
+static inline uint16_t ptr_of(Segment seg, uint16_t offset) {
+  switch (seg) {
+    case THIS: return 0;
+    case THAT: return 1;
+    default: return offset;
+  }
+}
+
+/* Walk backwards through block `b` and remove stores which are
+ * overwritten before the next read. `dead[k]` is set if local `k`
+ * isn't read after the block. Other entries are tracked in `over`. */
+static void dse_block(IrFunc* fn, int b, char* dead) {
+  IrBlock* blk = &fn->blocks[b];
+  Slots over = { .cell=NULL, .idx=0, .len=0 };
+
+  for (size_t i = blk->ninsts; i-- > 0;) {
+    IrInst* inst = &fn->insts[blk->insts[i]];
+    Segment seg = inst->inst.mem.seg;
+    uint16_t offset = inst->inst.mem.offset;
+    int local = is_local(inst, fn->nlocals);
+
+    switch (inst->op) {
+      case IR_STORE:
+        if (!inst->safe) {
+          if (seg != ARG) unset_slot(&over, PTR, ptr_of(seg, offset));
+          break;
+        }
+        if (local ? dead[offset] : find_slot(&over, seg, offset) != NULL) {
+          make_drop(inst);
+        }
+        if (local) dead[offset] = 1;
+        else set_slot(&over, seg, offset, NO_VAL);
+        break;
+      case IR_LOAD:
+        if (aliases_ram(fn, inst)) {
+          /* It might read any static, temp or pointer entry. */
+          over.idx = 0;
+        } else if (!inst->safe) {
+          if (seg != ARG) unset_slot(&over, PTR, ptr_of(seg, offset));
+        } else if (local) {
+          dead[offset] = 0;
+        } else {
+          unset_slot(&over, seg, offset);
+        }
+        break;
+      case IR_CALL:
+        /* The called function might read any static,
+         * temp or pointer entry but no locals. */
+        over.idx = 0;
+        break;
+      default:
+        break;
+    }
+  }
+
+  free(over.cell);
+}
+
+void ir_dse(IrFunc* fn) {
+  assert(fn != NULL);
+
+  unsigned int nb = fn->nblocks;
+  size_t nl = fn->nlocals;
+  char* use = (char*) calloc (nb * nl + 1, 1);
+  char* def = (char*) calloc (nb * nl + 1, 1);
+  char* live = (char*) calloc (nb * nl + 1, 1);
+  char* dead = (char*) malloc (nl + 1);
+  assert(use != NULL && def != NULL && live != NULL && dead != NULL);
+
+  for (unsigned int b = 0; b < nb; b++) {
+    const IrBlock* blk = &fn->blocks[b];
+    for (size_t i = 0; i < blk->ninsts; i++) {
+      const IrInst* inst = &fn->insts[blk->insts[i]];
+      if (!is_local(inst, fn->nlocals)) continue;
+      uint16_t offset = inst->inst.mem.offset;
+      if (inst->op == IR_LOAD && !def[b * nl + offset]) use[b * nl + offset] = 1;
+      else if (inst->op == IR_STORE) def[b * nl + offset] = 1;
+    }
+  }
+
+  /* Locals which are live when entering a block. */
+  int changed;
+  do {
+    changed = 0;
+    for (unsigned int b = nb; b-- > 0;) {
+      const IrBlock* blk = &fn->blocks[b];
+      for (size_t k = 0; k < nl; k++) {
+        char out = 0;
+        for (unsigned int i = 0; i < blk->nsucc; i++)
+          out |= live[blk->succ[i] * nl + k];
+        char in = use[b * nl + k] || (out && !def[b * nl + k]);
+        if (in != live[b * nl + k]) {
+          live[b * nl + k] = in;
+          changed = 1;
+        }
+      }
+    }
+  } while (changed);
+
+  for (unsigned int b = 0; b < nb; b++) {
+    const IrBlock* blk = &fn->blocks[b];
+    for (size_t k = 0; k < nl; k++) {
+      char out = 0;
+      for (unsigned int i = 0; i < blk->nsucc; i++)
+        out |= live[blk->succ[i] * nl + k];
+      dead[k] = !out;
+    }
+    dse_block(fn, b, dead);
+  }
+
+  free(dead);
+  free(live);
+  free(def);
+  free(use);
+}
+
+static size_t* count_uses(const IrFunc* fn) {
+  size_t* nuses = (size_t*) calloc (fn->ninsts + 1, sizeof(size_t));
+  assert(nuses != NULL);
+
+  for (unsigned int b = 0; b < fn->nblocks; b++) {
+    const IrBlock* blk = &fn->blocks[b];
+    for (size_t i = 0; i < blk->ninsts; i++) {
+      Val v = blk->insts[i];
+      if (fn->insts[v].op == IR_NOP) continue;
+      for (unsigned int j = 0; j < fn->insts[v].nops; j++)
+        nuses[ops_of(fn, v)[j]] ++;
+    }
+    if (blk->term != NO_VAL) {
+      for (unsigned int j = 0; j < fn->insts[blk->term].nops; j++)
+        nuses[ops_of(fn, blk->term)[j]] ++;
+    }
+    /* Values left on the stack when returning aren't used. */
+    if (blk->term == NO_VAL || fn->insts[blk->term].op != IR_RET) {
+      for (unsigned int j = 0; j < blk->nexit; j++)
+        nuses[blk->exit[j]] ++;
+    }
+  }
+
+  return nuses;
+}
+
+void ir_dce(IrFunc* fn) {
+  assert(fn != NULL);
+
+  int changed;
+  do {
+    changed = 0;
+    size_t* nuses = count_uses(fn);
+
+    for (unsigned int b = 0; b < fn->nblocks; b++) {
+      const IrBlock* blk = &fn->blocks[b];
+      for (size_t i = blk->ninsts; i-- > 0;) {
+        Val v = blk->insts[i];
+        IrInst* inst = &fn->insts[v];
+
+        if (inst->op == IR_DROP) {
+          /* Unused values are dropped when they're lowered. */
+          inst->op = IR_NOP;
+          nuses[ops_of(fn, v)[0]] --;
+          changed = 1;
+        } else if (is_pure(inst) && nuses[v] == 0) {
+          for (unsigned int j = 0; j < inst->nops; j++)
+            nuses[ops_of(fn, v)[j]] --;
+          inst->op = IR_NOP;
+          changed = 1;
+        }
+      }
+    }
+
+    free(nuses);
+  } while (changed);
+}
+
+/* Segment entries which are written inside a loop. */
+typedef struct {
+  Slots stored;
+  int has_call;
+  int has_ram_store;  /* See `aliases_ram`. */
+} LoopEffects;
+
+static int is_invariant(const IrFunc* fn, LoopEffects* fx, Val v, size_t* size) {
+  const IrInst* inst = &fn->insts[v];
+
+  switch (inst->op) {
+    case IR_CONST:
+      *size += 1;
+      return 1;
+    case IR_LOAD: {
+      Segment seg = inst->inst.mem.seg;
+      *size += 1;
+      return inst->safe
+        && find_slot(&fx->stored, seg, inst->inst.mem.offset) == NULL
+        && !(fx->has_call && (seg == STAT || seg == TMP))
+        && !(fx->has_ram_store && seg != LOC);
+    }
+    case IR_UNARY:
+    case IR_BINARY:
+      if (!is_pure(inst)) return 0;
+      *size += 1;
+      for (unsigned int i = 0; i < inst->nops; i++) {
+        if (!is_invariant(fn, fx, ops_of(fn, v)[i], size)) return 0;
+      }
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Copy the computation of `v` to the end of `blk`. */
+static Val clone_tree(IrFunc* fn, int b, Val v) {
+  IrInst inst = fn->insts[v];
+  Val ops[2];
+  for (unsigned int i = 0; i < inst.nops; i++)
+    ops[i] = clone_tree(fn, b, ops_of(fn, v)[i]);
+
+  Val w = new_val(fn, inst.op, inst.inst, inst.nops);
+  fn->insts[w].c = inst.c;
+  fn->insts[w].safe = inst.safe;
+  for (unsigned int i = 0; i < inst.nops; i++)
+    ops_of(fn, w)[i] = ops[i];
+  append(&fn->blocks[b], w);
+
+  return w;
+}
+
+static void hoist_loop(IrFunc* fn, const char* inloop, int pre) {
+  LoopEffects fx = {
+    .stored={ .cell=NULL, .idx=0, .len=0 }, .has_call=0, .has_ram_store=0,
+  };
+
+  for (unsigned int b = 0; b < fn->nblocks; b++) {
+    if (!inloop[b]) continue;
+    const IrBlock* blk = &fn->blocks[b];
+    for (size_t i = 0; i < blk->ninsts; i++) {
+      const IrInst* inst = &fn->insts[blk->insts[i]];
+      if (inst->op == IR_STORE) {
+        set_slot(&fx.stored, inst->inst.mem.seg, inst->inst.mem.offset, NO_VAL);
+        fx.has_ram_store |= aliases_ram(fn, inst);
+      } else if (inst->op == IR_CALL) {
+        fx.has_call = 1;
+      }
+    }
+  }
+
+  size_t* nuses = count_uses(fn);
+  size_t nvals = fn->ninsts;
+
+  for (unsigned int b = 0; b < fn->nblocks; b++) {
+    if (!inloop[b]) continue;
+
+    /* Visit the last value of a computation first so
+     * that the largest computation is hoisted. */
+    for (size_t i = fn->blocks[b].ninsts; i-- > 0;) {
+      Val v = fn->blocks[b].insts[i];
+      IrInst* inst = &fn->insts[v];
+      size_t size = 0;
+
+      if (v >= (Val) nvals || nuses[v] == 0) continue;
+      if (inst->op != IR_UNARY && inst->op != IR_BINARY) continue;
+      if (!is_invariant(fn, &fx, v, &size) || size < IR_MIN_HOIST) continue;
+      if ((size_t) fn->nlocals + fn->nhoisted >= IR_MAX_LOCALS) break;
+
+      uint16_t local = fn->nlocals + fn->nhoisted ++;
+      Offset off = inst->inst.off;
+
+      Val w = clone_tree(fn, pre, v);
+      Val store = new_val(fn, IR_STORE,
+        (Inst) { .code=POP, .mem={ .seg=LOC, .offset=local }, .off=off }, 1);
+      fn->insts[store].safe = 1;
+      ops_of(fn, store)[0] = w;
+      append(&fn->blocks[pre], store);
+
+      /* The operands of the original computation are now unused. */
+      for (unsigned int j = 0; j < fn->insts[v].nops; j++)
+        nuses[ops_of(fn, v)[j]] --;
+
+      inst = &fn->insts[v];
+      inst->op = IR_LOAD;
+      inst->inst = (Inst) { .code=PUSH, .mem={ .seg=LOC, .offset=local }, .off=off };
+      inst->nops = 0;
+      inst->safe = 1;
+    }
+  }
+
+  free(nuses);
+  free(fx.stored.cell);
+}
+
+typedef struct {
+  int from;
+  int header;
+  size_t size;
+} BackEdge;
+
+static int cmp_back_edges(const void* a, const void* b) {
+  size_t x = ((const BackEdge*) a)->size;
+  size_t y = ((const BackEdge*) b)->size;
+  return (x < y) - (x > y);
+}
+
+void ir_licm(IrFunc* fn) {
+  assert(fn != NULL);
+
+  unsigned int* npreds;
+  int** preds = pred_lists(fn, &npreds);
+  char* dom = dominators(fn, preds, npreds);
+  char* inloop = (char*) malloc (fn->nblocks);
+  assert(inloop != NULL);
+
+  /* Back edges ordered by the size of their loops. Outer loops
+   * come first so values are hoisted as far as possible. */
+  BackEdge* edges = (BackEdge*) malloc ((2 * fn->nblocks + 1) * sizeof(BackEdge));
+  assert(edges != NULL);
+  size_t nedges = 0;
+
+  for (unsigned int u = 0; u < fn->nblocks; u++) {
+    for (unsigned int i = 0; i < fn->blocks[u].nsucc; i++) {
+      int h = fn->blocks[u].succ[i];
+      if (!dom[u * fn->nblocks + h]) continue;
+
+      loop_body(fn, preds, npreds, u, h, inloop);
+      size_t size = 0;
+      for (unsigned int b = 0; b < fn->nblocks; b++) size += inloop[b];
+      edges[nedges ++] = (BackEdge) { .from=u, .header=h, .size=size };
+    }
+  }
+  qsort(edges, nedges, sizeof(BackEdge), cmp_back_edges);
+
+  for (size_t e = 0; e < nedges; e++) {
+    int h = edges[e].header;
+    loop_body(fn, preds, npreds, edges[e].from, h, inloop);
+
+    /* Hoisted values are computed in the only block which
+     * enters the loop. It must always continue with the loop. */
+    int pre = -1;
+    unsigned int nouter = 0;
+    for (unsigned int j = 0; j < npreds[h]; j++) {
+      if (!inloop[preds[h][j]]) {
+        pre = preds[h][j];
+        nouter ++;
+      }
+    }
+    if (nouter != 1 || fn->blocks[pre].nsucc != 1) continue;
+
+    hoist_loop(fn, inloop, pre);
+  }
+
+  free(edges);
+  free(inloop);
+  free(dom);
+  del_pred_lists(fn, preds, npreds);
+}
+
+static void emit(Insts* out, Inst inst) {
+  out->cell = (Inst*) grow(out->cell, &out->len, out->idx + 1, sizeof(Inst));
+  out->cell[out->idx ++] = inst;
+}
+
+/* Number of `ops` which are on top of `stack` in the same order. */
+static size_t match_ops(const Val* stack, size_t sp, const Val* ops, size_t nops) {
+  for (size_t m = nops < sp ? nops : sp; m > 0; m--) {
+    if (memcmp(stack + sp - m, ops, m * sizeof(Val)) == 0) return m;
+  }
+  return 0;
+}
+
+/* A block is lowered as a sequence of steps. Step `i < nsteps`
+ * is the instruction `steps[i]`. The last step leaves the
+ * block: its operands are the values on the operand stack
+ * when the block ends followed by the operand of the
+ * terminator (if any). */
+typedef struct {
+  const Val* steps;
+  size_t nsteps;
+  Val* fin;
+  size_t nfin;
+  int ret;  /* The block returns so there's no operand stack to keep. */
+} Steps;
+
+static const Val* step_ops(const IrFunc* fn, const Steps* st, size_t i, size_t* nops) {
+  if (i < st->nsteps) {
+    *nops = fn->insts[st->steps[i]].nops;
+    return ops_of(fn, st->steps[i]);
+  }
+  *nops = st->nfin;
+  return st->fin;
+}
+
+static int mark_spill(char* spill, Val v) {
+  if (spill[v]) return 0;
+  spill[v] = 1;
+  return 1;
+}
+
+/* Decide which values can stay on the operand stack until
+ * they're used. All other values are spilled: they're stored
+ * in a scratch local or computed again where they're used.
+ * Values which are used more than once are always spilled. */
+static void place_values(
+  const IrFunc* fn, const IrBlock* blk, const Steps* st,
+  const size_t* nuses, char* spill, Val* stack
+) {
+  for (unsigned int j = 0; j < blk->nparams; j++) {
+    if (nuses[blk->params[j]] != 1) spill[blk->params[j]] = 1;
+  }
+  for (size_t i = 0; i < st->nsteps; i++) {
+    Val v = st->steps[i];
+    if (has_val(&fn->insts[v]) && nuses[v] != 1) spill[v] = 1;
+  }
+
+  /* Spilling a value can't change how values above it on the
+   * stack are used. Repeat until no new values are spilled. */
+  int changed;
+  do {
+    changed = 0;
+    size_t sp = 0;
+
+    /* Parameters can only be taken off the stack from the top. */
+    int spilled = 0;
+    for (unsigned int j = 0; j < blk->nparams; j++) {
+      Val p = blk->params[j];
+      if (spilled) changed |= mark_spill(spill, p);
+      spilled = spill[p];
+      if (!spilled) stack[sp ++] = p;
+    }
+
+    for (size_t i = 0; i <= st->nsteps; i++) {
+      size_t nops;
+      const Val* ops = step_ops(fn, st, i, &nops);
+      size_t m = match_ops(stack, sp, ops, nops);
+
+      /* Operands which aren't on top are buried below other values. */
+      for (size_t j = m; j < nops; j++) {
+        for (size_t k = 0; k + m < sp; k++) {
+          if (stack[k] != ops[j]) continue;
+          changed |= mark_spill(spill, ops[j]);
+          memmove(stack + k, stack + k + 1, (sp - k - 1) * sizeof(Val));
+          sp --;
+          break;
+        }
+      }
+      sp -= m;
+
+      if (i < st->nsteps) {
+        Val v = st->steps[i];
+        if (has_val(&fn->insts[v]) && !spill[v]) stack[sp ++] = v;
+      } else if (!st->ret) {
+        for (size_t k = 0; k < sp; k++) changed |= mark_spill(spill, stack[k]);
+      }
+    }
+  } while (changed);
+}
+
+/* Can the spilled value `v` defined in step `def` be computed
+ * again in each step up to `last` instead of being stored? */
+static int can_remat(const IrFunc* fn, const Steps* st, Val v, size_t def, size_t last) {
+  const IrInst* inst = &fn->insts[v];
+  if (inst->op == IR_CONST) return 1;
+  if (inst->op != IR_LOAD || !inst->safe) return 0;
+
+  Segment seg = inst->inst.mem.seg;
+  for (size_t i = def + 1; i < last && i < st->nsteps; i++) {
+    const IrInst* next = &fn->insts[st->steps[i]];
+    if (next->op == IR_STORE && next->inst.mem.seg == seg
+        && next->inst.mem.offset == inst->inst.mem.offset) return 0;
+    if (next->op == IR_CALL && (seg == STAT || seg == TMP)) return 0;
+    if (next->op == IR_STORE && aliases_ram(fn, next) && seg != LOC) return 0;
+  }
+
+  return 1;
+}
+
+/* Scratch locals which hold spilled values. */
+typedef struct {
+  Val* holder;
+  size_t len;
+  size_t used;  /* Maximum number of scratch locals used at once. */
+  uint16_t base;  /* Index of the first scratch local. */
+} Scratch;
+
+static uint16_t alloc_scratch(Scratch* sc, Val v) {
+  size_t s = 0;
+  while (s < sc->len && sc->holder[s] != NO_VAL) s++;
+  if (s == sc->len) {
+    size_t len = sc->len;
+    sc->holder = (Val*) grow(sc->holder, &sc->len, s + 1, sizeof(Val));
+    for (size_t i = len; i < sc->len; i++) sc->holder[i] = NO_VAL;
+  }
+  sc->holder[s] = v;
+  if (s + 1 > sc->used) sc->used = s + 1;
+  return sc->base + s;
+}
+
+static void free_scratch(Scratch* sc, uint16_t local) {
+  sc->holder[local - sc->base] = NO_VAL;
+}
+
+static inline Inst local_inst(enum InstCode code, uint16_t local, Offset off) {
+  return (Inst) { .code=code, .mem={ .seg=LOC, .offset=local }, .off=off };
+}
+
+static void lower_block(IrFunc* fn, int b, const size_t* nuses, Scratch* sc, Insts* out) {
+  const IrBlock* blk = &fn->blocks[b];
+  const IrInst* term = blk->term != NO_VAL ? &fn->insts[blk->term] : NULL;
+
+  Val* steps = (Val*) malloc ((blk->ninsts + 1) * sizeof(Val));
+  Val* fin = (Val*) malloc ((blk->nexit + 2) * sizeof(Val));
+  assert(steps != NULL && fin != NULL);
+
+  Steps st = { .steps=steps, .nsteps=0, .fin=fin, .nfin=0, .ret=0 };
+  for (size_t i = 0; i < blk->ninsts; i++) {
+    if (fn->insts[blk->insts[i]].op != IR_NOP) steps[st.nsteps ++] = blk->insts[i];
+  }
+  if (term != NULL && term->op == IR_RET) {
+    st.ret = 1;
+  } else {
+    memcpy(fin, blk->exit, blk->nexit * sizeof(Val));
+    st.nfin = blk->nexit;
+  }
+  if (term != NULL && term->nops > 0) fin[st.nfin ++] = ops_of(fn, blk->term)[0];
+
+  /* Positions of the definition and last use of values. */
+  size_t* def = (size_t*) calloc (fn->ninsts, sizeof(size_t));
+  size_t* last = (size_t*) calloc (fn->ninsts, sizeof(size_t));
+  char* spill = (char*) calloc (fn->ninsts, sizeof(char));
+  char* remat = (char*) calloc (fn->ninsts, sizeof(char));
+  uint16_t* local = (uint16_t*) calloc (fn->ninsts, sizeof(uint16_t));
+  Val* stack = (Val*) malloc ((blk->nparams + st.nsteps + 1) * sizeof(Val));
+  assert(def != NULL && last != NULL && spill != NULL && remat != NULL);
+  assert(local != NULL && stack != NULL);
+
+  for (size_t i = 0; i <= st.nsteps; i++) {
+    if (i < st.nsteps) def[steps[i]] = i;
+    size_t nops;
+    const Val* ops = step_ops(fn, &st, i, &nops);
+    for (size_t j = 0; j < nops; j++) last[ops[j]] = i;
+  }
+
+  place_values(fn, blk, &st, nuses, spill, stack);
+
+  for (size_t i = 0; i < st.nsteps; i++) {
+    Val v = steps[i];
+    if (spill[v]) remat[v] = can_remat(fn, &st, v, i, last[v]);
+  }
+
+  Offset off = st.nsteps > 0 ? fn->insts[steps[0]].inst.off
+    : term != NULL ? term->inst.off : 0;
+  size_t sp = 0;
+
+  /* Take spilled parameters off the stack. */
+  unsigned int nkept = 0;
+  while (nkept < blk->nparams && !spill[blk->params[nkept]]) nkept ++;
+  for (unsigned int j = blk->nparams; j-- > nkept;) {
+    Val p = blk->params[j];
+    if (nuses[p] == 0) {
+      emit(out, (Inst) { .code=POP, .mem={ .seg=CONST, .offset=0 }, .off=off });
+    } else {
+      local[p] = alloc_scratch(sc, p);
+      emit(out, local_inst(POP, local[p], off));
+    }
+  }
+  for (unsigned int j = 0; j < nkept; j++) stack[sp ++] = blk->params[j];
+
+  for (size_t i = 0; i <= st.nsteps; i++) {
+    const IrInst* inst = i < st.nsteps ? &fn->insts[steps[i]] : term;
+    size_t nops;
+    const Val* ops = step_ops(fn, &st, i, &nops);
+    size_t m = match_ops(stack, sp, ops, nops);
+    sp -= m;
+
+    if (inst != NULL) off = inst->inst.off;
+
+    for (size_t j = m; j < nops; j++) {
+      Val w = ops[j];
+      if (remat[w]) emit(out, fn->insts[w].inst);
+      else emit(out, local_inst(PUSH, local[w], off));
+    }
+    for (size_t j = m; j < nops; j++) {
+      Val w = ops[j];
+      if (!remat[w] && last[w] == i && sc->holder[local[w] - sc->base] == w)
+        free_scratch(sc, local[w]);
+    }
+
+    if (inst == NULL) continue;  /* Falls through. */
+
+    Val v = i < st.nsteps ? steps[i] : blk->term;
+    if (remat[v]) continue;  /* Computed where it's used. */
+
+    emit(out, inst->inst);
+
+    if (!has_val(inst)) continue;
+    if (!spill[v]) {
+      stack[sp ++] = v;
+    } else if (nuses[v] == 0) {
+      emit(out, (Inst) { .code=POP, .mem={ .seg=CONST, .offset=0 }, .off=off });
+    } else {
+      local[v] = alloc_scratch(sc, v);
+      emit(out, local_inst(POP, local[v], off));
+    }
+  }
+
+  free(stack);
+  free(local);
+  free(remat);
+  free(spill);
+  free(last);
+  free(def);
+  free(fin);
+  free(steps);
+}
+
+void lower_ir(IrFunc* fn, Insts* out, size_t* map) {
+  assert(fn != NULL);
+  assert(out != NULL);
+  assert(map != NULL);
+
+  size_t* nuses = count_uses(fn);
+  Scratch sc = {
+    .holder=NULL,
+    .len=0,
+    .used=0,
+    .base=fn->nlocals + fn->nhoisted,
+  };
+
+  for (unsigned int b = 0; b < fn->nblocks; b++) {
+    map[b] = out->idx;
+    lower_block(fn, b, nuses, &sc, out);
+  }
+
+  fn->nscratch = sc.used;
+
+  free(sc.holder);
+  free(nuses);
+}
+
+/* Function in a file. Only functions which are entered by
+ * calls and which never leave the function except through
+ * `return` are converted to the IR. */
+typedef struct {
+  size_t start;
+  size_t end;
+  uint16_t nlocals;
+  int ok;
+  int changed;
+} Region;
+
+static int cmp_regions(const void* a, const void* b) {
+  size_t x = ((const Region*) a)->start;
+  size_t y = ((const Region*) b)->start;
+  return (x > y) - (x < y);
+}
+
+static int region_of(const Region* regions, size_t nregions, size_t addr) {
+  size_t lo = 0;
+  size_t hi = nregions;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (regions[mid].start <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0 || addr >= regions[lo - 1].end) return -1;
+  return (int) lo - 1;
+}
+
+/* Resolve a jump to `label` from file `fi` the same way `jump_to` does. */
+static int resolve_label(const Program* prog, unsigned int fi, const char* label,
+    unsigned int* target_fi, size_t* addr) {
+  SymKey key = mk_key(label, SBT_LABEL);
+  SymVal val;
+
+  if (get_st(prog->files[fi].st, &key, &val) == GTRES_OK) {
+    *target_fi = fi;
+    *addr = val.inst_addr;
+    return 1;
+  }
+
+  unsigned int ndefs = 0;
+  for (unsigned int next_fi = 0; next_fi < prog->nfiles; next_fi++) {
+    if (next_fi != fi && get_st(prog->files[next_fi].st, &key, &val) == GTRES_OK) {
+      *target_fi = next_fi;
+      *addr = val.inst_addr;
+      ndefs ++;
+    }
+  }
+
+  return ndefs == 1;
+}
+
+static size_t block_weight(unsigned int depth) {
+  size_t weight = 1;
+  for (unsigned int i = 0; i < depth && i < IR_MAX_LOOP_DEPTH; i++)
+    weight *= IR_LOOP_WEIGHT;
+  return weight;
+}
+
+/* Convert the function to the IR, optimize it and lower it
+ * to `out`. Returns `0` if this doesn't make it any cheaper. */
+static int opt_region(const File* file, Region* region, int ram, Insts* out, size_t* map) {
+  IrFunc fn;
+  int ok = 0;
+
+  if (build_ir(file, region->start, region->end, region->nlocals, &fn) == IR_OK) {
+    fn.ram = ram;
+    ir_gvn(&fn);
+    ir_dse(&fn);
+    ir_dce(&fn);
+    ir_licm(&fn);
+    ir_dce(&fn);
+
+    Insts tmp = { .idx=0, .len=0, .cell=NULL, .src=out->src };
+    size_t* bmap = (size_t*) malloc ((fn.nblocks + 1) * sizeof(size_t));
+    assert(bmap != NULL);
+    lower_ir(&fn, &tmp, bmap);
+    bmap[fn.nblocks] = tmp.idx;
+
+    /* Each added local is set to zero on every call. */
+    size_t nlocals = (size_t) fn.nlocals + fn.nhoisted + fn.nscratch;
+    size_t old_cost = 0;
+    size_t new_cost = nlocals - fn.nlocals;
+    for (unsigned int b = 0; b < fn.nblocks; b++) {
+      const IrBlock* blk = &fn.blocks[b];
+      size_t weight = block_weight(blk->depth);
+      old_cost += (blk->end - blk->start) * weight;
+      new_cost += (bmap[b + 1] - bmap[b]) * weight;
+    }
+
+    if (nlocals <= IR_MAX_LOCALS && new_cost < old_cost) {
+      for (unsigned int b = 0; b < fn.nblocks; b++) {
+        const IrBlock* blk = &fn.blocks[b];
+        for (size_t addr = blk->start; addr < blk->end; addr++)
+          map[addr] = out->idx + bmap[b];
+      }
+      for (size_t i = 0; i < tmp.idx; i++) emit(out, tmp.cell[i]);
+      region->nlocals = nlocals;
+      ok = 1;
+    }
+
+    free(bmap);
+    free(tmp.cell);
+  }
+
+  del_ir(&fn);
+  return ok;
+}
+
+static unsigned int ir_file(Program* prog, unsigned int fi) {
+  File* file = &prog->files[fi];
+  Insts* insts = &file->insts;
+  size_t n = insts->idx;
+
+  size_t nregions = 0;
+  Region* regions = (Region*) malloc ((file->st.len + 1) * sizeof(Region));
+  assert(regions != NULL);
+  for (size_t i = 0; i < file->st.len; i++) {
+    const Symbol* sym = &file->st.cell[i];
+    if (sym->key.type != SBT_FUNC) continue;
+    regions[nregions ++] = (Region) {
+      .start=sym->val.inst_addr,
+      .nlocals=sym->val.nlocals,
+      .ok=1,
+      .changed=0,
+    };
+  }
+  qsort(regions, nregions, sizeof(Region), cmp_regions);
+
+  for (size_t r = 0; r < nregions; r++) {
+    Region* region = &regions[r];
+    region->end = r + 1 < nregions ? regions[r + 1].start : n;
+    if (region->start >= region->end) {
+      /* Multiple functions start at the same instruction. */
+      region->ok = 0;
+      if (r + 1 < nregions) regions[r + 1].ok = 0;
+    } else if (region->start > 0) {
+      /* Execution must not continue from the previous function. */
+      enum InstCode code = insts->cell[region->start - 1].code;
+      if (code != RET && code != GOTO) region->ok = 0;
+    }
+  }
+  for (size_t r = 0; r < nregions; r++) {
+    if (regions[r].start >= regions[r].end) regions[r].ok = 0;
+  }
+
+  /* Functions can only be entered through calls. */
+  for (unsigned int fj = 0; fj < prog->nfiles; fj++) {
+    const Insts* from = &prog->files[fj].insts;
+    for (size_t i = 0; i < from->idx; i++) {
+      const Inst* inst = &from->cell[i];
+      unsigned int target_fi;
+      size_t addr;
+      if (inst->code != GOTO && inst->code != IF_GOTO && inst->code != IF_NOT_GOTO)
+        continue;
+      if (!resolve_label(prog, fj, inst->ident, &target_fi, &addr) || target_fi != fi)
+        continue;
+      int r = region_of(regions, nregions, addr);
+      if (r >= 0 && !(fj == fi && region_of(regions, nregions, i) == r))
+        regions[r].ok = 0;
+    }
+  }
+
+  size_t* map = (size_t*) malloc ((n + 1) * sizeof(size_t));
+  assert(map != NULL);
+  Insts out = { .idx=0, .len=0, .cell=NULL, .src=insts->src };
+  unsigned int nchanged = 0;
+
+  for (size_t addr = 0, r = 0; addr < n;) {
+    if (r < nregions && regions[r].start == addr) {
+      Region* region = &regions[r ++];
+      if (region->ok && opt_region(file, region, prog->heap.mask != 0, &out, map)) {
+        region->changed = 1;
+        nchanged ++;
+        addr = region->end;
+        continue;
+      }
+    }
+    map[addr] = out.idx;
+    emit(&out, insts->cell[addr ++]);
+  }
+  map[n] = out.idx;
+
+  if (nchanged > 0) {
+    SymbolTable st = new_st();
+    for (size_t i = 0; i < file->st.len; i++) {
+      const Symbol* sym = &file->st.cell[i];
+      if (sym->key.type == SBT_UNUSED) continue;
+
+      SymVal val = sym->val;
+      if (sym->key.type == SBT_FUNC) {
+        int r = region_of(regions, nregions, val.inst_addr);
+        if (r >= 0 && regions[r].changed) val.nlocals = regions[r].nlocals;
+      }
+      val.inst_addr = map[val.inst_addr];
+      insert_st(&st, sym->key, val);
+    }
+    st.num_inst = out.idx;
+    del_st(file->st);
+    file->st = st;
+
+    file->ei = map[file->ei];
+
+    free(insts->cell);
+    insts->cell = out.cell;
+    insts->idx = out.idx;
+    insts->len = out.len;
+  } else {
+    free(out.cell);
+  }
+
+  free(map);
+  free(regions);
+
+  return nchanged;
+}
+
+unsigned int ir_prog(Program* prog) {
+  assert(prog != NULL);
+
+  /* The system file only contains builtins and the startup code. */
+  unsigned int nchanged = 0;
+  for (unsigned int fi = 1; fi < prog->nfiles; fi++)
+    nchanged += ir_file(prog, fi);
+
+  return nchanged;
+}
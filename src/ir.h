@@ -0,0 +1,123 @@
+#pragma once
+
+#ifndef _IR_H_
+#define _IR_H_
+
+#include "prog.h"
+
+/* SSA value. A value is the result of the IR
+ * instruction with the same index. */
+typedef int Val;
+
+#define NO_VAL -1
+
+typedef enum {
+  IR_NOP = 0,  // Removed instruction.
+  IR_CONST,    // Constant `c`.
+  IR_PARAM,    // Value on the operand stack when the block is entered.
+  IR_LOAD,     // Load from a segment (`push <seg> <offset>`).
+  IR_STORE,    // Store `ops[0]` to a segment (`pop <seg> <offset>`).
+  IR_DROP,     // Drop `ops[0]` (`pop constant`).
+  IR_UNARY,    // `neg` or `not` of `ops[0]`.
+  IR_BINARY,   // Arithmetic or comparison of `ops[0]` and `ops[1]`.
+  IR_CALL,     // `call` or `call-builtin` with `nops` arguments.
+  IR_GOTO,     // Unconditional jump to `target`.
+  IR_BRANCH,   // `if-goto`/`if-not-goto` to `target` depending on `ops[0]`.
+  IR_RET,      // Return `ops[0]`.
+} IrOp;
+
+typedef struct {
+  IrOp op;
+  /* Instruction the value comes from. Its code, operands
+   * and source offset are used when lowering. For folded
+   * constants it's a `push constant`. */
+  Inst inst;
+  /* Value of constants. */
+  Word c;
+  /* Operands are `IrFunc.pool[ops]` to `IrFunc.pool[ops + nops - 1]`
+   * in the order they were pushed on the stack. */
+  size_t ops;
+  unsigned int nops;
+  /* Set for loads and stores which can't fail. */
+  int safe;
+  /* Target block of `IR_GOTO` and `IR_BRANCH`. */
+  int target;
+  /* Value this value was replaced by. */
+  Val repl;
+} IrInst;
+
+typedef struct {
+  size_t start;  /* Address of the block's first instruction in `Insts`. */
+  size_t end;  /* Address after its last instruction. */
+  Val* insts;  /* Instructions in the block in order. */
+  size_t ninsts;
+  size_t cap;
+  Val* params;  /* Operand stack when entering the block (bottom first). */
+  unsigned int nparams;
+  Val* exit;  /* Operand stack when leaving the block (bottom first). */
+  unsigned int nexit;
+  Val term;  /* Terminator or `NO_VAL` if it falls through. */
+  int succ[2];
+  unsigned int nsucc;
+  unsigned int npreds;
+  unsigned int depth;  /* Loop nesting depth. */
+  int built;
+} IrBlock;
+
+/* A single VM function in SSA form. The operand stack
+ * is replaced by explicit values. Values which are on
+ * the stack across blocks are passed as block parameters.
+ * Segment accesses are loads and stores. */
+typedef struct {
+  IrInst* insts;
+  size_t ninsts;
+  size_t cap;
+  Val* pool;  /* Operands of all instructions. */
+  size_t npool;
+  size_t poolcap;
+  IrBlock* blocks;
+  unsigned int nblocks;
+  uint16_t nlocals;  /* Number of locals the function declares. */
+  uint16_t nhoisted;  /* Locals added for hoisted values. */
+  uint16_t nscratch;  /* Locals added when lowering. */
+  /* Set if `this` and `that` can reach the `static`, `temp`
+   * and `pointer` entries (the unified RAM, see `use_ram`). */
+  int ram;
+} IrFunc;
+
+#define IR_ERR 0
+#define IR_OK 1
+
+/* Build the IR of the function in `file` starting at `start` and
+ * ending before `end`. Returns `IR_ERR` if the function can't be
+ * converted safely (e.g. because the operand stack doesn't have the
+ * same depth on all paths or an instruction would always fail). */
+int build_ir(const File* file, size_t start, size_t end, uint16_t nlocals, IrFunc* fn);
+
+void del_ir(IrFunc* fn);
+
+/* Global value numbering. Folds constants, forwards stored
+ * values to later loads (copy propagation) and replaces
+ * redundant operations by earlier ones. */
+void ir_gvn(IrFunc* fn);
+
+/* Remove stores which are overwritten before they're read. */
+void ir_dse(IrFunc* fn);
+
+/* Remove values which are never used and can't fail. */
+void ir_dce(IrFunc* fn);
+
+/* Hoist computations which don't change inside
+ * loops into the block before the loop. */
+void ir_licm(IrFunc* fn);
+
+/* Lower `fn` back to VM instructions. `map[b]` is set to the
+ * index of the first instruction of block `b` in `out`. */
+void lower_ir(IrFunc* fn, Insts* out, size_t* map);
+
+/* Optimize all functions in `prog` which can be converted
+ * to the IR safely. Functions only change if the result is
+ * cheaper. Returns the number of changed functions. */
+unsigned int ir_prog(Program* prog);
+
+#endif  // _IR_H_
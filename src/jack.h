@@ -0,0 +1,150 @@
+#pragma once
+
+#ifndef _JACK_H_
+#define _JACK_H_
+
+#include "native.h"
+
+/* Native implementations of the Jack OS classes.
+ *
+ * Compiled Jack programs call the OS like any other VM
+ * code (e.g. `call Math.multiply 2` for each `*`). These
+ * natives take the place of the VM versions of the OS.
+ * Values are 16-bit two's complement numbers like on the
+ * Hack platform and errors which would call `Sys.error`
+ * in the Jack OS fail with a runtime error instead. */
+
+/* `Math.init`, `Math.multiply`, `Math.divide`, `Math.sqrt`,
+ * `Math.abs`, `Math.min` and `Math.max` */
+extern const Native math_natives[];
+extern const size_t nmath_natives;
+
+/* `Memory.init`, `Memory.alloc`, `Memory.deAlloc`,
+ * `Memory.peek` and `Memory.poke` */
+extern const Native memory_natives[];
+extern const size_t nmemory_natives;
+
+/* `String.new`, `String.dispose`, `String.length`, `String.charAt`,
+ * `String.setCharAt`, `String.appendChar`, `String.eraseLastChar`,
+ * `String.intValue`, `String.setInt`, `String.newLine`,
+ * `String.backSpace`, `String.doubleQuote`, `Array.new` and
+ * `Array.dispose` */
+extern const Native string_natives[];
+extern const size_t nstring_natives;
+
+/* `Screen.init`, `Screen.clearScreen`, `Screen.setColor`,
+ * `Screen.drawPixel`, `Screen.drawLine`, `Screen.drawRectangle`,
+ * `Screen.drawCircle` and `Screen.dump` */
+extern const Native screen_natives[];
+extern const size_t nscreen_natives;
+
+/* `Output.init`, `Output.moveCursor`, `Output.printChar`,
+ * `Output.printString`, `Output.printInt`, `Output.println`
+ * and `Output.backSpace` */
+extern const Native output_natives[];
+extern const size_t noutput_natives;
+
+/* `Keyboard.init`, `Keyboard.keyPressed`, `Keyboard.readChar`,
+ * `Keyboard.readLine` and `Keyboard.readInt` */
+extern const Native keyboard_natives[];
+extern const size_t nkeyboard_natives;
+
+/* Characters of the Hack character set which ASCII doesn't have. */
+#define CHAR_NEWLINE 128
+#define CHAR_BACKSPACE 129
+
+/* Size of the screen in characters of `Output`. */
+#define OUTPUT_LINES 23
+#define OUTPUT_COLS 64
+
+/* State of the OS classes which isn't stored in the heap. Each
+ * program has its own (see `Heap.os`), so programs can run at
+ * the same time. Options like `set_screen_file` are shared. */
+typedef struct {
+  Word color;  /* Color of `Screen.setColor` (`TRUE` is black). */
+  int line;  /* Position of the next character of `Output`. */
+  int col;
+  unsigned int nframes;  /* Number of frames written by `Screen.dump`. */
+  int has_last;  /* Set if `last` holds the last frame. */
+  Word last[MEM_SCREEN_SIZE];
+} JackOs;
+
+/* Get the state of the OS classes of `heap`. It's made
+ * on first use and freed with the heap. */
+JackOs* jack_os(Heap* heap);
+
+/* Allocate a block of `size` words like `Memory.alloc` and
+ * store its address in `addr`. Returns `NATIVE_OK` or sets the
+ * error of `ctx` and returns `NATIVE_ERR`. */
+int jack_alloc(NativeCtx* ctx, Word size, Word* addr);
+
+/* Free the block at `addr` like `Memory.deAlloc`. */
+int jack_dealloc(NativeCtx* ctx, Word addr);
+
+/* Read `heap[addr]` into `val`. Fails with an address overflow
+ * in the native `fn` if `addr` is outside of the heap and the
+ * memory maps. */
+int jack_peek(NativeCtx* ctx, const char* fn, size_t addr, Word* val);
+
+/* Set `heap[addr]` to `val`. Fails like `jack_peek`. */
+int jack_poke(NativeCtx* ctx, const char* fn, size_t addr, Word val);
+
+/* Read the array of characters and the length of the string
+ * `str` for the native `fn`. Fails if `str` isn't a string. */
+int jack_string(NativeCtx* ctx, const char* fn, size_t str, Word* chars, Word* length);
+
+/* Make a new string of the `length` characters in `chars`.
+ * Its maximum length is `length`. */
+int jack_new_string(NativeCtx* ctx, const Word* chars, Word length, Word* str);
+
+/* Start of the heap region `Memory.alloc` uses by default.
+ * The region ends at the end of the heap. Like in the Jack
+ * OS, the words below are free for the program to use. */
+#ifndef ALLOC_BASE
+#define ALLOC_BASE 0x800
+#endif  // ALLOC_BASE
+
+/* Let `Memory.alloc` use the `size` words of the heap starting
+ * at `base`. If `size` is `0`, the region ends at `end`, the end
+ * of the heap. Returns `NATIVE_ERR` if the region doesn't fit into
+ * the heap or is too small or large for the allocator. */
+int set_alloc_region(Addr base, size_t size, size_t end);
+
+/* Print how much of the allocator's region is used and how
+ * fragmented it is. */
+void print_alloc_stats(Heap* heap);
+
+/* Write frames of the screen to `path`. They are PBM images or
+ * PPM images if `path` ends with `.ppm`. `Screen.dump` writes
+ * numbered frames (`out.pbm` becomes `out-1.pbm` etc.) but only
+ * if the screen changed since the last one. `NULL` disables this. */
+void set_screen_file(const char* path);
+
+/* Write the screen to the path given to `set_screen_file`. */
+int write_screen(Heap* heap);
+
+/* Print `c` at the cursor of `Output` like `Output.printChar`. */
+void output_char(Heap* heap, Word c);
+
+/* Print the string `str` like `Output.printString` for the native `fn`. */
+int output_string(NativeCtx* ctx, const char* fn, size_t str);
+
+/* Also print the text of `Output` to stdout if `on` is set. */
+void set_output_mirror(int on);
+
+/* Feed the keyboard from the events in the file `script` or from
+ * stdin if `raw` is set. Each line of a script is the time in
+ * milliseconds since the program started and a key. On failure,
+ * `line` is the line of the invalid event or `0` if the file
+ * can't be read. */
+int set_keyboard(const char* script, int raw, unsigned int* line);
+
+/* Start feeding the keyboard register of `heap` in the background
+ * if `set_keyboard` gave it a source. Since the source is shared,
+ * only one program can use the keyboard at a time. */
+int start_keyboard(Heap* heap);
+
+/* Stop feeding the keyboard register. */
+void stop_keyboard(void);
+
+#endif  // _JACK_H_
@@ -0,0 +1,410 @@
+#include "jack.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The keyboard register is a word of the heap like on the Hack
+ * platform. A thread feeds it from the input source and the
+ * program reads it like any other word, so polling the keyboard
+ * is a single load. The thread only ever stores whole words. */
+
+#define KEY_NONE 0
+#define KEY_LEFT 130
+#define KEY_UP 131
+#define KEY_RIGHT 132
+#define KEY_DOWN 133
+#define KEY_ESC 140
+#define KEY_F1 141
+
+/* Keys read from a terminal are released after this long
+ * without another key since terminals don't report releases. */
+#define KEY_HOLD_MS 100
+
+/* Longest line `Keyboard.readLine` reads. */
+#define READ_LINE_MAX 256
+
+/* How long natives which wait for a key sleep between polls. */
+#define WAIT_NS 1000000l
+
+typedef struct {
+  unsigned long ms;  /* Time since the program started. */
+  Word key;
+} KeyEvent;
+
+static struct {
+  int raw;  /* Read keys from stdin. */
+  KeyEvent* events;  /* Events of a script (or `NULL`). */
+  size_t nevents;
+  Word* reg;  /* The keyboard register while the thread runs. */
+  pthread_t thread;
+  int running;
+  int stop;  /* Tells the thread to stop. */
+  int done;  /* Set once the source has no more keys. */
+  int has_term;  /* Set if `term` must be restored. */
+  int at_exit;  /* Set once `restore_term` runs at exit. */
+  struct termios term;
+} kbd;
+
+static inline void set_key(Word key) {
+  __atomic_store_n(kbd.reg, key, __ATOMIC_RELAXED);
+}
+
+static inline Word get_key(void) {
+  return __atomic_load_n(kbd.reg, __ATOMIC_RELAXED);
+}
+
+static inline int is_done(void) {
+  return __atomic_load_n(&kbd.done, __ATOMIC_ACQUIRE);
+}
+
+static inline int should_stop(void) {
+  return __atomic_load_n(&kbd.stop, __ATOMIC_ACQUIRE);
+}
+
+static unsigned long now_ms(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long) (now.tv_sec - start->tv_sec) * 1000
+    + (unsigned long) ((now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+static void sleep_ns(long ns) {
+  struct timespec ts = { .tv_sec=ns / 1000000000l, .tv_nsec=ns % 1000000000l };
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR) ;
+}
+
+/* Sleep for `ms` but stop early if the thread should stop. */
+static void hold(unsigned long ms) {
+  for (unsigned long t = 0; t < ms && !should_stop(); t += 10)
+    sleep_ns((long) (ms - t < 10 ? ms - t : 10) * 1000000l);
+}
+
+/* Play the events of the script at their time. */
+static void play_script(void) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (size_t i = 0; i < kbd.nevents && !should_stop(); ) {
+    unsigned long ms = now_ms(&start);
+    if (ms >= kbd.events[i].ms) {
+      set_key(kbd.events[i ++].key);
+      continue;
+    }
+
+    hold(kbd.events[i].ms - ms);
+  }
+
+  /* The last key is released like a typed one. */
+  if (get_key() != KEY_NONE) {
+    hold(KEY_HOLD_MS);
+    set_key(KEY_NONE);
+  }
+}
+
+/* Read a byte from stdin if one arrives within `ms`. */
+static int read_byte(int ms, unsigned char* c) {
+  struct pollfd fd = { .fd=STDIN_FILENO, .events=POLLIN, .revents=0 };
+  int res = poll(&fd, 1, ms);
+  if (res <= 0) return res;
+  return read(STDIN_FILENO, c, 1) == 1 ? 1 : -1;
+}
+
+/* Translate the bytes of a terminal key to its Hack key code. */
+static Word term_key(unsigned char c) {
+  if (c == '\r' || c == '\n') return CHAR_NEWLINE;
+  if (c == 127 || c == '\b') return CHAR_BACKSPACE;
+  if (c != 27) return c;
+
+  /* Arrow keys are `ESC [ A` to `ESC [ D`. */
+  unsigned char seq[2];
+  if (read_byte(10, &seq[0]) != 1 || seq[0] != '[') return KEY_ESC;
+  if (read_byte(10, &seq[1]) != 1) return KEY_ESC;
+  switch (seq[1]) {
+  case 'A': return KEY_UP;
+  case 'B': return KEY_DOWN;
+  case 'C': return KEY_RIGHT;
+  case 'D': return KEY_LEFT;
+  default: return KEY_ESC;
+  }
+}
+
+static void read_term(void) {
+  int tty = isatty(STDIN_FILENO);
+  while (!should_stop()) {
+    unsigned char c;
+    int res = read_byte(get_key() == KEY_NONE ? 10 : KEY_HOLD_MS, &c);
+    if (res < 0) break;
+    if (res == 0) {
+      set_key(KEY_NONE);
+      continue;
+    }
+
+    set_key(term_key(c));
+    /* Input from a pipe arrives all at once. Each key is
+     * held and released before the next one instead. */
+    if (!tty) {
+      hold(KEY_HOLD_MS);
+      set_key(KEY_NONE);
+      hold(10);
+    }
+  }
+}
+
+static void* feed_keys(void* arg) {
+  (void) arg;
+  if (kbd.events != NULL) {
+    play_script();
+  } else {
+    read_term();
+  }
+  __atomic_store_n(&kbd.done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void restore_term(void) {
+  if (kbd.has_term) tcsetattr(STDIN_FILENO, TCSANOW, &kbd.term);
+  kbd.has_term = 0;
+}
+
+/* Parse the key of an event. A single character is itself.
+ * Anything longer is the name of a key or a key code. */
+static int parse_key(const char* name, Word* key) {
+  static const struct { const char* name; Word key; } names[] = {
+    { "none", KEY_NONE }, { "space", ' ' }, { "newline", CHAR_NEWLINE },
+    { "backspace", CHAR_BACKSPACE }, { "left", KEY_LEFT }, { "up", KEY_UP },
+    { "right", KEY_RIGHT }, { "down", KEY_DOWN }, { "home", 134 },
+    { "end", 135 }, { "pageup", 136 }, { "pagedown", 137 },
+    { "insert", 138 }, { "delete", 139 }, { "esc", KEY_ESC },
+  };
+
+  if (name[1] == '\0') {
+    *key = (unsigned char) name[0];
+    return NATIVE_OK;
+  }
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(name, names[i].name) == 0) {
+      *key = names[i].key;
+      return NATIVE_OK;
+    }
+  }
+
+  char* end;
+  unsigned long num;
+  if (name[0] == 'f' && name[1] != '\0') {
+    num = strtoul(name + 1, &end, 10);
+    if (*end != '\0' || num < 1 || num > 12) return NATIVE_ERR;
+    *key = (Word) (KEY_F1 + num - 1);
+    return NATIVE_OK;
+  }
+  num = strtoul(name, &end, 10);
+  if (name[0] == '-' || *end != '\0' || num > 0x7FFF) return NATIVE_ERR;
+  *key = (Word) num;
+  return NATIVE_OK;
+}
+
+/* Read the events of `path`. On failure, `line` is the line
+ * of the invalid event or `0` if the file can't be read. */
+static int load_script(const char* path, unsigned int* line) {
+  FILE* file = fopen(path, "r");
+  *line = 0;
+  if (file == NULL) return NATIVE_ERR;
+
+  char buf[128];
+  size_t cap = 0;
+  unsigned long last = 0;
+  while (fgets(buf, sizeof(buf), file) != NULL) {
+    (*line) ++;
+    char name[32];
+    unsigned long ms;
+    char* comment = strchr(buf, '#');
+    if (comment != NULL) *comment = '\0';
+    if (strspn(buf, " \t\r\n") == strlen(buf)) continue;
+
+    /* Events must be in order. */
+    Word key;
+    int n = 0;
+    if (
+      sscanf(buf, " %lu %31s %n", &ms, name, &n) != 2 || buf[n] != '\0' ||
+      ms < last || parse_key(name, &key) == NATIVE_ERR
+    ) {
+      fclose(file);
+      return NATIVE_ERR;
+    }
+
+    if (kbd.nevents == cap) {
+      cap = cap == 0 ? 16 : cap * 2;
+      kbd.events = (KeyEvent*) realloc (kbd.events, cap * sizeof(KeyEvent));
+    }
+    kbd.events[kbd.nevents ++] = (KeyEvent) { .ms=ms, .key=key };
+    last = ms;
+  }
+
+  fclose(file);
+  /* An empty script still ends the input. */
+  if (kbd.events == NULL) kbd.events = (KeyEvent*) malloc (sizeof(KeyEvent));
+  return NATIVE_OK;
+}
+
+/* Wait until a key is pressed. Fails if there are no more keys. */
+static int wait_press(NativeCtx* ctx, const char* fn, Word* key) {
+  if (!kbd.running) {
+    return native_error(ctx,
+      "`%s` needs keyboard input (`--keys` or `--keyboard`)", fn);
+  }
+
+  while ((*key = get_key()) == KEY_NONE) {
+    if (is_done()) return native_error(ctx, "`%s` ran out of keyboard input", fn);
+    sleep_ns(WAIT_NS);
+  }
+  return NATIVE_OK;
+}
+
+/* Wait until `key` is released or another key is pressed. */
+static void wait_release(Word key) {
+  while (get_key() == key && !is_done()) sleep_ns(WAIT_NS);
+}
+
+/* Read a key and print it like the Jack OS does. */
+static int read_char(NativeCtx* ctx, const char* fn, Word* key) {
+  if (!wait_press(ctx, fn, key)) return NATIVE_ERR;
+  wait_release(*key);
+  output_char(ctx->heap, *key);
+  return NATIVE_OK;
+}
+
+/* Print `message` and read characters up to a newline into `line`. */
+static int read_line(NativeCtx* ctx, const char* fn, Word message, Word* line, Word* len) {
+  if (!output_string(ctx, fn, message)) return NATIVE_ERR;
+
+  *len = 0;
+  for (;;) {
+    Word key;
+    if (!read_char(ctx, fn, &key)) return NATIVE_ERR;
+    if (key == CHAR_NEWLINE) return NATIVE_OK;
+
+    if (key == CHAR_BACKSPACE) {
+      if (*len > 0) (*len) --;
+    } else if (*len == READ_LINE_MAX) {
+      return native_error(ctx,
+        "`%s` can't read lines longer than %d characters", fn, READ_LINE_MAX);
+    } else {
+      line[(*len) ++] = key;
+    }
+  }
+}
+
+/* `Keyboard.init() -> 0` */
+static int keyboard_init(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  (void) args;
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Keyboard.keyPressed() -> key`
+ * returns the key which is currently pressed or `0`. */
+static int keyboard_key_pressed(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  *ret = heap_get(*ctx->heap, MEM_KBD);
+  return NATIVE_OK;
+}
+
+/* `Keyboard.readChar() -> c`
+ * waits until a key is pressed and released and prints it. */
+static int keyboard_read_char(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  return read_char(ctx, "Keyboard.readChar", ret);
+}
+
+/* `Keyboard.readLine(message) -> str`
+ * prints `message` and reads a line. */
+static int keyboard_read_line(NativeCtx* ctx, const Word* args, Word* ret) {
+  Word line[READ_LINE_MAX];
+  Word len;
+  if (!read_line(ctx, "Keyboard.readLine", args[0], line, &len)) return NATIVE_ERR;
+  return jack_new_string(ctx, line, len, ret);
+}
+
+/* `Keyboard.readInt(message) -> num`
+ * prints `message` and reads a line like `Keyboard.readLine`.
+ * Returns the number at its start like `String.intValue`. */
+static int keyboard_read_int(NativeCtx* ctx, const Word* args, Word* ret) {
+  Word line[READ_LINE_MAX];
+  Word len;
+  if (!read_line(ctx, "Keyboard.readInt", args[0], line, &len)) return NATIVE_ERR;
+
+  Word num = 0;
+  int neg = len > 0 && line[0] == '-';
+  for (Word j = neg; j < len && line[j] >= '0' && line[j] <= '9'; j++)
+    num = num * 10 + (line[j] - '0');
+  *ret = neg ? (Word) -num : num;
+  return NATIVE_OK;
+}
+
+const Native keyboard_natives[] = {
+  { "Keyboard.init", 0, keyboard_init, NULL },
+  { "Keyboard.keyPressed", 0, keyboard_key_pressed, NULL },
+  { "Keyboard.readChar", 0, keyboard_read_char, NULL },
+  { "Keyboard.readLine", 1, keyboard_read_line, NULL },
+  { "Keyboard.readInt", 1, keyboard_read_int, NULL },
+};
+
+const size_t nkeyboard_natives = sizeof(keyboard_natives) / sizeof(keyboard_natives[0]);
+
+int set_keyboard(const char* script, int raw, unsigned int* line) {
+  free(kbd.events);
+  kbd.events = NULL;
+  kbd.nevents = 0;
+  kbd.raw = raw;
+  *line = 0;
+  return script != NULL ? load_script(script, line) : NATIVE_OK;
+}
+
+int start_keyboard(Heap* heap) {
+  assert(!kbd.running);
+  if (kbd.events == NULL && !kbd.raw) return NATIVE_OK;
+
+  /* Keys are read as they are typed and not echoed. */
+  if (kbd.events == NULL && isatty(STDIN_FILENO) && !kbd.has_term) {
+    struct termios raw;
+    if (tcgetattr(STDIN_FILENO, &kbd.term) == 0) {
+      raw = kbd.term;
+      raw.c_lflag &= ~(ICANON | ECHO);
+      raw.c_cc[VMIN] = 1;
+      raw.c_cc[VTIME] = 0;
+      if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0) {
+        kbd.has_term = 1;
+        if (!kbd.at_exit) atexit(restore_term);
+        kbd.at_exit = 1;
+      }
+    }
+  }
+
+  kbd.reg = &heap->mem[MEM_KBD];
+  kbd.stop = 0;
+  kbd.done = 0;
+  set_key(KEY_NONE);
+  if (pthread_create(&kbd.thread, NULL, feed_keys, NULL) != 0) {
+    restore_term();
+    return NATIVE_ERR;
+  }
+  kbd.running = 1;
+  return NATIVE_OK;
+}
+
+void stop_keyboard(void) {
+  if (!kbd.running) return;
+  __atomic_store_n(&kbd.stop, 1, __ATOMIC_RELEASE);
+  pthread_join(kbd.thread, NULL);
+  kbd.running = 0;
+  kbd.reg = NULL;
+  restore_term();
+}
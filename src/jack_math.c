@@ -0,0 +1,86 @@
+#include "jack.h"
+
+/* Signed value of a word. */
+#define SIGNED(w) ((int16_t) (w))
+
+/* `Math.init() -> 0` */
+static int math_init(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  (void) args;
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Math.multiply(x, y) -> x * y`
+ * The product wraps around like on the Hack platform. */
+static int math_multiply(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  *ret = (Word) ((uint32_t) args[0] * (uint32_t) args[1]);
+  return NATIVE_OK;
+}
+
+/* `Math.divide(x, y) -> x / y`
+ * rounded towards zero. */
+static int math_divide(NativeCtx* ctx, const Word* args, Word* ret) {
+  int32_t x = SIGNED(args[0]);
+  int32_t y = SIGNED(args[1]);
+  if (y == 0)
+    return native_error(ctx, "`Math.divide` can't divide %d by zero", x);
+
+  /* `-32768 / -1` wraps around to `-32768`. */
+  *ret = (Word) (x / y);
+  return NATIVE_OK;
+}
+
+/* `Math.sqrt(x) -> y`
+ * where `y` is the largest number with `y * y <= x`. */
+static int math_sqrt(NativeCtx* ctx, const Word* args, Word* ret) {
+  int32_t x = SIGNED(args[0]);
+  if (x < 0)
+    return native_error(ctx, "`Math.sqrt` can't take the square root of %d", x);
+
+  /* Set the bits of the result from the highest
+   * one like the Jack OS does. */
+  int32_t y = 0;
+  for (int32_t bit = 1 << 7; bit > 0; bit >>= 1) {
+    if ((y + bit) * (y + bit) <= x) y += bit;
+  }
+  *ret = (Word) y;
+  return NATIVE_OK;
+}
+
+/* `Math.abs(x) -> |x|`
+ * `-32768` stays `-32768`. */
+static int math_abs(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  *ret = SIGNED(args[0]) < 0 ? (Word) -args[0] : args[0];
+  return NATIVE_OK;
+}
+
+/* `Math.min(x, y) -> min`
+ * of the signed values. */
+static int math_min(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  *ret = SIGNED(args[0]) < SIGNED(args[1]) ? args[0] : args[1];
+  return NATIVE_OK;
+}
+
+/* `Math.max(x, y) -> max`
+ * of the signed values. */
+static int math_max(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  *ret = SIGNED(args[0]) > SIGNED(args[1]) ? args[0] : args[1];
+  return NATIVE_OK;
+}
+
+const Native math_natives[] = {
+  { "Math.init", 0, math_init, NULL },
+  { "Math.multiply", 2, math_multiply, NULL },
+  { "Math.divide", 2, math_divide, NULL },
+  { "Math.sqrt", 1, math_sqrt, NULL },
+  { "Math.abs", 1, math_abs, NULL },
+  { "Math.min", 2, math_min, NULL },
+  { "Math.max", 2, math_max, NULL },
+};
+
+const size_t nmath_natives = sizeof(math_natives) / sizeof(math_natives[0]);
@@ -0,0 +1,378 @@
+#include "jack.h"
+#include "msg.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Heap allocator of `Memory.alloc` and `Memory.deAlloc`.
+ *
+ * All of its state is stored in the region of the heap it
+ * manages. The region starts with the allocator's metadata,
+ * followed by the blocks and an end marker:
+ *
+ *   [ meta | block | block | ... | end ]
+ *
+ * The first word of a block (its header) is its size in words
+ * including the header. Sizes are even, so the lowest bit marks
+ * blocks which are in use (`BLK_USED`). The highest bit marks
+ * blocks which follow a block that is in use (`BLK_PREV_USED`).
+ * `Memory.alloc` returns the address right after the header,
+ * so objects have the same layout as in the Jack OS.
+ *
+ * Free blocks additionally store the next and previous block
+ * of their free list and a copy of their size in the last word
+ * (the footer). A block is merged with its free neighbours when
+ * it's freed: the header of the next block follows directly and
+ * the footer of a free previous block is right before the header.
+ *
+ * Small blocks are kept in one free list per size. Larger ones
+ * are kept in one list for each power of two. A bitmap of the
+ * non-empty lists allows finding a block which fits in constant
+ * time. Both allocating and freeing blocks take constant time. */
+
+#define ALLOC_MAGIC 0xA110
+
+#define BLK_USED 0x0001
+#define BLK_PREV_USED 0x8000
+#define BLK_SIZE(hdr) ((Word) ((hdr) & 0x7FFE))
+
+/* Header, next, previous and footer of free blocks. */
+#define BLK_MIN_SIZE 4
+#define BLK_MAX_SIZE 0x7FFE
+
+/* Blocks smaller than `SMALL_LIMIT` have a list per size. */
+#define SMALL_LIMIT 64
+#define NSMALL ((SMALL_LIMIT - BLK_MIN_SIZE) / 2)
+#define NCLASSES (NSMALL + 15 - 6 + 1)
+#define MAP_WORDS ((NCLASSES + 15) / 16)
+
+/* Layout of the metadata. */
+#define META_MAGIC 0
+#define META_USED 1  /* Words in blocks which are in use. */
+#define META_PEAK 2  /* Maximum of `META_USED`. */
+#define META_TOP 3  /* End of the highest block which was used. */
+#define META_MAP 4  /* Bitmap of non-empty free lists. */
+#define META_HEADS (META_MAP + MAP_WORDS)  /* First block of each list. */
+#define META_SIZE (META_HEADS + NCLASSES)
+
+#define ALLOC_MIN_REGION (META_SIZE + BLK_MIN_SIZE + 1)
+#define ALLOC_MAX_REGION (META_SIZE + BLK_MAX_SIZE + 1)
+
+typedef struct {
+  Addr base;  /* First word of the region. */
+  size_t size;  /* Number of words in the region. */
+} AllocConfig;
+
+static AllocConfig config = {
+  .base=ALLOC_BASE,
+  .size=MEM_HEAP_SIZE - ALLOC_BASE,
+};
+
+JackOs* jack_os(Heap* heap) {
+  if (heap->os == NULL) {
+    JackOs* os = (JackOs*) calloc (1, sizeof(JackOs));
+    assert(os != NULL);
+    os->color = TRUE;
+    heap->os = os;
+  }
+  return (JackOs*) heap->os;
+}
+
+/* Region of the heap used by a single call. */
+typedef struct {
+  Word* mem;
+  Addr base;
+  Addr first;  /* Header of the first block. */
+  Addr end;  /* Header of the end marker. */
+} Alloc;
+
+static Alloc get_alloc(Heap* heap, const AllocConfig* cfg) {
+  Alloc a = { .mem=heap->mem, .base=cfg->base, .first=cfg->base + META_SIZE };
+  a.end = a.first + ((cfg->size - META_SIZE - 1) & ~1lu);
+  return a;
+}
+
+#define META(a, i) ((a)->mem[(a)->base + (i)])
+
+static unsigned int size_class(Word size) {
+  if (size < SMALL_LIMIT) return size / 2 - BLK_MIN_SIZE / 2;
+
+  unsigned int log = 8 * sizeof(unsigned int) - 1 - __builtin_clz(size);
+  return NSMALL + log - 6;
+}
+
+/* Check that `hdr` can be the header of a block. The region
+ * isn't protected from the program, so this must hold before
+ * following any address stored in the region. */
+static int is_block(const Alloc* a, Addr hdr) {
+  if (hdr < a->first || hdr >= a->end) return 0;
+  Word size = BLK_SIZE(a->mem[hdr]);
+  return size >= BLK_MIN_SIZE && size <= a->end - hdr;
+}
+
+static int insert_free(Alloc* a, Addr blk, Word size) {
+  unsigned int c = size_class(size);
+  Addr next = META(a, META_HEADS + c);
+  if (next != 0 && !is_block(a, next)) return 0;
+
+  a->mem[blk + 1] = next;
+  a->mem[blk + 2] = 0;
+  if (next != 0) a->mem[next + 2] = blk;
+  META(a, META_HEADS + c) = blk;
+  META(a, META_MAP + c / 16) |= (Word) (1 << (c % 16));
+  return 1;
+}
+
+static int remove_free(Alloc* a, Addr blk, Word size) {
+  unsigned int c = size_class(size);
+  Addr next = a->mem[blk + 1];
+  Addr prev = a->mem[blk + 2];
+  if ((next != 0 && !is_block(a, next)) || (prev != 0 && !is_block(a, prev)))
+    return 0;
+
+  if (prev != 0) a->mem[prev + 1] = next;
+  else META(a, META_HEADS + c) = next;
+  if (next != 0) a->mem[next + 2] = prev;
+
+  if (META(a, META_HEADS + c) == 0)
+    META(a, META_MAP + c / 16) &= (Word) ~(1 << (c % 16));
+  return 1;
+}
+
+/* Find a free block with at least `size` words.
+ * Returns `0` if there is none. */
+static Addr find_free(const Alloc* a, Word size) {
+  unsigned int c = size_class(size);
+
+  /* Small lists only have blocks of the exact size.
+   * Larger ones might have a block which is enough. */
+  Addr blk = META(a, META_HEADS + c);
+  if (blk != 0 && is_block(a, blk) && BLK_SIZE(a->mem[blk]) >= size) return blk;
+
+  /* Any block of the next non-empty list fits. */
+  for (unsigned int w = (c + 1) / 16; w < MAP_WORDS; w++) {
+    Word map = META(a, META_MAP + w);
+    if (w == (c + 1) / 16) map &= (Word) (0xFFFF << ((c + 1) % 16));
+    if (map != 0) return META(a, META_HEADS + w * 16 + __builtin_ctz(map));
+  }
+
+  return 0;
+}
+
+static void init_alloc(Alloc* a) {
+  for (size_t i = 0; i < META_SIZE; i++) META(a, i) = 0;
+  META(a, META_MAGIC) = ALLOC_MAGIC;
+
+  /* Everything is one large free block. */
+  Word size = a->end - a->first;
+  a->mem[a->first] = size | BLK_PREV_USED;
+  a->mem[a->first + size - 1] = size;
+  META(a, META_HEADS + size_class(size)) = a->first;
+  META(a, META_MAP + size_class(size) / 16) = (Word) (1 << (size_class(size) % 16));
+  a->mem[a->end] = BLK_USED;
+}
+
+static Alloc use_alloc(NativeCtx* ctx) {
+  Alloc a = get_alloc(ctx->heap, &config);
+  if (META(&a, META_MAGIC) != ALLOC_MAGIC) init_alloc(&a);
+  return a;
+}
+
+/* `Memory.init() -> 0`
+ * frees all blocks. */
+static int memory_init(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  Alloc a = get_alloc(ctx->heap, &config);
+  init_alloc(&a);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+int jack_alloc(NativeCtx* ctx, Word size_arg, Word* addr) {
+  int16_t nwords = (int16_t) size_arg;
+  if (nwords <= 0)
+    return native_error(ctx, "`Memory.alloc` needs a positive size, got %d", nwords);
+
+  Alloc a = use_alloc(ctx);
+  Word size = (Word) ((nwords + 2) & ~1);
+  if (size < BLK_MIN_SIZE) size = BLK_MIN_SIZE;
+
+  Addr blk = size <= BLK_MAX_SIZE ? find_free(&a, size) : 0;
+  if (blk == 0) {
+    return native_error(ctx, "heap overflow: `Memory.alloc` can't allocate "
+      "%d words (%d words in use)", nwords, META(&a, META_USED));
+  }
+  if (
+    !is_block(&a, blk) || (a.mem[blk] & BLK_USED) ||
+    BLK_SIZE(a.mem[blk]) < size || !remove_free(&a, blk, BLK_SIZE(a.mem[blk]))
+  )
+    return native_error(ctx, "`Memory.alloc` found a corrupted heap at %d", blk);
+  Word hdr = a.mem[blk];
+  Word free_size = BLK_SIZE(hdr);
+
+  /* Split off the rest if it's large enough for another block. */
+  if (free_size - size >= BLK_MIN_SIZE) {
+    Addr rest = blk + size;
+    Word rest_size = free_size - size;
+    a.mem[rest] = rest_size | BLK_PREV_USED;
+    a.mem[rest + rest_size - 1] = rest_size;
+    if (!insert_free(&a, rest, rest_size))
+      return native_error(ctx, "`Memory.alloc` found a corrupted heap at %d", rest);
+  } else {
+    size = free_size;
+    a.mem[blk + size] |= BLK_PREV_USED;
+  }
+  a.mem[blk] = size | (hdr & BLK_PREV_USED) | BLK_USED;
+
+  META(&a, META_USED) += size;
+  if (META(&a, META_USED) > META(&a, META_PEAK))
+    META(&a, META_PEAK) = META(&a, META_USED);
+  if (blk + size - a.base > META(&a, META_TOP))
+    META(&a, META_TOP) = blk + size - a.base;
+
+  *addr = blk + 1;
+  return NATIVE_OK;
+}
+
+int jack_dealloc(NativeCtx* ctx, Word addr) {
+  Alloc a = use_alloc(ctx);
+  Addr blk = addr - 1;
+  if (addr == 0 || !is_block(&a, blk) || !(a.mem[blk] & BLK_USED)) {
+    return native_error(ctx,
+      "`Memory.deAlloc` got %d which isn't an allocated block", addr);
+  }
+
+  Word size = BLK_SIZE(a.mem[blk]);
+  META(&a, META_USED) -= size;
+
+  /* Merge with the next block. */
+  Addr next = blk + size;
+  if (next != a.end && !(a.mem[next] & BLK_USED)) {
+    Word next_size = BLK_SIZE(a.mem[next]);
+    if (!is_block(&a, next) || !remove_free(&a, next, next_size))
+      return native_error(ctx, "`Memory.deAlloc` found a corrupted heap at %d", next);
+    size += next_size;
+  }
+
+  /* Merge with the previous block. */
+  if (!(a.mem[blk] & BLK_PREV_USED)) {
+    Word prev_size = a.mem[blk - 1];
+    Addr prev = blk - prev_size;
+    if (
+      prev_size > blk - a.first || !is_block(&a, prev) ||
+      BLK_SIZE(a.mem[prev]) != prev_size || !remove_free(&a, prev, prev_size)
+    ) return native_error(ctx, "`Memory.deAlloc` found a corrupted heap at %d", blk);
+    blk = prev;
+    size += prev_size;
+  }
+
+  /* The block before a free block is always in use. */
+  a.mem[blk] = size | BLK_PREV_USED;
+  a.mem[blk + size - 1] = size;
+  a.mem[blk + size] &= (Word) ~BLK_PREV_USED;
+  if (!insert_free(&a, blk, size))
+    return native_error(ctx, "`Memory.deAlloc` found a corrupted heap at %d", blk);
+
+  return NATIVE_OK;
+}
+
+/* `Memory.alloc(size) -> addr`
+ * of a new block with `size` words. */
+static int memory_alloc(NativeCtx* ctx, const Word* args, Word* ret) {
+  return jack_alloc(ctx, args[0], ret);
+}
+
+/* `Memory.deAlloc(addr) -> 0`
+ * frees the block at `addr`. */
+static int memory_dealloc(NativeCtx* ctx, const Word* args, Word* ret) {
+  *ret = 0;
+  return jack_dealloc(ctx, args[0]);
+}
+
+int jack_peek(NativeCtx* ctx, const char* fn, size_t addr, Word* val) {
+  if (!in_heap(ctx->heap, addr)) {
+    return native_error(ctx, "address overflow: `%s` "
+      "tries to access heap at %lu", fn, addr);
+  }
+  *val = heap_get(*ctx->heap, (Addr) addr);
+  return NATIVE_OK;
+}
+
+int jack_poke(NativeCtx* ctx, const char* fn, size_t addr, Word val) {
+  if (!in_heap(ctx->heap, addr)) {
+    return native_error(ctx, "address overflow: `%s` "
+      "tries to access heap at %lu", fn, addr);
+  }
+  heap_set(*ctx->heap, (Addr) addr, val);
+  return NATIVE_OK;
+}
+
+/* `Memory.peek(addr) -> heap[addr]` */
+static int memory_peek(NativeCtx* ctx, const Word* args, Word* ret) {
+  return jack_peek(ctx, "Memory.peek", args[0], ret);
+}
+
+/* `Memory.poke(addr, val) -> 0`
+ * sets `heap[addr]` to `val`. */
+static int memory_poke(NativeCtx* ctx, const Word* args, Word* ret) {
+  *ret = 0;
+  return jack_poke(ctx, "Memory.poke", args[0], args[1]);
+}
+
+const Native memory_natives[] = {
+  { "Memory.init", 0, memory_init, NULL },
+  { "Memory.alloc", 1, memory_alloc, NULL },
+  { "Memory.deAlloc", 1, memory_dealloc, NULL },
+  { "Memory.peek", 1, memory_peek, NULL },
+  { "Memory.poke", 2, memory_poke, NULL },
+};
+
+const size_t nmemory_natives = sizeof(memory_natives) / sizeof(memory_natives[0]);
+
+int set_alloc_region(Addr base, size_t size, size_t end) {
+  if (size == 0 && base < end) size = end - base;
+  if (
+    base + size > end ||
+    size < ALLOC_MIN_REGION || size > ALLOC_MAX_REGION
+  ) return NATIVE_ERR;
+
+  config.base = base;
+  config.size = size;
+  return NATIVE_OK;
+}
+
+void print_alloc_stats(Heap* heap) {
+  assert(heap != NULL);
+
+  Alloc a = get_alloc(heap, &config);
+  if (META(&a, META_MAGIC) != ALLOC_MAGIC) {
+    hvme_fputs("The heap allocator wasn't used\n", stderr);
+    return;
+  }
+
+  /* Walk all blocks. This stops early if the program
+   * overwrote the headers of some of them. */
+  size_t nfree = 0;
+  size_t free_words = 0;
+  size_t largest = 0;
+  for (Addr blk = a.first; blk != a.end && is_block(&a, blk); blk += BLK_SIZE(a.mem[blk])) {
+    if (a.mem[blk] & BLK_USED) continue;
+    Word size = BLK_SIZE(a.mem[blk]);
+    nfree ++;
+    free_words += size;
+    if (size > largest) largest = size;
+  }
+
+  /* Share of free memory which can't be used for the largest block. */
+  double frag = free_words == 0
+    ? 0.0
+    : 100.0 * (double) (free_words - largest) / (double) free_words;
+
+  hvme_fprintf(stderr,
+    "Heap: %d of %lu words in use (peak %d, top %d), "
+    "%lu free blocks (largest %lu words, %.1f%% fragmented)\n",
+    META(&a, META_USED), (size_t) (a.end - a.first),
+    META(&a, META_PEAK), META(&a, META_TOP),
+    nfree, largest, frag);
+}
@@ -0,0 +1,263 @@
+#include "jack.h"
+#include "msg.h"
+
+#include <stdio.h>
+
+/* Text is drawn with the font of the Jack OS. The screen has
+ * 23 lines of 64 characters. Each character is 8 pixels wide
+ * and 11 pixels high, so it takes up one byte of 11 words in
+ * a column of the screen. The glyphs below are stored as these
+ * bytes (the lowest bit is the leftmost pixel), which makes
+ * drawing a character 11 masked stores. */
+
+#define FONT_FIRST 32  /* Space */
+#define FONT_LAST 126  /* `~` */
+#define GLYPH_ROWS 11
+
+static const unsigned char font[2 + FONT_LAST - FONT_FIRST][GLYPH_ROWS] = {
+  { 63, 63, 63, 63, 63, 63, 63, 63, 63,  0,  0 },  /* missing */
+  {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },  /* space */
+  { 12, 30, 30, 30, 12, 12,  0, 12, 12,  0,  0 },  /* ! */
+  { 54, 54, 20,  0,  0,  0,  0,  0,  0,  0,  0 },  /* " */
+  {  0, 18, 18, 63, 18, 18, 63, 18, 18,  0,  0 },  /* # */
+  { 12, 30, 51,  3, 30, 48, 51, 30, 12, 12,  0 },  /* $ */
+  {  0,  0, 35, 51, 24, 12,  6, 51, 49,  0,  0 },  /* % */
+  { 12, 30, 30, 12, 54, 27, 27, 27, 54,  0,  0 },  /* & */
+  { 12, 12,  6,  0,  0,  0,  0,  0,  0,  0,  0 },  /* ' */
+  { 24, 12,  6,  6,  6,  6,  6, 12, 24,  0,  0 },  /* ( */
+  {  6, 12, 24, 24, 24, 24, 24, 12,  6,  0,  0 },  /* ) */
+  {  0,  0,  0, 51, 30, 63, 30, 51,  0,  0,  0 },  /* * */
+  {  0,  0,  0, 12, 12, 63, 12, 12,  0,  0,  0 },  /* + */
+  {  0,  0,  0,  0,  0,  0,  0, 12, 12,  6,  0 },  /* , */
+  {  0,  0,  0,  0,  0, 63,  0,  0,  0,  0,  0 },  /* - */
+  {  0,  0,  0,  0,  0,  0,  0, 12, 12,  0,  0 },  /* . */
+  {  0,  0, 32, 48, 24, 12,  6,  3,  1,  0,  0 },  /* / */
+  { 12, 30, 51, 51, 51, 51, 51, 30, 12,  0,  0 },  /* 0 */
+  { 12, 14, 15, 12, 12, 12, 12, 12, 63,  0,  0 },  /* 1 */
+  { 30, 51, 48, 24, 12,  6,  3, 51, 63,  0,  0 },  /* 2 */
+  { 30, 51, 48, 48, 28, 48, 48, 51, 30,  0,  0 },  /* 3 */
+  { 16, 24, 28, 26, 25, 63, 24, 24, 60,  0,  0 },  /* 4 */
+  { 63,  3,  3, 31, 48, 48, 48, 51, 30,  0,  0 },  /* 5 */
+  { 28,  6,  3,  3, 31, 51, 51, 51, 30,  0,  0 },  /* 6 */
+  { 63, 49, 48, 48, 24, 12, 12, 12, 12,  0,  0 },  /* 7 */
+  { 30, 51, 51, 51, 30, 51, 51, 51, 30,  0,  0 },  /* 8 */
+  { 30, 51, 51, 51, 62, 48, 48, 24, 14,  0,  0 },  /* 9 */
+  {  0,  0, 12, 12,  0,  0, 12, 12,  0,  0,  0 },  /* : */
+  {  0,  0, 12, 12,  0,  0, 12, 12,  6,  0,  0 },  /* ; */
+  {  0,  0, 24, 12,  6,  3,  6, 12, 24,  0,  0 },  /* < */
+  {  0,  0,  0, 63,  0,  0, 63,  0,  0,  0,  0 },  /* = */
+  {  0,  0,  3,  6, 12, 24, 12,  6,  3,  0,  0 },  /* > */
+  { 30, 51, 51, 24, 12, 12,  0, 12, 12,  0,  0 },  /* ? */
+  { 30, 51, 51, 59, 59, 59, 27,  3, 30,  0,  0 },  /* @ */
+  { 12, 30, 51, 51, 63, 51, 51, 51, 51,  0,  0 },  /* A */
+  { 31, 51, 51, 51, 31, 51, 51, 51, 31,  0,  0 },  /* B */
+  { 28, 54, 35,  3,  3,  3, 35, 54, 28,  0,  0 },  /* C */
+  { 15, 27, 51, 51, 51, 51, 51, 27, 15,  0,  0 },  /* D */
+  { 63, 51, 35, 11, 15, 11, 35, 51, 63,  0,  0 },  /* E */
+  { 63, 51, 35, 11, 15, 11,  3,  3,  3,  0,  0 },  /* F */
+  { 28, 54, 35,  3, 59, 51, 51, 54, 44,  0,  0 },  /* G */
+  { 51, 51, 51, 51, 63, 51, 51, 51, 51,  0,  0 },  /* H */
+  { 30, 12, 12, 12, 12, 12, 12, 12, 30,  0,  0 },  /* I */
+  { 60, 24, 24, 24, 24, 24, 27, 27, 14,  0,  0 },  /* J */
+  { 51, 51, 51, 27, 15, 27, 51, 51, 51,  0,  0 },  /* K */
+  {  3,  3,  3,  3,  3,  3, 35, 51, 63,  0,  0 },  /* L */
+  { 33, 51, 63, 63, 51, 51, 51, 51, 51,  0,  0 },  /* M */
+  { 51, 51, 55, 55, 63, 59, 59, 51, 51,  0,  0 },  /* N */
+  { 30, 51, 51, 51, 51, 51, 51, 51, 30,  0,  0 },  /* O */
+  { 31, 51, 51, 51, 31,  3,  3,  3,  3,  0,  0 },  /* P */
+  { 30, 51, 51, 51, 51, 51, 63, 59, 30, 48,  0 },  /* Q */
+  { 31, 51, 51, 51, 31, 27, 51, 51, 51,  0,  0 },  /* R */
+  { 30, 51, 51,  6, 28, 48, 51, 51, 30,  0,  0 },  /* S */
+  { 63, 63, 45, 12, 12, 12, 12, 12, 30,  0,  0 },  /* T */
+  { 51, 51, 51, 51, 51, 51, 51, 51, 30,  0,  0 },  /* U */
+  { 51, 51, 51, 51, 51, 30, 30, 12, 12,  0,  0 },  /* V */
+  { 51, 51, 51, 51, 51, 63, 63, 63, 18,  0,  0 },  /* W */
+  { 51, 51, 30, 30, 12, 30, 30, 51, 51,  0,  0 },  /* X */
+  { 51, 51, 51, 51, 30, 12, 12, 12, 30,  0,  0 },  /* Y */
+  { 63, 51, 49, 24, 12,  6, 35, 51, 63,  0,  0 },  /* Z */
+  { 30,  6,  6,  6,  6,  6,  6,  6, 30,  0,  0 },  /* [ */
+  {  0,  0,  1,  3,  6, 12, 24, 48, 32,  0,  0 },  /* backslash */
+  { 30, 24, 24, 24, 24, 24, 24, 24, 30,  0,  0 },  /* ] */
+  {  8, 28, 54,  0,  0,  0,  0,  0,  0,  0,  0 },  /* ^ */
+  {  0,  0,  0,  0,  0,  0,  0,  0,  0, 63,  0 },  /* _ */
+  {  6, 12, 24,  0,  0,  0,  0,  0,  0,  0,  0 },  /* ` */
+  {  0,  0,  0, 14, 24, 30, 27, 27, 54,  0,  0 },  /* a */
+  {  3,  3,  3, 15, 27, 51, 51, 51, 30,  0,  0 },  /* b */
+  {  0,  0,  0, 30, 51,  3,  3, 51, 30,  0,  0 },  /* c */
+  { 48, 48, 48, 60, 54, 51, 51, 51, 30,  0,  0 },  /* d */
+  {  0,  0,  0, 30, 51, 63,  3, 51, 30,  0,  0 },  /* e */
+  { 28, 54, 38,  6, 15,  6,  6,  6, 15,  0,  0 },  /* f */
+  {  0,  0, 30, 51, 51, 51, 62, 48, 51, 30,  0 },  /* g */
+  {  3,  3,  3, 27, 55, 51, 51, 51, 51,  0,  0 },  /* h */
+  { 12, 12,  0, 14, 12, 12, 12, 12, 30,  0,  0 },  /* i */
+  { 48, 48,  0, 56, 48, 48, 48, 48, 51, 30,  0 },  /* j */
+  {  3,  3,  3, 51, 27, 15, 15, 27, 51,  0,  0 },  /* k */
+  { 14, 12, 12, 12, 12, 12, 12, 12, 30,  0,  0 },  /* l */
+  {  0,  0,  0, 29, 63, 43, 43, 43, 43,  0,  0 },  /* m */
+  {  0,  0,  0, 29, 51, 51, 51, 51, 51,  0,  0 },  /* n */
+  {  0,  0,  0, 30, 51, 51, 51, 51, 30,  0,  0 },  /* o */
+  {  0,  0,  0, 30, 51, 51, 51, 31,  3,  3,  0 },  /* p */
+  {  0,  0,  0, 30, 51, 51, 51, 62, 48, 48,  0 },  /* q */
+  {  0,  0,  0, 29, 55, 51,  3,  3,  7,  0,  0 },  /* r */
+  {  0,  0,  0, 30, 51,  6, 24, 51, 30,  0,  0 },  /* s */
+  {  4,  6,  6, 15,  6,  6,  6, 54, 28,  0,  0 },  /* t */
+  {  0,  0,  0, 27, 27, 27, 27, 27, 54,  0,  0 },  /* u */
+  {  0,  0,  0, 51, 51, 51, 51, 30, 12,  0,  0 },  /* v */
+  {  0,  0,  0, 51, 51, 51, 63, 63, 18,  0,  0 },  /* w */
+  {  0,  0,  0, 51, 30, 12, 12, 30, 51,  0,  0 },  /* x */
+  {  0,  0,  0, 51, 51, 51, 62, 48, 24, 15,  0 },  /* y */
+  {  0,  0,  0, 63, 27, 12,  6, 51, 63,  0,  0 },  /* z */
+  { 56, 12, 12, 12,  7, 12, 12, 12, 56,  0,  0 },  /* { */
+  { 12, 12, 12, 12, 12, 12, 12, 12, 12,  0,  0 },  /* | */
+  {  7, 12, 12, 12, 56, 12, 12, 12,  7,  0,  0 },  /* } */
+  { 38, 45, 25,  0,  0,  0,  0,  0,  0,  0,  0 },  /* ~ */
+};
+
+/* Whether text is also printed to stdout. */
+static int mirror = 0;
+
+static const unsigned char* glyph(Word c) {
+  return font[c >= FONT_FIRST && c <= FONT_LAST ? c - FONT_FIRST + 1 : 0];
+}
+
+/* Draw `c` at the cursor without moving it. */
+static void draw_char(Heap* heap, Word c) {
+  const JackOs* os = jack_os(heap);
+  const unsigned char* rows = glyph(c);
+  int shift = (os->col % 2) * 8;
+  Word mask = (Word) (0xFF << shift);
+  Word* word = &heap->mem[MEM_SCREEN + (size_t) os->line * GLYPH_ROWS
+    * SCREEN_ROW_WORDS + os->col / 2];
+
+  for (int r = 0; r < GLYPH_ROWS; r++, word += SCREEN_ROW_WORDS)
+    *word = (*word & ~mask) | (Word) (rows[r] << shift);
+}
+
+/* Like in the Jack OS, text continues at the top
+ * after the last line. */
+static void new_line(Heap* heap) {
+  JackOs* os = jack_os(heap);
+  os->col = 0;
+  os->line = (os->line + 1) % OUTPUT_LINES;
+  if (mirror) hvme_fprintf(stdout, "\n");
+}
+
+/* Erase the character before the cursor and move back to it. */
+static void back_space(Heap* heap) {
+  JackOs* os = jack_os(heap);
+  if (os->col > 0) {
+    os->col --;
+  } else if (os->line > 0) {
+    os->line --;
+    os->col = OUTPUT_COLS - 1;
+  }
+  draw_char(heap, ' ');
+  if (mirror) hvme_fprintf(stdout, "\b \b");
+}
+
+void output_char(Heap* heap, Word c) {
+  if (c == CHAR_NEWLINE) {
+    new_line(heap);
+    return;
+  }
+  if (c == CHAR_BACKSPACE) {
+    back_space(heap);
+    return;
+  }
+
+  draw_char(heap, c);
+  if (mirror && c >= FONT_FIRST && c <= FONT_LAST)
+    hvme_fprintf(stdout, "%c", (char) c);
+  if (++ jack_os(heap)->col == OUTPUT_COLS) new_line(heap);
+}
+
+int output_string(NativeCtx* ctx, const char* fn, size_t str) {
+  Word chars, length;
+  if (!jack_string(ctx, fn, str, &chars, &length)) return NATIVE_ERR;
+
+  for (Word j = 0; j < length; j++) {
+    Word c;
+    if (!jack_peek(ctx, fn, (size_t) chars + j, &c)) return NATIVE_ERR;
+    output_char(ctx->heap, c);
+  }
+  return NATIVE_OK;
+}
+
+/* `Output.init() -> 0` */
+static int output_init(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  jack_os(ctx->heap)->line = 0;
+  jack_os(ctx->heap)->col = 0;
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Output.moveCursor(i, j) -> 0`
+ * moves the cursor to column `j` of line `i`. */
+static int output_move_cursor(NativeCtx* ctx, const Word* args, Word* ret) {
+  int line = (int16_t) args[0];
+  int col = (int16_t) args[1];
+  if (line < 0 || line >= OUTPUT_LINES || col < 0 || col >= OUTPUT_COLS) {
+    return native_error(ctx, "`Output.moveCursor` got (%d, %d) which "
+      "is outside of the %dx%d lines", line, col, OUTPUT_LINES, OUTPUT_COLS);
+  }
+
+  jack_os(ctx->heap)->line = line;
+  jack_os(ctx->heap)->col = col;
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Output.printChar(c) -> 0` */
+static int output_print_char(NativeCtx* ctx, const Word* args, Word* ret) {
+  output_char(ctx->heap, args[0]);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Output.printString(str) -> 0` */
+static int output_print_string(NativeCtx* ctx, const Word* args, Word* ret) {
+  *ret = 0;
+  return output_string(ctx, "Output.printString", args[0]);
+}
+
+/* `Output.printInt(i) -> 0` */
+static int output_print_int(NativeCtx* ctx, const Word* args, Word* ret) {
+  char digits[8];
+  snprintf(digits, sizeof(digits), "%d", (int16_t) args[0]);
+  for (const char* d = digits; *d != '\0'; d++) output_char(ctx->heap, *d);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Output.println() -> 0` */
+static int output_println(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  new_line(ctx->heap);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Output.backSpace() -> 0` */
+static int output_back_space(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  back_space(ctx->heap);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+const Native output_natives[] = {
+  { "Output.init", 0, output_init, NULL },
+  { "Output.moveCursor", 2, output_move_cursor, NULL },
+  { "Output.printChar", 1, output_print_char, NULL },
+  { "Output.printString", 1, output_print_string, NULL },
+  { "Output.printInt", 1, output_print_int, NULL },
+  { "Output.println", 0, output_println, NULL },
+  { "Output.backSpace", 0, output_back_space, NULL },
+};
+
+const size_t noutput_natives = sizeof(output_natives) / sizeof(output_natives[0]);
+
+void set_output_mirror(int on) {
+  mirror = on;
+}
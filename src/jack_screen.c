@@ -0,0 +1,273 @@
+#include "jack.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Drawing works on whole words of the screen where possible.
+ * Horizontal spans set the words between their ends at once,
+ * which compilers turn into vector stores. Rectangles and
+ * circles are drawn as one span per row. */
+
+#define CIRCLE_MAX_RADIUS 181
+
+/* Where `Screen.dump` writes frames (`NULL` if it doesn't). */
+static const char* frames_path = NULL;
+
+static inline Word* screen_row(Heap* heap, int y) {
+  return &heap->mem[MEM_SCREEN + (size_t) y * SCREEN_ROW_WORDS];
+}
+
+static inline int on_screen(int x, int y) {
+  return x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT;
+}
+
+static inline void set_bits(Word* word, Word mask, Word color) {
+  *word = (*word & ~mask) | (color & mask);
+}
+
+/* Draw the pixels from `x1` to `x2` (both included) of `row`. */
+static void draw_span(Word* row, int x1, int x2, Word color) {
+  int w1 = x1 / 16;
+  int w2 = x2 / 16;
+  Word first = (Word) (0xFFFF << (x1 % 16));
+  Word last = (Word) (0xFFFF >> (15 - x2 % 16));
+
+  if (w1 == w2) {
+    set_bits(&row[w1], first & last, color);
+    return;
+  }
+
+  set_bits(&row[w1], first, color);
+  for (int w = w1 + 1; w < w2; w++) row[w] = color;
+  set_bits(&row[w2], last, color);
+}
+
+static inline void draw_pixel(Heap* heap, int x, int y, Word color) {
+  set_bits(&screen_row(heap, y)[x / 16], (Word) (1 << (x % 16)), color);
+}
+
+static int outside_error(NativeCtx* ctx, const char* fn, int x, int y) {
+  return native_error(ctx,
+    "`%s` got (%d, %d) which is outside of the screen", fn, x, y);
+}
+
+/* `Screen.init() -> 0` */
+static int screen_init(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  jack_os(ctx->heap)->color = TRUE;
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Screen.clearScreen() -> 0` */
+static int screen_clear(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  memset(screen_row(ctx->heap, 0), 0, MEM_SCREEN_SIZE * sizeof(Word));
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Screen.setColor(b) -> 0`
+ * sets the color to black if `b` is true and to white otherwise. */
+static int screen_set_color(NativeCtx* ctx, const Word* args, Word* ret) {
+  jack_os(ctx->heap)->color = args[0] != FALSE ? TRUE : FALSE;
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Screen.drawPixel(x, y) -> 0` */
+static int screen_draw_pixel(NativeCtx* ctx, const Word* args, Word* ret) {
+  int x = (int16_t) args[0];
+  int y = (int16_t) args[1];
+  if (!on_screen(x, y)) return outside_error(ctx, "Screen.drawPixel", x, y);
+
+  draw_pixel(ctx->heap, x, y, jack_os(ctx->heap)->color);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Screen.drawLine(x1, y1, x2, y2) -> 0` */
+static int screen_draw_line(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "Screen.drawLine";
+  int x1 = (int16_t) args[0];
+  int y1 = (int16_t) args[1];
+  int x2 = (int16_t) args[2];
+  int y2 = (int16_t) args[3];
+  if (!on_screen(x1, y1)) return outside_error(ctx, fn, x1, y1);
+  if (!on_screen(x2, y2)) return outside_error(ctx, fn, x2, y2);
+  *ret = 0;
+
+  Word color = jack_os(ctx->heap)->color;
+  if (y1 == y2) {
+    draw_span(screen_row(ctx->heap, y1), x1 < x2 ? x1 : x2, x1 < x2 ? x2 : x1, color);
+    return NATIVE_OK;
+  }
+
+  /* Bresenham's algorithm. */
+  int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+  int dy = y2 > y1 ? y1 - y2 : y2 - y1;
+  int sx = x2 > x1 ? 1 : -1;
+  int sy = y2 > y1 ? 1 : -1;
+  int diff = dx + dy;
+  for (;;) {
+    draw_pixel(ctx->heap, x1, y1, color);
+    if (x1 == x2 && y1 == y2) break;
+    if (2 * diff >= dy) {
+      diff += dy;
+      x1 += sx;
+    }
+    if (2 * diff <= dx) {
+      diff += dx;
+      y1 += sy;
+    }
+  }
+
+  return NATIVE_OK;
+}
+
+/* `Screen.drawRectangle(x1, y1, x2, y2) -> 0`
+ * fills the rectangle with the upper left corner `(x1, y1)`
+ * and the lower right corner `(x2, y2)`. */
+static int screen_draw_rectangle(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "Screen.drawRectangle";
+  int x1 = (int16_t) args[0];
+  int y1 = (int16_t) args[1];
+  int x2 = (int16_t) args[2];
+  int y2 = (int16_t) args[3];
+  if (!on_screen(x1, y1)) return outside_error(ctx, fn, x1, y1);
+  if (!on_screen(x2, y2)) return outside_error(ctx, fn, x2, y2);
+  if (x1 > x2 || y1 > y2) {
+    return native_error(ctx, "`%s` got (%d, %d) which is "
+      "below or right of (%d, %d)", fn, x1, y1, x2, y2);
+  }
+
+  Word color = jack_os(ctx->heap)->color;
+  for (int y = y1; y <= y2; y++)
+    draw_span(screen_row(ctx->heap, y), x1, x2, color);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Screen.drawCircle(x, y, r) -> 0`
+ * fills the circle. Parts outside of the screen are cut off. */
+static int screen_draw_circle(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "Screen.drawCircle";
+  int x = (int16_t) args[0];
+  int y = (int16_t) args[1];
+  int r = (int16_t) args[2];
+  if (!on_screen(x, y)) return outside_error(ctx, fn, x, y);
+  if (r < 0 || r > CIRCLE_MAX_RADIUS) {
+    return native_error(ctx, "`%s` needs a radius from 0 to %d, got %d",
+      fn, CIRCLE_MAX_RADIUS, r);
+  }
+
+  Word color = jack_os(ctx->heap)->color;
+  for (int dy = -r; dy <= r; dy++) {
+    if (y + dy < 0 || y + dy >= SCREEN_HEIGHT) continue;
+
+    int half = (int) sqrt((double) (r * r - dy * dy));
+    int x1 = x - half < 0 ? 0 : x - half;
+    int x2 = x + half >= SCREEN_WIDTH ? SCREEN_WIDTH - 1 : x + half;
+    draw_span(screen_row(ctx->heap, y + dy), x1, x2, color);
+  }
+
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* Write the screen to `path` as a PBM image or as
+ * a PPM image if `path` ends with `.ppm`. */
+static int write_frame(const Word* screen, const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) return NATIVE_ERR;
+
+  size_t len = strlen(path);
+  int ppm = len >= 4 && strcmp(path + len - 4, ".ppm") == 0;
+  fprintf(file, "%s\n%d %d\n%s", ppm ? "P6" : "P4",
+    SCREEN_WIDTH, SCREEN_HEIGHT, ppm ? "255\n" : "");
+
+  /* PBM stores the leftmost pixel in the highest bit and
+   * uses `1` for black like the screen. */
+  for (size_t i = 0; i < MEM_SCREEN_SIZE; i++) {
+    unsigned char out[16 * 3];
+    size_t nout = 0;
+    if (ppm) {
+      for (int bit = 0; bit < 16; bit++) {
+        unsigned char c = (screen[i] >> bit) & 1 ? 0 : 255;
+        out[nout ++] = c;
+        out[nout ++] = c;
+        out[nout ++] = c;
+      }
+    } else {
+      for (int byte = 0; byte < 2; byte++) {
+        unsigned char c = 0;
+        for (int bit = 0; bit < 8; bit++)
+          c |= ((screen[i] >> (byte * 8 + bit)) & 1) << (7 - bit);
+        out[nout ++] = c;
+      }
+    }
+    fwrite(out, 1, nout, file);
+  }
+
+  int failed = ferror(file);
+  return fclose(file) == 0 && !failed ? NATIVE_OK : NATIVE_ERR;
+}
+
+/* `Screen.dump() -> 0`
+ * writes the screen to the next numbered frame file unless no
+ * row changed since the last frame. Does nothing without one. */
+static int screen_dump(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  *ret = 0;
+  if (frames_path == NULL) return NATIVE_OK;
+
+  JackOs* os = jack_os(ctx->heap);
+  const Word* screen = screen_row(ctx->heap, 0);
+  int dirty = !os->has_last;
+  for (int y = 0; y < SCREEN_HEIGHT && !dirty; y++) {
+    size_t row = (size_t) y * SCREEN_ROW_WORDS;
+    dirty = memcmp(&screen[row], &os->last[row], SCREEN_ROW_WORDS * sizeof(Word)) != 0;
+  }
+  if (!dirty) return NATIVE_OK;
+
+  /* `out.pbm` becomes `out-1.pbm`, `out-2.pbm` and so on. */
+  char path[FILENAME_MAX];
+  const char* ext = strrchr(frames_path, '.');
+  const char* dir = strrchr(frames_path, '/');
+  if (ext == NULL || (dir != NULL && ext < dir)) ext = frames_path + strlen(frames_path);
+  snprintf(path, sizeof(path), "%.*s-%u%s",
+    (int) (ext - frames_path), frames_path, os->nframes + 1, ext);
+
+  if (write_frame(screen, path) == NATIVE_ERR)
+    return native_error(ctx, "`Screen.dump` can't write `%s`", path);
+
+  memcpy(os->last, screen, sizeof(os->last));
+  os->has_last = 1;
+  os->nframes ++;
+  return NATIVE_OK;
+}
+
+const Native screen_natives[] = {
+  { "Screen.init", 0, screen_init, NULL },
+  { "Screen.clearScreen", 0, screen_clear, NULL },
+  { "Screen.setColor", 1, screen_set_color, NULL },
+  { "Screen.drawPixel", 2, screen_draw_pixel, NULL },
+  { "Screen.drawLine", 4, screen_draw_line, NULL },
+  { "Screen.drawRectangle", 4, screen_draw_rectangle, NULL },
+  { "Screen.drawCircle", 3, screen_draw_circle, NULL },
+  { "Screen.dump", 0, screen_dump, NULL },
+};
+
+const size_t nscreen_natives = sizeof(screen_natives) / sizeof(screen_natives[0]);
+
+void set_screen_file(const char* path) {
+  frames_path = path;
+}
+
+int write_screen(Heap* heap) {
+  assert(heap != NULL);
+  if (frames_path == NULL) return NATIVE_OK;
+  return write_frame(screen_row(heap, 0), frames_path);
+}
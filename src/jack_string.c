@@ -0,0 +1,258 @@
+#include "jack.h"
+
+#include <stdio.h>
+
+/* Strings are objects with three fields like in the Jack OS:
+ *
+ *   this[0]: the array of characters
+ *   this[1]: the current length
+ *   this[2]: the maximum length (size of the array)
+ *
+ * Both the object and the array are allocated with
+ * `Memory.alloc`. */
+
+#define STR_CHARS 0
+#define STR_LENGTH 1
+#define STR_MAX_LENGTH 2
+#define STR_NFIELDS 3
+
+#define CHAR_DOUBLE_QUOTE 34
+
+/* The fields of a string while a native works on it. */
+typedef struct {
+  Word chars;
+  Word length;
+  Word max_length;
+} Str;
+
+static int get_str(NativeCtx* ctx, const char* fn, size_t this, Str* str) {
+  if (
+    !jack_peek(ctx, fn, this + STR_CHARS, &str->chars) ||
+    !jack_peek(ctx, fn, this + STR_LENGTH, &str->length) ||
+    !jack_peek(ctx, fn, this + STR_MAX_LENGTH, &str->max_length)
+  ) return NATIVE_ERR;
+
+  if (str->length > str->max_length)
+    return native_error(ctx, "`%s` got %lu which isn't a string", fn, this);
+  return NATIVE_OK;
+}
+
+/* Check that `j` is the index of a character of `str`. */
+static int check_index(NativeCtx* ctx, const char* fn, const Str* str, Word j) {
+  if (j >= str->length) {
+    return native_error(ctx, "`%s` can't access character %d "
+      "of a string of length %d", fn, (int16_t) j, str->length);
+  }
+  return NATIVE_OK;
+}
+
+/* `String.new(maxLength) -> this` */
+static int string_new(NativeCtx* ctx, const Word* args, Word* ret) {
+  int16_t max_length = (int16_t) args[0];
+  if (max_length < 0) {
+    return native_error(ctx,
+      "`String.new` needs a non-negative length, got %d", max_length);
+  }
+
+  /* Empty strings still get an array. */
+  Word this, chars;
+  if (
+    !jack_alloc(ctx, STR_NFIELDS, &this) ||
+    !jack_alloc(ctx, max_length > 0 ? max_length : 1, &chars)
+  ) return NATIVE_ERR;
+
+  heap_set(*ctx->heap, this + STR_CHARS, chars);
+  heap_set(*ctx->heap, this + STR_LENGTH, 0);
+  heap_set(*ctx->heap, this + STR_MAX_LENGTH, max_length);
+  *ret = this;
+  return NATIVE_OK;
+}
+
+/* `String.dispose(this) -> 0` */
+static int string_dispose(NativeCtx* ctx, const Word* args, Word* ret) {
+  Str str;
+  if (!get_str(ctx, "String.dispose", args[0], &str)) return NATIVE_ERR;
+  *ret = 0;
+  return jack_dealloc(ctx, str.chars) && jack_dealloc(ctx, args[0]);
+}
+
+/* `String.length(this) -> length` */
+static int string_length(NativeCtx* ctx, const Word* args, Word* ret) {
+  Str str;
+  if (!get_str(ctx, "String.length", args[0], &str)) return NATIVE_ERR;
+  *ret = str.length;
+  return NATIVE_OK;
+}
+
+/* `String.charAt(this, j) -> c` */
+static int string_char_at(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "String.charAt";
+  Str str;
+  if (!get_str(ctx, fn, args[0], &str) || !check_index(ctx, fn, &str, args[1]))
+    return NATIVE_ERR;
+  return jack_peek(ctx, fn, str.chars + args[1], ret);
+}
+
+/* `String.setCharAt(this, j, c) -> 0` */
+static int string_set_char_at(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "String.setCharAt";
+  Str str;
+  if (!get_str(ctx, fn, args[0], &str) || !check_index(ctx, fn, &str, args[1]))
+    return NATIVE_ERR;
+  *ret = 0;
+  return jack_poke(ctx, fn, str.chars + args[1], args[2]);
+}
+
+/* `String.appendChar(this, c) -> this` */
+static int string_append_char(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "String.appendChar";
+  Str str;
+  if (!get_str(ctx, fn, args[0], &str)) return NATIVE_ERR;
+  if (str.length == str.max_length) {
+    return native_error(ctx,
+      "`%s` can't append to a full string of length %d", fn, str.length);
+  }
+
+  if (!jack_poke(ctx, fn, str.chars + str.length, args[1])) return NATIVE_ERR;
+  heap_set(*ctx->heap, args[0] + STR_LENGTH, str.length + 1);
+  *ret = args[0];
+  return NATIVE_OK;
+}
+
+/* `String.eraseLastChar(this) -> 0` */
+static int string_erase_last_char(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "String.eraseLastChar";
+  Str str;
+  if (!get_str(ctx, fn, args[0], &str)) return NATIVE_ERR;
+  if (str.length == 0)
+    return native_error(ctx, "`%s` can't erase from an empty string", fn);
+
+  heap_set(*ctx->heap, args[0] + STR_LENGTH, str.length - 1);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `String.intValue(this) -> num`
+ * of the digits at the start of the string. A leading
+ * `-` makes it negative. Other characters end the number. */
+static int string_int_value(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "String.intValue";
+  Str str;
+  if (!get_str(ctx, fn, args[0], &str)) return NATIVE_ERR;
+
+  Word num = 0;
+  int neg = 0;
+  for (Word j = 0; j < str.length; j++) {
+    Word c;
+    if (!jack_peek(ctx, fn, str.chars + j, &c)) return NATIVE_ERR;
+    if (j == 0 && c == '-') {
+      neg = 1;
+    } else if (c >= '0' && c <= '9') {
+      num = num * 10 + (c - '0');
+    } else {
+      break;
+    }
+  }
+
+  *ret = neg ? (Word) -num : num;
+  return NATIVE_OK;
+}
+
+/* `String.setInt(this, num) -> 0`
+ * replaces the string by the digits of `num`. */
+static int string_set_int(NativeCtx* ctx, const Word* args, Word* ret) {
+  const char* fn = "String.setInt";
+  Str str;
+  if (!get_str(ctx, fn, args[0], &str)) return NATIVE_ERR;
+
+  /* `-32768` has six characters. */
+  char digits[8];
+  int len = snprintf(digits, sizeof(digits), "%d", (int16_t) args[1]);
+  if (len > str.max_length) {
+    return native_error(ctx, "`%s` can't store %d in a string "
+      "of maximum length %d", fn, (int16_t) args[1], str.max_length);
+  }
+
+  for (int j = 0; j < len; j++) {
+    if (!jack_poke(ctx, fn, str.chars + j, digits[j])) return NATIVE_ERR;
+  }
+  heap_set(*ctx->heap, args[0] + STR_LENGTH, len);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `String.newLine() -> 128` */
+static int string_new_line(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  (void) args;
+  *ret = CHAR_NEWLINE;
+  return NATIVE_OK;
+}
+
+/* `String.backSpace() -> 129` */
+static int string_back_space(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  (void) args;
+  *ret = CHAR_BACKSPACE;
+  return NATIVE_OK;
+}
+
+/* `String.doubleQuote() -> 34` */
+static int string_double_quote(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  (void) args;
+  *ret = CHAR_DOUBLE_QUOTE;
+  return NATIVE_OK;
+}
+
+/* `Array.new(size) -> this` */
+static int array_new(NativeCtx* ctx, const Word* args, Word* ret) {
+  if ((int16_t) args[0] <= 0) {
+    return native_error(ctx,
+      "`Array.new` needs a positive size, got %d", (int16_t) args[0]);
+  }
+  return jack_alloc(ctx, args[0], ret);
+}
+
+/* `Array.dispose(this) -> 0` */
+static int array_dispose(NativeCtx* ctx, const Word* args, Word* ret) {
+  *ret = 0;
+  return jack_dealloc(ctx, args[0]);
+}
+
+int jack_string(NativeCtx* ctx, const char* fn, size_t str, Word* chars, Word* length) {
+  Str fields;
+  if (!get_str(ctx, fn, str, &fields)) return NATIVE_ERR;
+  *chars = fields.chars;
+  *length = fields.length;
+  return NATIVE_OK;
+}
+
+int jack_new_string(NativeCtx* ctx, const Word* chars, Word length, Word* str) {
+  Word args[] = { length };
+  if (!string_new(ctx, args, str)) return NATIVE_ERR;
+
+  Word array = heap_get(*ctx->heap, *str + STR_CHARS);
+  for (Word j = 0; j < length; j++) heap_set(*ctx->heap, array + j, chars[j]);
+  heap_set(*ctx->heap, *str + STR_LENGTH, length);
+  return NATIVE_OK;
+}
+
+const Native string_natives[] = {
+  { "String.new", 1, string_new, NULL },
+  { "String.dispose", 1, string_dispose, NULL },
+  { "String.length", 1, string_length, NULL },
+  { "String.charAt", 2, string_char_at, NULL },
+  { "String.setCharAt", 3, string_set_char_at, NULL },
+  { "String.appendChar", 2, string_append_char, NULL },
+  { "String.eraseLastChar", 1, string_erase_last_char, NULL },
+  { "String.intValue", 1, string_int_value, NULL },
+  { "String.setInt", 2, string_set_int, NULL },
+  { "String.newLine", 0, string_new_line, NULL },
+  { "String.backSpace", 0, string_back_space, NULL },
+  { "String.doubleQuote", 0, string_double_quote, NULL },
+  { "Array.new", 1, array_new, NULL },
+  { "Array.dispose", 1, array_dispose, NULL },
+};
+
+const size_t nstring_natives = sizeof(string_natives) / sizeof(string_natives[0]);
@@ -0,0 +1,248 @@
+#include "libhvme.h"
+#include "msg.h"
+#include "link.h"
+#include "opt.h"
+#include "inline.h"
+#include "ir.h"
+#include "exec.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Hvme {
+  Program* prog;  /* `NULL` if it couldn't be made. */
+  HvmeConfig config;
+  HvmeStatus status;
+  HvmeError error;
+  int has_error;
+  size_t steps;
+  MsgSink sink;  /* Routes messages and I/O to `config.io`. */
+};
+
+static void sink_write(void* data, FILE* stream, const char* s) {
+  const HvmeIo* io = &((Hvme*) data)->config.io;
+  if (stream == stdout) {
+    if (io->out != NULL) io->out(io->data, s);
+  } else {
+    if (io->err != NULL) io->err(io->data, s);
+  }
+}
+
+static void sink_error(void* data, Pos pos, const char* msg) {
+  Hvme* vm = (Hvme*) data;
+  /* Later errors only follow from the first one. */
+  if (vm->has_error) return;
+  vm->has_error = 1;
+  vm->error.pos = pos;
+  snprintf(vm->error.msg, sizeof(vm->error.msg), "%s", msg);
+}
+
+static int sink_read(void* data) {
+  const HvmeIo* io = &((Hvme*) data)->config.io;
+  return io->in != NULL ? io->in(io->data) : EOF;
+}
+
+HvmeConfig hvme_config(void) {
+  HvmeConfig config;
+  memset(&config, 0, sizeof(config));
+  config.opt = OPT_PEEPHOLE;
+  return config;
+}
+
+/* Prepare `prog` like `run_hvme` does. */
+static Program* prepare_prog(Program* prog, const HvmeConfig* config) {
+  if (prog == NULL) return NULL;
+
+  bind_builtins(prog);
+  strip_prog(prog, NULL);
+  if (config->ram != 0 && !use_ram(prog, config->ram)) {
+    del_prog(prog);
+    return NULL;
+  }
+  if (config->opt >= OPT_PEEPHOLE) inline_prog(prog);
+  if (config->opt >= OPT_SSA) ir_prog(prog);
+  opt_prog(prog, config->opt);
+  return prog;
+}
+
+static Hvme* alloc_vm(const HvmeConfig* config) {
+  Hvme* vm = (Hvme*) calloc (1, sizeof(Hvme));
+  assert(vm != NULL);
+  vm->config = config != NULL ? *config : hvme_config();
+  vm->sink = (MsgSink) {
+    .data=vm, .write=sink_write, .error=sink_error, .read=sink_read, .unread=EOF,
+  };
+  return vm;
+}
+
+/* Can a program with `nsrcs` sources be made with the VM's config? */
+static int can_make(const Hvme* vm, unsigned int nsrcs) {
+  size_t ram = vm->config.ram;
+  if (ram != 0 && ram != 0x8000 && ram != 0x10000) {
+    err("The RAM must have 32768 or 65536 words");
+    return 0;
+  } else if (nsrcs == 0) {
+    err("Can't execute 0 files!");
+    return 0;
+  }
+  return 1;
+}
+
+Hvme* hvme_new(unsigned int nfiles, const char** files, const HvmeConfig* config) {
+  assert(files != NULL || nfiles == 0);
+
+  Hvme* vm = alloc_vm(config);
+  MsgSink* prev = set_msg_sink(&vm->sink);
+  if (can_make(vm, nfiles))
+    vm->prog = prepare_prog(make_prog(nfiles, files), &vm->config);
+  set_msg_sink(prev);
+
+  vm->status = vm->prog != NULL ? HVME_BUDGET : HVME_ERROR;
+  return vm;
+}
+
+Hvme* hvme_new_bufs(unsigned int nbufs, const SourceBuf* bufs, const HvmeConfig* config) {
+  assert(bufs != NULL || nbufs == 0);
+
+  Hvme* vm = alloc_vm(config);
+  MsgSink* prev = set_msg_sink(&vm->sink);
+  if (can_make(vm, nbufs))
+    vm->prog = prepare_prog(make_prog_bufs(nbufs, bufs), &vm->config);
+  set_msg_sink(prev);
+
+  vm->status = vm->prog != NULL ? HVME_BUDGET : HVME_ERROR;
+  return vm;
+}
+
+Hvme* hvme_clone(const Hvme* vm, const HvmeIo* io) {
+  assert(vm != NULL);
+  assert(vm->steps == 0);
+
+  Hvme* copy = alloc_vm(&vm->config);
+  if (io != NULL) copy->config.io = *io;
+  copy->status = vm->status;
+  copy->error = vm->error;
+  copy->has_error = vm->has_error;
+  if (vm->prog != NULL) copy->prog = clone_prog(vm->prog);
+  return copy;
+}
+
+void hvme_del(Hvme* vm) {
+  if (vm != NULL) {
+    del_prog(vm->prog);
+    free(vm);
+  }
+}
+
+HvmeStatus hvme_run(Hvme* vm, size_t budget) {
+  assert(vm != NULL);
+  if (vm->status != HVME_BUDGET) return vm->status;
+
+  size_t left = budget;
+  MsgSink* prev = set_msg_sink(&vm->sink);
+  int res = vm->config.unchecked
+    ? exec_budget_unchecked(vm->prog, &left)
+    : exec_budget(vm->prog, &left);
+  set_msg_sink(prev);
+
+  vm->steps += budget - left;
+  vm->status = res == EXEC_ERR ? HVME_ERROR : res == EXEC_BUDGET ? HVME_BUDGET : HVME_FINISHED;
+  return vm->status;
+}
+
+HvmeStatus hvme_status(const Hvme* vm) {
+  assert(vm != NULL);
+  return vm->status;
+}
+
+const HvmeError* hvme_error(const Hvme* vm) {
+  assert(vm != NULL);
+  return vm->has_error ? &vm->error : NULL;
+}
+
+size_t hvme_steps(const Hvme* vm) {
+  assert(vm != NULL);
+  return vm->steps;
+}
+
+size_t hvme_size(const Hvme* vm) {
+  assert(vm != NULL);
+  return sizeof(Hvme) + (vm->prog != NULL ? prog_size(vm->prog) : 0);
+}
+
+int hvme_peek(const Hvme* vm, size_t addr, Word* val) {
+  assert(vm != NULL);
+  if (vm->prog == NULL || !in_heap(&vm->prog->heap, addr)) return 0;
+  *val = heap_get(vm->prog->heap, addr);
+  return 1;
+}
+
+int hvme_poke(Hvme* vm, size_t addr, Word val) {
+  assert(vm != NULL);
+  if (vm->prog == NULL || !in_heap(&vm->prog->heap, addr)) return 0;
+  heap_set(vm->prog->heap, addr, val);
+  return 1;
+}
+
+size_t hvme_stack_depth(const Hvme* vm) {
+  assert(vm != NULL);
+  return vm->prog != NULL ? vm->prog->stack.sp : 0;
+}
+
+int hvme_stack_get(const Hvme* vm, size_t index, Word* val) {
+  if (index >= hvme_stack_depth(vm)) return 0;
+  *val = vm->prog->stack.ops[index];
+  return 1;
+}
+
+int hvme_stack_set(Hvme* vm, size_t index, Word val) {
+  if (index >= hvme_stack_depth(vm)) return 0;
+  vm->prog->stack.ops[index] = val;
+  return 1;
+}
+
+void hvme_push(Hvme* vm, Word val) {
+  assert(vm != NULL);
+  if (vm->prog != NULL) spush(&vm->prog->stack, val);
+}
+
+int hvme_pop(Hvme* vm, Word* val) {
+  assert(vm != NULL);
+  return vm->prog != NULL && spop(&vm->prog->stack, val) == SPOP_OK;
+}
+
+/* The static `index` of `file` or `NULL` if it doesn't exist. */
+static Word* find_static(const Hvme* vm, const char* file, size_t index) {
+  assert(vm != NULL);
+  assert(file != NULL);
+  if (vm->prog == NULL) return NULL;
+
+  const Program* prog = vm->prog;
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    const Memory* mem = &prog->files[fi].mem;
+    if (strcmp(prog->files[fi].filename, file) != 0) continue;
+    if (prog->heap.mask != 0) {
+      /* The statics of all files share the RAM. */
+      if ((size_t) (mem->_static - prog->heap.mem) + index >= RAM_STATIC_END) return NULL;
+    } else if (index >= MEM_STAT_SIZE) {
+      return NULL;
+    }
+    return &mem->_static[index];
+  }
+  return NULL;
+}
+
+int hvme_static_get(const Hvme* vm, const char* file, size_t index, Word* val) {
+  const Word* stat = find_static(vm, file, index);
+  if (stat == NULL) return 0;
+  *val = *stat;
+  return 1;
+}
+
+int hvme_static_set(Hvme* vm, const char* file, size_t index, Word val) {
+  Word* stat = find_static(vm, file, index);
+  if (stat == NULL) return 0;
+  *stat = val;
+  return 1;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef _LIBHVME_H_
+#define _LIBHVME_H_
+
+#include "prog.h"
+
+#include <stdint.h>
+
+/* Embedding API (`build/libhvme.a` and `build/libhvme.so`).
+ *
+ * A `Hvme` is a single program which is run in steps by
+ * `hvme_run`. Nothing is printed and nothing is read from the
+ * standard streams. The program's output, its input and all
+ * messages go through the callbacks in `HvmeIo`. Errors don't
+ * leave the library: they end the run with `HVME_ERROR` and
+ * `hvme_error` tells where they happened.
+ *
+ * Each VM must only be used by one thread at a time, but
+ * different VMs can run on different threads at the same
+ * time. Natives and plugins are shared by all of them (see
+ * `native.h`) and must be registered before VMs are made. */
+
+#define HVME_ERR_LEN 256
+
+/* Run until the program finishes. */
+#define HVME_UNLIMITED SIZE_MAX
+
+typedef enum {
+  HVME_ERROR = -1,  /* The program failed (see `hvme_error`). */
+  HVME_FINISHED = 0,  /* The program reached its end. */
+  HVME_BUDGET = 1,  /* The budget ran out; `hvme_run` continues. */
+} HvmeStatus;
+
+/* Callbacks for the program's I/O. Missing output callbacks
+ * drop the text and missing input reads `EOF`. */
+typedef struct {
+  void* data;  /* Passed to all callbacks. */
+  /* Text the program prints to stdout (e.g. `Sys.print_num`). */
+  void (*out)(void* data, const char* s);
+  /* Error messages and warnings. */
+  void (*err)(void* data, const char* s);
+  /* Next character for `Sys.read_*` or `EOF`. */
+  int (*in)(void* data);
+} HvmeIo;
+
+typedef struct {
+  int opt;  /* Optimization level (see `opt.h`). */
+  int unchecked;  /* Run without checks (see `exec_prog_unchecked`). */
+  size_t ram;  /* Size of the unified RAM or `0` (see `use_ram`). */
+  HvmeIo io;
+} HvmeConfig;
+
+typedef struct {
+  Pos pos;  /* The file name is `NULL` if there is no position. */
+  char msg[HVME_ERR_LEN];
+} HvmeError;
+
+typedef struct Hvme Hvme;
+
+/* Configuration with the defaults of the `hvme` executable and
+ * no I/O callbacks. */
+HvmeConfig hvme_config(void);
+
+/* Make a VM from the given source files. `config` is copied
+ * and can be `NULL` for `hvme_config()`. If the program
+ * can't be made, the VM is in the state `HVME_ERROR`. */
+Hvme* hvme_new(unsigned int nfiles, const char** files, const HvmeConfig* config);
+
+/* Like `hvme_new` for sources in memory. Their names are used
+ * as file names. The texts are only read by this function. */
+Hvme* hvme_new_bufs(unsigned int nbufs, const SourceBuf* bufs, const HvmeConfig* config);
+
+/* Make a VM which runs the program of `vm` from the start with
+ * its own memory and with `io` (`NULL` keeps the one of `vm`).
+ * The program isn't made again and its code is shared, so `vm`
+ * must not run itself and must be deleted after all clones. */
+Hvme* hvme_clone(const Hvme* vm, const HvmeIo* io);
+
+void hvme_del(Hvme* vm);
+
+/* Run at most `budget` instructions, starting where the previous
+ * run stopped. Once the program finished or failed, this returns
+ * the same status again without running anything. */
+HvmeStatus hvme_run(Hvme* vm, size_t budget);
+
+HvmeStatus hvme_status(const Hvme* vm);
+
+/* The first error if the status is `HVME_ERROR`. Positions
+ * refer to the files of the VM and stay valid until it's
+ * deleted. */
+const HvmeError* hvme_error(const Hvme* vm);
+
+/* Number of instructions run so far. */
+size_t hvme_steps(const Hvme* vm);
+
+/* Approximate number of bytes used by `vm`. The code of
+ * clones is counted for the VM they were made from. */
+size_t hvme_size(const Hvme* vm);
+
+/* Access memory the same way the program can. All of them
+ * return `0` if the location doesn't exist and `1` otherwise.
+ *
+ * Heap addresses are the addresses `this` and `that` use.
+ * Stack index `0` is the bottom of the stack and there are
+ * `hvme_stack_depth` values on it. Statics are found by the
+ * name of the file or buffer the VM was made from. */
+int hvme_peek(const Hvme* vm, size_t addr, Word* val);
+int hvme_poke(Hvme* vm, size_t addr, Word val);
+
+size_t hvme_stack_depth(const Hvme* vm);
+int hvme_stack_get(const Hvme* vm, size_t index, Word* val);
+int hvme_stack_set(Hvme* vm, size_t index, Word val);
+void hvme_push(Hvme* vm, Word val);
+int hvme_pop(Hvme* vm, Word* val);
+
+int hvme_static_get(const Hvme* vm, const char* file, size_t index, Word* val);
+int hvme_static_set(Hvme* vm, const char* file, size_t index, Word val);
+
+#endif  // _LIBHVME_H_
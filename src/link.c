@@ -0,0 +1,279 @@
+#include "link.h"
+#include "msg.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Instruction which is reachable at runtime. */
+typedef struct {
+  unsigned int fi;  /* file index. */
+  size_t ei;  /* execution index into the file's `insts`. */
+} Target;
+
+typedef struct {
+  Target* cell;
+  size_t idx;
+  size_t len;
+} Worklist;
+
+#ifndef WORKLIST_BLOCK_SIZE
+#define WORKLIST_BLOCK_SIZE 0x100
+#endif  // WORKLIST_BLOCK_SIZE
+
+static void push_target(Worklist* wl, const Program* prog, unsigned int fi, size_t ei) {
+  assert(wl != NULL);
+
+  /* Jumping to the end of a file ends execution.
+   * There's no instruction to mark. */
+  if (ei >= prog->files[fi].insts.idx) return;
+
+  if (wl->idx == wl->len) {
+    wl->len += WORKLIST_BLOCK_SIZE;
+    wl->cell = (Target*) realloc (wl->cell, wl->len * sizeof(Target));
+    assert(wl->cell != NULL);
+  }
+
+  wl->cell[wl->idx ++] = (Target) { .fi=fi, .ei=ei };
+}
+
+/* Push the target of a jump to `key` from file `fi`. Symbols
+ * are resolved the same way `jump_to` resolves them when the
+ * program is executed: the active file is checked first, then
+ * all other files. If there are multiple definitions in other
+ * files, all of them are pushed so that the runtime error
+ * about multiple definitions stays the same. */
+static void push_symbol(Worklist* wl, const Program* prog, unsigned int fi, SymKey key) {
+  SymVal val;
+
+  if (get_st(prog->files[fi].st, &key, &val) == GTRES_OK) {
+    push_target(wl, prog, fi, val.inst_addr);
+    return;
+  }
+
+  /* Like `jump_to`, check the system file last and only
+   * if no other file defines the symbol. */
+  int found = 0;
+  for (unsigned int i = 1; i <= prog->nfiles; i++) {
+    unsigned int next_fi = i % prog->nfiles;
+    if (next_fi == 0 && found) break;
+    if (next_fi != fi && get_st(prog->files[next_fi].st, &key, &val) == GTRES_OK) {
+      push_target(wl, prog, next_fi, val.inst_addr);
+      found = 1;
+    }
+  }
+}
+
+/* Walk all paths of execution starting at
+ * the startup code and mark each instruction
+ * on the way as live. */
+static void mark_live(const Program* prog, char** live) {
+  Worklist wl = { .cell=NULL, .idx=0, .len=0 };
+
+  /* Execution always starts in the system file. */
+  push_target(&wl, prog, 0, prog->files[0].ei);
+
+  while (wl.idx > 0) {
+    Target t = wl.cell[-- wl.idx];
+    const Insts* insts = &prog->files[t.fi].insts;
+
+    for (size_t ei = t.ei; ei < insts->idx && !live[t.fi][ei]; ei++) {
+      const Inst* inst = &insts->cell[ei];
+      live[t.fi][ei] = 1;
+
+      if (inst->code == GOTO) {
+        push_symbol(&wl, prog, t.fi, mk_key(inst->ident, SBT_LABEL));
+        break;  /* Nothing after an unconditional jump is reached. */
+      } else if (inst->code == IF_GOTO || inst->code == IF_NOT_GOTO) {
+        push_symbol(&wl, prog, t.fi, mk_key(inst->ident, SBT_LABEL));
+      } else if (inst->code == CALL || inst->code == TAIL_CALL) {
+        /* Execution continues after the call once it returns. */
+        push_symbol(&wl, prog, t.fi, mk_key(inst->ident, SBT_FUNC));
+      } else if (inst->code == RET) {
+        break;
+      }
+    }
+  }
+
+  free(wl.cell);
+}
+
+static size_t count_funcs(const SymbolTable* st) {
+  size_t n = 0;
+  for (size_t i = 0; i < st->len; i++) {
+    if (st->cell[i].key.type == SBT_FUNC) n++;
+  }
+  return n;
+}
+
+void compact_file(File* file, const char* live, int drop_syms) {
+  assert(file != NULL);
+
+  Insts* insts = &file->insts;
+
+  /* `map[i]` is the new address of the instruction at `i`.
+   * For dead instructions this is the address of the next
+   * live instruction. */
+  size_t* map = (size_t*) malloc ((insts->idx + 1) * sizeof(size_t));
+  assert(map != NULL);
+
+  size_t nlive = 0;
+  for (size_t i = 0; i < insts->idx; i++) {
+    map[i] = nlive;
+    if (live[i]) insts->cell[nlive ++] = insts->cell[i];
+  }
+  map[insts->idx] = nlive;
+
+  SymbolTable st = new_st();
+  for (size_t i = 0; i < file->st.len; i++) {
+    const Symbol* sym = &file->st.cell[i];
+    if (sym->key.type == SBT_UNUSED) continue;
+
+    /* Labels at the very end are always kept. */
+    size_t addr = sym->val.inst_addr;
+    if (drop_syms && addr < insts->idx && !live[addr]) continue;
+
+    SymVal val = sym->val;
+    val.inst_addr = map[addr];
+    insert_st(&st, sym->key, val);
+  }
+  st.num_inst = nlive;
+  del_st(file->st);
+  file->st = st;
+
+  file->ei = map[file->ei];
+
+  insts->idx = nlive;
+  insts->len = nlive > 0 ? nlive : 1;
+  insts->cell = (Inst*) realloc (insts->cell, insts->len * sizeof(Inst));
+  assert(insts->cell != NULL);
+
+  free(map);
+}
+
+void strip_prog(Program* prog, LinkStats* stats) {
+  assert(prog != NULL);
+  assert(prog->nfiles > 0);
+
+  LinkStats s = { 0, 0, 0, 0 };
+
+  char** live = (char**) calloc (prog->nfiles, sizeof(char*));
+  assert(live != NULL);
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    const File* file = &prog->files[fi];
+    live[fi] = (char*) calloc (file->insts.idx + 1, sizeof(char));
+    assert(live[fi] != NULL);
+    s.ninsts_before += file->insts.idx;
+    s.nfuncs_before += count_funcs(&file->st);
+  }
+
+  mark_live(prog, live);
+
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    File* file = &prog->files[fi];
+    /* Drop symbols pointing to dead code.
+     * Nothing can jump there. */
+    compact_file(file, live[fi], 1);
+    s.ninsts_after += file->insts.idx;
+    s.nfuncs_after += count_funcs(&file->st);
+    free(live[fi]);
+  }
+  free(live);
+
+  if (stats != NULL) *stats = s;
+}
+
+int resolve_symbol(const Program* prog, unsigned int fi, SymKey key,
+    unsigned int* target_fi, SymVal* val) {
+  assert(prog != NULL);
+
+  if (get_st(prog->files[fi].st, &key, val) == GTRES_OK) {
+    *target_fi = fi;
+    return 1;
+  }
+
+  unsigned int ndefs = 0;
+  SymVal next_val;
+  for (unsigned int i = 1; i <= prog->nfiles; i++) {
+    unsigned int next_fi = i % prog->nfiles;
+    if (next_fi == 0 && ndefs > 0) break;
+    if (next_fi != fi && get_st(prog->files[next_fi].st, &key, &next_val) == GTRES_OK) {
+      *target_fi = next_fi;
+      *val = next_val;
+      ndefs ++;
+    }
+  }
+
+  return ndefs == 1;
+}
+
+/* Find the builtin instruction in the wrapper function at `addr`
+ * of the system file. Wrappers only push their arguments and
+ * constants, run the builtin and return. */
+static int get_builtin(const File* file, size_t addr, Inst* call) {
+  int found = 0;
+  call->builtin.nargs = 0;
+
+  for (size_t i = addr; i < file->insts.idx; i++) {
+    const Inst* inst = &file->insts.cell[i];
+    if (inst->code == RET) {
+      return found;
+    } else if (inst->code == BUILTIN && !found) {
+      call->builtin.index = inst->builtin.index;
+      call->builtin.off = inst->off;
+      found = 1;
+    } else if (inst->code == PUSH && inst->mem.seg == ARG) {
+      if (inst->mem.offset >= call->builtin.nargs)
+        call->builtin.nargs = inst->mem.offset + 1;
+    } else if (!(inst->code == PUSH && inst->mem.seg == CONST)) {
+      return 0;
+    }
+  }
+
+  return 0;
+}
+
+size_t bind_builtins(Program* prog) {
+  assert(prog != NULL);
+  assert(prog->nfiles > 0);
+
+  size_t nbound = 0;
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    Insts* insts = &prog->files[fi].insts;
+    for (size_t i = 0; i < insts->idx; i++) {
+      Inst* inst = &insts->cell[i];
+      if (inst->code != CALL) continue;
+
+      unsigned int target_fi;
+      SymVal val;
+      Inst bound = *inst;
+      if (
+        resolve_symbol(prog, fi, mk_key(inst->ident, SBT_FUNC), &target_fi, &val) &&
+        target_fi == 0 && get_builtin(&prog->files[0], val.inst_addr, &bound) &&
+        bound.builtin.nargs <= inst->nargs
+      ) {
+        bound.code = CALL_BUILTIN;
+        *inst = bound;
+        nbound ++;
+      }
+    }
+  }
+
+  return nbound;
+}
+
+void print_link_stats(const LinkStats* stats) {
+  assert(stats != NULL);
+
+  size_t ninsts = stats->ninsts_before - stats->ninsts_after;
+  size_t nfuncs = stats->nfuncs_before - stats->nfuncs_after;
+  double percent = stats->ninsts_before == 0
+    ? 0.0
+    : 100.0 * (double) ninsts / (double) stats->ninsts_before;
+
+  hvme_fprintf(stderr,
+    "Stripped %lu of %lu instructions (%.1f%%) "
+    "and %lu of %lu functions\n",
+    ninsts, stats->ninsts_before, percent,
+    nfuncs, stats->nfuncs_before);
+}
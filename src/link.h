@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include "prog.h"
+
+typedef struct {
+  size_t ninsts_before;  /* instructions in all files before stripping. */
+  size_t ninsts_after;  /* instructions left after stripping. */
+  size_t nfuncs_before;  /* functions in all files before stripping. */
+  size_t nfuncs_after;  /* functions left after stripping. */
+} LinkStats;
+
+/* Remove all instructions from `prog` which can't be
+ * reached from the startup code in the system file.
+ * This drops unused functions and dead code after
+ * unconditional jumps and returns. Instruction arrays
+ * and symbol tables are compacted afterwards. If `stats`
+ * isn't `NULL`, it's filled with the removed amounts. */
+void strip_prog(Program* prog, LinkStats* stats);
+
+/* Remove each instruction `i` with `live[i] == 0` from `file`
+ * and move its symbols to the new addresses. Symbols pointing
+ * to removed instructions are dropped if `drop_syms` is set.
+ * Otherwise they point to the next instruction which is kept. */
+void compact_file(File* file, const char* live, int drop_syms);
+
+/* Resolve a jump or call to `key` from file `fi` the same way
+ * `jump_to` does when the program runs. Returns `0` if there is
+ * no definition or if it's ambiguous. */
+int resolve_symbol(const Program* prog, unsigned int fi, SymKey key,
+    unsigned int* target_fi, SymVal* val);
+
+/* Replace calls to the builtin functions of the system file by
+ * `CALL_BUILTIN` which runs the builtin directly on the caller's
+ * stack. Only calls which would enter the builtin's wrapper at
+ * runtime and pass at least the arguments it reads are replaced,
+ * so errors stay the same. Returns the number of replaced calls. */
+size_t bind_builtins(Program* prog);
+
+/* Print a report of what `strip_prog` removed. */
+void print_link_stats(const LinkStats* stats);
+
+#endif  // _LINK_H_
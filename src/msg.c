@@ -7,14 +7,46 @@
 
 #define NO_COLOR "NO_COLOR"
 
+/* Last character printed to stdout. It belongs to the stream,
+ * which is shared by all programs running in this process, so
+ * it's only accessed atomically. */
 static char last_stdout = '\0';
 
 #define PRINT_BUF_SIZE 1024
 
+/* Sink of the program running on this thread (see `set_msg_sink`). */
+static _Thread_local MsgSink* sink = NULL;
+
+MsgSink* set_msg_sink(MsgSink* new_sink) {
+  MsgSink* old = sink;
+  sink = new_sink;
+  return old;
+}
+
+int hvme_getc(void) {
+  if (sink == NULL) return getchar();
+  int c = sink->unread;
+  if (c == EOF) return sink->read(sink->data);
+  sink->unread = EOF;
+  return c;
+}
+
+void hvme_ungetc(int c) {
+  if (sink == NULL) {
+    ungetc(c, stdin);
+  } else {
+    sink->unread = c;
+  }
+}
+
 int hvme_fputs(const char *restrict s, FILE *restrict stream) {
   int len = strlen(s);
+  if (sink != NULL) {
+    sink->write(sink->data, stream, s);
+    return len;
+  }
   if (stream == stdout) {
-    last_stdout = s[len > 0 ? len - 1 : '\0'];
+    __atomic_store_n(&last_stdout, s[len > 0 ? len - 1 : 0], __ATOMIC_RELAXED);
   }
   return fputs(s, stream);  // <- Only time `fputs` is allowed.
 }
@@ -49,9 +81,12 @@ int hvme_fprintf(FILE *restrict stream, const char *restrict fmt, ...) {
 void clean_stdout(void) {
   /* Print a trailing newline if there's none. */
   #ifndef UNIT_TESTS
+  /* Sinks get the text exactly as it was printed. */
+  if (sink != NULL) return;
   /* Print a newline if the last character wasn't
    * already a newline and stdout isn't empty. */
-  if (last_stdout != '\n' && last_stdout != '\0')
+  char last = __atomic_load_n(&last_stdout, __ATOMIC_RELAXED);
+  if (last != '\n' && last != '\0')
     hvme_fprintf(stdout, "\n");
   fflush(stdout);
   #endif  // UNIT_TESTS
@@ -76,20 +111,17 @@ static inline void init_perr(Pos pos) {
 }
 
 void perrf(Pos pos, const char* fmt, ...) {  
+  char msg[PRINT_BUF_SIZE];
   va_list args;
   va_start(args, fmt);
-  clean_stdout();
-  init_perr(pos);
-  /* This is ok because it is internal; `clean_stdout`
-   * will never be called before another `hvme_fprintf` 
-   * is called to correctly set `last_stdout`. */
-  vfprintf(stderr,  fmt, args);
-  hvme_fprintf(stderr, "\n");
+  vsnprintf(msg, sizeof(msg), fmt, args);
   va_end(args);
+  perr(pos, msg);
 }
 
 void perr(Pos pos, const char* msg) {
   clean_stdout();
+  if (sink != NULL) sink->error(sink->data, pos, msg);
   init_perr(pos);
   hvme_fputs(msg, stderr);
   hvme_fputs("\n", stderr);
@@ -97,6 +129,7 @@ void perr(Pos pos, const char* msg) {
 
 void err(const char* msg) {
   clean_stdout();
+  if (sink != NULL) sink->error(sink->data, (Pos) { 0, 0, NULL }, msg);
   char* no_color = getenv(NO_COLOR);
   char* err_init = "\033[31mError\033[0m";
   if (no_color != NULL && no_color[0] != '\0') {
@@ -172,3 +205,10 @@ void warn_no_st(const SymKey* key, const SymVal* val) {
   hvme_fprintf(stderr, "Can't enter %s `%s` starting at instruction %lu\n",
     key_type_name(key->type), key->ident, val->inst_addr + 1);
 }
+
+void warn_no_snapshot(unsigned long count) {
+  init_warn();
+  hvme_fprintf(stderr, "the program finished before instruction %lu.\n", count);
+  hint_indicator();
+  hvme_fprintf(stderr, "No snapshot was written\n");
+}
@@ -7,6 +7,31 @@
 #include "st.h"
 #include <stdio.h>
 
+/* Receives the messages, output and input of the programs
+ * running on a thread instead of the standard streams. */
+typedef struct {
+  void* data;
+  /* Text printed to `stream` (`stdout` or `stderr`). */
+  void (*write)(void* data, FILE* stream, const char* s);
+  /* Error at `pos`. Its text is written afterwards. Errors
+   * without a position have a `NULL` file name. */
+  void (*error)(void* data, Pos pos, const char* msg);
+  /* Next input character or `EOF`. */
+  int (*read)(void* data);
+  int unread;  /* Character given back by `hvme_ungetc` or `EOF`. */
+} MsgSink;
+
+/* Use `sink` for everything printed and read on this thread
+ * until it's replaced. `NULL` goes back to the standard
+ * streams. Returns the previous sink. */
+MsgSink* set_msg_sink(MsgSink* sink);
+
+/* Read a character from stdin. */
+int hvme_getc(void);
+
+/* Give back `c` to be read again by `hvme_getc`. */
+void hvme_ungetc(int c);
+
 /* Print a format string. Using this function makes
  * `clean_stdout` work. HVME internals should not use
  * any other function to print something. */
@@ -50,4 +75,8 @@ void warn_trunc_ident(const char* blk, size_t len, size_t max);
  * instruction doesn't work. */
 void warn_no_st(const SymKey* key, const SymVal* val);
 
+/* Warn that the program finished before the snapshot
+ * after `count` instructions could be written. */
+void warn_no_snapshot(unsigned long count);
+
 #endif  // _MSG_H_
@@ -0,0 +1,321 @@
+#include "native.h"
+#include "jack.h"
+#include "snapshot.h"
+#include "msg.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BIT16_LIMIT 65535
+
+/* `Sys.print_char (c) -> 0`
+ * prints the given character. */
+static int sys_print_char(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  hvme_fprintf(stdout, "%c", (char) args[0]);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Sys.print_num (num) -> 0`
+ * prints the given number as an unsigned integer. */
+static int sys_print_num(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  hvme_fprintf(stdout, "%d", args[0]);
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Sys.print_str (nchars, addr) -> 0`
+ * prints a character array of length `nchars`. */
+static int sys_print_str(NativeCtx* ctx, const Word* args, Word* ret) {
+  Word nchars = args[0];
+  Addr str_start = args[1];
+  for (size_t i = 0; i < nchars; i++) {
+    if (!in_heap(ctx->heap, str_start + i)) {
+      return native_error(ctx, "address overflow: `Sys.print_str` "
+        "tries to access heap at %lu", str_start + i);
+    }
+  }
+
+  for (Addr i = 0; i < nchars; i++) {
+    hvme_fprintf(stdout, "%c",
+      (char) heap_get(*ctx->heap, str_start + i));
+  }
+  *ret = 0;
+  return NATIVE_OK;
+}
+
+/* `Sys.read_char() -> char`
+ * reads a single character and returns it. */
+static int sys_read_char(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) ctx;
+  (void) args;
+  *ret = hvme_getc();
+  return NATIVE_OK;
+}
+
+/* `Sys.read_num() -> num`
+ * reads a single unsigned integer and returns it.
+ * Whitespace before it is skipped like by `scanf`. */
+static int sys_read_num(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+
+  int c = hvme_getc();
+  while (isspace(c)) c = hvme_getc();
+  if (c == EOF) {
+    return native_error(ctx, "system read failed.");
+  } else if (!isdigit(c)) {
+    // Input was invalid and nothing was read.
+    // This consumes the rest of the line.
+    while (c != '\n' && c != EOF) {
+      c = hvme_getc();
+    }
+    return native_error(ctx,
+      "invalid input, `Sys.read_num` only accepts digits.");
+  }
+
+  unsigned int num_buf = 0;
+  for (; isdigit(c); c = hvme_getc()) {
+    if (num_buf <= UINT_MAX / 10) num_buf = num_buf * 10 + (c - '0');
+  }
+  /* The character after the number is left for the next read. */
+  hvme_ungetc(c);
+
+  if (num_buf > BIT16_LIMIT) {
+    return native_error(ctx, "number %u read by `Sys.read_num` "
+      "is too large. The limit is %d", num_buf, BIT16_LIMIT);
+  }
+
+  *ret = (Word) num_buf;
+  return NATIVE_OK;
+}
+
+/* `Sys.read_str(addr) -> nchars`
+ * reads a line and stores it on heap starting at `addr`.
+ * The number of characters stored is returned.
+ * The stored string doesn't include the terminating
+ * newline character. */
+static int sys_read_str(NativeCtx* ctx, const Word* args, Word* ret) {
+  Word heap_addr = args[0];
+
+  int c = hvme_getc();
+  if (c == EOF) {
+    return native_error(ctx, "system read failed.");
+  }
+
+  char* buf = NULL;
+  size_t len = 0;
+  size_t nread = 0;
+  for (; c != '\n' && c != EOF; c = hvme_getc()) {
+    if (nread == len) {
+      len = len == 0 ? 64 : len * 2;
+      buf = (char*) realloc (buf, len);
+      assert(buf != NULL);
+    }
+    buf[nread ++] = (char) c;
+  }
+
+  for (size_t i = 0; i < nread; i++) {
+    if (!in_heap(ctx->heap, heap_addr + i)) {
+      free(buf);
+      return native_error(ctx, "address overflow: `Sys.read_str` "
+        "tries to access heap at %lu", heap_addr + i);
+    }
+  }
+
+  /* `memcpy` doesn't work here because we read
+   * `char`s which we must store as `Word`s. */
+  for (unsigned int i = 0; i < nread; i++) {
+    ctx->heap->mem[heap_addr + i] = (Word) buf[i];
+  }
+
+  free(buf);
+
+  *ret = (Word) nread;
+  return NATIVE_OK;
+}
+
+/* NOTE: On adding another builtin.
+ * Add its implementation above (or to one of the Jack OS
+ * classes) and an entry to its table in `tables`. The
+ * wrapper function in the system file and everything
+ * else is derived from it. */
+static const Native sys_natives[] = {
+  { "Sys.print_char", 1, sys_print_char, NULL },
+  { "Sys.print_num", 1, sys_print_num, NULL },
+  { "Sys.print_str", 2, sys_print_str, NULL },
+  { "Sys.read_char", 0, sys_read_char, NULL },
+  { "Sys.read_num", 0, sys_read_num, NULL },
+  { "Sys.read_str", 1, sys_read_str, NULL },
+};
+
+static const size_t nsys_natives = sizeof(sys_natives) / sizeof(sys_natives[0]);
+
+/* Natives which are always available. */
+static const struct {
+  const Native* natives;
+  const size_t* n;
+} tables[] = {
+  { sys_natives, &nsys_natives },
+  { math_natives, &nmath_natives },
+  { memory_natives, &nmemory_natives },
+  { string_natives, &nstring_natives },
+  { screen_natives, &nscreen_natives },
+  { output_natives, &noutput_natives },
+  { keyboard_natives, &nkeyboard_natives },
+  { snapshot_natives, &nsnapshot_natives },
+};
+
+static Native natives[NATIVE_MAX];
+static unsigned int nnatives = 0;
+static unsigned int ndefaults = 0;
+
+/* Handles of the loaded plugins. */
+static void* plugins[NATIVE_MAX];
+static unsigned int nplugins = 0;
+
+static void init_natives(void) {
+  if (nnatives > 0) return;
+
+  for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+    for (size_t i = 0; i < *tables[t].n; i++)
+      natives[nnatives ++] = tables[t].natives[i];
+  }
+  ndefaults = nnatives;
+}
+
+int add_native(const char* name, uint16_t nargs, NativeFn fn, void* data) {
+  init_natives();
+
+  if (
+    name == NULL || fn == NULL || name[0] == '\0' ||
+    strlen(name) > MAX_IDENT_LEN || nargs > NATIVE_MAX_ARGS ||
+    nnatives == NATIVE_MAX
+  ) return -1;
+
+  for (unsigned int i = 0; i < nnatives; i++) {
+    if (strcmp(natives[i].name, name) == 0) return -1;
+  }
+
+  Native* native = &natives[nnatives];
+  strcpy(native->name, name);
+  native->nargs = nargs;
+  native->fn = fn;
+  native->data = data;
+  return (int) nnatives ++;
+}
+
+const Native* get_native(unsigned int index) {
+  init_natives();
+  assert(index < nnatives);
+  return &natives[index];
+}
+
+unsigned int count_natives(void) {
+  init_natives();
+  return nnatives;
+}
+
+void reset_natives(void) {
+  init_natives();
+  nnatives = ndefaults;
+
+  for (unsigned int i = 0; i < nplugins; i++)
+    dlclose(plugins[i]);
+  nplugins = 0;
+}
+
+int native_error(NativeCtx* ctx, const char* fmt, ...) {
+  assert(ctx != NULL);
+
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(ctx->err, NATIVE_ERR_LEN, fmt, ap);
+  va_end(ap);
+  return NATIVE_ERR;
+}
+
+static int api_peek(NativeCtx* ctx, size_t addr, Word* val) {
+  if (!in_heap(ctx->heap, addr)) {
+    return native_error(ctx, "address overflow: "
+      "native tries to access heap at %lu", addr);
+  }
+  *val = heap_get(*ctx->heap, (Addr) addr);
+  return NATIVE_OK;
+}
+
+static int api_poke(NativeCtx* ctx, size_t addr, Word val) {
+  if (!in_heap(ctx->heap, addr)) {
+    return native_error(ctx, "address overflow: "
+      "native tries to access heap at %lu", addr);
+  }
+  heap_set(*ctx->heap, (Addr) addr, val);
+  return NATIVE_OK;
+}
+
+static const NativeApi api = {
+  .version=NATIVE_ABI_VERSION,
+  .add_native=add_native,
+  .error=native_error,
+  .peek=api_peek,
+  .poke=api_poke,
+};
+
+int load_plugin(const char* path) {
+  assert(path != NULL);
+
+  char msg[NATIVE_ERR_LEN];
+  if (nplugins == NATIVE_MAX) {
+    snprintf(msg, sizeof(msg), "Can't load more than %d plugins", NATIVE_MAX);
+    err(msg);
+    return NATIVE_ERR;
+  }
+
+  void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (handle == NULL) {
+    snprintf(msg, sizeof(msg), "Can't load plugin `%s`: %s", path, dlerror());
+    err(msg);
+    return NATIVE_ERR;
+  }
+
+  /* ISO C doesn't allow casting `void*` to function pointers. */
+  union { void* obj; NativePluginInit fn; } init;
+  init.obj = dlsym(handle, NATIVE_PLUGIN_INIT);
+  const unsigned int* version = (const unsigned int*) dlsym(handle, NATIVE_PLUGIN_VERSION);
+  if (init.obj == NULL || version == NULL) {
+    snprintf(msg, sizeof(msg), "Plugin `%s` doesn't define `%s`", path,
+      init.obj == NULL ? NATIVE_PLUGIN_INIT : NATIVE_PLUGIN_VERSION);
+    err(msg);
+    dlclose(handle);
+    return NATIVE_ERR;
+  }
+
+  /* `api` might not even match what the plugin expects. */
+  if (*version != NATIVE_ABI_VERSION) {
+    snprintf(msg, sizeof(msg), "Plugin `%s` was built for version %u "
+      "of the native interface instead of %u", path, *version, NATIVE_ABI_VERSION);
+    err(msg);
+    dlclose(handle);
+    return NATIVE_ERR;
+  }
+
+  /* Natives must not outlive the plugin's code. */
+  unsigned int prev_nnatives = count_natives();
+  if (init.fn(&api) != NATIVE_OK) {
+    snprintf(msg, sizeof(msg), "Plugin `%s` failed to register its functions", path);
+    err(msg);
+    nnatives = prev_nnatives;
+    dlclose(handle);
+    return NATIVE_ERR;
+  }
+
+  plugins[nplugins ++] = handle;
+  return NATIVE_OK;
+}
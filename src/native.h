@@ -0,0 +1,107 @@
+#pragma once
+
+#ifndef _NATIVE_H_
+#define _NATIVE_H_
+
+#include "prog.h"
+
+/* Native functions.
+ *
+ * Builtins are C functions which VM code calls like any other
+ * function. Each one is registered under a function name with
+ * a fixed number of arguments and always returns one value.
+ * `init_system_file` adds a wrapper function for every native
+ * to the system file, so calls which `bind_builtins` doesn't
+ * replace still work.
+ *
+ * Natives can also be added at startup from plugins (shared
+ * objects loaded with `load_plugin`). A plugin exports the
+ * version of this interface it was built for and a function
+ * named `NATIVE_PLUGIN_INIT` which gets a table of functions
+ * of this module (`NativeApi`) and registers its natives with
+ * it. Plugins built for another version are refused. Plugins
+ * only depend on this header, not on any symbols of the `hvme`
+ * executable. They access the heap through `NativeApi` as
+ * well, so the layout of `Heap` isn't part of the interface.
+ *
+ * The natives are shared by all programs in the process. They
+ * must be registered before programs run and natives keep the
+ * state of a program with its heap, so programs can run on
+ * different threads at the same time. */
+
+/* Increased whenever `NativeApi`, `NativeCtx` or `NativeFn` change. */
+#define NATIVE_ABI_VERSION 2
+
+#ifndef NATIVE_MAX
+#define NATIVE_MAX 0x100
+#endif  // NATIVE_MAX
+
+#define NATIVE_MAX_ARGS 16
+#define NATIVE_ERR_LEN 256
+
+#define NATIVE_ERR 0
+#define NATIVE_OK 1
+
+/* State a native function runs with. */
+typedef struct {
+  Heap* heap;  /* The program's heap. */
+  void* data;  /* Data passed when the function was registered. */
+  char err[NATIVE_ERR_LEN];  /* Error message (see `native_error`). */
+} NativeCtx;
+
+/* Native function. `args[0]` is the first argument (lowest
+ * on the stack). Returns `NATIVE_OK` and sets `ret` on success.
+ * On failure it returns `NATIVE_ERR` (`native_error` does both). */
+typedef int (*NativeFn)(NativeCtx* ctx, const Word* args, Word* ret);
+
+typedef struct {
+  char name[MAX_IDENT_LEN + 1];
+  uint16_t nargs;
+  NativeFn fn;
+  void* data;
+} Native;
+
+/* Register a new native function. Returns its index or
+ * `-1` if the name is taken or the arguments are invalid. */
+int add_native(const char* name, uint16_t nargs, NativeFn fn, void* data);
+
+/* Get the native with the given index. */
+const Native* get_native(unsigned int index);
+
+/* Number of registered natives. */
+unsigned int count_natives(void);
+
+/* Remove all natives added by `add_native` or plugins
+ * and unload the plugins. The default natives stay. */
+void reset_natives(void);
+
+/* Set the error message of `ctx` and return `NATIVE_ERR`.
+ * The error is reported at the position of the call. */
+int native_error(NativeCtx* ctx, const char* fmt, ...);
+
+/* Functions passed to plugins. */
+typedef struct {
+  unsigned int version;  /* `NATIVE_ABI_VERSION` */
+  int (*add_native)(const char* name, uint16_t nargs, NativeFn fn, void* data);
+  int (*error)(NativeCtx* ctx, const char* fmt, ...);
+  /* Read or write `heap[addr]`. They fail with an error
+   * (like `error`) if the heap doesn't include `addr`. */
+  int (*peek)(NativeCtx* ctx, size_t addr, Word* val);
+  int (*poke)(NativeCtx* ctx, size_t addr, Word val);
+} NativeApi;
+
+/* Name of the function plugins must export. It returns
+ * `NATIVE_OK` if all of its natives were registered. */
+#define NATIVE_PLUGIN_INIT "hvme_plugin_init"
+
+/* Name of the `const unsigned int` plugins must export. It is
+ * the `NATIVE_ABI_VERSION` they were built with. */
+#define NATIVE_PLUGIN_VERSION "hvme_plugin_version"
+
+typedef int (*NativePluginInit)(const NativeApi* api);
+
+/* Load the plugin at `path` and register its natives. Prints
+ * an error and returns `NATIVE_ERR` if that doesn't work. */
+int load_plugin(const char* path);
+
+#endif  // _NATIVE_H_
@@ -0,0 +1,200 @@
+#include "opt.h"
+#include "link.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Maximum number of `goto`s followed when threading a jump. */
+#ifndef MAX_JUMP_THREAD
+#define MAX_JUMP_THREAD 8
+#endif  // MAX_JUMP_THREAD
+
+static inline int is_const(const Inst* inst) {
+  return inst->code == PUSH && inst->mem.seg == CONST;
+}
+
+int fold_binary(enum InstCode code, Word x, Word y, Word* res) {
+  switch (code) {
+    case ADD:
+      if ((uint32_t) x + (uint32_t) y > 0xFFFF) return 0;
+      *res = x + y;
+      return 1;
+    case SUB:
+      if (x < y) return 0;
+      *res = x - y;
+      return 1;
+    case AND: *res = x & y; return 1;
+    case OR: *res = x | y; return 1;
+    case EQ: *res = x == y ? TRUE : FALSE; return 1;
+    case LT: *res = x < y ? TRUE : FALSE; return 1;
+    case GT: *res = x > y ? TRUE : FALSE; return 1;
+    default: return 0;
+  }
+}
+
+int fold_unary(enum InstCode code, Word y, Word* res) {
+  switch (code) {
+    case NEG: *res = ~y + 1; return 1;
+    case NOT: *res = ~y; return 1;
+    default: return 0;
+  }
+}
+
+/* Is `push <seg> <offset>` followed by `pop <seg> <offset>`
+ * a no-op? This is only the case for segments where both
+ * instructions can't fail. Accessing `local`, `argument`,
+ * `this` and `that` depends on the frame and pointers at
+ * runtime so they're kept. */
+static int is_noop_pair(const Inst* push, const Inst* pop) {
+  if (push->code != PUSH || pop->code != POP) return 0;
+  if (push->mem.seg != pop->mem.seg) return 0;
+
+  switch (push->mem.seg) {
+    case CONST:
+      /* `pop constant` drops any value. */
+      return 1;
+    case STAT:
+      return push->mem.offset == pop->mem.offset
+        && push->mem.offset < MEM_STAT_SIZE;
+    case TMP:
+      return push->mem.offset == pop->mem.offset
+        && push->mem.offset < MEM_TEMP_SIZE;
+    case PTR:
+      return push->mem.offset == pop->mem.offset
+        && push->mem.offset <= 1;
+    default:
+      return 0;
+  }
+}
+
+static inline int is_cmp(const Inst* inst) {
+  /* Comparisons only produce `TRUE` or `FALSE`. */
+  return inst->code == EQ || inst->code == LT || inst->code == GT;
+}
+
+static inline int is_jump(const Inst* inst) {
+  return inst->code == GOTO || inst->code == IF_GOTO || inst->code == IF_NOT_GOTO;
+}
+
+/* Get the address of `label` in `file`. Labels which aren't
+ * in the file itself are resolved at runtime so they're left
+ * alone here. Returns `0` if it doesn't exist. */
+static int label_addr(const File* file, const char* label, size_t* addr) {
+  SymKey key = mk_key(label, SBT_LABEL);
+  SymVal val;
+  if (get_st(file->st, &key, &val) != GTRES_OK) return 0;
+  *addr = val.inst_addr;
+  return 1;
+}
+
+/* Let `inst` jump straight to the end of a chain of `goto`s. */
+static void thread_jump(const File* file, Inst* inst) {
+  size_t addr;
+  for (
+    int n = 0;
+    n < MAX_JUMP_THREAD
+      && label_addr(file, inst->ident, &addr)
+      && addr < file->insts.idx
+      && file->insts.cell[addr].code == GOTO;
+    n++
+  ) {
+    const char* next = file->insts.cell[addr].ident;
+    if (strcmp(next, inst->ident) == 0) break;  /* `label a; goto a` */
+    strcpy(inst->ident, next);
+  }
+}
+
+/* Run a single pass over `file`. Returns the
+ * number of instructions which were removed. */
+static size_t opt_pass(File* file) {
+  Insts* insts = &file->insts;
+  size_t n = insts->idx;
+
+  /* Instructions which are jumped to. Patterns
+   * can only start at these instructions. */
+  char* leader = (char*) calloc (n + 1, sizeof(char));
+  assert(leader != NULL);
+  for (size_t i = 0; i < file->st.len; i++) {
+    const Symbol* sym = &file->st.cell[i];
+    if (sym->key.type != SBT_UNUSED && sym->val.inst_addr <= n)
+      leader[sym->val.inst_addr] = 1;
+  }
+
+  char* live = (char*) malloc (n + 1);
+  assert(live != NULL);
+  memset(live, 1, n + 1);
+  size_t nremoved = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    Inst* a = &insts->cell[i];
+    Inst* b = i + 1 < n && !leader[i + 1] ? &insts->cell[i + 1] : NULL;
+    Inst* c = b != NULL && i + 2 < n && !leader[i + 2] ? &insts->cell[i + 2] : NULL;
+    Word res;
+
+    if (c != NULL && is_const(a) && is_const(b)
+        && fold_binary(c->code, a->mem.offset, b->mem.offset, &res)) {
+      /* `push constant x; push constant y; <op>` */
+      a->mem.offset = res;
+      live[i + 1] = live[i + 2] = 0;
+      nremoved += 2;
+      i += 2;
+    } else if (b != NULL && is_const(a)
+        && fold_unary(b->code, a->mem.offset, &res)) {
+      /* `push constant y; <op>` */
+      a->mem.offset = res;
+      live[i + 1] = 0;
+      nremoved += 1;
+      i += 1;
+    } else if (b != NULL && is_noop_pair(a, b)) {
+      /* `push x; pop x` */
+      live[i] = live[i + 1] = 0;
+      nremoved += 2;
+      i += 1;
+    } else if (c != NULL && is_cmp(a) && b->code == NOT && c->code == IF_GOTO) {
+      /* `<cmp>; not; if-goto l` jumps if `<cmp>` is false. */
+      c->code = IF_NOT_GOTO;
+      live[i + 1] = 0;
+      nremoved += 1;
+      i += 2;
+    } else if (a->code == CALL && i + 1 < n && insts->cell[i + 1].code == RET) {
+      /* `call f n; return`. The `return` is kept for
+       * when the frame can't be reused at runtime. */
+      a->code = TAIL_CALL;
+    } else if (is_jump(a)) {
+      thread_jump(file, a);
+      size_t addr;
+      if (a->code == GOTO && label_addr(file, a->ident, &addr) && addr == i + 1) {
+        /* `goto l; label l` */
+        live[i] = 0;
+        nremoved += 1;
+      }
+    }
+  }
+
+  if (nremoved > 0) compact_file(file, live, 0);
+
+  free(live);
+  free(leader);
+
+  return nremoved;
+}
+
+size_t opt_prog(Program* prog, int level) {
+  assert(prog != NULL);
+
+  if (level == OPT_NONE) return 0;
+
+  size_t nremoved = 0;
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    /* Folding might create new patterns. Repeat
+     * until nothing changes anymore. */
+    size_t npass;
+    do {
+      npass = opt_pass(&prog->files[fi]);
+      nremoved += npass;
+    } while (npass > 0);
+  }
+
+  return nremoved;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#ifndef _OPT_H_
+#define _OPT_H_
+
+#include "prog.h"
+
+/* Optimization levels. */
+#define OPT_NONE 0  /* `-O0`: run the instructions as they are. */
+#define OPT_PEEPHOLE 1  /* `-O1`: peephole optimizations (default). */
+#define OPT_SSA 2  /* `-O2`: optimizations on the SSA IR (see `ir.h`). */
+
+/* Evaluate `x <op> y`. Returns `0` if the operation
+ * can't be folded because it fails at runtime. */
+int fold_binary(enum InstCode code, Word x, Word y, Word* res);
+
+/* Evaluate `<op> y`. */
+int fold_unary(enum InstCode code, Word y, Word* res);
+
+/* Optimize the instructions in all files of `prog`.
+ *
+ * `-O1` folds constant operations, removes `push`/`pop`
+ * pairs which don't change anything, threads jumps to
+ * jumps, replaces negated conditional jumps by
+ * `IF_NOT_GOTO` and calls followed by `return` by
+ * `TAIL_CALL`. Operations which would fail at runtime
+ * (e.g. an overflowing `add`) are never folded so that
+ * they still fail with the original position.
+ *
+ * Returns the number of removed instructions. */
+size_t opt_prog(Program* prog, int level);
+
+#endif  // _OPT_H_
@@ -11,16 +11,9 @@ Insts new_insts(const char* filename) {
   Insts insts = {
     .idx=0,
     .len=INST_BLOCK_SIZE,
+    .src=new_src(filename),
   };
 
-  if (filename != NULL) {
-    insts.filename = (char*) calloc (strlen(filename) + 1, sizeof(char));
-    assert(filename != NULL);
-    strcpy(insts.filename, filename);
-  } else {
-    insts.filename = NULL;
-  }
-
   insts.cell = (Inst*) calloc (insts.len, sizeof(Inst));
   assert(insts.cell != NULL);
 
@@ -29,7 +22,7 @@ Insts new_insts(const char* filename) {
 
 void del_insts(Insts insts) {
   free(insts.cell);
-  free(insts.filename);
+  del_src(insts.src);
 }
 
 void cpy_insts(Insts* dest, Insts* src) {
@@ -55,13 +48,20 @@ void inst_str(const Inst* i, char* str) {
     static char* meminsts[] = { [POP]="pop", [PUSH]="push" };
     snprintf(str, INST_STR_BUF,  "%s %s %d",
       meminsts[i->code], segs[i->mem.seg], i->mem.offset);
-  } else if (i->code == GOTO || i->code == IF_GOTO) {
-    static char* ctrlflow_insts[] = { [TK_GOTO]="goto", [TK_IF_GOTO]="if-goto" };
+  } else if (i->code == GOTO || i->code == IF_GOTO || i->code == IF_NOT_GOTO) {
+    static char* ctrlflow_insts[] = {
+      [TK_GOTO]="goto", [TK_IF_GOTO]="if-goto", [IF_NOT_GOTO]="if-not-goto",
+    };
     snprintf(str, INST_STR_BUF, "%s %s",
       ctrlflow_insts[i->code], i->ident);
-  } else if (i->code == CALL) {
-    snprintf(str, INST_STR_BUF, "call %s %d",
-      i->ident, i->nargs);
+  } else if (i->code == BUILTIN) {
+    snprintf(str, INST_STR_BUF, "<builtin %s>", i->ident);
+  } else if (i->code == CALL || i->code == TAIL_CALL || i->code == CALL_BUILTIN) {
+    static char* call_insts[] = {
+      [TK_CALL]="call", [TAIL_CALL]="tail-call", [CALL_BUILTIN]="call-builtin",
+    };
+    snprintf(str, INST_STR_BUF, "%s %s %d",
+      call_insts[i->code], i->ident, i->nargs);
   } else {
     static char* insts[] = {
       [0]="IC_NONE",
@@ -69,12 +69,6 @@ void inst_str(const Inst* i, char* str) {
       [TK_AND]="and", [TK_OR]="or", [TK_NOT]="not",
       [TK_EQ]="eq", [TK_GT]="gt", [TK_LT]="lt",
       [TK_RET]="return",
-      [BUILTIN_PRINT_CHAR]="<builtin print char>",
-      [BUILTIN_PRINT_NUM]="<builtin print num>",
-      [BUILTIN_PRINT_STR]="<builtin print str>",
-      [BUILTIN_READ_CHAR]="<builtin read char>",
-      [BUILTIN_READ_NUM]="<builtin read num>",
-      [BUILTIN_READ_STR]="<builtin read str>",
     };
     strncpy(str, insts[i->code], INST_STR_BUF);
   }
@@ -91,7 +85,7 @@ typedef struct {
 const static Token none_token = (Token) {
   .t=TK_NONE,
   .uilit=0,
-  .pos={.ln=0, .cl=0},
+  .off=0,
 };
 
 // Return the current token and go to the next.
@@ -136,15 +130,14 @@ TokenStream its_slice(TokenStream* its, size_t ol, size_t or) {
   };
 }
 
-void print_multi_def_err(SymKey* key, SymVal* val, Pos pos, const char* filename) {
-  pos.filename = filename;
-  perrf(pos,
+void print_multi_def_err(SymKey* key, SymVal* val, Offset off, Source* src) {
+  perrf(src_pos(src, off),
     "multiple definitions of the same %s.\n"
     "  Won't enter `%s` starting at instruction %lu",
     key_type_name(key->type), key->ident, val->inst_addr + 1);
 }
 
-void print_expect3_err(TokenStream its, const char* expectation, const char* filename) {
+void print_expect3_err(TokenStream its, const char* expectation, Source* src) {
   assert(expectation != NULL);
 
   // `calloc` will indirectly add the null-terminator
@@ -166,15 +159,13 @@ void print_expect3_err(TokenStream its, const char* expectation, const char* fil
   assert(pointer != NULL);
   memset(pointer, '^', strlen(self));
 
-  Pos display_pos = it->pos;
+  Offset display_off = it->off;
   if (it->t == TK_NONE) {
     /* Correct the position in none tokens. */
-    display_pos.cl = strlen(second) + second_it->pos.cl + 1;
-    display_pos.ln = second_it->pos.ln;
+    display_off = strlen(second) + second_it->off + 1;
   }
-  display_pos.filename = filename;
 
-  perrf(display_pos,
+  perrf(src_pos(src, display_off),
     "wrong token, expected %s\n"
     " | %s %s %s\n"  // <- Scanned instruction.
     " | %s %s %s",  // <- Error marker.
@@ -188,7 +179,7 @@ void print_expect3_err(TokenStream its, const char* expectation, const char* fil
   free(pointer);
 }
 
-void print_expect2_err(TokenStream its, const char* expectation, const char* filename) {
+void print_expect2_err(TokenStream its, const char* expectation, Source* src) {
   assert(expectation != NULL);
   
   // `calloc` will indirectly add the null-terminator
@@ -205,23 +196,15 @@ void print_expect2_err(TokenStream its, const char* expectation, const char* fil
   assert(pointer != NULL);
   memset(pointer, '^', strlen(self));
 
-  Token display_it = *it;
-  if (display_it.t == TK_NONE) {
-    // Correct the position in none tokens.
-    display_it.pos.cl = prev_it->pos.cl + strlen(prev) + 1;
-    display_it.pos.ln = prev_it->pos.ln;
-  }
-  Pos display_pos = it->pos;
+  Offset display_off = it->off;
   if (it->t == TK_NONE) {
     /* Correct the position in none tokens. */
-    display_pos.cl = prev_it->pos.cl + strlen(prev) + 1;
-    display_pos.ln = prev_it->pos.ln;
+    display_off = prev_it->off + strlen(prev) + 1;
   }
-  display_pos.filename = filename;
 
   TOKEN_STR(next, its_next(&its));
 
-  perrf(display_pos,
+  perrf(src_pos(src, display_off),
     "wrong token, expected %s\n"
     " | %s %s %s\n"  // <- Scanned instruction.
     " | %s %s",  // <- Error marker.
@@ -234,14 +217,12 @@ void print_expect2_err(TokenStream its, const char* expectation, const char* fil
   free(pointer);
 }
 
-void print_token_err(const Token* it, const char* filename) {
+void print_token_err(const Token* it, Source* src) {
   TOKEN_STR(it_str, it);
-  Pos pos = it->pos;
-  pos.filename = filename;
-  perrf(pos, "wrong start of instruction\n | %s", it_str);
+  perrf(src_pos(src, it->off), "wrong start of instruction\n | %s", it_str);
 }
 
-void print_ident_err(TokenStream its, const char* filename) {
+void print_ident_err(TokenStream its, Source* src) {
   const Token* ctrlflow_it = its_next(&its);
   TOKEN_STR(ctrlflow_str, ctrlflow_it);
   char* ctrlflow_spacer = (char*) calloc (strlen(ctrlflow_str) + 1, sizeof(char));
@@ -254,15 +235,13 @@ void print_ident_err(TokenStream its, const char* filename) {
   assert(pointer != NULL);
   memset(pointer, '^', strlen(no_id_str));
 
-  Pos display_pos = no_ident->pos;
+  Offset display_off = no_ident->off;
   if (no_ident->t == TK_NONE) {
     /* Correct the position in none tokens. */
-    display_pos.cl = strlen(ctrlflow_str) + ctrlflow_it->pos.cl + 1;
-    display_pos.ln = ctrlflow_it->pos.ln;
+    display_off = strlen(ctrlflow_str) + ctrlflow_it->off + 1;
   }
-  display_pos.filename = filename;
 
-  perrf(display_pos,
+  perrf(src_pos(src, display_off),
     "wrong token, expected an identifier\n"
     " | %s %s\n"  // <- Scanned instruction.
     " | %s %s",  // <- Error marker.
@@ -274,14 +253,14 @@ void print_ident_err(TokenStream its, const char* filename) {
   free(pointer);
 }
 
-static inline int map_inst(TokenStream* its, Inst* inst, const char* filename) {
-  (void) filename;
+static inline int map_inst(TokenStream* its, Inst* inst, Source* src) {
+  (void) src;
 
   assert(its != NULL);
   assert(inst != NULL);
 
   const Token* it = its_next(its);
-  inst->pos = it->pos;
+  inst->off = it->off;
 
   // Any token which points to this function
   // maps 1:1 to its instruction code.
@@ -290,12 +269,12 @@ static inline int map_inst(TokenStream* its, Inst* inst, const char* filename) {
   return PARSE_OK;
 }
 
-static inline int memory_inst(TokenStream* its, Inst* inst, const char* filename) {
+static inline int memory_inst(TokenStream* its, Inst* inst, Source* src) {
   assert(its != NULL);
   assert(inst != NULL);
 
   const Token* mem_it = its_next(its);
-  inst->pos = mem_it->pos;
+  inst->off = mem_it->off;
   // The tokens `TK_PUSH` and `TK_POP` map
   // to their instruction codes, too.
   inst->code = (enum InstCode) mem_it->t;
@@ -306,7 +285,7 @@ static inline int memory_inst(TokenStream* its, Inst* inst, const char* filename
       // Segment tokens map 1:1 to their codes, too!
       inst->mem.seg = (Segment) its_next(its)->t;
   } else {
-    print_expect2_err(its_slice(its, 1, 1), "a segment", filename);
+    print_expect2_err(its_slice(its, 1, 1), "a segment", src);
     return PARSE_ERR;
   }
 
@@ -314,55 +293,55 @@ static inline int memory_inst(TokenStream* its, Inst* inst, const char* filename
   if (its_lh(its)->t == TK_UINT) {
     inst->mem.offset = its_next(its)->uilit;
   } else {
-    print_expect3_err(its_slice(its, 2, 1), "an offset", filename);
+    print_expect3_err(its_slice(its, 2, 1), "an offset", src);
     return PARSE_ERR;
   }
   return PARSE_OK;
 }
 
-static inline int goto_inst(TokenStream* its, Inst* inst, const char* filename) {
+static inline int goto_inst(TokenStream* its, Inst* inst, Source* src) {
   assert(its != NULL);
   assert(inst != NULL);
 
   const Token* goto_it = its_next(its);  // Consume `goto`.
-  inst->pos = goto_it->pos;
+  inst->off = goto_it->off;
   inst->code = (enum InstCode) goto_it->t;
 
   if (its_lh(its)->t == TK_IDENT) {
     strcpy(inst->ident, its_next(its)->ident);
   } else {
-    print_ident_err(its_slice(its, 1, 1), filename);
+    print_ident_err(its_slice(its, 1, 1), src);
     return PARSE_ERR;
   }
 
   return PARSE_OK;
 }
 
-static inline int if_goto_inst(TokenStream* its, Inst* inst, const char* filename) {
+static inline int if_goto_inst(TokenStream* its, Inst* inst, Source* src) {
   assert(its != NULL);
   assert(inst != NULL);
 
   const Token* if_goto_it = its_next(its);  // Consume `if-goto`.
-  inst->pos = if_goto_it->pos;
+  inst->off = if_goto_it->off;
   inst->code = (enum InstCode) if_goto_it->t;
 
   if (its_lh(its)->t == TK_IDENT) {
     strcpy(inst->ident, its_next(its)->ident);
   } else {
-    print_ident_err(its_slice(its, 1, 1), filename);
+    print_ident_err(its_slice(its, 1, 1), src);
     return PARSE_ERR;
   }
 
   return PARSE_OK;
 }
 
-static inline int label_meta(TokenStream* its, SymbolTable* st, size_t num_inst, const char* filename) {
+static inline int label_meta(TokenStream* its, SymbolTable* st, size_t num_inst, Source* src) {
   assert(its != NULL);
   assert(st != NULL);
   
   // This function is only called if the return value
   // of this call is `TK_LABEL`.
-  Pos pos = its_next(its)->pos;
+  Offset off = its_next(its)->off;
 
   if (its_lh(its)->t == TK_IDENT) {
     const char* ident = its_next(its)->ident;
@@ -370,14 +349,14 @@ static inline int label_meta(TokenStream* its, SymbolTable* st, size_t num_inst,
     SymVal val = mk_lbval(num_inst);
     if (st != NULL) {
       if (insert_st(st, key, val) == INRES_EXISTS)  {
-        print_multi_def_err(&key, &val, pos, filename);
+        print_multi_def_err(&key, &val, off, src);
         return PARSE_ERR;
       }
     }
     else
       warn_no_st(&key, &val);
   } else {
-    print_ident_err(its_slice(its, 1, 1), filename);
+    print_ident_err(its_slice(its, 1, 1), src);
     return PARSE_ERR;
   }
 
@@ -388,19 +367,19 @@ static inline int function_inst(
   TokenStream* its,
   SymbolTable* st,
   size_t num_inst,
-  const char* filename
+  Source* src
 ) {
   assert(its != NULL);
 
   /* Consume `TK_FUNC` only keeping the position. */
-  Pos pos = its_next(its)->pos;
+  Offset off = its_next(its)->off;
 
   const char* ident = NULL;
 
   if (its_lh(its)->t == TK_IDENT) {
     ident = its_next(its)->ident;
   } else {
-    print_ident_err(its_slice(its, 1, 1), filename);
+    print_ident_err(its_slice(its, 1, 1), src);
     return PARSE_ERR;
   }
 
@@ -412,7 +391,7 @@ static inline int function_inst(
     print_expect3_err(
       its_slice(its, 2, 1),
       "the number of locals",
-      filename
+      src
     );
   }
 
@@ -421,7 +400,7 @@ static inline int function_inst(
 
   if (st != NULL) {
     if (insert_st(st, key, val) == INRES_EXISTS)  {
-      print_multi_def_err(&key, &val, pos, filename);
+      print_multi_def_err(&key, &val, off, src);
       return PARSE_ERR;
     }
   }
@@ -431,31 +410,31 @@ static inline int function_inst(
   return PARSE_OK;
 }
 
-static inline int call_inst(TokenStream* its, Inst* inst, const char* filename) {
+static inline int call_inst(TokenStream* its, Inst* inst, Source* src) {
   assert(its != NULL);
   assert(inst != NULL);
 
   const Token* call_it = its_next(its);
-  inst->pos = call_it->pos;
+  inst->off = call_it->off;
   inst->code = (enum InstCode) call_it->t;
 
   if (its_lh(its)->t == TK_IDENT) {
     strcpy(inst->ident, its_next(its)->ident);
   } else {
-    print_ident_err(its_slice(its, 1, 1), filename);
+    print_ident_err(its_slice(its, 1, 1), src);
     return PARSE_ERR;
   }
 
   if (its_lh(its)->t == TK_UINT) {
     inst->nargs = its_next(its)->uilit;
   } else {
-    print_expect3_err(its_slice(its, 2, 1), "the number of arguments", filename);
+    print_expect3_err(its_slice(its, 2, 1), "the number of arguments", src);
   }
   
   return PARSE_OK;
 }
 
-typedef int(*ParseFnPtr)(TokenStream*, Inst*, const char*);
+typedef int(*ParseFnPtr)(TokenStream*, Inst*, Source*);
 static ParseFnPtr parse_fns[] = {
   [TK_ADD]=map_inst,
   [TK_SUB]=map_inst,
@@ -511,7 +490,7 @@ int parse(const Tokens* tokens, Insts* insts, SymbolTable* st) {
     // Error if the token can't be the beginning
     // of an instruction.
     if (!is_inst_token(it->t)) {
-      print_token_err(it, tokens->filename);
+      print_token_err(it, tokens->src);
       return PARSE_ERR;
     }
 
@@ -528,7 +507,7 @@ int parse(const Tokens* tokens, Insts* insts, SymbolTable* st) {
           &its,
           st,
           insts->idx + st_num_inst,
-          tokens->filename
+          tokens->src
         );
         break;
       case TK_FUNC:
@@ -536,7 +515,7 @@ int parse(const Tokens* tokens, Insts* insts, SymbolTable* st) {
           &its,
           st,
           insts->idx + st_num_inst,
-          tokens->filename
+          tokens->src
         );
         break;
       default:
@@ -544,14 +523,9 @@ int parse(const Tokens* tokens, Insts* insts, SymbolTable* st) {
         // the token stream. A parse function might
         // advance by any number but has to stop
         // if it reaches the end of the input.
+        insts->cell[insts->idx] = NULL_INST;
         res =
-          parse_fns[it->t](&its, &insts->cell[insts->idx], tokens->filename);
-        /* Set the a pointer to the filename of
-         * the instruction's source file in the
-         * position instance. This is only a copy
-         * of the pointer and must not be freed or
-         * modified at any point. */
-        insts->cell[insts->idx].pos.filename = insts->filename;
+          parse_fns[it->t](&its, &insts->cell[insts->idx], tokens->src);
         insts->idx ++;
         break;
     }
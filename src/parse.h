@@ -40,12 +40,16 @@ typedef struct {
     // `TK_IDENT` is the last token (must be since it has the
     // lowest precedence). Therefore it's used from here on out
     // to ensure that there is no overlap.
-    BUILTIN_PRINT_CHAR=(TK_IDENT + 1),
-    BUILTIN_PRINT_NUM,
-    BUILTIN_PRINT_STR,
-    BUILTIN_READ_CHAR,
-    BUILTIN_READ_NUM,
-    BUILTIN_READ_STR,
+    // Runs the native function `builtin.index` (see `native.h`).
+    BUILTIN=(TK_IDENT + 1),
+    // Optimized instructions. They can't be written in
+    // source code either but are produced by `opt_prog`.
+    IF_NOT_GOTO,
+    // `call` followed by `return`. Reuses the caller's frame.
+    TAIL_CALL,
+    // `call` of a builtin function. Runs the builtin
+    // directly on the caller's stack without a frame.
+    CALL_BUILTIN,
   } code;
 
   union {
@@ -54,26 +58,39 @@ typedef struct {
       Segment seg;
       uint16_t offset;
     } mem;
-    // Identifier (set for `GOTO`, `IF_GOTO` and `CALL`).
+    // Identifier (set for `GOTO`, `IF_GOTO`, `IF_NOT_GOTO`, `CALL`,
+    // `TAIL_CALL` and `CALL_BUILTIN`). Name of the native for `BUILTIN`.
     char ident[MAX_IDENT_LEN + 1];
   };
 
   /* This field is separate from the above
    * union so  that `ident` and `nargs` can
    * both be set for `CALL`.
-   * Number of arguments (set for `CALL`):
+   * Number of arguments (set for `CALL`, `TAIL_CALL` and `CALL_BUILTIN`):
    */
   uint16_t nargs;
 
-  // Original position in source file.
-  Pos pos;
+  // Native run by `BUILTIN` and `CALL_BUILTIN`. For the
+  // latter also the number of arguments the native takes
+  // and the position of its `BUILTIN` in the system file.
+  struct {
+    unsigned int index;
+    uint16_t nargs;
+    Offset off;
+  } builtin;
+
+  // Original byte offset in source file.
+  Offset off;
+  // Source file of instructions which were inlined from
+  // another file. `NULL` if it's the file's own source.
+  Source* src;
 } Inst;
 
 typedef struct {
   size_t idx;
   size_t len;
   Inst* cell;
-  char* filename;
+  Source* src;
 } Insts;
 
 // Initialize a new `Insts` instance.
@@ -0,0 +1,144 @@
+#include "pos.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#ifndef NL_BLOCK_SIZE
+#define NL_BLOCK_SIZE 0x400
+#endif  // NL_BLOCK_SIZE
+
+#ifndef READ_BLOCK_SIZE
+#define READ_BLOCK_SIZE 0x10000
+#endif  // READ_BLOCK_SIZE
+
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+Source* new_src(const char* filename) {
+  if (filename == NULL) return NULL;
+
+  Source* src = (Source*) calloc (1, sizeof(Source));
+  assert(src != NULL);
+
+  src->filename = (char*) calloc (strlen(filename) + 1, sizeof(char));
+  assert(src->filename != NULL);
+  strcpy(src->filename, filename);
+
+  return src;
+}
+
+void del_src(Source* src) {
+  if (src != NULL) {
+    free(src->filename);
+    free(src->buf);
+    free(src->nl);
+    free(src);
+  }
+}
+
+Offset src_append(Source* src, const char* text, size_t len) {
+  assert(src != NULL);
+  assert(text != NULL);
+
+  Offset start = (Offset) src->len;
+  src->buf = (char*) realloc (src->buf, src->len + len);
+  assert(src->buf != NULL);
+  memcpy(src->buf + src->len, text, len);
+  src->len += len;
+
+  /* The index is out of date now. */
+  free(src->nl);
+  src->nl = NULL;
+  src->nnl = 0;
+  src->indexed = 0;
+
+  return start;
+}
+
+static void index_blk(Source* src, const char* blk, size_t len, size_t base) {
+  for (size_t i = 0; i < len; i++) {
+    if (blk[i] == '\n') {
+      if (src->nnl % NL_BLOCK_SIZE == 0) {
+        src->nl = (Offset*) realloc (src->nl,
+          (src->nnl + NL_BLOCK_SIZE) * sizeof(Offset));
+        assert(src->nl != NULL);
+      }
+      src->nl[src->nnl ++] = (Offset) (base + i);
+    }
+  }
+}
+
+Source* new_src_buf(const char* name, const char* text, size_t len) {
+  assert(name != NULL);
+  assert(text != NULL || len == 0);
+
+  Source* src = new_src(name);
+  index_blk(src, text, len, 0);
+  src->indexed = 1;
+  return src;
+}
+
+/* Build the newline index of `src`. If neither the
+ * buffer nor the file is available, the index stays
+ * empty and every offset is on the first line. */
+static void index_src(Source* src) {
+  if (src->buf != NULL) {
+    index_blk(src, src->buf, src->len, 0);
+    return;
+  }
+
+  int fd = open(src->filename, O_RDONLY);
+  if (fd == -1) return;
+
+  char* blk = (char*) malloc (READ_BLOCK_SIZE * sizeof(char));
+  assert(blk != NULL);
+
+  size_t base = 0;
+  ssize_t nread;
+  while ((nread = read(fd, blk, READ_BLOCK_SIZE)) > 0) {
+    index_blk(src, blk, (size_t) nread, base);
+    base += (size_t) nread;
+  }
+
+  free(blk);
+  close(fd);
+}
+
+Pos src_pos(Source* src, Offset off) {
+  if (src == NULL) {
+    return (Pos) { .ln=0, .cl=off, .filename=NULL };
+  }
+
+  /* Programs which share their sources can run on different
+   * threads, so only one of them builds the index. */
+  if (!__atomic_load_n(&src->indexed, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&index_lock);
+    if (!src->indexed) {
+      index_src(src);
+      __atomic_store_n(&src->indexed, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&index_lock);
+  }
+
+  /* Find the number of newlines before `off`. This
+   * is the (zero-based) line `off` is on. */
+  size_t lo = 0;
+  size_t hi = src->nnl;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (src->nl[mid] < off) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return (Pos) {
+    .ln=lo,
+    .cl=lo == 0 ? off : off - src->nl[lo - 1] - 1,
+    .filename=src->filename,
+  };
+}
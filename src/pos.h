@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef _POS_H_
+#define _POS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Byte offset into a source file. Tokens and
+ * instructions only store this offset. Line and
+ * column are computed from it when they're needed
+ * to print an error or warning. */
+typedef uint32_t Offset;
+
+typedef struct {
+  unsigned int ln;
+  unsigned int cl;
+  const char* filename;
+} Pos;
+
+/* Source of a file's tokens and instructions. */
+typedef struct {
+  char* filename;
+  /* Optional copy of the source text. If it's `NULL`,
+   * the text is read from `filename` when the
+   * newline index is built. */
+  char* buf;
+  size_t len;
+  /* Offsets of all newline characters. Built lazily
+   * the first time a position is requested. */
+  Offset* nl;
+  size_t nnl;
+  int indexed;
+} Source;
+
+/* Create a new source for the given file name. Returns
+ * `NULL` if `filename` is `NULL`. Positions in a `NULL`
+ * source only consist of line `0` and column `off`. */
+Source* new_src(const char* filename);
+
+/* Create a source named `name` for `len` bytes of `text` in
+ * memory. The newline index is built right away, so positions
+ * can be found after `text` is gone. */
+Source* new_src_buf(const char* name, const char* text, size_t len);
+
+/* Delete a source and its newline index. */
+void del_src(Source* src);
+
+/* Append `len` bytes to the source text in `src->buf`.
+ * Returns the offset at which the text starts. */
+Offset src_append(Source* src, const char* text, size_t len);
+
+/* Translate `off` into a line and a column in `src`.
+ * If the source text can't be read, line `0` and
+ * column `off` are returned. */
+Pos src_pos(Source* src, Offset off);
+
+/* Unresolved position of an instruction. */
+typedef struct {
+  Source* src;
+  Offset off;
+} Loc;
+
+#define LOC_POS(loc) src_pos((loc).src, (loc).off)
+
+#endif  // _POS_H_
@@ -1,4 +1,5 @@
 #include "prog.h"
+#include "native.h"
 
 #include "scan.h"
 #include "msg.h"
@@ -6,6 +7,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 Stack new_stack(void) {
   Stack s = {
@@ -65,31 +67,33 @@ int spop(Stack* stack, Word* val) {
 }
 
 Heap new_heap(void) {
-  Heap h = {
-    ._this = 0,
-    .that = 0,
-  };
-  h.mem = (Word*) calloc (MEM_HEAP_SIZE, sizeof(Word));
+  /* The pointers are stored behind all 16-bit addresses. */
+  Heap h = { .mask=0, .os=NULL };
+  h.mem = (Word*) calloc (MEM_HEAP_WORDS + 2, sizeof(Word));
   assert(h.mem != NULL);
+  h._this = &h.mem[MEM_HEAP_WORDS];
+  h.that = &h.mem[MEM_HEAP_WORDS + 1];
   return h;
 }
 
 void del_heap(Heap h) {
-  free(h.mem);
+  if (h.mask != 0) {
+    munmap(h.mem, RAM_MAP_WORDS * sizeof(Word));
+  } else {
+    free(h.mem);
+  }
+  free(h.os);
 }
 
 Word heap_get(const Heap h, Addr addr) {
   assert(h.mem != NULL);
-  // No need to check out of range errors
-  // since `heap.mem` has 0xFFFF entries
-  // and `Addr` can't be larger than that.
-  // Rare case of C type-safety ...
+  assert(in_heap(&h, addr));
   return h.mem[addr];
 }
 
 void heap_set(Heap h, Addr addr, Word val) {
   assert(h.mem != NULL);
-  // See `heap_get` about further range checks.
+  assert(in_heap(&h, addr));
   h.mem[addr] = val;
 }
 
@@ -118,145 +122,33 @@ void add_bii(Insts* insts, Inst add) {
   insts->cell[insts->idx] = add;
 
   /* Give the instruction an automatic position.
-   * Without special formatting each instruction
-   * spans one line. Hence, we can translate the
-   * instruction index into the line. The column
-   * number can stay unchanged (0). */
-  insts->cell[insts->idx].pos.ln = insts->idx;
-  insts->cell[insts->idx].pos.filename = insts->filename;
+   * The source text of the system file is a listing
+   * of its instructions, one per line. Hence, the
+   * line is the instruction index and the column
+   * is always 0. */
+  INST_STR(line, &add);
+  insts->cell[insts->idx].off =
+    src_append(insts->src, line, strlen(line));
+  src_append(insts->src, "\n", 1);
 
   insts->idx ++;
 }
 
-/* NOTE: On adding another builtin.
- * Builtins work by defining an internal instructions which
- * implements the desired function and exposing it wrapped
- * in a regular function. To add a new one changes have to
- * be made in the following files.
- *
- *   1. Add the wrapping function to the
- *      system functions here (`src/prog.c`).
- *   2. Add the new internal instruction to `InstCode`
- *      in `src/parse.h`.
- *   3. Add the builtin's name to `inst_str` in `src/parse.c`.
- *   4. Add a `case NEW_BUILTIN` to `exec_prog` which
- *      executes the builtin's implementation in `src/exec.c`.
- *
- */
-
-void builtin_print_char(File* file) {
-  assert(file != NULL);
-
-  /*
-   * `Sys.print_char (c) -> 0`
-   * prints the given character.
-   */
-
-  insert_st(&file->st,
-    mk_key("Sys.print_char", SBT_FUNC),
-    mk_fnval(file->insts.idx, 0));
-
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=ARG, .offset=0 }});
-  add_bii(&file->insts, (Inst) { .code=BUILTIN_PRINT_CHAR });
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=CONST, .offset=0 }});
-  add_bii(&file->insts, (Inst) { .code=RET });
-}
-
-void builtin_print_num(File* file) {
-  assert(file != NULL);
-
-  /*
-   * `Sys.print_num (num) -> 0`
-   * prints the given number as an unsigned integer.
-   */
-
-  insert_st(&file->st,
-    mk_key("Sys.print_num", SBT_FUNC),
-    mk_fnval(file->insts.idx, 0));
-
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=ARG, .offset=0 }});
-  add_bii(&file->insts, (Inst) { .code=BUILTIN_PRINT_NUM });
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=CONST, .offset=0 }});
-  add_bii(&file->insts, (Inst) { .code=RET });
-}
-
-void builtin_print_str(File* file) {
-  assert(file != NULL);
-
-  /*
-   * `Sys.print_str (nchars, addr) -> 0`
-   * prints a character array of length `nchars`.
-   * `nchars` is placed on stack below `addr`.
-   */
-
-  insert_st(&file->st,
-    mk_key("Sys.print_str", SBT_FUNC),
-    mk_fnval(file->insts.idx, 0));
-
-  // Push `nchars` from the arguments onto stack.
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=ARG, .offset=0 }});
-  // Push `addr` from the arguments onto the stack.
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=ARG, .offset=1 }});
-  add_bii(&file->insts, (Inst) { .code=BUILTIN_PRINT_STR });
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=CONST, .offset=0 }});
-  add_bii(&file->insts, (Inst) { .code=RET });
-}
-
-void builtin_read_char(File* file) {
-  assert(file != NULL);
-
-  /*
-   * `Sys.read_char() -> char`
-   * reads a single character and returns it.
-   */
-
-  insert_st(&file->st,
-    mk_key("Sys.read_char", SBT_FUNC),
-    mk_fnval(file->insts.idx, 0));
-
-  // Read a character.
-  add_bii(&file->insts, (Inst) { .code=BUILTIN_READ_CHAR });
-  // Return the character.
-  add_bii(&file->insts, (Inst) { .code=RET });
-}
-
-void builtin_read_num(File* file) {
+/* Add a wrapper function for the native `index`. It pushes
+ * the arguments, runs the native and returns its result. */
+void builtin_native(File* file, unsigned int index) {
   assert(file != NULL);
 
-  /*
-   * `Sys.read_num() -> num`
-   * reads a single unsigned integer and returns it.
-   */
-
+  const Native* native = get_native(index);
   insert_st(&file->st,
-    mk_key("Sys.read_num", SBT_FUNC),
+    mk_key(native->name, SBT_FUNC),
     mk_fnval(file->insts.idx, 0));
 
-  add_bii(&file->insts, (Inst) { .code=BUILTIN_READ_NUM });
-  add_bii(&file->insts, (Inst) { .code=RET });
-}
-
-void builtin_read_str(File* file) {
-  assert(file != NULL);
-
-  /*
-   * `Sys.read_str(addr) -> nchars`
-   * reads a line and stores it on heap starting at `addr`.
-   * The number of characters stored is returned.
-   * The stored string doesn't include the terminating
-   * newline character.
-   */
-
-  insert_st(&file->st,
-    mk_key("Sys.read_str", SBT_FUNC),
-    mk_fnval(file->insts.idx, 1));
-
-  // Push heap address to store the read string.
-  add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=ARG, .offset=0 }});
-  // Read a line and store the string at this heap address.
-  // `BUILTIN_READ_STR` pushes the number of chars read on stack.
-  add_bii(&file->insts, (Inst) { .code=BUILTIN_READ_STR });
-  // Return the number of read characters (pushed by `BUILTIN_READ_STR`).
+  for (uint16_t i = 0; i < native->nargs; i++)
+    add_bii(&file->insts, (Inst) { .code=PUSH, .mem={ .seg=ARG, .offset=i }});
+  Inst builtin = { .code=BUILTIN, .builtin={ .index=index } };
+  strcpy(builtin.ident, native->name);
+  add_bii(&file->insts, builtin);
   add_bii(&file->insts, (Inst) { .code=RET });
 }
 
@@ -273,13 +165,8 @@ void init_system_file(File* file) {
   file->mem = new_mem();
 
   /* Store builtin functions in system file. */
-  
-  builtin_print_char(file);
-  builtin_print_num(file);
-  builtin_print_str(file);
-  builtin_read_char(file);
-  builtin_read_num(file);
-  builtin_read_str(file);
+  for (unsigned int i = 0; i < count_natives(); i++)
+    builtin_native(file, i);
 
   /* Add startup code (must be at the very end).
    * This first pushed the number of arguments `Sys.init`
@@ -292,39 +179,32 @@ void init_system_file(File* file) {
 #define PROC_ERR 0
 #define PROC_OK 1
 
-int proc_file(File* file, const char* fn) {
-  assert(file != NULL);
-  assert(fn != NULL);
-
-  /* 1. Scan */
-  Tokens tokens = new_tokens(fn);
-  int scan_res = scan(&tokens);
-  if (scan_res == SCAN_ERR) { 
-    del_tokens(tokens);
-    return PROC_ERR;
-  }
-
-  /* 2. Parse */
+/* Parse the scanned `tokens` of the source `name` into `file`. */
+static int proc_tokens(File* file, Tokens* tokens, const char* name) {
+  /* 2. Parse. The instructions take over the tokens'
+   * source, so its newline index is only built once. */
   file->st = new_st();
-  file->insts = new_insts(fn);
-  int parse_res = parse(&tokens, &file->insts, &file->st);
-  del_tokens(tokens);
+  file->insts = new_insts(NULL);
+  int parse_res = parse(tokens, &file->insts, &file->st);
+  file->insts.src = tokens->src;
+  tokens->src = NULL;
+  del_tokens(*tokens);
   if (parse_res == PARSE_ERR) {
     del_st(file->st);
     del_insts(file->insts);
     return PROC_ERR;
   }
 
-  /* Now we know the source code in `fn` is a
+  /* Now we know the source code in `name` is a
    * valid source file. Next all other members
    * of the file instance are initialized. */
 
   file->mem = new_mem();
 
   file->filename =
-    (char*) calloc (strlen(fn) + 1, sizeof(char));
+    (char*) calloc (strlen(name) + 1, sizeof(char));
   assert(file->filename != NULL);
-  strcpy(file->filename, fn);
+  strcpy(file->filename, name);
 
   /* Should already be `0`. */
   file->ei = 0;
@@ -332,9 +212,39 @@ int proc_file(File* file, const char* fn) {
   return PROC_OK;
 }
 
-Program* make_prog(unsigned int nfn, const char* fn[]) {
+int proc_file(File* file, const char* fn) {
+  assert(file != NULL);
   assert(fn != NULL);
 
+  /* 1. Scan */
+  Tokens tokens = new_tokens(fn);
+  int scan_res = scan(&tokens);
+  if (scan_res == SCAN_ERR) { 
+    del_tokens(tokens);
+    return PROC_ERR;
+  }
+
+  return proc_tokens(file, &tokens, fn);
+}
+
+/* `proc_file` for a source in memory. */
+static int proc_buf(File* file, const SourceBuf* buf) {
+  assert(file != NULL);
+  assert(buf->name != NULL);
+
+  /* 1. Scan */
+  Tokens tokens = new_buf_tokens(buf->name, buf->text, buf->len);
+  int scan_res = scan_buf(&tokens, buf->text, buf->len);
+  if (scan_res == SCAN_ERR) {
+    del_tokens(tokens);
+    return PROC_ERR;
+  }
+
+  return proc_tokens(file, &tokens, buf->name);
+}
+
+/* Program with only the system file and room for `nfiles` more. */
+static Program* new_prog(unsigned int nfiles) {
   Program* prog =
     (Program*) calloc (1, sizeof(Program));
   assert(prog != NULL);
@@ -342,14 +252,20 @@ Program* make_prog(unsigned int nfn, const char* fn[]) {
   prog->heap = new_heap();
   prog->stack = new_stack();
 
-  /* Allocate `nfn + 1` for the startup code. */
-  prog->files = (File*) calloc (nfn + 1, sizeof(File));
+  /* Allocate `nfiles + 1` for the startup code. */
+  prog->files = (File*) calloc (nfiles + 1, sizeof(File));
   assert(prog->files != NULL);
 
   /* Store the system code (startup code, builtins etc.)
    * the first file. `fi` starts in this file. */
   init_system_file(&prog->files[prog->nfiles ++]);
-  
+  return prog;
+}
+
+Program* make_prog(unsigned int nfn, const char* fn[]) {
+  assert(fn != NULL);
+
+  Program* prog = new_prog(nfn);
   for (; prog->nfiles <= nfn; prog->nfiles++) {
     warn_file_ext(fn[prog->nfiles - 1]);
     if (proc_file(
@@ -364,6 +280,20 @@ Program* make_prog(unsigned int nfn, const char* fn[]) {
   return prog;
 }
 
+Program* make_prog_bufs(unsigned int nbufs, const SourceBuf bufs[]) {
+  assert(bufs != NULL || nbufs == 0);
+
+  Program* prog = new_prog(nbufs);
+  for (; prog->nfiles <= nbufs; prog->nfiles++) {
+    if (proc_buf(&prog->files[prog->nfiles], &bufs[prog->nfiles - 1]) == PROC_ERR) {
+      del_prog(prog);
+      return NULL;
+    }
+  }
+
+  return prog;
+}
+
 void del_mem(Memory mem) {
   free(mem._static);
   free(mem.tmp);
@@ -381,7 +311,14 @@ void del_file(File* file) {
 void del_prog(Program* prog) {
   if (prog != NULL) {
     for (unsigned int i = 0; i < prog->nfiles; i++) {
-      del_file(&prog->files[i]);
+      /* The segments are part of the RAM. */
+      if (prog->heap.mask != 0) prog->files[i].mem = (Memory) { NULL, NULL };
+      /* The rest of the file belongs to the original. */
+      if (prog->origin != NULL) {
+        del_mem(prog->files[i].mem);
+      } else {
+        del_file(&prog->files[i]);
+      }
     }
     del_heap(prog->heap);
     del_stack(prog->stack);
@@ -389,3 +326,135 @@ void del_prog(Program* prog) {
     free(prog);
   }
 }
+
+/* Report the segment access `inst` of `file` which doesn't fit
+ * into the RAM's segment of `nentries` words. */
+static void ram_error(const File* file, const Inst* inst, size_t nentries) {
+  INST_STR(inst_str_buf, inst);
+  Loc loc = { inst->src != NULL ? inst->src : file->insts.src, inst->off };
+  perrf(LOC_POS(loc), "address overflow in `%s`: "
+    "segment has %lu entries in the RAM", inst_str_buf, nentries);
+}
+
+/* Map a unified RAM of `size` words. Everything after the
+ * RAM is a guard region, so accessing it faults instead of
+ * being checked (see `exec.c`). */
+static Heap new_ram(size_t size) {
+  Heap ram = { .mask=size - 1, .os=NULL };
+  ram.mem = (Word*) mmap(NULL, RAM_MAP_WORDS * sizeof(Word), PROT_NONE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  assert(ram.mem != MAP_FAILED);
+  int res = mprotect(ram.mem, size * sizeof(Word), PROT_READ | PROT_WRITE);
+  assert(res == 0);
+  (void) res;
+  ram._this = &ram.mem[RAM_THIS];
+  ram.that = &ram.mem[RAM_THAT];
+  return ram;
+}
+
+int use_ram(Program* prog, size_t size) {
+  assert(prog != NULL);
+  assert(size >= MEM_MAPS_END && (size & (size - 1)) == 0);
+
+  /* Check all accesses first so nothing changes on errors. */
+  size_t nstatic = 0;
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    const File* file = &prog->files[fi];
+    size_t file_static = 0;
+    for (size_t i = 0; i < file->insts.idx; i++) {
+      const Inst* inst = &file->insts.cell[i];
+      if (inst->code != PUSH && inst->code != POP) continue;
+
+      if (inst->mem.seg == TMP && inst->mem.offset >= RAM_TEMP_SIZE) {
+        ram_error(file, inst, RAM_TEMP_SIZE);
+        return 0;
+      }
+      if (inst->mem.seg == STAT && inst->mem.offset >= file_static) {
+        file_static = inst->mem.offset + 1;
+        if (RAM_STATIC + nstatic + file_static > RAM_STATIC_END) {
+          ram_error(file, inst, RAM_STATIC_END - RAM_STATIC - nstatic);
+          return 0;
+        }
+      }
+    }
+    nstatic += file_static;
+  }
+
+  del_heap(prog->heap);
+  Heap ram = new_ram(size);
+  prog->heap = ram;
+
+  /* Each file's statics follow the ones of the file before. */
+  size_t next = RAM_STATIC;
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    File* file = &prog->files[fi];
+    size_t file_static = 0;
+    for (size_t i = 0; i < file->insts.idx; i++) {
+      const Inst* inst = &file->insts.cell[i];
+      if ((inst->code == PUSH || inst->code == POP) && inst->mem.seg == STAT
+          && inst->mem.offset >= file_static)
+        file_static = inst->mem.offset + 1;
+    }
+
+    del_mem(file->mem);
+    file->mem._static = &ram.mem[next];
+    file->mem.tmp = &ram.mem[RAM_TEMP];
+    next += file_static;
+  }
+
+  return 1;
+}
+
+Program* clone_prog(const Program* prog) {
+  assert(prog != NULL);
+  assert(prog->origin == NULL);
+
+  Program* copy = (Program*) calloc (1, sizeof(Program));
+  assert(copy != NULL);
+  copy->origin = prog;
+  copy->nfiles = prog->nfiles;
+  copy->fi = prog->fi;
+  copy->heap = prog->heap.mask != 0 ? new_ram(prog->heap.mask + 1) : new_heap();
+  copy->stack = new_stack();
+
+  copy->files = (File*) calloc (prog->nfiles, sizeof(File));
+  assert(copy->files != NULL);
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    const File* file = &prog->files[fi];
+    copy->files[fi] = *file;
+    if (prog->heap.mask != 0) {
+      /* The segments are at the same addresses in the new RAM. */
+      copy->files[fi].mem._static = &copy->heap.mem[file->mem._static - prog->heap.mem];
+      copy->files[fi].mem.tmp = &copy->heap.mem[RAM_TEMP];
+    } else {
+      copy->files[fi].mem = new_mem();
+    }
+  }
+
+  return copy;
+}
+
+size_t prog_size(const Program* prog) {
+  assert(prog != NULL);
+
+  size_t size = sizeof(Program) + prog->nfiles * sizeof(File);
+  size += prog->stack.len * sizeof(Word);
+  size += prog->heap.mask != 0
+    ? (prog->heap.mask + 1) * sizeof(Word)
+    : (MEM_HEAP_WORDS + 2) * sizeof(Word);
+
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    const File* file = &prog->files[fi];
+    if (prog->heap.mask == 0)
+      size += (MEM_STAT_SIZE + MEM_TEMP_SIZE) * sizeof(Word);
+    if (prog->origin != NULL) continue;
+
+    size += file->insts.len * sizeof(Inst);
+    size += file->st.len * sizeof(Symbol);
+    if (file->filename != NULL) size += strlen(file->filename) + 1;
+    const Source* src = file->insts.src;
+    if (src != NULL)
+      size += sizeof(Source) + src->len + src->nnl * sizeof(Offset);
+  }
+  return size;
+}
@@ -6,10 +6,59 @@
 #include "st.h"
 #include "parse.h"
 
+#include <setjmp.h>
+
 // Single RAM word.
 typedef uint16_t Word;
 
+/* NOTE: Boolean operations return 0xFFFF (-1)
+ * if the result is true. Otherwise they return
+ * 0x0000 (false). Any value which is not 0x0000
+ * is interpreted as being true.
+ */
+
+# define TRUE 0xFFFF
+# define FALSE 0
+
 #define MEM_HEAP_SIZE 0x1000lu
+
+/* The screen memory map of the Hack platform. It's a 512x256
+ * pixel black and white framebuffer with 32 words per row. The
+ * lowest bit of a word is its leftmost pixel. The screen can be
+ * accessed through `this` and `that` just like the heap. */
+#define MEM_SCREEN 0x4000lu
+#define MEM_SCREEN_SIZE 0x2000lu
+
+/* The keyboard memory map. It holds the code of the key which
+ * is currently pressed or `0` if there is none. */
+#define MEM_KBD 0x6000lu
+#define MEM_MAPS_END (MEM_KBD + 1)
+
+#define SCREEN_WIDTH 512
+#define SCREEN_HEIGHT 256
+#define SCREEN_ROW_WORDS (SCREEN_WIDTH / 16)
+
+#define IN_MAPS(addr) ((addr) >= MEM_SCREEN && (addr) < MEM_MAPS_END)
+
+/* The separate heap has a word for every 16-bit address. Without
+ * the checks (`--unchecked`), addresses are only cast to `Addr`,
+ * so they must all stay within it. */
+#define MEM_HEAP_WORDS 0x10000lu
+
+/* The unified RAM (see `use_ram`) puts everything at its address
+ * on the Hack platform. The heap is between the statics and the
+ * screen. The stack stays separate since it grows on demand. */
+#define RAM_THIS 3
+#define RAM_THAT 4
+#define RAM_TEMP 5
+#define RAM_TEMP_SIZE 8lu
+#define RAM_STATIC 16
+#define RAM_STATIC_END 256
+#define RAM_HEAP_END MEM_SCREEN
+
+/* `this` and `that` can reach `0xFFFF + 0xFFFF`. The unified
+ * RAM reserves this many words and protects those after it. */
+#define RAM_MAP_WORDS 0x20000lu
 #define MEM_STAT_SIZE 0x100lu
 #define MEM_TEMP_SIZE 0x10lu
 
@@ -54,16 +103,28 @@ void del_stack(Stack s);
 // Machine address in 16-bit RAM.
 typedef uint16_t Addr;
 
-// Heap. Addressable range [0;0xFFFF].
+// Heap. Addressable range [0;MEM_HEAP_SIZE) and the memory maps
+// or all of the RAM with `use_ram`.
 typedef struct {
   Word* mem;
-  size_t _this;
-  size_t that;
+  Word* _this;  // The pointers are words in `mem` which
+  Word* that;   // `this` and `that` can't access.
+  size_t mask;  // `0` unless `mem` is the unified RAM.
+  void* os;  // State of the native OS classes (see `jack.h`).
 } Heap;
 
 // Allocate and initialize a new heap.
 Heap new_heap(void);
 
+// Can `this` and `that` access `addr`? In the unified
+// RAM, that's the case if it's within the mask. Its
+// guard pages make the check unnecessary for `mem` itself.
+static inline int in_heap(const Heap* h, size_t addr) {
+  if (h->mask != 0) return (addr & ~h->mask) == 0;
+  return addr < MEM_HEAP_SIZE || IN_MAPS(addr);
+}
+
+// The caller must check the address with `in_heap`.
 Word heap_get(const Heap h, Addr addr);
 
 void heap_set(Heap h, Addr addr, Word val);
@@ -84,18 +145,53 @@ typedef struct {
   unsigned int ei;  /* execution index into  `insts`. */
 } File;
 
-typedef struct {
+typedef struct Program Program;
+
+struct Program {
   File* files;  /* files for all sources. */
   unsigned int nfiles;  /* number of files in `files`. */
   unsigned int fi;  /* file index into `files`. */
   Heap heap;  /* Program heap memory. */
   Stack stack;  /* Program stack memory. */
-} Program;
+  jmp_buf env;  /* Where runtime errors return to (see `exec.c`). */
+  sigjmp_buf guard_env;  /* Where faults on the RAM's guard pages return to. */
+  const Program* origin;  /* Owner of the files' code (see `clone_prog`). */
+};
 
 /* Assemable the source code in all the given
  * files into an executable program. */
 Program* make_prog(unsigned int nfn, const char** fn);
 
+/* Source code in memory. */
+typedef struct {
+  const char* name;  /* File name used in positions and for statics. */
+  const char* text;
+  size_t len;
+} SourceBuf;
+
+/* `make_prog` for sources in memory. The texts are only
+ * read while the program is made. */
+Program* make_prog_bufs(unsigned int nbufs, const SourceBuf* bufs);
+
+/* Replace the heap and the `static` and `temp` segments of
+ * all files by a single RAM of `size` words (a power of two
+ * of at least `MEM_MAPS_END`). Like on the Hack platform,
+ * `temp` has 8 words and the statics of all files share
+ * the 240 words from `RAM_STATIC`. Returns `0` and prints
+ * an error if the program's segments don't fit. */
+int use_ram(Program* prog, size_t size);
+
+/* Make a program which runs the code of `prog` from where
+ * `prog` starts, but with its own heap, stack and segments.
+ * The code isn't copied. It stays owned by `prog`, which
+ * mustn't change or be deleted before the copy. Copies of
+ * the same program can run on different threads. */
+Program* clone_prog(const Program* prog);
+
+/* Approximate number of bytes `prog` uses. Clones only
+ * count their own memory. */
+size_t prog_size(const Program* prog);
+
 void del_prog(Program* prog);
 
 #endif // _PROG_H_
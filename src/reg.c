@@ -0,0 +1,266 @@
+#include "reg.h"
+#include "link.h"
+#include "msg.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Get the operand `push <seg> <offset>` reads from. */
+static int src_opd(const Inst* inst, Opd* opd) {
+  if (inst->code != PUSH) return 0;
+
+  switch (inst->mem.seg) {
+    case CONST: opd->kind = OPD_CONST; break;
+    case LOC: opd->kind = OPD_LOC; break;
+    case ARG: opd->kind = OPD_ARG; break;
+    case STAT: opd->kind = OPD_STAT; break;
+    case TMP: opd->kind = OPD_TMP; break;
+    case THIS: opd->kind = OPD_THIS; break;
+    case THAT: opd->kind = OPD_THAT; break;
+    /* `pointer` changes `this` and `that`. */
+    default: return 0;
+  }
+  opd->index = inst->mem.offset;
+  return 1;
+}
+
+/* Get the operand `pop <seg> <offset>` writes to. */
+static int dst_opd(const Inst* inst, Opd* opd) {
+  if (inst->code != POP) return 0;
+
+  switch (inst->mem.seg) {
+    case CONST: opd->kind = OPD_NONE; break;
+    case LOC: opd->kind = OPD_LOC; break;
+    case ARG: opd->kind = OPD_ARG; break;
+    case STAT: opd->kind = OPD_STAT; break;
+    case TMP: opd->kind = OPD_TMP; break;
+    case THIS: opd->kind = OPD_THIS; break;
+    case THAT: opd->kind = OPD_THAT; break;
+    default: return 0;
+  }
+  opd->index = inst->mem.offset;
+  return 1;
+}
+
+static int is_binary(enum InstCode code) {
+  switch (code) {
+    case ADD: case SUB: case AND: case OR:
+    case EQ: case LT: case GT:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int is_unary(enum InstCode code) {
+  return code == NEG || code == NOT;
+}
+
+static int is_branch(enum InstCode code) {
+  return code == IF_GOTO || code == IF_NOT_GOTO;
+}
+
+/* Resolve the target of the jump or call `inst` in file `fi`. */
+static int resolve_inst(const Program* prog, unsigned int fi, const Inst* inst, RegInst* reg) {
+  SymVal val;
+  int is_call = inst->code == CALL || inst->code == TAIL_CALL;
+  SymKey key = mk_key(inst->ident, is_call ? SBT_FUNC : SBT_LABEL);
+  if (!resolve_symbol(prog, fi, key, &reg->target_fi, &val)) return 0;
+
+  reg->target_ei = val.inst_addr;
+  reg->nlocals = val.nlocals;
+  return 1;
+}
+
+/* Translate the stack instructions starting at `ei`. The register
+ * instruction never covers an instruction in `leader` other than
+ * the first one. Jumps only ever end a register instruction. */
+static RegInst translate(const Program* prog, unsigned int fi, const char* leader, size_t ei) {
+  const Insts* insts = &prog->files[fi].insts;
+  RegInst reg = { .code=REG_INST, .op=IC_NONE, .ei=ei, .n=1 };
+  reg.dst.kind = reg.a.kind = reg.b.kind = OPD_STACK;
+
+  /* Number of instructions which can be covered. */
+  size_t end = ei + 1;
+  while (end < insts->idx && !leader[end]) end ++;
+  const Inst* cell = insts->cell;
+
+  /* Up to two operands pushed for an operation. */
+  Opd pushed[2];
+  unsigned int npushed = 0;
+  size_t i = ei;
+  while (npushed < 2 && i < end && src_opd(&cell[i], &pushed[npushed])) {
+    npushed ++;
+    i ++;
+  }
+
+  if (i < end && is_binary(cell[i].code)) {
+    reg.code = REG_BINARY;
+    reg.op = cell[i].code;
+    /* The last pushed operand is always the right one. */
+    if (npushed == 2) {
+      reg.a = pushed[0];
+      reg.b = pushed[1];
+    } else if (npushed == 1) {
+      reg.b = pushed[0];
+    }
+    i ++;
+  } else if (i < end && is_unary(cell[i].code) && npushed < 2) {
+    reg.code = REG_UNARY;
+    reg.op = cell[i].code;
+    if (npushed == 1) reg.a = pushed[0];
+    i ++;
+  } else if (npushed > 0) {
+    /* Only the first push is needed. */
+    reg.code = REG_MOVE;
+    reg.a = pushed[0];
+    i = ei + 1;
+  } else if (dst_opd(&cell[ei], &reg.dst)) {
+    reg.code = REG_MOVE;
+    return reg;
+  } else {
+    /* Control flow and everything else. */
+    switch (cell[ei].code) {
+      case GOTO:
+        if (resolve_inst(prog, fi, &cell[ei], &reg))
+          reg.code = REG_GOTO;
+        break;
+      case IF_GOTO:
+      case IF_NOT_GOTO:
+        if (resolve_inst(prog, fi, &cell[ei], &reg)) {
+          reg.code = REG_BRANCH;
+          reg.if_true = cell[ei].code == IF_GOTO;
+        }
+        break;
+      case CALL:
+      case TAIL_CALL:
+        if (resolve_inst(prog, fi, &cell[ei], &reg)) {
+          reg.code = cell[ei].code == CALL ? REG_CALL : REG_TAIL_CALL;
+          reg.nargs = cell[ei].nargs;
+        }
+        break;
+      case RET:
+        reg.code = REG_RET;
+        break;
+      default:
+        break;
+    }
+    return reg;
+  }
+
+  /* Where does the result go? */
+  if (i < end && dst_opd(&cell[i], &reg.dst)) {
+    i ++;
+  } else if (
+    i < end && is_branch(cell[i].code) && reg.code != REG_UNARY &&
+    resolve_inst(prog, fi, &cell[i], &reg)
+  ) {
+    if (reg.code == REG_MOVE) reg.op = IC_NONE;
+    reg.code = REG_BRANCH;
+    reg.if_true = cell[i].code == IF_GOTO;
+    i ++;
+  }
+
+  reg.n = (unsigned int) (i - ei);
+  return reg;
+}
+
+static void append(RegFile* file, size_t* len, RegInst reg) {
+  if (file->ninsts == *len) {
+    *len = *len == 0 ? 0x100 : *len * 2;
+    file->insts = (RegInst*) realloc (file->insts, *len * sizeof(RegInst));
+    assert(file->insts != NULL);
+  }
+  file->insts[file->ninsts ++] = reg;
+}
+
+static void translate_file(const Program* prog, unsigned int fi, RegFile* out) {
+  const File* file = &prog->files[fi];
+  size_t idx = file->insts.idx;
+
+  /* Everything which can be jumped to must start
+   * a register instruction. */
+  char* leader = (char*) calloc (idx + 1, sizeof(char));
+  assert(leader != NULL);
+  for (size_t i = 0; i < file->st.len; i++) {
+    const Symbol* sym = &file->st.cell[i];
+    size_t addr = sym->val.inst_addr + file->st.offset;
+    if (sym->key.type != SBT_UNUSED && addr <= idx)
+      leader[addr] = 1;
+  }
+
+  out->insts = NULL;
+  out->ninsts = 0;
+  out->map = (size_t*) malloc ((idx + 1) * sizeof(size_t));
+  assert(out->map != NULL);
+
+  size_t len = 0;
+  for (size_t ei = 0; ei < idx;) {
+    RegInst reg = translate(prog, fi, leader, ei);
+    out->map[ei] = out->ninsts;
+    for (size_t i = ei + 1; i < ei + reg.n; i++)
+      out->map[i] = NO_REG;
+    append(out, &len, reg);
+    ei += reg.n;
+  }
+
+  out->map[idx] = out->ninsts;
+  append(out, &len, (RegInst) { .code=REG_HALT, .ei=idx, .n=0 });
+
+  free(leader);
+}
+
+Regs* make_regs(const Program* prog) {
+  assert(prog != NULL);
+
+  Regs* regs = (Regs*) calloc (1, sizeof(Regs));
+  assert(regs != NULL);
+  regs->nfiles = prog->nfiles;
+  regs->files = (RegFile*) calloc (prog->nfiles, sizeof(RegFile));
+  assert(regs->files != NULL);
+
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    translate_file(prog, fi, &regs->files[fi]);
+    regs->nstack += prog->files[fi].insts.idx;
+  }
+
+  /* Targets are symbols, so they always start an instruction. */
+  for (unsigned int fi = 0; fi < regs->nfiles; fi++) {
+    RegFile* file = &regs->files[fi];
+    for (size_t ri = 0; ri < file->ninsts; ri++) {
+      RegInst* reg = &file->insts[ri];
+      if (reg->code >= REG_GOTO && reg->code <= REG_TAIL_CALL) {
+        reg->target = regs->files[reg->target_fi].map[reg->target_ei];
+        assert(reg->target != NO_REG);
+      }
+    }
+  }
+
+  return regs;
+}
+
+void del_regs(Regs* regs) {
+  if (regs == NULL) return;
+
+  for (unsigned int fi = 0; fi < regs->nfiles; fi++) {
+    free(regs->files[fi].insts);
+    free(regs->files[fi].map);
+  }
+  free(regs->files);
+  free(regs);
+}
+
+void print_reg_stats(const Regs* regs) {
+  assert(regs != NULL);
+
+  size_t nregs = 0;
+  for (unsigned int fi = 0; fi < regs->nfiles; fi++) {
+    /* Don't count `REG_HALT`. */
+    nregs += regs->files[fi].ninsts - 1;
+  }
+
+  hvme_fprintf(stderr,
+    "Translated %lu stack instructions to %lu register instructions\n",
+    regs->nstack, nregs);
+}
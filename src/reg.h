@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef _REG_H_
+#define _REG_H_
+
+#include "prog.h"
+
+/* Register bytecode.
+ *
+ * Each register instruction covers a short run of stack
+ * instructions and names its operands directly instead of
+ * passing them through the operand stack. For example
+ *
+ *   push local 0
+ *   push constant 1
+ *   add
+ *   pop local 0
+ *
+ * becomes the single instruction `local 0 = local 0 + 1`.
+ * Values which stay on the stack across instructions are
+ * addressed by the `OPD_STACK` operand.
+ *
+ * The stack instructions are kept around. Whenever a register
+ * instruction can't be executed directly because one of its
+ * checks fails (e.g. an addition overflows), the stack
+ * instructions it covers are run instead. This way every
+ * error is reported exactly like by `exec_prog`. */
+
+/* Where an operand is read from or written to. */
+typedef enum {
+  OPD_STACK = 0,  /* Pop the value as a source, push it as a destination. */
+  OPD_NONE,  /* Discard the value (`pop constant`). */
+  OPD_CONST,
+  OPD_LOC,
+  OPD_ARG,
+  OPD_STAT,
+  OPD_TMP,
+  OPD_THIS,
+  OPD_THAT,
+} OpdKind;
+
+typedef struct {
+  OpdKind kind;
+  uint16_t index;  /* Segment offset or constant value. */
+} Opd;
+
+typedef struct {
+  enum RegCode {
+    REG_INST = 0,  /* Run the covered stack instructions. */
+    REG_MOVE,  /* `dst = a` */
+    REG_UNARY,  /* `dst = <op> a` */
+    REG_BINARY,  /* `dst = a <op> b` */
+    REG_GOTO,  /* Jump to `target`. */
+    REG_BRANCH,  /* Jump to `target` if `a` (or `a <op> b`) is true (`if_true`) or false. */
+    REG_CALL,  /* Call the function at `target`. */
+    REG_TAIL_CALL,  /* Call the function at `target` in the current frame. */
+    REG_RET,  /* Return from the current function. */
+    REG_HALT,  /* End of the file. */
+  } code;
+
+  enum InstCode op;  /* Operation (`IC_NONE` to branch on `a` itself). */
+  int if_true;  /* Branch condition (`REG_BRANCH`). */
+  Opd dst, a, b;
+
+  size_t ei;  /* Index of the first covered stack instruction. */
+  unsigned int n;  /* Number of covered stack instructions. */
+
+  /* Jump targets are resolved ahead of time like `jump_to` resolves
+   * them at runtime. Jumps which would fail stay `REG_INST`. */
+  unsigned int target_fi;  /* File of the target. */
+  size_t target_ei;  /* Stack instruction index of the target. */
+  size_t target;  /* Register instruction index of the target. */
+  uint16_t nargs;  /* `REG_CALL` and `REG_TAIL_CALL` */
+  uint16_t nlocals;  /* `REG_CALL` and `REG_TAIL_CALL` */
+} RegInst;
+
+#define NO_REG ((size_t) -1)
+
+typedef struct {
+  RegInst* insts;  /* Register instructions ending with `REG_HALT`. */
+  size_t ninsts;
+  /* Index of the register instruction starting at each stack
+   * instruction (`NO_REG` for instructions in the middle of
+   * one). Has one more entry for the end of the file. */
+  size_t* map;
+} RegFile;
+
+typedef struct {
+  RegFile* files;  /* One for each file of the program. */
+  unsigned int nfiles;
+  size_t nstack;  /* Number of translated stack instructions. */
+} Regs;
+
+/* Translate all files of `prog` to register bytecode. The
+ * program must not change until the result is deleted. */
+Regs* make_regs(const Program* prog);
+
+void del_regs(Regs* regs);
+
+/* Print how many instructions were translated. */
+void print_reg_stats(const Regs* regs);
+
+#endif  // _REG_H_
@@ -8,12 +8,6 @@
 #include <assert.h>
 #include <stdio.h>
 
-// Used by `T_KUINT` to store the scanned number.
-static Uint uilit = 0;
-// Used by `TK_IDENT` to store the scanned identifier.
-// The maximum identifier length is 24.
-static char ident_buf[MAX_IDENT_LEN + 1];
-
 #define TOKEN_COMPLETED -1
 #define INTERNAL_SCAN_ERR -1
 
@@ -21,47 +15,26 @@ Tokens new_tokens(const char* filename) {
   Tokens tokens = {
     .idx = 0,
     .len = TOKEN_BLOCK_SIZE,
-    .cur.ln = 0,
-    .cur.cl = 0,
+    .src = new_src(filename),
+    .base = 0,
+    .inside_comment = 0,
   };
 
-  if (filename != NULL) {
-    tokens.filename = (char*) calloc (strlen(filename) + 1, sizeof(char));
-    assert(tokens.filename != NULL);
-    strcpy(tokens.filename, filename);
-  } else {
-    tokens.filename = NULL;
-  }
-
   tokens.cell = (Token*) calloc (tokens.len, sizeof(Token));
   assert(tokens.cell != NULL);
 
   return tokens;
 }
 
-void del_tokens(Tokens tokens) {
-  free(tokens.cell);
-  free(tokens.filename);
-}
-
-static inline void inc(size_t *restrict offset, Pos *restrict pos) {
-  *offset += 1;
-  pos->cl += 1;
-}
-
-static inline void incby(
-  size_t inc,
-  size_t *restrict offset,
-  Pos *restrict pos
-) {
-  *offset += inc;
-  pos->cl += inc;
+Tokens new_buf_tokens(const char* name, const char* text, size_t len) {
+  Tokens tokens = new_tokens(NULL);
+  tokens.src = new_src_buf(name, text, len);
+  return tokens;
 }
 
-static inline void incl(size_t *restrict offset, Pos *restrict pos) {
-  *offset += 1;
-  pos->ln += 1;
-  pos->cl = 0;
+void del_tokens(Tokens tokens) {
+  free(tokens.cell);
+  del_src(tokens.src);
 }
 
 void token_str(const Token* it, char* str) {
@@ -113,16 +86,19 @@ void token_str(const Token* it, char* str) {
 
 #define MAX_ERR_BLK_LEN 32
 
-void scan_err(const char* blk, const char* filename, Pos pos) {
-  pos.filename = filename;
-  perrf(pos, "couldn't scan input\n `%s`", blk);
+void scan_err(const char* blk, Source* src, Offset off) {
+  perrf(src_pos(src, off), "couldn't scan input\n `%s`", blk);
 }
 
 
-static inline int static_scan(const char* search, const char* blk, size_t len, size_t* offset, Pos* pos) {
+/* The scan functions below try to match a token at `offset`
+ * in `blk`. Tokens with a value store it in `token`. */
+
+static inline int static_scan(const char* search, const char* blk, size_t len, size_t* offset, Token* token) {
   assert(search != NULL);
   assert(blk != NULL);
   assert(offset != NULL);
+  (void) token;
 
   size_t slen = strlen(search);
   if ((*offset + slen) > len) {
@@ -131,7 +107,7 @@ static inline int static_scan(const char* search, const char* blk, size_t len, s
   }
 
   if (strncmp(blk + *offset, search, slen) == 0) {
-    incby(slen, offset, pos);
+    *offset += slen;
     return TOKEN_COMPLETED;
   } else {
     // TODO: Temporaty until finding the exact character is implemented.
@@ -139,47 +115,47 @@ static inline int static_scan(const char* search, const char* blk, size_t len, s
   }
 }
 
-static inline int push(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("push", blk, len, offset, pos);
+static inline int push(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("push", blk, len, offset, token);
 }
 
-static inline int pop(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("pop", blk, len, offset, pos);
+static inline int pop(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("pop", blk, len, offset, token);
 }
 
-static inline int argument(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("argument", blk, len, offset, pos);
+static inline int argument(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("argument", blk, len, offset, token);
 }
 
-static inline int local(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("local", blk, len, offset, pos);
+static inline int local(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("local", blk, len, offset, token);
 }
 
-static inline int _static(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("static", blk, len, offset, pos);
+static inline int _static(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("static", blk, len, offset, token);
 }
 
-static inline int constant(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("constant", blk, len, offset, pos);
+static inline int constant(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("constant", blk, len, offset, token);
 }
 
-static inline int this(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("this", blk, len, offset, pos);
+static inline int this(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("this", blk, len, offset, token);
 }
 
-static inline int that(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("that", blk, len, offset, pos);
+static inline int that(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("that", blk, len, offset, token);
 }
 
-static inline int pointer(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("pointer", blk, len, offset, pos);
+static inline int pointer(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("pointer", blk, len, offset, token);
 }
 
-static inline int temp(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("temp", blk, len, offset, pos);
+static inline int temp(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("temp", blk, len, offset, token);
 }
 
-static inline int _uint(const char* blk, size_t len, size_t* offset, Pos* pos) {
+static inline int _uint(const char* blk, size_t len, size_t* offset, Token* token) {
   assert(blk != NULL);
   assert(offset != NULL);
   
@@ -242,78 +218,78 @@ static inline int _uint(const char* blk, size_t len, size_t* offset, Pos* pos) {
   // emitted.
   if (uilit_buf > 65535) {
     warn_sat_uilit(uilit_buf);
-    uilit = 65535;
+    token->uilit = 65535;
   } else {
     // `uilit` fits the scanned number.
-    uilit = uilit_buf;
+    token->uilit = uilit_buf;
   }
 
-  incby(ndigits, offset, pos);
+  *offset += ndigits;
 
   return TOKEN_COMPLETED;
 }
 
-static inline int label(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("label", blk, len, offset, pos);
+static inline int label(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("label", blk, len, offset, token);
 }
 
-static inline int _goto(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("goto", blk, len, offset, pos);
+static inline int _goto(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("goto", blk, len, offset, token);
 }
 
-static inline int if_goto(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("if-goto", blk, len, offset, pos);
+static inline int if_goto(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("if-goto", blk, len, offset, token);
 }
 
-static inline int function(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("function", blk, len, offset, pos);
+static inline int function(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("function", blk, len, offset, token);
 }
 
-static inline int call(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("call", blk, len, offset, pos);
+static inline int call(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("call", blk, len, offset, token);
 }
 
-static inline int _return(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("return", blk, len, offset, pos);
+static inline int _return(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("return", blk, len, offset, token);
 }
 
-static inline int add(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("add", blk, len, offset, pos);
+static inline int add(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("add", blk, len, offset, token);
 }
 
-static inline int sub(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("sub", blk, len, offset, pos);
+static inline int sub(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("sub", blk, len, offset, token);
 }
 
-static inline int neg(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("neg", blk, len, offset, pos);
+static inline int neg(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("neg", blk, len, offset, token);
 }
 
-static inline int eq(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("eq", blk, len, offset, pos);
+static inline int eq(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("eq", blk, len, offset, token);
 }
 
-static inline int gt(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("gt", blk, len, offset, pos);
+static inline int gt(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("gt", blk, len, offset, token);
 }
 
-static inline int lt(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("lt", blk, len, offset, pos);
+static inline int lt(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("lt", blk, len, offset, token);
 }
 
-static inline int and(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("and", blk, len, offset, pos);
+static inline int and(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("and", blk, len, offset, token);
 }
 
-static inline int or(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("or", blk, len, offset, pos);
+static inline int or(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("or", blk, len, offset, token);
 }
 
-static inline int not(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("not", blk, len, offset, pos);
+static inline int not(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("not", blk, len, offset, token);
 }
 
-static inline int ident(const char* blk, size_t len, size_t* offset, Pos* pos) {
+static inline int ident(const char* blk, size_t len, size_t* offset, Token* token) {
   assert(blk != NULL);
   assert(offset != NULL);
 
@@ -361,21 +337,21 @@ static inline int ident(const char* blk, size_t len, size_t* offset, Pos* pos) {
     warn_trunc_ident(blk + *offset, nchars, MAX_IDENT_LEN);
 
   size_t nleft = len - *offset;  /* Number of chars left in buffer after offset */
-  strncpy(ident_buf, blk + *offset, MAX_IDENT_LEN > nleft ? nleft : MAX_IDENT_LEN);
+  strncpy(token->ident, blk + *offset, MAX_IDENT_LEN > nleft ? nleft : MAX_IDENT_LEN);
   /* `nchars` might be larger than `MAX_IDENT_LEN`. Place
    * the NULL-terminator so it doesn't exceed the buffer. */
-  ident_buf[nchars >= MAX_IDENT_LEN ? MAX_IDENT_LEN : nchars] = '\0';
+  token->ident[nchars >= MAX_IDENT_LEN ? MAX_IDENT_LEN : nchars] = '\0';
 
-  incby(nchars, offset, pos);
+  *offset += nchars;
 
   return TOKEN_COMPLETED;
 }
 
-static inline int comment(const char* blk, size_t len, size_t* offset, Pos* pos) {
-  return static_scan("//", blk, len, offset, pos);
+static inline int comment(const char* blk, size_t len, size_t* offset, Token* token) {
+  return static_scan("//", blk, len, offset, token);
 }
 
-typedef int(*ScanFnPtr)(const char*, size_t, size_t*, Pos*);
+typedef int(*ScanFnPtr)(const char*, size_t, size_t*, Token*);
 static ScanFnPtr match_fns[] = {
   push,
   pop,
@@ -408,36 +384,21 @@ static ScanFnPtr match_fns[] = {
   NULL,
 };
 
-Token token_from_fn(size_t fn_idx, Pos pos) {
+Token token_from_fn(size_t fn_idx, Offset off, const Token* scanned) {
   // IMPORTANT: It has to be ensured, that
   // `TokenCode(fn_idx) = fn_idx + 1` remains true.
-  Token token = {
-    .t=fn_idx + 1,
-    .uilit=uilit,
-    .pos=pos,
-  };
-  strcpy(token.ident, ident_buf);
-  memset(ident_buf, ' ', MAX_IDENT_LEN);
-  uilit = 0;
+  Token token = *scanned;
+  token.t = fn_idx + 1;
+  token.off = off;
   return token;
 }
 
-static inline int eat_ws(const char* blk, size_t len, size_t* offset, Pos* pos) {
+static inline void eat_ws(const char* blk, size_t len, size_t* offset) {
   assert(blk != NULL);
   assert(offset != NULL);
-  
-  int found_nl = 0;
-
-  while (*offset < len && isspace(blk[*offset])) {
-    if (blk[*offset] == '\n') {
-      found_nl = 1;
-      incl(offset, pos);
-    } else {
-      inc(offset, pos);
-    }
-  }
 
-  return found_nl;
+  while (*offset < len && isspace(blk[*offset]))
+    *offset += 1;
 }
 
 static inline ssize_t num_trailing(const char* blk, size_t len) {
@@ -465,8 +426,6 @@ ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len) {
   assert(blk != NULL);
   
   size_t offset = 0;
-  // Remember whether we left inside a comment.
-  static int inside_comment = 0;
 
   while (offset < len) {
     // `offset` now points to the first
@@ -474,28 +433,30 @@ ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len) {
 
     // Eat comments. Newline check must happen
     // before starting whitespace is consumed.
-    if (inside_comment) {
-      if (blk[offset] == '\n') {
-        inside_comment = 0;
-        incl(&offset, &tokens->cur);
+    if (tokens->inside_comment) {
+      const char* nl = memchr(blk + offset, '\n', len - offset);
+      if (nl != NULL) {
+        tokens->inside_comment = 0;
+        offset = nl - blk + 1;
       } else {
-        inc(&offset, &tokens->cur);
+        offset = len;
       }
 
       continue;
     }
 
     // Eat up initial whitespace.
-    eat_ws(blk, len, &offset, &tokens->cur);
+    eat_ws(blk, len, &offset);
 
     int num_matched = 0;
     size_t fn_idx = 0;
-    Pos cur_start = tokens->cur;
+    Offset cur_start = tokens->base + offset;
+    Token scanned = { .uilit=0, .ident="" };
     while (
       num_matched != TOKEN_COMPLETED
       && match_fns[fn_idx] != NULL
     ) {
-      num_matched = match_fns[fn_idx](blk, len, &offset, &tokens->cur);
+      num_matched = match_fns[fn_idx](blk, len, &offset, &scanned);
       if (num_matched != TOKEN_COMPLETED)
         fn_idx++;
     }
@@ -504,7 +465,7 @@ ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len) {
       // Comment scan function as completed successfully.
       // This means that we set `inside_comment` to true and
       // continue until the comment is terminated by a newline.
-      inside_comment = 1;
+      tokens->inside_comment = 1;
     } else if (num_matched == TOKEN_COMPLETED && match_fns[fn_idx] != NULL) {
       // The scan function `fn_idx`
       // completed successfully.
@@ -515,7 +476,7 @@ ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len) {
         assert(tokens->cell != NULL);
       }
 
-      tokens->cell[tokens->idx] = token_from_fn(fn_idx, cur_start);
+      tokens->cell[tokens->idx] = token_from_fn(fn_idx, cur_start, &scanned);
       tokens->idx ++;
     } else {
       // No scan function completed. This must
@@ -538,7 +499,7 @@ ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len) {
         // pblk[len - 1] is NULL already because calloc
         // was used to allocate it. No need to add it.
 
-        scan_err(pblk, tokens->filename, cur_start);
+        scan_err(pblk, tokens->src, cur_start);
         free(pblk);
       }
 
@@ -546,7 +507,7 @@ ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len) {
     }
 
     // Eat up trailing whitespace.
-    eat_ws(blk, len, &offset, &tokens->cur);
+    eat_ws(blk, len, &offset);
   }
 
   // All characters in `blk` were scanned successfully.
@@ -556,10 +517,10 @@ ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len) {
 
 int scan(Tokens* tokens) {
   assert(tokens != NULL);
-  assert(tokens->filename != NULL);
+  assert(tokens->src != NULL && tokens->src->filename != NULL);
   assert(SCAN_BLOCK_SIZE >= MAX_TOKEN_LEN);
   
-  int fd = open(tokens->filename, O_RDONLY);
+  int fd = open(tokens->src->filename, O_RDONLY);
   if (fd == -1)  {
     return SCAN_ERR;
   }
@@ -619,8 +580,12 @@ int scan(Tokens* tokens) {
       close(fd);
       return SCAN_ERR;
     } else if (res > 0) {
-      memcpy(blk, blk + SCAN_BLOCK_SIZE - bytes_copied, bytes_copied);
+      // The ranges overlap if the rest is more than half a block.
+      memmove(blk, blk + SCAN_BLOCK_SIZE - bytes_copied, bytes_copied);
     }
+    // The next block starts after all bytes
+    // which were consumed from this one.
+    tokens->base += len - bytes_copied;
   } while (orig_len == SCAN_BLOCK_SIZE);
   
   free(blk);
@@ -628,3 +593,30 @@ int scan(Tokens* tokens) {
 
   return SCAN_OK;
 }
+
+int scan_buf(Tokens* tokens, const char* text, size_t len) {
+  assert(tokens != NULL);
+  assert(text != NULL || len == 0);
+
+  if (len == 0) return SCAN_OK;
+
+  // The whole text is a single block. Only what's left
+  // at its end is copied to add the missing newline.
+  ssize_t res = scan_blk(tokens, text, len);
+  if (res == INTERNAL_SCAN_ERR) return SCAN_ERR;
+
+  if (text[len - 1] != '\n') {
+    warn_eof_nl();
+    size_t rest = (size_t) res;
+    char* blk = (char*) malloc ((rest + 1) * sizeof(char));
+    assert(blk != NULL);
+    memcpy(blk, text + len - rest, rest);
+    blk[rest] = '\n';
+    tokens->base += len - rest;
+    res = scan_blk(tokens, blk, rest + 1);
+    free(blk);
+    if (res == INTERNAL_SCAN_ERR) return SCAN_ERR;
+  }
+
+  return SCAN_OK;
+}
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "pos.h"
+
 // NOTE: The marked beginnings and end of
 // the ranges of different token types must
 // remain unchanged so that all range check
@@ -64,19 +66,10 @@ typedef enum {
 
 typedef uint16_t Uint;
 
-typedef struct {
-  unsigned int ln;
-  unsigned int cl;
-  /* Not used by the scanner because tokens
-   * doesn't contain a filename which will
-   * last long enought. */
-  const char* filename;
-} Pos;
-
 // Scanned token
 typedef struct {
   TokenCode t;
-  Pos pos;
+  Offset off;  // Byte offset in the source file.
   Uint uilit;
   char ident[MAX_IDENT_LEN + 1];
 } Token;
@@ -85,8 +78,9 @@ typedef struct {
   size_t idx;
   size_t len;
   Token* cell;
-  char* filename;
-  Pos cur;   // Used only while scanning to track where we are.
+  Source* src;
+  Offset base;  // Used only while scanning: file offset of the current block.
+  int inside_comment;  // Used only while scanning: the block ended inside a comment.
 } Tokens;
 
 # ifndef TOKEN_BLOCK_SIZE
@@ -95,6 +89,9 @@ typedef struct {
 
 // Initialize a new `Tokens` instance.
 Tokens new_tokens(const char* filename);
+// Initialize a new `Tokens` instance for `len` bytes
+// of `text` in memory. Positions refer to `name`.
+Tokens new_buf_tokens(const char* name, const char* text, size_t len);
 // Delete an `Items` instance.
 void del_tokens(Tokens tokens);
 
@@ -126,4 +123,8 @@ void token_str(const Token* it, char* str);
 /* Scan input and store the tokens in `tokens`. */
 int scan(Tokens* tokens);
 
+/* Scan `len` bytes of `text` in place instead of
+ * reading the file of `tokens`. */
+int scan_buf(Tokens* tokens, const char* text, size_t len);
+
 #endif  // _SCAN_H_
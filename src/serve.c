@@ -0,0 +1,779 @@
+#include "serve.h"
+#include "msg.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define FRAME_HEADER 5
+#define FRAME_MAX (64lu << 20)
+#define LISTEN_BACKLOG 64
+
+/* Instructions run between checks whether the client is
+ * still there and the server is still running. */
+#define RUN_SLICE (1lu << 20)
+
+/* Output is sent once this many bytes are buffered. */
+#define FLUSH_SIZE 4096
+
+typedef struct {
+  char* data;
+  size_t len;
+  size_t cap;
+} Buf;
+
+static void buf_add(Buf* buf, const void* data, size_t len) {
+  if (buf->len + len > buf->cap) {
+    buf->cap = buf->len + len > 2 * buf->cap ? buf->len + len : 2 * buf->cap;
+    buf->data = (char*) realloc (buf->data, buf->cap);
+    assert(buf->data != NULL);
+  }
+  if (len > 0) memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+}
+
+static void put_u64(unsigned char* p, uint64_t val) {
+  for (int i = 7; i >= 0; i--, val >>= 8) p[i] = val & 0xFF;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+  uint64_t val = 0;
+  for (int i = 0; i < 8; i++) val = (val << 8) | p[i];
+  return val;
+}
+
+/* Add the header of a frame with `len` bytes of payload. */
+static void add_header(Buf* buf, char type, size_t len) {
+  unsigned char header[FRAME_HEADER] = {
+    type, (len >> 24) & 0xFF, (len >> 16) & 0xFF, (len >> 8) & 0xFF, len & 0xFF,
+  };
+  buf_add(buf, header, FRAME_HEADER);
+}
+
+static void add_frame(Buf* buf, char type, const void* data, size_t len) {
+  add_header(buf, type, len);
+  buf_add(buf, data, len);
+}
+
+static void add_u64_frame(Buf* buf, char type, uint64_t val) {
+  unsigned char data[8];
+  put_u64(data, val);
+  add_frame(buf, type, data, sizeof(data));
+}
+
+/* Read exactly `len` bytes. Returns `0` at the end of the
+ * stream, on errors and once `stop_fd` (if it's not `-1`)
+ * becomes readable. */
+static int read_all(int fd, int stop_fd, void* data, size_t len) {
+  char* p = (char*) data;
+  while (len > 0) {
+    if (stop_fd >= 0) {
+      struct pollfd fds[2] = { { fd, POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) continue;
+        return 0;
+      }
+      if (fds[1].revents != 0) return 0;
+    }
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return 0;
+    p += n;
+    len -= n;
+  }
+  return 1;
+}
+
+static int write_all(int fd, const void* data, size_t len) {
+  const char* p = (const char*) data;
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return 0;
+    p += n;
+    len -= n;
+  }
+  return 1;
+}
+
+#define FRAME_ERR -1
+#define FRAME_END 0
+#define FRAME_OK 1
+
+typedef struct {
+  char type;
+  char* data;  /* Followed by `'\0'`. */
+  size_t len;
+} Frame;
+
+/* Returns `FRAME_END` if the stream ended before the frame
+ * and `FRAME_ERR` if the frame is too long. */
+static int read_frame(int fd, int stop_fd, Frame* frame) {
+  unsigned char header[FRAME_HEADER];
+  if (!read_all(fd, stop_fd, header, FRAME_HEADER)) return FRAME_END;
+
+  frame->type = (char) header[0];
+  frame->len = ((size_t) header[1] << 24) | ((size_t) header[2] << 16)
+    | ((size_t) header[3] << 8) | header[4];
+  if (frame->len > FRAME_MAX) return FRAME_ERR;
+
+  frame->data = (char*) malloc (frame->len + 1);
+  assert(frame->data != NULL);
+  frame->data[frame->len] = '\0';
+  if (!read_all(fd, stop_fd, frame->data, frame->len)) {
+    free(frame->data);
+    return FRAME_END;
+  }
+  return FRAME_OK;
+}
+
+/* FNV-1a over the names and texts of the sources. */
+static uint64_t hash_bufs(unsigned int nbufs, const SourceBuf* bufs) {
+  uint64_t hash = 0xcbf29ce484222325u;
+  for (unsigned int i = 0; i < nbufs; i++) {
+    unsigned char len[8];
+    put_u64(len, bufs[i].len);
+    const unsigned char* parts[] = {
+      (const unsigned char*) bufs[i].name, len, (const unsigned char*) bufs[i].text,
+    };
+    size_t lens[] = { strlen(bufs[i].name) + 1, sizeof(len), bufs[i].len };
+    for (int j = 0; j < 3; j++) {
+      for (size_t k = 0; k < lens[j]; k++) {
+        hash ^= parts[j][k];
+        hash *= 0x100000001b3u;
+      }
+    }
+  }
+  return hash;
+}
+
+typedef struct {
+  uint64_t id;
+  Hvme* vm;  /* Never runs itself. Requests run clones of it. */
+  size_t size;
+  unsigned int refs;  /* Number of requests using it. */
+  unsigned long used;  /* Tick of its last use. */
+} CacheEntry;
+
+typedef struct {
+  pthread_mutex_t lock;
+  CacheEntry** entries;
+  size_t len;
+  size_t cap;
+  size_t size;  /* Size of all entries. */
+  size_t max_size;
+  unsigned long tick;
+} Cache;
+
+/* Delete the least recently used entries which aren't in
+ * use until the cache fits. The lock must be held. */
+static void evict(Cache* cache) {
+  while (cache->size > cache->max_size) {
+    size_t lru = cache->len;
+    for (size_t i = 0; i < cache->len; i++) {
+      if (cache->entries[i]->refs == 0
+          && (lru == cache->len || cache->entries[i]->used < cache->entries[lru]->used))
+        lru = i;
+    }
+    if (lru == cache->len) return;
+
+    CacheEntry* entry = cache->entries[lru];
+    cache->entries[lru] = cache->entries[-- cache->len];
+    cache->size -= entry->size;
+    hvme_del(entry->vm);
+    free(entry);
+  }
+}
+
+/* Take the program with `id` if it's cached. The lock
+ * must be held. */
+static CacheEntry* take_entry(Cache* cache, uint64_t id) {
+  for (size_t i = 0; i < cache->len; i++) {
+    CacheEntry* entry = cache->entries[i];
+    if (entry->id == id) {
+      entry->refs ++;
+      entry->used = ++ cache->tick;
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static CacheEntry* cache_get(Cache* cache, uint64_t id) {
+  pthread_mutex_lock(&cache->lock);
+  CacheEntry* entry = take_entry(cache, id);
+  pthread_mutex_unlock(&cache->lock);
+  return entry;
+}
+
+/* Add `vm` and take it. If another request added the same
+ * program in the meantime, `vm` is deleted and that one is
+ * taken instead. */
+static CacheEntry* cache_add(Cache* cache, uint64_t id, Hvme* vm) {
+  pthread_mutex_lock(&cache->lock);
+  CacheEntry* entry = take_entry(cache, id);
+  if (entry != NULL) {
+    pthread_mutex_unlock(&cache->lock);
+    hvme_del(vm);
+    return entry;
+  }
+
+  if (cache->len == cache->cap) {
+    cache->cap = cache->cap == 0 ? 16 : 2 * cache->cap;
+    cache->entries = (CacheEntry**) realloc (cache->entries, cache->cap * sizeof(CacheEntry*));
+    assert(cache->entries != NULL);
+  }
+  entry = (CacheEntry*) malloc (sizeof(CacheEntry));
+  assert(entry != NULL);
+  *entry = (CacheEntry) { .id=id, .vm=vm, .size=hvme_size(vm), .refs=1, .used=++ cache->tick };
+  cache->entries[cache->len ++] = entry;
+  cache->size += entry->size;
+  evict(cache);
+  pthread_mutex_unlock(&cache->lock);
+  return entry;
+}
+
+static void cache_release(Cache* cache, CacheEntry* entry) {
+  pthread_mutex_lock(&cache->lock);
+  entry->refs --;
+  evict(cache);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+struct Server {
+  char* path;
+  int fd;
+  int stop[2];  /* Becomes readable once the server stops. */
+  int stopping;
+  HvmeConfig config;
+  Cache cache;
+  pthread_t acceptor;
+  pthread_t* workers;
+  unsigned int nworkers;
+  /* Accepted connections waiting for a worker. */
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  int* queue;
+  size_t queue_len;
+  size_t queue_cap;
+  size_t nrequests;
+};
+
+/* A client's connection. The I/O callbacks of its program
+ * buffer the output as frames. */
+typedef struct {
+  Server* server;
+  int fd;
+  Buf out;
+  int broken;  /* The client is gone. */
+  Buf in;
+  size_t in_pos;
+} Conn;
+
+static void flush_conn(Conn* conn) {
+  if (!conn->broken && conn->out.len > 0)
+    conn->broken = !write_all(conn->fd, conn->out.data, conn->out.len);
+  conn->out.len = 0;
+}
+
+static void send_frame(Conn* conn, char type, const void* data, size_t len) {
+  add_frame(&conn->out, type, data, len);
+  if (conn->out.len >= FLUSH_SIZE) flush_conn(conn);
+}
+
+static void send_status(Conn* conn, ServeStatus status) {
+  unsigned char data = status;
+  send_frame(conn, 'X', &data, 1);
+  flush_conn(conn);
+}
+
+static void conn_out(void* data, const char* s) {
+  send_frame((Conn*) data, 'O', s, strlen(s));
+}
+
+static void conn_err(void* data, const char* s) {
+  send_frame((Conn*) data, 'E', s, strlen(s));
+}
+
+static int conn_in(void* data) {
+  Conn* conn = (Conn*) data;
+  if (conn->in_pos == conn->in.len) return EOF;
+  return (unsigned char) conn->in.data[conn->in_pos ++];
+}
+
+typedef struct {
+  unsigned int nbufs;
+  SourceBuf* bufs;  /* Point into the frames in `data`. */
+  char** data;
+  int has_id;
+  uint64_t id;
+  size_t budget;
+} Request;
+
+static void free_request(Request* req) {
+  for (unsigned int i = 0; i < req->nbufs; i++) free(req->data[i]);
+  free(req->data);
+  free(req->bufs);
+}
+
+/* Read the frames of a request up to its `'R'`. Returns
+ * `FRAME_END` if the client is done and `FRAME_ERR` if
+ * the request is invalid. The input goes to `conn->in`. */
+static int read_request(Conn* conn, Request* req) {
+  memset(req, 0, sizeof(Request));
+  req->budget = HVME_UNLIMITED;
+  conn->in.len = 0;
+  conn->in_pos = 0;
+
+  Frame frame;
+  int res;
+  while ((res = read_frame(conn->fd, conn->server->stop[0], &frame)) == FRAME_OK) {
+    int valid = 1;
+    switch (frame.type) {
+      case 'S': {
+        size_t name_len = strlen(frame.data);
+        valid = name_len > 0 && name_len < frame.len;
+        if (!valid) break;
+        req->bufs = (SourceBuf*) realloc (req->bufs, (req->nbufs + 1) * sizeof(SourceBuf));
+        req->data = (char**) realloc (req->data, (req->nbufs + 1) * sizeof(char*));
+        assert(req->bufs != NULL && req->data != NULL);
+        req->bufs[req->nbufs] = (SourceBuf) {
+          .name=frame.data,
+          .text=frame.data + name_len + 1,
+          .len=frame.len - name_len - 1,
+        };
+        req->data[req->nbufs ++] = frame.data;
+        continue;  /* The request keeps the frame. */
+      }
+      case 'P':
+        valid = frame.len == 8;
+        if (valid) req->id = get_u64((unsigned char*) frame.data);
+        req->has_id = 1;
+        break;
+      case 'I':
+        buf_add(&conn->in, frame.data, frame.len);
+        break;
+      case 'B':
+        valid = frame.len == 8;
+        if (valid) req->budget = get_u64((unsigned char*) frame.data);
+        break;
+      case 'R':
+        free(frame.data);
+        /* Either sources or an id. */
+        return (req->nbufs > 0) != req->has_id ? FRAME_OK : FRAME_ERR;
+      default:
+        valid = 0;
+    }
+    free(frame.data);
+    if (!valid) return FRAME_ERR;
+  }
+  /* A request which ends half way is cut off. */
+  return res;
+}
+
+/* Find or make the program of `req`. Messages while it's
+ * made go to the client. */
+static CacheEntry* find_prog(Conn* conn, const Request* req, uint64_t* id) {
+  Cache* cache = &conn->server->cache;
+  *id = req->has_id ? req->id : hash_bufs(req->nbufs, req->bufs);
+  CacheEntry* entry = cache_get(cache, *id);
+  if (entry != NULL || req->has_id) return entry;
+
+  /* The cached VM keeps these callbacks, but only its
+   * clones run and they have their own. */
+  HvmeConfig config = conn->server->config;
+  config.io = (HvmeIo) { .data=conn, .out=conn_out, .err=conn_err, .in=NULL };
+  Hvme* vm = hvme_new_bufs(req->nbufs, req->bufs, &config);
+  if (hvme_status(vm) == HVME_ERROR) {
+    hvme_del(vm);
+    return NULL;
+  }
+  return cache_add(cache, *id, vm);
+}
+
+static void run_request(Conn* conn, const Request* req) {
+  Server* server = conn->server;
+  uint64_t id;
+  CacheEntry* entry = find_prog(conn, req, &id);
+  if (entry == NULL) {
+    send_status(conn, req->has_id ? SERVE_UNKNOWN : SERVE_ERROR);
+    return;
+  }
+  add_u64_frame(&conn->out, 'H', id);
+
+  HvmeIo io = { .data=conn, .out=conn_out, .err=conn_err, .in=conn_in };
+  Hvme* vm = hvme_clone(entry->vm, &io);
+  HvmeStatus status = HVME_BUDGET;
+  for (size_t left = req->budget; left > 0;) {
+    size_t slice = left < RUN_SLICE ? left : RUN_SLICE;
+    status = hvme_run(vm, slice);
+    left -= slice;
+    if (status != HVME_BUDGET) break;
+    flush_conn(conn);
+    if (conn->broken || __atomic_load_n(&server->stopping, __ATOMIC_RELAXED)) break;
+  }
+  hvme_del(vm);
+  cache_release(&server->cache, entry);
+  __atomic_add_fetch(&server->nrequests, 1, __ATOMIC_RELAXED);
+
+  send_status(conn,
+    status == HVME_FINISHED ? SERVE_FINISHED
+    : status == HVME_ERROR ? SERVE_ERROR : SERVE_BUDGET);
+}
+
+static void serve_conn(Server* server, int fd) {
+  Conn conn;
+  memset(&conn, 0, sizeof(conn));
+  conn.server = server;
+  conn.fd = fd;
+
+  while (!conn.broken) {
+    Request req;
+    int res = read_request(&conn, &req);
+    if (res == FRAME_OK) run_request(&conn, &req);
+    free_request(&req);
+    if (res == FRAME_ERR) send_status(&conn, SERVE_INVALID);
+    if (res != FRAME_OK) break;
+  }
+
+  free(conn.out.data);
+  free(conn.in.data);
+}
+
+static void* run_worker(void* arg) {
+  Server* server = (Server*) arg;
+  for (;;) {
+    pthread_mutex_lock(&server->lock);
+    while (server->queue_len == 0 && !server->stopping)
+      pthread_cond_wait(&server->ready, &server->lock);
+    if (server->stopping) {
+      pthread_mutex_unlock(&server->lock);
+      return NULL;
+    }
+    int fd = server->queue[0];
+    memmove(server->queue, server->queue + 1, -- server->queue_len * sizeof(int));
+    pthread_mutex_unlock(&server->lock);
+
+    serve_conn(server, fd);
+    close(fd);
+  }
+}
+
+static void* run_acceptor(void* arg) {
+  Server* server = (Server*) arg;
+  for (;;) {
+    struct pollfd fds[2] = { { server->fd, POLLIN, 0 }, { server->stop[0], POLLIN, 0 } };
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) return NULL;
+    if (fds[1].revents != 0) return NULL;
+    if (fds[0].revents == 0) continue;
+
+    int fd = accept(server->fd, NULL, NULL);
+    if (fd < 0) continue;
+
+    pthread_mutex_lock(&server->lock);
+    if (server->queue_len == server->queue_cap) {
+      server->queue_cap = server->queue_cap == 0 ? 16 : 2 * server->queue_cap;
+      server->queue = (int*) realloc (server->queue, server->queue_cap * sizeof(int));
+      assert(server->queue != NULL);
+    }
+    server->queue[server->queue_len ++] = fd;
+    pthread_cond_signal(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+  }
+}
+
+/* Fill in `addr` for `path`. Prints an error if it's too long. */
+static int socket_addr(const char* path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    char msg[FILENAME_MAX + 64];
+    snprintf(msg, sizeof(msg), "The socket path `%s` is too long", path);
+    err(msg);
+    return 0;
+  }
+  strcpy(addr->sun_path, path);
+  return 1;
+}
+
+Server* new_server(const char* path, unsigned int nthreads,
+    size_t cache_size, const HvmeConfig* config) {
+  assert(path != NULL);
+
+  struct sockaddr_un addr;
+  if (!socket_addr(path, &addr)) return NULL;
+
+  /* Sockets are left behind by servers which didn't stop. */
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+      || listen(fd, LISTEN_BACKLOG) != 0) {
+    char msg[FILENAME_MAX + 128];
+    snprintf(msg, sizeof(msg), "Can't listen on `%s`: %s", path, strerror(errno));
+    err(msg);
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+
+  Server* server = (Server*) calloc (1, sizeof(Server));
+  assert(server != NULL);
+  server->path = (char*) malloc (strlen(path) + 1);
+  assert(server->path != NULL);
+  strcpy(server->path, path);
+  server->fd = fd;
+  int res = pipe(server->stop);
+  assert(res == 0);
+  (void) res;
+  server->config = config != NULL ? *config : hvme_config();
+  server->config.io = (HvmeIo) { .data=NULL, .out=NULL, .err=NULL, .in=NULL };
+  pthread_mutex_init(&server->cache.lock, NULL);
+  server->cache.max_size = cache_size;
+  pthread_mutex_init(&server->lock, NULL);
+  pthread_cond_init(&server->ready, NULL);
+
+  if (nthreads == 0) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = ncpus > 0 ? (unsigned int) ncpus : 1;
+  }
+  server->nworkers = nthreads;
+  server->workers = (pthread_t*) calloc (nthreads, sizeof(pthread_t));
+  assert(server->workers != NULL);
+  for (unsigned int i = 0; i < nthreads; i++) {
+    res = pthread_create(&server->workers[i], NULL, run_worker, server);
+    assert(res == 0);
+  }
+  res = pthread_create(&server->acceptor, NULL, run_acceptor, server);
+  assert(res == 0);
+
+  return server;
+}
+
+void del_server(Server* server) {
+  if (server == NULL) return;
+
+  pthread_mutex_lock(&server->lock);
+  __atomic_store_n(&server->stopping, 1, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&server->ready);
+  pthread_mutex_unlock(&server->lock);
+  /* Wakes up everyone waiting for a client. */
+  ssize_t n = write(server->stop[1], "", 1);
+  assert(n == 1);
+  (void) n;
+
+  pthread_join(server->acceptor, NULL);
+  for (unsigned int i = 0; i < server->nworkers; i++)
+    pthread_join(server->workers[i], NULL);
+
+  for (size_t i = 0; i < server->queue_len; i++) close(server->queue[i]);
+  close(server->fd);
+  unlink(server->path);
+  close(server->stop[0]);
+  close(server->stop[1]);
+
+  for (size_t i = 0; i < server->cache.len; i++) {
+    hvme_del(server->cache.entries[i]->vm);
+    free(server->cache.entries[i]);
+  }
+  free(server->cache.entries);
+  pthread_mutex_destroy(&server->cache.lock);
+  pthread_mutex_destroy(&server->lock);
+  pthread_cond_destroy(&server->ready);
+  free(server->queue);
+  free(server->workers);
+  free(server->path);
+  free(server);
+}
+
+int run_server(const char* path, unsigned int nthreads,
+    size_t cache_size, const HvmeConfig* config, int stats) {
+  /* Only this thread takes the signals. */
+  sigset_t signals, old;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, &old);
+
+  Server* server = new_server(path, nthreads, cache_size, config);
+  if (server == NULL) {
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return 1;
+  }
+  if (stats)
+    hvme_fprintf(stderr, "Serving on `%s` with %u threads\n", path, server->nworkers);
+
+  int sig;
+  sigwait(&signals, &sig);
+
+  if (stats) {
+    pthread_mutex_lock(&server->cache.lock);
+    hvme_fprintf(stderr, "Served %lu requests with %lu programs (%lu bytes) in the cache\n",
+      __atomic_load_n(&server->nrequests, __ATOMIC_RELAXED),
+      server->cache.len, server->cache.size);
+    pthread_mutex_unlock(&server->cache.lock);
+  }
+  del_server(server);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return 0;
+}
+
+int connect_server(const char* path) {
+  assert(path != NULL);
+
+  struct sockaddr_un addr;
+  if (!socket_addr(path, &addr)) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+    char msg[FILENAME_MAX + 128];
+    snprintf(msg, sizeof(msg), "Can't connect to `%s`: %s", path, strerror(errno));
+    err(msg);
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int serve_request(int fd, const ServeRequest* req, const HvmeIo* io, uint64_t* id) {
+  assert(req != NULL && io != NULL && id != NULL);
+
+  Buf buf = { NULL, 0, 0 };
+  for (unsigned int i = 0; i < req->nbufs; i++) {
+    size_t name_len = strlen(req->bufs[i].name) + 1;
+    add_header(&buf, 'S', name_len + req->bufs[i].len);
+    buf_add(&buf, req->bufs[i].name, name_len);
+    buf_add(&buf, req->bufs[i].text, req->bufs[i].len);
+  }
+  if (req->nbufs == 0) add_u64_frame(&buf, 'P', req->id);
+  if (req->input_len > 0) add_frame(&buf, 'I', req->input, req->input_len);
+  if (req->budget != HVME_UNLIMITED) add_u64_frame(&buf, 'B', req->budget);
+  add_frame(&buf, 'R', NULL, 0);
+  int sent = write_all(fd, buf.data, buf.len);
+  free(buf.data);
+  if (!sent) return -1;
+
+  Frame frame;
+  while (read_frame(fd, -1, &frame) == FRAME_OK) {
+    int status = -1;
+    if (frame.type == 'H' && frame.len == 8) {
+      *id = get_u64((unsigned char*) frame.data);
+    } else if (frame.type == 'O') {
+      if (io->out != NULL) io->out(io->data, frame.data);
+    } else if (frame.type == 'E') {
+      if (io->err != NULL) io->err(io->data, frame.data);
+    } else if (frame.type == 'X' && frame.len == 1) {
+      status = (unsigned char) frame.data[0];
+    }
+    free(frame.data);
+    if (status != -1) return status;
+  }
+  return -1;
+}
+
+/* Read all of `f`. */
+static char* read_stream(FILE* f, size_t* len) {
+  Buf buf = { NULL, 0, 0 };
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, sizeof(char), sizeof(chunk), f)) > 0)
+    buf_add(&buf, chunk, n);
+  buf_add(&buf, "", 1);
+  *len = buf.len - 1;
+  return buf.data;
+}
+
+static void client_out(void* data, const char* s) {
+  (void) data;
+  hvme_fputs(s, stdout);
+}
+
+static void client_err(void* data, const char* s) {
+  (void) data;
+  hvme_fputs(s, stderr);
+}
+
+int run_client(const char* path, unsigned int nfiles, const char** files,
+    const char* id, size_t budget, int stats) {
+  ServeRequest req = { .nbufs=nfiles, .bufs=NULL, .id=0, .budget=budget };
+  if (nfiles == 0) {
+    char* end;
+    if (id == NULL) {
+      err("Can't execute 0 files!");
+      return 1;
+    }
+    req.id = strtoull(id, &end, 16);
+    if (id[0] == '\0' || *end != '\0') {
+      char msg[64];
+      snprintf(msg, sizeof(msg), "Invalid program id `%.16s`", id);
+      err(msg);
+      return 1;
+    }
+  }
+
+  SourceBuf* bufs = (SourceBuf*) calloc (nfiles + 1, sizeof(SourceBuf));
+  assert(bufs != NULL);
+  int ret = 1;
+  unsigned int nread = 0;
+  for (; nread < nfiles; nread++) {
+    FILE* f = fopen(files[nread], "r");
+    if (f == NULL) {
+      char msg[FILENAME_MAX + 32];
+      snprintf(msg, sizeof(msg), "Can't read `%s`", files[nread]);
+      err(msg);
+      goto done;
+    }
+    bufs[nread].name = files[nread];
+    bufs[nread].text = read_stream(f, &bufs[nread].len);
+    fclose(f);
+  }
+  req.bufs = bufs;
+
+  char* input = read_stream(stdin, &req.input_len);
+  req.input = input;
+  int fd = connect_server(path);
+  if (fd >= 0) {
+    HvmeIo io = { .data=NULL, .out=client_out, .err=client_err, .in=NULL };
+    uint64_t prog_id = req.id;
+    int status = serve_request(fd, &req, &io, &prog_id);
+    close(fd);
+
+    if (stats && status >= 0 && status != SERVE_INVALID)
+      hvme_fprintf(stderr, "Program %016" PRIx64 "\n", prog_id);
+    switch (status) {
+      case SERVE_FINISHED:
+        clean_stdout();
+        ret = 0;
+        break;
+      case SERVE_ERROR:
+        break;
+      case SERVE_BUDGET:
+        err("The program ran out of budget");
+        break;
+      case SERVE_UNKNOWN:
+        err("The server doesn't have this program (anymore)");
+        break;
+      case SERVE_INVALID:
+        err("The server rejected the request");
+        break;
+      default:
+        err("Lost the connection to the server");
+    }
+  }
+  free(input);
+
+done:
+  for (unsigned int i = 0; i < nread; i++) free((char*) bufs[i].text);
+  free(bufs);
+  return ret;
+}
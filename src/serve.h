@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef _SERVE_H_
+#define _SERVE_H_
+
+#include "libhvme.h"
+
+#include <stdint.h>
+
+/* Server mode (`--serve`) and its client (`--connect`).
+ *
+ * The server listens on a Unix domain socket and keeps the
+ * programs it made. Requests and answers are frames: a byte
+ * with the frame's type, the length of its payload as 4
+ * bytes in network byte order and then the payload. A
+ * request is
+ *
+ *   'S' name '\0' text  a source file (one frame per file), or
+ *   'P' id              the id of a program the server made,
+ *   'I' bytes           input of the program (optional),
+ *   'B' budget          at most this many instructions (optional),
+ *   'R'                 run the request.
+ *
+ * The server answers with
+ *
+ *   'H' id              the id of the program,
+ *   'O' or 'E' text     the program's stdout or stderr,
+ *   'X' status          how the run ended (see `ServeStatus`).
+ *
+ * Ids and budgets are 8 bytes in network byte order. The id
+ * of a program is the hash of its sources. Output is sent
+ * while the program runs. A connection can send any number
+ * of requests one after another.
+ *
+ * Requests run on a thread pool, each with its own copy of
+ * the program's memory (see `hvme_clone`). Programs which
+ * aren't in use are deleted, least recently used first,
+ * once all programs need more than the cache size. */
+
+/* Default cache size of `--serve` in bytes. */
+#define SERVE_CACHE_SIZE (64lu << 20)
+
+typedef enum {
+  SERVE_FINISHED = 0,  /* The program reached its end. */
+  SERVE_ERROR = 1,  /* The program couldn't be made or failed. */
+  SERVE_BUDGET = 2,  /* The budget ran out. */
+  SERVE_UNKNOWN = 3,  /* There is no program with the id. */
+  SERVE_INVALID = 4,  /* The request is invalid. The connection is closed. */
+} ServeStatus;
+
+typedef struct Server Server;
+
+/* Listen on `path` and serve requests on `nthreads` threads
+ * (`0` for one per core) with programs made with `config`.
+ * Returns `NULL` and prints an error if it can't listen. */
+Server* new_server(const char* path, unsigned int nthreads,
+  size_t cache_size, const HvmeConfig* config);
+
+/* Stop serving and remove the socket. Requests which are
+ * running are cut off. */
+void del_server(Server* server);
+
+/* Serve until SIGINT or SIGTERM. Returns `0` if the server
+ * could listen on `path` and `1` otherwise. */
+int run_server(const char* path, unsigned int nthreads,
+  size_t cache_size, const HvmeConfig* config, int stats);
+
+typedef struct {
+  unsigned int nbufs;  /* `0` to run the program with `id`. */
+  const SourceBuf* bufs;
+  uint64_t id;
+  const char* input;
+  size_t input_len;
+  size_t budget;  /* `HVME_UNLIMITED` for no limit. */
+} ServeRequest;
+
+/* Connect to the server on `path`. Returns the socket or `-1`
+ * and prints an error. */
+int connect_server(const char* path);
+
+/* Run `req` on the server connected to `fd`. The output is
+ * passed to `io` as it arrives and `id` is set to the
+ * program's id. Returns a `ServeStatus` or `-1` if the
+ * connection broke. */
+int serve_request(int fd, const ServeRequest* req, const HvmeIo* io, uint64_t* id);
+
+/* Run `files` or the program `id` (if there are no files)
+ * on the server on `path` with stdin as input, like running
+ * them directly. Returns the exit status. */
+int run_client(const char* path, unsigned int nfiles, const char** files,
+  const char* id, size_t budget, int stats);
+
+#endif  // _SERVE_H_
@@ -0,0 +1,267 @@
+#include "snapshot.h"
+#include "exec.h"
+#include "jack.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Snapshots with deeper stacks are rejected as invalid. */
+#define SNAP_MAX_STACK (1lu << 28)
+
+static const char* snapshot_file = NULL;
+
+void set_snapshot_file(const char* path) {
+  snapshot_file = path;
+}
+
+const char* snapshot_error(int res) {
+  switch (res) {
+    case SNAP_OK: return "no error";
+    case SNAP_ERR: return "can't access the file";
+    case SNAP_INVALID: return "not a valid snapshot";
+    case SNAP_MISMATCH: return "taken from another program";
+    default: return "unknown error";
+  }
+}
+
+static void put_num(FILE* f, uint64_t num, int nbytes) {
+  for (int i = 0; i < nbytes; i++, num >>= 8) fputc(num & 0xFF, f);
+}
+
+static int get_num(FILE* f, uint64_t* num, int nbytes) {
+  *num = 0;
+  for (int i = 0; i < nbytes; i++) {
+    int c = fgetc(f);
+    if (c == EOF) return 0;
+    *num |= (uint64_t) c << (8 * i);
+  }
+  return 1;
+}
+
+/* Write `n` words as runs of zeros and runs of other words. */
+static void put_words(FILE* f, const Word* words, size_t n) {
+  for (size_t i = 0; i < n;) {
+    size_t nzero = 0;
+    while (i + nzero < n && words[i + nzero] == 0) nzero ++;
+    size_t nlit = 0;
+    while (i + nzero + nlit < n && words[i + nzero + nlit] != 0) nlit ++;
+
+    put_num(f, nzero, 4);
+    put_num(f, nlit, 4);
+    for (size_t j = 0; j < nlit; j++) put_num(f, words[i + nzero + j], 2);
+    i += nzero + nlit;
+  }
+}
+
+static int get_words(FILE* f, Word* words, size_t n) {
+  for (size_t i = 0; i < n;) {
+    uint64_t nzero, nlit;
+    if (!get_num(f, &nzero, 4) || !get_num(f, &nlit, 4)) return 0;
+    if (nzero + nlit == 0 || nzero + nlit > n - i) return 0;
+    memset(&words[i], 0, nzero * sizeof(Word));
+    i += nzero;
+    for (; nlit > 0; nlit --) {
+      uint64_t word;
+      if (!get_num(f, &word, 2)) return 0;
+      words[i ++] = (Word) word;
+    }
+  }
+  return 1;
+}
+
+static size_t heap_words(const Heap* heap) {
+  return heap->mask != 0 ? heap->mask + 1 : MEM_HEAP_WORDS + 2;
+}
+
+int save_snapshot(const Program* prog, const char* path) {
+  assert(prog != NULL && path != NULL);
+
+  FILE* f = fopen(path, "wb");
+  if (f == NULL) return SNAP_ERR;
+
+  fputs(SNAP_MAGIC, f);
+  put_num(f, SNAP_VERSION, 4);
+
+  /* What the snapshot must be restored into. */
+  put_num(f, prog->nfiles, 4);
+  put_num(f, prog->heap.mask, 8);
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    const File* file = &prog->files[fi];
+    size_t len = strlen(file->filename);
+    put_num(f, len, 4);
+    fwrite(file->filename, sizeof(char), len, f);
+    put_num(f, file->insts.idx, 8);
+  }
+
+  put_num(f, prog->fi, 4);
+  for (unsigned int fi = 0; fi < prog->nfiles; fi++) {
+    const File* file = &prog->files[fi];
+    put_num(f, file->ei, 8);
+    /* The segments are part of the unified RAM. */
+    if (prog->heap.mask == 0) {
+      put_words(f, file->mem._static, MEM_STAT_SIZE);
+      put_words(f, file->mem.tmp, MEM_TEMP_SIZE);
+    }
+  }
+
+  /* `this` and `that` are stored in the heap. */
+  put_words(f, prog->heap.mem, heap_words(&prog->heap));
+
+  const Stack* stack = &prog->stack;
+  put_num(f, stack->sp, 8);
+  put_num(f, stack->arg, 8);
+  put_num(f, stack->arg_len, 8);
+  put_num(f, stack->lcl, 8);
+  put_num(f, stack->lcl_len, 8);
+  put_words(f, stack->ops, stack->sp);
+
+  const JackOs* os = (const JackOs*) prog->heap.os;
+  fputc(os != NULL, f);
+  if (os != NULL) {
+    put_num(f, os->color, 2);
+    put_num(f, (uint32_t) os->line, 4);
+    put_num(f, (uint32_t) os->col, 4);
+    put_num(f, os->nframes, 4);
+  }
+
+  int failed = ferror(f);
+  return fclose(f) == 0 && !failed ? SNAP_OK : SNAP_ERR;
+}
+
+/* Check that the snapshot in `f` was taken from `prog`. */
+static int check_prog(FILE* f, const Program* prog) {
+  char magic[sizeof(SNAP_MAGIC) - 1];
+  uint64_t version, nfiles, mask;
+  if (
+    fread(magic, sizeof(char), sizeof(magic), f) != sizeof(magic) ||
+    memcmp(magic, SNAP_MAGIC, sizeof(magic)) != 0 ||
+    !get_num(f, &version, 4) || version != SNAP_VERSION ||
+    !get_num(f, &nfiles, 4) || !get_num(f, &mask, 8)
+  ) return SNAP_INVALID;
+
+  int res = nfiles == prog->nfiles && mask == prog->heap.mask ? SNAP_OK : SNAP_MISMATCH;
+  for (unsigned int fi = 0; fi < nfiles && res == SNAP_OK; fi++) {
+    const File* file = &prog->files[fi];
+    uint64_t len, ninsts;
+    if (!get_num(f, &len, 4)) return SNAP_INVALID;
+    if (len != strlen(file->filename)) return SNAP_MISMATCH;
+
+    char* name = (char*) malloc (len + 1);
+    assert(name != NULL);
+    int read = fread(name, sizeof(char), len, f) == len;
+    name[len] = '\0';
+    int same = read && strcmp(name, file->filename) == 0;
+    free(name);
+
+    if (!read || !get_num(f, &ninsts, 8)) return SNAP_INVALID;
+    if (!same || ninsts != file->insts.idx) res = SNAP_MISMATCH;
+  }
+  return res;
+}
+
+/* Read the state after the header into `prog`. */
+static int read_state(FILE* f, Program* prog) {
+  uint64_t fi;
+  if (!get_num(f, &fi, 4) || fi >= prog->nfiles) return SNAP_INVALID;
+  prog->fi = (unsigned int) fi;
+
+  for (unsigned int i = 0; i < prog->nfiles; i++) {
+    File* file = &prog->files[i];
+    uint64_t ei;
+    if (!get_num(f, &ei, 8) || ei > file->insts.idx) return SNAP_INVALID;
+    file->ei = (unsigned int) ei;
+    if (prog->heap.mask == 0 && (
+      !get_words(f, file->mem._static, MEM_STAT_SIZE) ||
+      !get_words(f, file->mem.tmp, MEM_TEMP_SIZE)
+    )) return SNAP_INVALID;
+  }
+
+  if (!get_words(f, prog->heap.mem, heap_words(&prog->heap))) return SNAP_INVALID;
+
+  Stack* stack = &prog->stack;
+  uint64_t sp, arg, arg_len, lcl, lcl_len;
+  if (
+    !get_num(f, &sp, 8) || !get_num(f, &arg, 8) || !get_num(f, &arg_len, 8) ||
+    !get_num(f, &lcl, 8) || !get_num(f, &lcl_len, 8) ||
+    sp > SNAP_MAX_STACK || arg > sp || lcl > sp
+  ) return SNAP_INVALID;
+  if (sp > stack->len) {
+    while (sp > stack->len) stack->len += STACK_BLOCK_SIZE;
+    stack->ops = (Word*) realloc (stack->ops, stack->len * sizeof(Word));
+    assert(stack->ops != NULL);
+  }
+  if (!get_words(f, stack->ops, sp)) return SNAP_INVALID;
+  stack->sp = sp;
+  stack->arg = arg;
+  stack->arg_len = arg_len;
+  stack->lcl = lcl;
+  stack->lcl_len = lcl_len;
+
+  int has_os = fgetc(f);
+  if (has_os == 1) {
+    uint64_t color, line, col, nframes;
+    if (
+      !get_num(f, &color, 2) || !get_num(f, &line, 4) ||
+      !get_num(f, &col, 4) || !get_num(f, &nframes, 4) ||
+      line >= OUTPUT_LINES || col >= OUTPUT_COLS
+    ) return SNAP_INVALID;
+    JackOs* os = jack_os(&prog->heap);
+    os->color = (Word) color;
+    os->line = (int) line;
+    os->col = (int) col;
+    os->nframes = (unsigned int) nframes;
+  } else if (has_os != 0) {
+    return SNAP_INVALID;
+  }
+
+  return fgetc(f) == EOF ? SNAP_OK : SNAP_INVALID;
+}
+
+int load_snapshot(Program* prog, const char* path) {
+  assert(prog != NULL && path != NULL);
+
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) return SNAP_ERR;
+  int res = check_prog(f, prog);
+  if (res == SNAP_OK) res = read_state(f, prog);
+  fclose(f);
+  return res;
+}
+
+/* `Sys.snapshot() -> 0`
+ * writes a snapshot to the file of `set_snapshot_file`.
+ * Runs which are restored from it continue after the call. */
+static int sys_snapshot(NativeCtx* ctx, const Word* args, Word* ret) {
+  (void) args;
+  *ret = 0;
+  if (snapshot_file == NULL) return NATIVE_OK;
+
+  Program* prog = running_prog();
+  if (prog == NULL)
+    return native_error(ctx, "`Sys.snapshot` needs the stack interpreter (no `--registers`)");
+
+  /* Save the state right after the call. A bound call has
+   * already made room for the result. The wrapper in the
+   * system file pushes it afterwards. */
+  File* file = &prog->files[prog->fi];
+  int wrapped = file->insts.cell[file->ei].code == BUILTIN;
+  if (wrapped) spush(&prog->stack, 0);
+  file->ei ++;
+  int res = save_snapshot(prog, snapshot_file);
+  file->ei --;
+  if (wrapped) prog->stack.sp --;
+
+  if (res != SNAP_OK) {
+    return native_error(ctx, "can't write the snapshot to `%s`: %s",
+      snapshot_file, snapshot_error(res));
+  }
+  return NATIVE_OK;
+}
+
+const Native snapshot_natives[] = {
+  { "Sys.snapshot", 0, sys_snapshot, NULL },
+};
+
+const size_t nsnapshot_natives = sizeof(snapshot_natives) / sizeof(snapshot_natives[0]);
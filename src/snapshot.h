@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "native.h"
+
+/* Snapshots of a running program (`--snapshot`, `--restore`).
+ *
+ * A snapshot holds everything a program changes while it runs:
+ * the heap (including `this` and `that`), the stack with its
+ * `arg` and `lcl` segments, the `static` and `temp` segments
+ * of all files, the active file, the execution index of every
+ * file and the state of the OS classes. The code isn't part of
+ * it. It can only be restored into the program it was taken
+ * from, made from the same files with the same options. Its
+ * file names and numbers of instructions are checked.
+ *
+ * The file starts with `SNAP_MAGIC` and a version. All numbers
+ * are little endian. Runs of zero words are only stored as
+ * their length, so unused memory takes almost no space. */
+
+#define SNAP_MAGIC "HVMESNAP"
+#define SNAP_VERSION 1
+
+#define SNAP_OK 1
+#define SNAP_ERR 0  /* The file can't be read or written. */
+#define SNAP_INVALID -1  /* The file isn't a valid snapshot. */
+#define SNAP_MISMATCH -2  /* The snapshot is of another program. */
+
+/* `Sys.snapshot` */
+extern const Native snapshot_natives[];
+extern const size_t nsnapshot_natives;
+
+/* Write the state of `prog` to `path`. The program continues
+ * where it is now once the snapshot is restored. */
+int save_snapshot(const Program* prog, const char* path);
+
+/* Replace the state of `prog` by the snapshot in `path`.
+ * `prog` runs from there on instead of from `Sys.init`. */
+int load_snapshot(Program* prog, const char* path);
+
+/* Error message for the result of `save_snapshot` or
+ * `load_snapshot`. */
+const char* snapshot_error(int res);
+
+/* Write a snapshot to `path` whenever the program calls
+ * `Sys.snapshot`. `NULL` (the default) makes the calls do
+ * nothing. */
+void set_snapshot_file(const char* path);
+
+#endif  // _SNAPSHOT_H_
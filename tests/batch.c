@@ -0,0 +1,79 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include "utils.h"
+#include "../src/batch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define NJOBS 20
+
+/* Read the first line of `fn` into `buf`. */
+static const char* first_line(const char* fn, char* buf, size_t len) {
+  FILE* f = fopen(fn, "r");
+  assert(f != NULL);
+  if (fgets(buf, len, f) == NULL) buf[0] = '\0';
+  fclose(f);
+  return buf;
+}
+
+TEST(runs_all_jobs) {
+  char double_vm[] = "/tmp/XXXXXX";
+  setup_tmp(double_vm,
+    "function Sys.init 0\n"
+    "call Sys.read_num 0\n"
+    "push constant 2\n"
+    "call Math.multiply 2\n"
+    "call Sys.print_num 1\n"
+    "return\n");
+  char fail_vm[] = "/tmp/XXXXXX";
+  setup_tmp(fail_vm,
+    "function Sys.init 0\n"
+    "add\n"
+    "return\n");
+
+  char inputs[NJOBS][12];
+  char outputs[NJOBS + 1][12];
+  char jobs_txt[NJOBS * 48 + 64] = "# input output files\n\n";
+  for (int i = 0; i < NJOBS; i++) {
+    char num[8];
+    snprintf(num, sizeof(num), "%d\n", i);
+    strcpy(inputs[i], "/tmp/XXXXXX");
+    strcpy(outputs[i], "/tmp/XXXXXX");
+    setup_tmp(inputs[i], num);
+    setup_tmp(outputs[i], "");
+    snprintf(jobs_txt + strlen(jobs_txt), sizeof(jobs_txt) - strlen(jobs_txt),
+      "%s %s %s\n", inputs[i], outputs[i], double_vm);
+  }
+  strcpy(outputs[NJOBS], "/tmp/XXXXXX");
+  setup_tmp(outputs[NJOBS], "");
+  snprintf(jobs_txt + strlen(jobs_txt), sizeof(jobs_txt) - strlen(jobs_txt),
+    "%s %s %s\n", inputs[0], outputs[NJOBS], fail_vm);
+
+  char jobs[] = "/tmp/XXXXXX";
+  setup_tmp(jobs, jobs_txt);
+
+  HvmeConfig config = hvme_config();
+  /* The failing job fails the batch, but all others run. */
+  assert_int(run_batch(jobs, 3, &config, 0), ==, 1);
+  char line[32];
+  for (int i = 0; i < NJOBS; i++) {
+    char expect[16];
+    snprintf(expect, sizeof(expect), "%d\n", 2 * i);
+    assert_string_equal(first_line(outputs[i], line, sizeof(line)), expect);
+  }
+  assert_int(check_stream("stack underflow", 400, stderr), ==, 1);
+
+  /* Lines without source files are rejected. */
+  char bad_jobs[] = "/tmp/XXXXXX";
+  setup_tmp(bad_jobs, "in.txt out.txt\n");
+  assert_int(run_batch(bad_jobs, 1, &config, 0), ==, 1);
+
+  return MUNIT_OK;
+}
+
+MunitTest batch_tests[] = {
+  REG_TEST(runs_all_jobs),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
@@ -5,6 +5,7 @@
 #include "../src/parse.h"
 #include "../src/exec.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -13,6 +14,37 @@ extern Memory new_mem(void);
 
 #define TEST_PROG_NAME "test_internal"
 
+/* Every test runs both on the stack instructions
+ * and on their register bytecode. */
+static char* interp_values[] = { "stack", "registers", NULL };
+static MunitParameterEnum interp_params[] = {
+  { "interp", interp_values },
+  { NULL, NULL },
+};
+
+#define EXEC_TEST(name) \
+  { "/"#name, name, NULL, NULL, MUNIT_TEST_OPTION_NONE, interp_params }
+
+static int run_prog(const MunitParameter p[], Program* prog) {
+  if (strcmp(munit_parameters_get(p, "interp"), "registers") != 0)
+    return exec_prog(prog);
+
+  Regs* regs = make_regs(prog);
+  int res = exec_regs(prog, regs);
+  del_regs(regs);
+  return res;
+}
+
+static int run_unchecked(const MunitParameter p[], Program* prog) {
+  if (strcmp(munit_parameters_get(p, "interp"), "registers") != 0)
+    return exec_prog_unchecked(prog);
+
+  Regs* regs = make_regs(prog);
+  int res = exec_regs_unchecked(prog, regs);
+  del_regs(regs);
+  return res;
+}
+
 static Program* setup_prog(Inst* arr, size_t len) {
   File* file = (File*) calloc (1, sizeof(File));
   file->filename =
@@ -20,7 +52,8 @@ static Program* setup_prog(Inst* arr, size_t len) {
   assert(file->filename != NULL);
   strcpy(file->filename, TEST_PROG_NAME);
   file->st = new_st();
-  file->insts = new_insts(TEST_PROG_NAME);
+  /* The instructions aren't from a source file. */
+  file->insts = new_insts(NULL);
   file->insts.cell =
     (Inst*) realloc (file->insts.cell, len * sizeof(Inst));
   memcpy(file->insts.cell, arr, len * sizeof(Inst));
@@ -46,7 +79,7 @@ TEST(correct_stack_errors) {
       {.code=POP, .mem={.seg=TMP, .offset=0}},
     };
     Program* prog = setup_prog(inst_arr, 1);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     del_prog(prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(check_stream("stack underflow", 30, stderr), ==, 1);
@@ -61,7 +94,7 @@ TEST(correct_memory_errors) {
       { .code=PUSH, .mem={ .seg=PTR, .offset=2 }},
     };
     Program* prog = setup_prog(inst_arr, 1);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     del_prog(prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(check_stream("can't access pointer segment at `2` (max. index is 1)", 30, stderr), ==, 1);
@@ -74,12 +107,25 @@ TEST(correct_memory_errors) {
       { .code=POP, .mem={ .seg=THIS, .offset=1 }},  // Pop this value to address 0xFFFF + 1 -> overflow
     };
     Program* prog = setup_prog(inst_arr, 4);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     del_prog(prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(check_stream("address overflow: "
       "`pop this 1` tries to access heap at 65536", 30, stderr), ==, 1);
   }
+  {  // The heap ends before `MEM_HEAP_SIZE`.
+    Inst inst_arr[] = {
+      { .code=PUSH, .mem={ .seg=CONST, .offset=MEM_HEAP_SIZE }},
+      { .code=POP, .mem={ .seg=PTR, .offset=1 }},
+      { .code=PUSH, .mem={ .seg=THAT, .offset=0 }},
+    };
+    Program* prog = setup_prog(inst_arr, 3);
+    int res = run_prog(p, prog);
+    del_prog(prog);
+    assert_int(res, ==, EXEC_ERR);
+    assert_int(check_stream("address overflow: "
+      "`push that 0` tries to access heap at 4096", 30, stderr), ==, 1);
+  }
 
   return MUNIT_OK;
 }
@@ -92,7 +138,7 @@ TEST(arithmetic_errors) {
       { .code=ADD },
     };
     Program* prog = setup_prog(inst_arr, 3);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     del_prog(prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(check_stream("addition overflow: 65535 + 1 = 65536 > 65535", 30, stderr), ==, 1);
@@ -104,7 +150,7 @@ TEST(arithmetic_errors) {
       { .code=SUB },
     };
     Program* prog = setup_prog(inst_arr, 3);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     del_prog(prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(check_stream("subtraction underflow: 0 - 1 = -1 < 0", 30, stderr), ==, 1);
@@ -126,13 +172,52 @@ TEST(arithmetic_instructions) {
     { .code=ADD },
   };
   Program* prog = setup_prog(inst_arr, 9);
-  int res = exec_prog(prog);
+  int res = run_prog(p, prog);
   assert_int(res, ==, 0);
   assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 3);
   del_prog(prog);
   return MUNIT_OK;
 }
 
+TEST(unchecked_arithmetic_wraps_around) {
+  Inst inst_arr[] = {
+    { .code=PUSH, .mem={ .seg=CONST, .offset=65535 }},
+    { .code=PUSH, .mem={ .seg=CONST, .offset=2 }},
+    { .code=ADD },
+    { .code=POP, .mem={ .seg=TMP, .offset=0 }},
+    { .code=PUSH, .mem={ .seg=CONST, .offset=0 }},
+    { .code=PUSH, .mem={ .seg=CONST, .offset=3 }},
+    { .code=SUB },
+    { .code=PUSH, .mem={ .seg=TMP, .offset=0 }},
+    { .code=ADD },
+  };
+  Program* prog = setup_prog(inst_arr, 9);
+  int res = run_unchecked(p, prog);
+  assert_int(res, ==, 0);
+  assert_int(prog->files[0].mem.tmp[0], ==, 1);
+  assert_int(prog->stack.sp, ==, 1);
+  assert_int(prog->stack.ops[0], ==, 65534);
+  del_prog(prog);
+  return MUNIT_OK;
+}
+
+TEST(unchecked_heap_covers_all_addresses) {
+  Inst inst_arr[] = {
+    { .code=PUSH, .mem={ .seg=CONST, .offset=30000 }},
+    { .code=POP, .mem={ .seg=PTR, .offset=0 }},
+    { .code=PUSH, .mem={ .seg=CONST, .offset=7 }},
+    { .code=POP, .mem={ .seg=THIS, .offset=10000 }},
+    { .code=PUSH, .mem={ .seg=THIS, .offset=10000 }},
+  };
+  Program* prog = setup_prog(inst_arr, 5);
+  int res = run_unchecked(p, prog);
+  assert_int(res, ==, 0);
+  assert_int(prog->heap.mem[40000], ==, 7);
+  assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 7);
+  del_prog(prog);
+  return MUNIT_OK;
+}
+
 TEST(stack_buildup_works) {
   // Buildup
   Inst inst_arr1[] = {
@@ -147,7 +232,7 @@ TEST(stack_buildup_works) {
     { .code=ADD },
   };
   Program* prog = setup_prog(inst_arr1, 9);
-  int res = exec_prog(prog);
+  int res = run_prog(p, prog);
   assert_int(res, ==, 0);
   // `prog->stack.len` might be the usual 4096
   // if parts of the binary were compiled without
@@ -174,7 +259,7 @@ TEST(stack_doesnt_change_on_error) {
       { .code=ADD },
     };
     Program* prog = setup_prog(inst_arr, 3);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 9);
     assert_int(prog->stack.ops[prog->stack.sp - 2], ==, 65535);
@@ -189,7 +274,7 @@ TEST(stack_doesnt_change_on_error) {
       { .code=POP, .mem={ .seg=THIS, .offset=1 }},
     };
     Program* prog = setup_prog(inst_arr, 4);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(prog->stack.sp, ==, 1);
     assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 1);
@@ -204,7 +289,7 @@ TEST(stack_doesnt_change_on_error) {
       { .code=PUSH, .mem={ .seg=THIS, .offset=1 }},
     };
     Program* prog = setup_prog(inst_arr, 4);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(prog->stack.sp, ==, 1);
     assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 1);
@@ -218,7 +303,7 @@ TEST(stack_doesnt_change_on_error) {
       { .code=POP, .mem={ .seg=PTR, .offset=2 }},
     };
     Program* prog = setup_prog(inst_arr, 2);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(prog->stack.sp, ==, 1);
     assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 1);
@@ -232,7 +317,7 @@ TEST(stack_doesnt_change_on_error) {
       { .code=SUB },
     };
     Program* prog = setup_prog(inst_arr, 3);
-    int res = exec_prog(prog);
+    int res = run_prog(p, prog);
     assert_int(res, ==, EXEC_ERR);
     assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 1);
     assert_int(prog->stack.ops[prog->stack.sp - 2], ==, 0);
@@ -242,13 +327,73 @@ TEST(stack_doesnt_change_on_error) {
   return MUNIT_OK;
 }
 
+typedef struct {
+  const MunitParameter* p;
+  Program* prog;
+  int res;
+} Run;
+
+static void* run_thread(void* arg) {
+  Run* run = (Run*) arg;
+  run->res = run_prog(run->p, run->prog);
+  return NULL;
+}
+
+TEST(programs_run_concurrently) {
+  Inst sum_arr[] = {
+    { .code=PUSH, .mem={ .seg=CONST, .offset=1000 }},
+    { .code=PUSH, .mem={ .seg=CONST, .offset=234 }},
+    { .code=ADD },
+    { .code=POP, .mem={ .seg=TMP, .offset=0 }},
+  };
+  Inst underflow_arr[] = {
+    { .code=PUSH, .mem={ .seg=CONST, .offset=1 }},
+    { .code=ADD },
+  };
+  /* Faults on the guard pages of the unified RAM. */
+  Inst guard_arr[] = {
+    { .code=PUSH, .mem={ .seg=CONST, .offset=32767 }},
+    { .code=POP, .mem={ .seg=PTR, .offset=1 }},
+    { .code=PUSH, .mem={ .seg=CONST, .offset=1 }},
+    { .code=POP, .mem={ .seg=THAT, .offset=1 }},
+  };
+
+  for (int round = 0; round < 8; round++) {
+    Run runs[] = {
+      { p, setup_prog(sum_arr, 4), 1 },
+      { p, setup_prog(underflow_arr, 2), 1 },
+      { p, setup_prog(guard_arr, 4), 1 },
+    };
+    assert_int(use_ram(runs[2].prog, 0x8000), ==, 1);
+
+    pthread_t threads[3];
+    for (int i = 0; i < 3; i++)
+      assert_int(pthread_create(&threads[i], NULL, run_thread, &runs[i]), ==, 0);
+    for (int i = 0; i < 3; i++)
+      pthread_join(threads[i], NULL);
+
+    assert_int(runs[0].res, ==, 0);
+    assert_int(runs[0].prog->files[0].mem.tmp[0], ==, 1234);
+    assert_int(runs[1].res, ==, EXEC_ERR);
+    assert_int(runs[2].res, ==, EXEC_ERR);
+    assert_int(runs[2].prog->heap.mem[0x7FFF], ==, 0);
+    for (int i = 0; i < 3; i++)
+      del_prog(runs[i].prog);
+  }
+
+  return MUNIT_OK;
+}
+
 MunitTest exec_tests[] = {
-  REG_TEST(correct_stack_errors),
-  REG_TEST(correct_memory_errors),
-  REG_TEST(arithmetic_errors),
-  REG_TEST(arithmetic_instructions),
-  REG_TEST(stack_doesnt_change_on_error),
-  REG_TEST(stack_buildup_works),
+  EXEC_TEST(correct_stack_errors),
+  EXEC_TEST(correct_memory_errors),
+  EXEC_TEST(arithmetic_errors),
+  EXEC_TEST(arithmetic_instructions),
+  EXEC_TEST(stack_doesnt_change_on_error),
+  EXEC_TEST(unchecked_arithmetic_wraps_around),
+  EXEC_TEST(unchecked_heap_covers_all_addresses),
+  EXEC_TEST(stack_buildup_works),
+  EXEC_TEST(programs_run_concurrently),
   { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -0,0 +1,76 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include "utils.h"
+#include "../src/fork_server.h"
+
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Double the number on stdin. Odd numbers fail and
+ * `13` kills the run. */
+static int double_num(void* data) {
+  int* nruns = (int*) data;
+  (*nruns) ++;
+  int num;
+  if (scanf("%d", &num) != 1) return 2;
+  if (num == 13) raise(SIGKILL);
+  printf("%d\n", 2 * num);
+  fprintf(stderr, "run %d\n", *nruns);
+  return num % 2;
+}
+
+/* Read all of `fn` into `buf`. */
+static const char* read_file(const char* fn, char* buf, size_t len) {
+  FILE* f = fopen(fn, "r");
+  assert(f != NULL);
+  size_t n = fread(buf, sizeof(char), len - 1, f);
+  buf[n] = '\0';
+  fclose(f);
+  return buf;
+}
+
+TEST(forks_runs) {
+  char in[3][12] = { "/tmp/XXXXXX", "/tmp/XXXXXX", "/tmp/XXXXXX" };
+  char out[3][12] = { "/tmp/XXXXXX", "/tmp/XXXXXX", "/tmp/XXXXXX" };
+  char errs[] = "/tmp/XXXXXX";
+  char replies[] = "/tmp/XXXXXX";
+  setup_tmp(in[0], "4");
+  setup_tmp(in[1], "7");
+  setup_tmp(in[2], "13");
+  for (int i = 0; i < 3; i++) setup_tmp(out[i], "");
+  setup_tmp(errs, "");
+  setup_tmp(replies, "");
+
+  char reqs[512];
+  snprintf(reqs, sizeof(reqs), "%s %s %s\n\n%s %s\n%s %s\n%s\n",
+    in[0], out[0], errs, in[1], out[1], in[2], out[2], in[0]);
+  int ctl[2];
+  assert_int(pipe(ctl), ==, 0);
+  assert_true(write(ctl[1], reqs, strlen(reqs)) == (ssize_t) strlen(reqs));
+  close(ctl[1]);
+
+  FILE* reply = fopen(replies, "w");
+  int nruns = 0;
+  assert_int(run_fork_server(ctl[0], reply, double_num, &nruns), ==, 1);
+  fclose(reply);
+  close(ctl[0]);
+
+  /* The runs happen in their own processes. */
+  assert_int(nruns, ==, 0);
+  char buf[64];
+  assert_string_equal(read_file(replies, buf, sizeof(buf)), "0\n1\n137\n-1\n");
+  assert_string_equal(read_file(out[0], buf, sizeof(buf)), "8\n");
+  assert_string_equal(read_file(errs, buf, sizeof(buf)), "run 1\n");
+  assert_string_equal(read_file(out[1], buf, sizeof(buf)), "14\n");
+  assert_string_equal(read_file(out[2], buf, sizeof(buf)), "");
+  assert_int(check_stream("Invalid request", 200, stderr), ==, 1);
+
+  return MUNIT_OK;
+}
+
+MunitTest fork_server_tests[] = {
+  REG_TEST(forks_runs),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
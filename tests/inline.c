@@ -0,0 +1,161 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <stdio.h>
+
+#include "../src/inline.h"
+#include "../src/exec.h"
+#include "utils.h"
+
+static Program* setup_inline_prog(char* fn, const char* cnt) {
+  setup_tmp(fn, cnt);
+  const char* argv[] = {fn};
+  Program* prog = make_prog(1, argv);
+  assert(prog != NULL);
+  return prog;
+}
+
+static int calls(const Program* prog, unsigned int fi) {
+  int n = 0;
+  for (size_t i = 0; i < prog->files[fi].insts.idx; i++) {
+    if (prog->files[fi].insts.cell[i].code == CALL) n++;
+  }
+  return n;
+}
+
+TEST(inline_accessor) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_inline_prog(fn,
+    "function Point.sum 1\n"
+    "push argument 0\n"
+    "push argument 1\n"
+    "add\n"
+    "pop local 0\n"
+    "push local 0\n"
+    "push local 0\n"
+    "add\n"
+    "return\n"
+    "function Sys.init 1\n"
+    "push constant 3\n"
+    "push constant 4\n"
+    "call Point.sum 2\n"
+    "pop local 0\n"
+    "push local 0\n"
+    "push constant 1\n"
+    "call Point.sum 2\n"
+    "return\n");
+  assert_int(inline_prog(prog), ==, 2);
+  assert_int(calls(prog, 1), ==, 0);
+
+  /* The arguments and the local of `Point.sum` are new locals. */
+  SymKey key = mk_key("Sys.init", SBT_FUNC);
+  SymVal val;
+  assert_int(get_st(prog->files[1].st, &key, &val), ==, GTRES_OK);
+  assert_int(val.nlocals, ==, 4);
+  key = mk_key("Point.sum", SBT_FUNC);
+  assert_int(get_st(prog->files[1].st, &key, &val), ==, GTRES_ERR);
+
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.sp, ==, 1);
+  assert_int(prog->stack.ops[0], ==, 30);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(restore_pointers) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_inline_prog(fn,
+    "function Point.x 0\n"
+    "push argument 0\n"
+    "pop pointer 0\n"
+    "push this 0\n"
+    "return\n"
+    "function Sys.init 0\n"
+    "push constant 100\n"
+    "pop pointer 0\n"
+    "push constant 9\n"
+    "pop this 0\n"
+    "push constant 200\n"
+    "pop pointer 0\n"
+    "push constant 5\n"
+    "pop this 0\n"
+    "push constant 100\n"
+    "call Point.x 1\n"
+    "push this 0\n"  // <- `this` is still 200.
+    "add\n"
+    "return\n");
+  assert_int(inline_prog(prog), ==, 1);
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 14);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(keep_error_positions) {
+  char fn1[] = "/tmp/XXXXXX";
+  setup_tmp(fn1,
+    "function Math.inc 0\n"
+    "push argument 0\n"
+    "push constant 1\n"
+    "add\n"
+    "return\n");
+  char fn2[] = "/tmp/XXXXXX";
+  setup_tmp(fn2,
+    "function Sys.init 0\n"
+    "push constant 65535\n"
+    "call Math.inc 1\n"
+    "return\n");
+  const char* argv[] = { fn1, fn2 };
+  Program* prog = make_prog(2, argv);
+  assert_ptr_not_null(prog);
+
+  assert_int(inline_prog(prog), ==, 1);
+  assert_int(calls(prog, 2), ==, 0);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  /* The error points into the callee's file. */
+  char expect[64];
+  snprintf(expect, sizeof(expect), "%s:4:1):\033[0m addition overflow", fn1);
+  assert_int(check_stream(expect, 400, stderr), ==, 1);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(skip_unknown_stack_depth) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_inline_prog(fn,
+    "function Main.one 0\n"
+    "push constant 1\n"
+    "return\n"
+    "function Main.branch 0\n"
+    "push argument 0\n"
+    "if-goto skip\n"
+    "push constant 2\n"
+    "label skip\n"  // <- The stack depth differs between paths.
+    "call Main.one 0\n"
+    "return\n"
+    "function Sys.init 0\n"
+    "push constant 0\n"
+    "call Main.branch 1\n"
+    "call Main.one 0\n"
+    "add\n"
+    "return\n");
+  /* Only the call from `Sys.init` is inlined. */
+  assert_int(inline_prog(prog), ==, 1);
+  assert_int(calls(prog, 1), ==, 2);
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 2);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+MunitTest inline_tests[] = {
+  REG_TEST(inline_accessor),
+  REG_TEST(restore_pointers),
+  REG_TEST(keep_error_positions),
+  REG_TEST(skip_unknown_stack_depth),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
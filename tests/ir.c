@@ -0,0 +1,221 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <stdio.h>
+
+#include "../src/ir.h"
+#include "../src/exec.h"
+#include "utils.h"
+
+static Program* setup_ir_prog(char* fn, const char* cnt) {
+  setup_tmp(fn, cnt);
+  const char* argv[] = {fn};
+  Program* prog = make_prog(1, argv);
+  assert(prog != NULL);
+  return prog;
+}
+
+static uint16_t nlocals_of(const Program* prog, const char* func) {
+  SymKey key = mk_key(func, SBT_FUNC);
+  SymVal val;
+  assert(get_st(prog->files[1].st, &key, &val) == GTRES_OK);
+  return val.nlocals;
+}
+
+TEST(build_blocks) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_ir_prog(fn,
+    "function Sys.init 1\n"
+    "push constant 1\n"
+    "label loop\n"  // <- Entered with one value on the stack.
+    "push local 0\n"
+    "add\n"
+    "push constant 1\n"
+    "if-goto loop\n"
+    "return\n");
+  IrFunc fn_ir;
+  assert_int(build_ir(&prog->files[1], 0, 6, 1, &fn_ir), ==, IR_OK);
+  assert_int(fn_ir.nblocks, ==, 3);
+  assert_int(fn_ir.blocks[1].nparams, ==, 1);
+  assert_int(fn_ir.blocks[1].nexit, ==, 1);
+  assert_int(fn_ir.blocks[1].depth, ==, 1);
+  assert_int(fn_ir.insts[fn_ir.blocks[1].term].op, ==, IR_BRANCH);
+  del_ir(&fn_ir);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(reject_uneven_stack) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_ir_prog(fn,
+    "function Sys.init 0\n"
+    "push argument 0\n"
+    "if-goto skip\n"
+    "push constant 1\n"
+    "label skip\n"  // <- Stack depth is either one or zero.
+    "push constant 2\n"
+    "return\n");
+  IrFunc fn_ir;
+  assert_int(build_ir(&prog->files[1], 0, 5, 0, &fn_ir), ==, IR_ERR);
+  del_ir(&fn_ir);
+  assert_int(ir_prog(prog), ==, 0);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(forward_stored_values) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_ir_prog(fn,
+    "function Sys.init 2\n"
+    "push constant 3\n"
+    "pop local 0\n"
+    "push local 0\n"
+    "push local 1\n"  // <- Locals start out as zero.
+    "push constant 4\n"
+    "add\n"
+    "add\n"
+    "pop local 1\n"
+    "push local 1\n"
+    "return\n");
+  assert_int(ir_prog(prog), ==, 1);
+  const Insts* insts = &prog->files[1].insts;
+  assert_int(insts->idx, ==, 2);
+  assert_int(insts->cell[0].code, ==, PUSH);
+  assert_int(insts->cell[0].mem.seg, ==, CONST);
+  assert_int(insts->cell[0].mem.offset, ==, 7);
+  assert_int(insts->cell[1].code, ==, RET);
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 7);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(hoist_loop_invariants) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_ir_prog(fn,
+    "function Sys.init 2\n"
+    "push constant 0\n"
+    "pop local 1\n"
+    "label loop\n"
+    "push local 1\n"
+    "push constant 10\n"
+    "lt\n"
+    "not\n"
+    "if-goto end\n"
+    "push local 0\n"
+    "push static 0\n"  // <- `static 0 | 3` doesn't change in the loop.
+    "push constant 3\n"
+    "or\n"
+    "add\n"
+    "pop local 0\n"
+    "push local 1\n"
+    "push constant 1\n"
+    "add\n"
+    "pop local 1\n"
+    "goto loop\n"
+    "label end\n"
+    "push local 0\n"
+    "return\n");
+  assert_int(ir_prog(prog), ==, 1);
+  assert_int(nlocals_of(prog, "Sys.init"), ==, 3);
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 30);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(keep_error_positions) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_ir_prog(fn,
+    "function Sys.init 1\n"
+    "push constant 1\n"
+    "pop local 0\n"
+    "push constant 2\n"
+    "pop local 0\n"
+    "push argument 0\n"
+    "push argument 3\n"  // <- Fails.
+    "add\n"
+    "push local 0\n"
+    "add\n"
+    "return\n");
+  assert_int(ir_prog(prog), ==, 1);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream(":7:1):\033[0m address overflow in `push argument 3`", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(skip_shared_labels) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_ir_prog(fn,
+    "function Sys.init 1\n"
+    "goto inside\n"
+    "function Other 1\n"
+    "push constant 1\n"
+    "pop local 0\n"
+    "label inside\n"  // <- Reached from `Sys.init`.
+    "push local 0\n"
+    "push local 0\n"
+    "pop local 0\n"
+    "return\n");
+  assert_int(ir_prog(prog), ==, 0);
+  assert_int(prog->files[1].insts.idx, ==, 7);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(keep_ram_aliases) {
+  /* In the unified RAM, `that 0` is `temp 0` (RAM[5]). */
+  const char* srcs[] = {
+    "function Sys.init 0\n"
+    "push constant 5\n"
+    "pop pointer 1\n"
+    "push constant 5\n"
+    "pop temp 0\n"
+    "push constant 7\n"
+    "pop that 0\n"  // <- Changes `temp 0`.
+    "push temp 0\n"
+    "push temp 0\n"
+    "add\n"
+    "return\n",
+
+    "function Sys.init 0\n"
+    "push constant 5\n"
+    "pop pointer 1\n"
+    "push constant 14\n"
+    "pop temp 0\n"
+    "push that 0\n"  // <- Reads `temp 0`.
+    "push constant 1\n"
+    "pop temp 0\n"
+    "return\n",
+  };
+
+  for (size_t i = 0; i < sizeof(srcs) / sizeof(srcs[0]); i++) {
+    char fn[] = "/tmp/XXXXXX";
+    Program* prog = setup_ir_prog(fn, srcs[i]);
+    assert_int(use_ram(prog, 0x8000), ==, 1);
+    ir_prog(prog);
+    assert_int(exec_prog(prog), ==, 0);
+    assert_int(prog->stack.ops[0], ==, 14);
+    del_prog(prog);
+  }
+
+  return MUNIT_OK;
+}
+
+MunitTest ir_tests[] = {
+  REG_TEST(build_blocks),
+  REG_TEST(reject_uneven_stack),
+  REG_TEST(forward_stored_values),
+  REG_TEST(hoist_loop_invariants),
+  REG_TEST(keep_error_positions),
+  REG_TEST(skip_shared_labels),
+  REG_TEST(keep_ram_aliases),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
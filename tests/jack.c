@@ -0,0 +1,551 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/jack.h"
+#include "../src/link.h"
+#include "../src/exec.h"
+#include "utils.h"
+
+/* Run `Sys.init` with the given body and return its result.
+ * The result must be the same whether the calls are bound
+ * or go through the wrappers in the system file. */
+static Word run_body(const char* body) {
+  char src[512];
+  snprintf(src, sizeof(src), "function Sys.init 0\n%sreturn\n", body);
+
+  Word res[2];
+  for (int bind = 0; bind <= 1; bind++) {
+    char fn[] = "/tmp/XXXXXX";
+    setup_tmp(fn, src);
+    const char* argv[] = {fn};
+    Program* prog = make_prog(1, argv);
+    assert(prog != NULL);
+    if (bind) bind_builtins(prog);
+    assert(exec_prog(prog) == 0);
+    res[bind] = prog->stack.ops[0];
+    del_prog(prog);
+  }
+
+  assert(res[0] == res[1]);
+  return res[0];
+}
+
+/* Run `Sys.init` with the given body and check that it fails with `msg`. */
+static int fail_body(const char* body, const char* msg) {
+  char src[512];
+  snprintf(src, sizeof(src), "function Sys.init 0\n%sreturn\n", body);
+
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn, src);
+  const char* argv[] = {fn};
+  Program* prog = make_prog(1, argv);
+  assert(prog != NULL);
+  bind_builtins(prog);
+  int failed = exec_prog(prog) == EXEC_ERR && check_stream(msg, 400, stderr);
+  del_prog(prog);
+  return failed;
+}
+
+/* Call the native `name` directly. Returns `NATIVE_OK`
+ * or `NATIVE_ERR` like the native does. */
+static int call(const char* name, Heap* heap, const Word* args, Word* ret) {
+  for (unsigned int i = 0; i < count_natives(); i++) {
+    const Native* native = get_native(i);
+    if (strcmp(native->name, name) != 0) continue;
+
+    NativeCtx ctx = { .heap=heap, .data=native->data };
+    return native->fn(&ctx, args, ret);
+  }
+
+  assert(0);
+  return NATIVE_ERR;
+}
+
+/* `Memory.alloc` which must succeed. */
+static Word alloc(Heap* heap, Word size) {
+  Word addr;
+  int res = call("Memory.alloc", heap, &size, &addr);
+  assert(res == NATIVE_OK);
+  (void) res;
+  return addr;
+}
+
+static int dealloc(Heap* heap, Word addr) {
+  Word ret;
+  return call("Memory.deAlloc", heap, &addr, &ret);
+}
+
+TEST(math_arithmetic) {
+  assert_int(run_body("call Math.init 0\n"), ==, 0);
+
+  /* -3 * 7 = -21 */
+  assert_int((int16_t) run_body(
+    "push constant 3\nneg\npush constant 7\ncall Math.multiply 2\n"), ==, -21);
+  /* The product wraps around. */
+  assert_int(run_body(
+    "push constant 300\npush constant 300\ncall Math.multiply 2\n"), ==, (90000 & 0xFFFF));
+
+  /* -7 / 2 = -3 */
+  assert_int((int16_t) run_body(
+    "push constant 7\nneg\npush constant 2\ncall Math.divide 2\n"), ==, -3);
+  assert_int(run_body(
+    "push constant 32767\npush constant 10\ncall Math.divide 2\n"), ==, 3276);
+  /* -32768 / -1 wraps around. */
+  assert_int(run_body(
+    "push constant 32768\npush constant 1\nneg\ncall Math.divide 2\n"), ==, 32768);
+
+  assert_int(run_body("push constant 1000\ncall Math.sqrt 1\n"), ==, 31);
+  assert_int(run_body("push constant 32767\ncall Math.sqrt 1\n"), ==, 181);
+  assert_int(run_body("push constant 0\ncall Math.sqrt 1\n"), ==, 0);
+
+  return MUNIT_OK;
+}
+
+TEST(math_compare) {
+  assert_int(run_body("push constant 5\nneg\ncall Math.abs 1\n"), ==, 5);
+  assert_int(run_body("push constant 32768\ncall Math.abs 1\n"), ==, 32768);
+
+  /* The comparisons are signed. */
+  assert_int((int16_t) run_body(
+    "push constant 1\nneg\npush constant 1\ncall Math.min 2\n"), ==, -1);
+  assert_int(run_body(
+    "push constant 1\nneg\npush constant 1\ncall Math.max 2\n"), ==, 1);
+
+  return MUNIT_OK;
+}
+
+TEST(math_errors) {
+  assert_int(fail_body(
+    "push constant 1\npush constant 0\ncall Math.divide 2\n",
+    "`Math.divide` can't divide 1 by zero"), ==, 1);
+  assert_int(fail_body(
+    "push constant 4\nneg\ncall Math.sqrt 1\n",
+    "`Math.sqrt` can't take the square root of -4"), ==, 1);
+
+  return MUNIT_OK;
+}
+
+TEST(shadow_natives) {
+  /* A VM version of the class replaces the native one. */
+  char fn1[] = "/tmp/XXXXXX";
+  setup_tmp(fn1,
+    "function Math.multiply 0\n"
+    "push constant 42\n"
+    "return\n");
+  char fn2[] = "/tmp/XXXXXX";
+  setup_tmp(fn2,
+    "function Sys.init 0\n"
+    "push constant 2\n"
+    "push constant 3\n"
+    "call Math.multiply 2\n"
+    "push constant 4\n"
+    "call Math.sqrt 1\n"
+    "add\n"
+    "return\n");
+  const char* argv[] = { fn1, fn2 };
+
+  for (int bind = 0; bind <= 1; bind++) {
+    Program* prog = make_prog(2, argv);
+    assert_ptr_not_null(prog);
+    if (bind) assert_int(bind_builtins(prog), ==, 1);
+    assert_int(exec_prog(prog), ==, 0);
+    assert_int(prog->stack.ops[0], ==, 44);
+    del_prog(prog);
+  }
+
+  return MUNIT_OK;
+}
+
+TEST(memory_alloc) {
+  Heap heap = new_heap();
+
+  Word a = alloc(&heap, 3);
+  Word b = alloc(&heap, 5);
+  Word c = alloc(&heap, 1);
+  assert_int(a, >=, ALLOC_BASE);
+  assert_int(b, >, a + 3);
+  assert_int(c, >, b + 5);
+
+  /* Blocks of the same size are reused. */
+  assert_int(dealloc(&heap, b), ==, NATIVE_OK);
+  assert_int(alloc(&heap, 5), ==, b);
+
+  /* Free neighbours are merged into one block. */
+  assert_int(dealloc(&heap, a), ==, NATIVE_OK);
+  assert_int(dealloc(&heap, b), ==, NATIVE_OK);
+  assert_int(alloc(&heap, 8), ==, a);
+
+  /* Freeing everything leaves a single block again. */
+  assert_int(dealloc(&heap, a), ==, NATIVE_OK);
+  assert_int(dealloc(&heap, c), ==, NATIVE_OK);
+  assert_int(alloc(&heap, 1000), ==, a);
+
+  del_heap(heap);
+  return MUNIT_OK;
+}
+
+TEST(memory_errors) {
+  Heap heap = new_heap();
+  Word ret;
+
+  Word zero = 0;
+  assert_int(call("Memory.alloc", &heap, &zero, &ret), ==, NATIVE_ERR);
+
+  /* Only blocks which are in use can be freed. */
+  Word a = alloc(&heap, 2);
+  assert_int(dealloc(&heap, a + 1), ==, NATIVE_ERR);
+  assert_int(dealloc(&heap, a), ==, NATIVE_OK);
+  assert_int(dealloc(&heap, a), ==, NATIVE_ERR);
+  assert_int(dealloc(&heap, 0), ==, NATIVE_ERR);
+
+  Word poke[] = { MEM_HEAP_SIZE, 1 };
+  assert_int(call("Memory.poke", &heap, poke, &ret), ==, NATIVE_ERR);
+  poke[0] = 7;
+  assert_int(call("Memory.poke", &heap, poke, &ret), ==, NATIVE_OK);
+  assert_int(call("Memory.peek", &heap, poke, &ret), ==, NATIVE_OK);
+  assert_int(ret, ==, 1);
+
+  del_heap(heap);
+  return MUNIT_OK;
+}
+
+TEST(memory_region) {
+  assert_int(set_alloc_region(0x100, 1, MEM_HEAP_SIZE), ==, NATIVE_ERR);
+  assert_int(set_alloc_region(0x100, MEM_HEAP_SIZE, MEM_HEAP_SIZE), ==, NATIVE_ERR);
+  assert_int(set_alloc_region(0x100, 0x80, MEM_HEAP_SIZE), ==, NATIVE_OK);
+
+  Heap heap = new_heap();
+  Word a = alloc(&heap, 10);
+  assert_int(a, >, 0x100);
+  assert_int(a, <, 0x180);
+
+  /* The region is full. */
+  Word size = 0x80;
+  Word ret;
+  assert_int(call("Memory.alloc", &heap, &size, &ret), ==, NATIVE_ERR);
+
+  /* `Memory.init` frees all blocks. */
+  assert_int(call("Memory.init", &heap, NULL, &ret), ==, NATIVE_OK);
+  assert_int(alloc(&heap, 10), ==, a);
+  del_heap(heap);
+
+  assert_int(set_alloc_region(ALLOC_BASE, 0, MEM_HEAP_SIZE), ==, NATIVE_OK);
+  return MUNIT_OK;
+}
+
+/* Jack code for `"12"` as the compiler generates it. */
+#define STR_12 \
+  "push constant 2\ncall String.new 1\n" \
+  "push constant 49\ncall String.appendChar 2\n" \
+  "push constant 50\ncall String.appendChar 2\n"
+
+TEST(string_ops) {
+  assert_int(run_body(STR_12 "call String.length 1\n"), ==, 2);
+  assert_int(run_body(STR_12 "call String.intValue 1\n"), ==, 12);
+  assert_int(run_body(
+    STR_12 "push constant 1\ncall String.charAt 2\n"), ==, '2');
+
+  /* `setInt` and `intValue` handle negative numbers. */
+  assert_int((int16_t) run_body(
+    "push constant 6\ncall String.new 1\npop temp 0\n"
+    "push temp 0\npush constant 32768\ncall String.setInt 2\npop temp 1\n"
+    "push temp 0\ncall String.intValue 1\n"), ==, -32768);
+
+  assert_int(run_body(
+    STR_12 "pop temp 0\n"
+    "push temp 0\npush constant 0\npush constant 55\ncall String.setCharAt 3\npop temp 1\n"
+    "push temp 0\ncall String.eraseLastChar 1\npop temp 1\n"
+    "push temp 0\ncall String.intValue 1\n"), ==, 7);
+
+  return MUNIT_OK;
+}
+
+TEST(string_errors) {
+  assert_int(fail_body(STR_12 "push constant 51\ncall String.appendChar 2\n",
+    "`String.appendChar` can't append to a full string of length 2"), ==, 1);
+  assert_int(fail_body(STR_12 "push constant 2\ncall String.charAt 2\n",
+    "`String.charAt` can't access character 2 of a string of length 2"), ==, 1);
+  assert_int(fail_body(STR_12 "push constant 100\ncall String.setInt 2\n",
+    "`String.setInt` can't store 100 in a string of maximum length 2"), ==, 1);
+  assert_int(fail_body("push constant 0\ncall String.new 1\ncall String.eraseLastChar 1\n",
+    "`String.eraseLastChar` can't erase from an empty string"), ==, 1);
+
+  return MUNIT_OK;
+}
+
+TEST(array_ops) {
+  Heap heap = new_heap();
+  Word size = 10;
+  Word a;
+  assert_int(call("Array.new", &heap, &size, &a), ==, NATIVE_OK);
+  assert_int(call("Array.dispose", &heap, &a, &size), ==, NATIVE_OK);
+
+  /* The block is free again. */
+  assert_int(alloc(&heap, 10), ==, a);
+  size = 0;
+  assert_int(call("Array.new", &heap, &size, &a), ==, NATIVE_ERR);
+
+  del_heap(heap);
+  return MUNIT_OK;
+}
+
+#define SCREEN_WORD(heap, x, y) \
+  ((heap).mem[MEM_SCREEN + (y) * SCREEN_ROW_WORDS + (x) / 16])
+
+TEST(screen_draw) {
+  Heap heap = new_heap();
+  Word ret;
+  assert_int(call("Screen.init", &heap, NULL, &ret), ==, NATIVE_OK);
+
+  /* Spans fill whole words between their ends. */
+  Word rect[] = { 8, 1, 40, 2 };
+  assert_int(call("Screen.drawRectangle", &heap, rect, &ret), ==, NATIVE_OK);
+  assert_int(SCREEN_WORD(heap, 0, 1), ==, 0xFF00);
+  assert_int(SCREEN_WORD(heap, 16, 1), ==, 0xFFFF);
+  assert_int(SCREEN_WORD(heap, 32, 2), ==, 0x01FF);
+  assert_int(SCREEN_WORD(heap, 0, 3), ==, 0);
+
+  Word white = FALSE;
+  assert_int(call("Screen.setColor", &heap, &white, &ret), ==, NATIVE_OK);
+  Word pixel[] = { 17, 1 };
+  assert_int(call("Screen.drawPixel", &heap, pixel, &ret), ==, NATIVE_OK);
+  assert_int(SCREEN_WORD(heap, 16, 1), ==, 0xFFFD);
+
+  /* A diagonal line sets one pixel per row. */
+  Word black = TRUE;
+  assert_int(call("Screen.setColor", &heap, &black, &ret), ==, NATIVE_OK);
+  Word line[] = { 100, 10, 103, 13 };
+  assert_int(call("Screen.drawLine", &heap, line, &ret), ==, NATIVE_OK);
+  for (int i = 0; i <= 3; i++)
+    assert_int(SCREEN_WORD(heap, 100 + i, 10 + i), ==, 1 << ((100 + i) % 16));
+
+  /* Circles are symmetric and cut off at the border. */
+  Word circle[] = { 0, 100, 5 };
+  assert_int(call("Screen.drawCircle", &heap, circle, &ret), ==, NATIVE_OK);
+  assert_int(SCREEN_WORD(heap, 0, 95), ==, 0x0001);
+  assert_int(SCREEN_WORD(heap, 0, 100), ==, 0x003F);
+  assert_int(SCREEN_WORD(heap, 0, 105), ==, 0x0001);
+
+  assert_int(call("Screen.clearScreen", &heap, NULL, &ret), ==, NATIVE_OK);
+  assert_int(SCREEN_WORD(heap, 16, 1), ==, 0);
+
+  del_heap(heap);
+  return MUNIT_OK;
+}
+
+TEST(screen_errors) {
+  Heap heap = new_heap();
+  Word ret;
+
+  Word pixel[] = { 512, 0 };
+  assert_int(call("Screen.drawPixel", &heap, pixel, &ret), ==, NATIVE_ERR);
+  Word rect[] = { 10, 10, 5, 20 };
+  assert_int(call("Screen.drawRectangle", &heap, rect, &ret), ==, NATIVE_ERR);
+  Word circle[] = { 10, 10, 182 };
+  assert_int(call("Screen.drawCircle", &heap, circle, &ret), ==, NATIVE_ERR);
+
+  del_heap(heap);
+  return MUNIT_OK;
+}
+
+TEST(screen_map) {
+  /* The screen is accessible through `that` and `Memory.poke`. */
+  assert_int(run_body(
+    "push constant 16384\npush constant 7\ncall Memory.poke 2\npop temp 0\n"
+    "push constant 24575\npop pointer 1\npush constant 5\npop that 0\n"
+    "push constant 16384\npop pointer 1\npush that 0\n"
+    "push constant 24575\ncall Memory.peek 1\nadd\n"), ==, 12);
+  assert_int(fail_body("push constant 24577\npop pointer 1\npush that 0\n",
+    "address overflow"), ==, 1);
+  return MUNIT_OK;
+}
+
+TEST(screen_frames) {
+  char dir[] = "/tmp/XXXXXX";
+  assert_ptr_not_null(mkdtemp(dir));
+  char path[64], frame[64];
+  snprintf(path, sizeof(path), "%s/out.pbm", dir);
+  set_screen_file(path);
+
+  Heap heap = new_heap();
+  Word ret;
+  assert_int(call("Screen.dump", &heap, NULL, &ret), ==, NATIVE_OK);
+  /* Nothing changed since the first frame. */
+  assert_int(call("Screen.dump", &heap, NULL, &ret), ==, NATIVE_OK);
+  Word pixel[] = { 0, 0 };
+  assert_int(call("Screen.drawPixel", &heap, pixel, &ret), ==, NATIVE_OK);
+  assert_int(call("Screen.dump", &heap, NULL, &ret), ==, NATIVE_OK);
+  assert_int(write_screen(&heap), ==, NATIVE_OK);
+  del_heap(heap);
+  set_screen_file(NULL);
+
+  /* A PBM header and one bit per pixel. */
+  const char* files[] = { "out-1.pbm", "out-2.pbm", "out.pbm" };
+  for (int i = 0; i < 3; i++) {
+    snprintf(frame, sizeof(frame), "%s/%s", dir, files[i]);
+    FILE* f = fopen(frame, "rb");
+    assert_ptr_not_null(f);
+    char head[12];
+    assert_int(fread(head, 1, 11, f), ==, 11);
+    head[11] = '\0';
+    assert_string_equal(head, "P4\n512 256\n");
+    assert_int(fgetc(f), ==, i == 0 ? 0 : 0x80);
+    fclose(f);
+    remove(frame);
+  }
+  snprintf(frame, sizeof(frame), "%s/out-3.pbm", dir);
+  assert_int(access(frame, F_OK), ==, -1);
+  rmdir(dir);
+
+  return MUNIT_OK;
+}
+
+/* Row `r` of the glyph in column `col` of line `line`. */
+#define GLYPH_ROW(heap, line, col, r) \
+  ((SCREEN_WORD(heap, (col) * 8, (line) * 11 + (r)) >> ((col) % 2 * 8)) & 0xFF)
+
+TEST(output_print) {
+  Heap heap = new_heap();
+  Word ret;
+  assert_int(call("Output.init", &heap, NULL, &ret), ==, NATIVE_OK);
+
+  /* Two characters share a word. */
+  Word c = 'A';
+  assert_int(call("Output.printChar", &heap, &c, &ret), ==, NATIVE_OK);
+  c = 'B';
+  assert_int(call("Output.printChar", &heap, &c, &ret), ==, NATIVE_OK);
+  assert_int(SCREEN_WORD(heap, 0, 0), ==, (31 << 8) | 12);
+  assert_int(GLYPH_ROW(heap, 0, 0, 4), ==, 63);
+  assert_int(GLYPH_ROW(heap, 0, 1, 8), ==, 31);
+
+  /* Text wraps at the end of a line. */
+  Word pos[] = { 1, 63 };
+  assert_int(call("Output.moveCursor", &heap, pos, &ret), ==, NATIVE_OK);
+  Word num = (Word) -5;
+  assert_int(call("Output.printInt", &heap, &num, &ret), ==, NATIVE_OK);
+  assert_int(GLYPH_ROW(heap, 1, 63, 5), ==, 63);
+  assert_int(GLYPH_ROW(heap, 2, 0, 0), ==, 63);
+
+  assert_int(call("Output.backSpace", &heap, NULL, &ret), ==, NATIVE_OK);
+  assert_int(GLYPH_ROW(heap, 2, 0, 0), ==, 0);
+  c = 128;  /* Newline */
+  assert_int(call("Output.printChar", &heap, &c, &ret), ==, NATIVE_OK);
+  c = 200;
+  assert_int(call("Output.printChar", &heap, &c, &ret), ==, NATIVE_OK);
+  assert_int(GLYPH_ROW(heap, 3, 0, 0), ==, 63);
+
+  pos[0] = 23;
+  pos[1] = 0;
+  assert_int(call("Output.moveCursor", &heap, pos, &ret), ==, NATIVE_ERR);
+
+  del_heap(heap);
+  return MUNIT_OK;
+}
+
+TEST(output_print_string) {
+  /* `1` and `2` in the first word of the screen. */
+  assert_int(run_body(
+    "call Output.init 0\npop temp 0\n"
+    STR_12 "call Output.printString 1\npop temp 0\n"
+    "push constant 16384\ncall Memory.peek 1\n"), ==, (30 << 8) | 12);
+  /* The length is larger than the maximum length. */
+  assert_int(fail_body(
+    "push constant 101\npush constant 5\ncall Memory.poke 2\npop temp 0\n"
+    "push constant 100\ncall Output.printString 1\n",
+    "`Output.printString` got 100 which isn't a string"), ==, 1);
+  return MUNIT_OK;
+}
+
+/* Feed the keyboard from a script with the given events. */
+static void set_keys(const char* events) {
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn, events);
+  unsigned int line;
+  int res = set_keyboard(fn, 0, &line);
+  assert(res == NATIVE_OK);
+  (void) res;
+  remove(fn);
+}
+
+TEST(keyboard_read) {
+  Heap heap = new_heap();
+  Word ret, msg, zero = 0;
+  assert_int(call("Output.init", &heap, NULL, &ret), ==, NATIVE_OK);
+  assert_int(call("String.new", &heap, &zero, &msg), ==, NATIVE_OK);
+
+  /* The program sees the register directly. */
+  set_keys("0 x\n");
+  assert_int(start_keyboard(&heap), ==, NATIVE_OK);
+  for (int i = 0; i < 100 && heap.mem[MEM_KBD] == 0; i++) usleep(1000);
+  assert_int(heap.mem[MEM_KBD], ==, 'x');
+  assert_int(call("Keyboard.keyPressed", &heap, NULL, &ret), ==, NATIVE_OK);
+  assert_int(ret, ==, 'x');
+  stop_keyboard();
+
+  /* A backspace erases the `7`. */
+  set_keys("0 4\n20 none\n40 7\n60 backspace\n80 2\n100 none\n120 newline\n");
+  assert_int(start_keyboard(&heap), ==, NATIVE_OK);
+  assert_int(call("Keyboard.readInt", &heap, &msg, &ret), ==, NATIVE_OK);
+  assert_int(ret, ==, 42);
+  /* The script has ended. */
+  assert_int(call("Keyboard.readChar", &heap, NULL, &ret), ==, NATIVE_ERR);
+  stop_keyboard();
+  assert_int(GLYPH_ROW(heap, 0, 0, 0), ==, 16);
+  assert_int(GLYPH_ROW(heap, 0, 1, 0), ==, 30);
+
+  set_keys("0 o\n20 k\n40 newline\n");
+  assert_int(start_keyboard(&heap), ==, NATIVE_OK);
+  Word str;
+  assert_int(call("Keyboard.readLine", &heap, &msg, &str), ==, NATIVE_OK);
+  assert_int(call("String.length", &heap, &str, &ret), ==, NATIVE_OK);
+  assert_int(ret, ==, 2);
+  stop_keyboard();
+
+  set_keys("");
+  del_heap(heap);
+  return MUNIT_OK;
+}
+
+TEST(keyboard_script) {
+  char fn[] = "/tmp/XXXXXX";
+  unsigned int line;
+  setup_tmp(fn, "# Comment\n0 a\n10 f12 # F12\n\n5 b\n");
+  assert_int(set_keyboard(fn, 0, &line), ==, NATIVE_ERR);
+  assert_int(line, ==, 5);
+  remove(fn);
+  assert_int(set_keyboard(fn, 0, &line), ==, NATIVE_ERR);
+  assert_int(line, ==, 0);
+
+  /* Without a source, reading a key is an error. */
+  assert_int(set_keyboard(NULL, 0, &line), ==, NATIVE_OK);
+  assert_int(fail_body("call Keyboard.readChar 0\n",
+    "`Keyboard.readChar` needs keyboard input"), ==, 1);
+  return MUNIT_OK;
+}
+
+MunitTest jack_tests[] = {
+  REG_TEST(math_arithmetic),
+  REG_TEST(math_compare),
+  REG_TEST(math_errors),
+  REG_TEST(shadow_natives),
+  REG_TEST(memory_alloc),
+  REG_TEST(memory_errors),
+  REG_TEST(memory_region),
+  REG_TEST(string_ops),
+  REG_TEST(string_errors),
+  REG_TEST(array_ops),
+  REG_TEST(screen_draw),
+  REG_TEST(screen_errors),
+  REG_TEST(screen_map),
+  REG_TEST(screen_frames),
+  REG_TEST(output_print),
+  REG_TEST(output_print_string),
+  REG_TEST(keyboard_read),
+  REG_TEST(keyboard_script),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
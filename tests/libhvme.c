@@ -0,0 +1,206 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include "utils.h"
+#include "../src/libhvme.h"
+#include "../src/opt.h"
+
+#include <string.h>
+
+/* I/O of a VM in memory. */
+typedef struct {
+  char out[256];
+  char err[1024];
+  const char* in;
+} Io;
+
+static void io_out(void* data, const char* s) {
+  Io* io = (Io*) data;
+  strncat(io->out, s, sizeof(io->out) - strlen(io->out) - 1);
+}
+
+static void io_err(void* data, const char* s) {
+  Io* io = (Io*) data;
+  strncat(io->err, s, sizeof(io->err) - strlen(io->err) - 1);
+}
+
+static int io_in(void* data) {
+  Io* io = (Io*) data;
+  return *io->in != '\0' ? *io->in ++ : EOF;
+}
+
+static Hvme* new_vm(const char* fn, Io* io, int opt) {
+  HvmeConfig config = hvme_config();
+  config.opt = opt;
+  config.io = (HvmeIo) { .data=io, .out=io_out, .err=io_err, .in=io_in };
+  const char* files[] = { fn };
+  return hvme_new(1, files, &config);
+}
+
+TEST(runs_within_budget) {
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn,
+    "function Sys.init 0\n"
+    "push constant 3\n"
+    "pop static 0\n"
+    "label loop\n"
+    "push static 0\n"
+    "call Sys.print_num 1\n"
+    "pop temp 0\n"
+    "push static 0\n"
+    "push constant 1\n"
+    "sub\n"
+    "pop static 0\n"
+    "push static 0\n"
+    "if-goto loop\n"
+    "push constant 0\n"
+    "return\n");
+
+  Io full_io = { .in="" };
+  Hvme* full = new_vm(fn, &full_io, OPT_PEEPHOLE);
+  assert_int(hvme_run(full, HVME_UNLIMITED), ==, HVME_FINISHED);
+  assert_string_equal(full_io.out, "321");
+
+  /* Running one instruction at a time gives the same result. */
+  Io io = { .in="" };
+  Hvme* vm = new_vm(fn, &io, OPT_PEEPHOLE);
+  size_t nruns = 1;
+  while (hvme_run(vm, 1) == HVME_BUDGET) nruns ++;
+  assert_int(hvme_status(vm), ==, HVME_FINISHED);
+  assert_string_equal(io.out, "321");
+  assert_size(hvme_steps(vm), ==, hvme_steps(full));
+  assert_size(nruns, ==, hvme_steps(vm));
+
+  /* Finished programs don't run again. */
+  assert_int(hvme_run(vm, HVME_UNLIMITED), ==, HVME_FINISHED);
+  assert_size(hvme_steps(vm), ==, hvme_steps(full));
+  assert_null(hvme_error(vm));
+
+  hvme_del(full);
+  hvme_del(vm);
+  return MUNIT_OK;
+}
+
+TEST(errors_are_returned) {
+  {  // Runtime error.
+    char fn[] = "/tmp/XXXXXX";
+    setup_tmp(fn,
+      "function Sys.init 0\n"
+      "push constant 1\n"
+      "add\n"
+      "return\n");
+    Io io = { .in="" };
+    Hvme* vm = new_vm(fn, &io, OPT_PEEPHOLE);
+    assert_int(hvme_run(vm, HVME_UNLIMITED), ==, HVME_ERROR);
+    const HvmeError* error = hvme_error(vm);
+    assert_not_null(error);
+    assert_string_equal(error->pos.filename, fn);
+    assert_int(error->pos.ln, ==, 2);
+    assert_not_null(strstr(io.err, error->msg));
+    assert_int(hvme_run(vm, HVME_UNLIMITED), ==, HVME_ERROR);
+    hvme_del(vm);
+  }
+  {  // Syntax error.
+    char fn[] = "/tmp/XXXXXX";
+    setup_tmp(fn,
+      "function Sys.init 0\n"
+      "labll cool\n");
+    Io io = { .in="" };
+    Hvme* vm = new_vm(fn, &io, OPT_PEEPHOLE);
+    assert_int(hvme_status(vm), ==, HVME_ERROR);
+    assert_int(hvme_run(vm, HVME_UNLIMITED), ==, HVME_ERROR);
+    assert_not_null(hvme_error(vm));
+    assert_int(hvme_error(vm)->pos.ln, ==, 1);
+    assert_size(hvme_stack_depth(vm), ==, 0);
+    hvme_del(vm);
+  }
+  return MUNIT_OK;
+}
+
+TEST(memory_and_input_are_accessible) {
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn,
+    "function Sys.init 0\n"
+    "call Sys.read_num 0\n"
+    "pop static 1\n"
+    "push constant 42\n"
+    "push static 2\n"
+    "push constant 0\n"
+    "pop pointer 1\n"
+    "push that 7\n"
+    "add\n"
+    "add\n"
+    "return\n");
+
+  /* Without optimizations, the instructions run as they're written. */
+  Io io = { .in="  17\n" };
+  Hvme* vm = new_vm(fn, &io, OPT_NONE);
+  assert_true(hvme_static_set(vm, fn, 2, 100));
+  assert_true(hvme_poke(vm, 7, 1000));
+  assert_false(hvme_poke(vm, MEM_MAPS_END, 0));
+  assert_false(hvme_static_set(vm, "Missing.vm", 0, 0));
+
+  /* Stop before the last `add` (after the two
+   * instructions of the startup code). */
+  assert_int(hvme_run(vm, 2 + 8), ==, HVME_BUDGET);
+  Word val;
+  assert_true(hvme_static_get(vm, fn, 1, &val));
+  assert_int(val, ==, 17);
+  size_t depth = hvme_stack_depth(vm);
+  assert_true(hvme_stack_get(vm, depth - 2, &val));
+  assert_int(val, ==, 42);
+  assert_true(hvme_stack_get(vm, depth - 1, &val));
+  assert_int(val, ==, 1100);
+  assert_false(hvme_stack_get(vm, depth, &val));
+
+  assert_true(hvme_pop(vm, &val));
+  hvme_push(vm, 5);
+  assert_true(hvme_stack_set(vm, depth - 2, 6));
+  assert_int(hvme_run(vm, HVME_UNLIMITED), ==, HVME_FINISHED);
+  assert_size(hvme_stack_depth(vm), ==, 1);
+  assert_true(hvme_stack_get(vm, 0, &val));
+  assert_int(val, ==, 11);
+  assert_true(hvme_peek(vm, 7, &val));
+  assert_int(val, ==, 1000);
+
+  hvme_del(vm);
+  return MUNIT_OK;
+}
+
+TEST(runs_sources_in_memory) {
+  const char* text =
+    "function Sys.init 0\n"
+    "push constant 7\n"
+    "pop static 0\n"
+    "push constant 7\n"
+    "call Sys.print_num 1\n"
+    "pop temp 0\n"
+    "push constant 1\n"
+    "add\n"
+    "return\n";
+  SourceBuf buf = { "Main.vm", text, strlen(text) };
+
+  Io io = { .in="" };
+  HvmeConfig config = hvme_config();
+  config.io = (HvmeIo) { .data=&io, .out=io_out, .err=io_err, .in=io_in };
+  Hvme* vm = hvme_new_bufs(1, &buf, &config);
+  assert_int(hvme_run(vm, HVME_UNLIMITED), ==, HVME_ERROR);
+  assert_string_equal(io.out, "7");
+  assert_string_equal(hvme_error(vm)->pos.filename, "Main.vm");
+  assert_int(hvme_error(vm)->pos.ln, ==, 7);
+
+  Word val;
+  assert_true(hvme_static_get(vm, "Main.vm", 0, &val));
+  assert_int(val, ==, 7);
+  hvme_del(vm);
+
+  return MUNIT_OK;
+}
+
+MunitTest libhvme_tests[] = {
+  REG_TEST(runs_within_budget),
+  REG_TEST(errors_are_returned),
+  REG_TEST(memory_and_input_are_accessible),
+  REG_TEST(runs_sources_in_memory),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
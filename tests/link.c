@@ -0,0 +1,123 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <stdio.h>
+
+#include "../src/link.h"
+#include "../src/native.h"
+#include "../src/exec.h"
+#include "utils.h"
+
+TEST(strip_unreachable_code) {
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn,
+    "function unused 0\n"
+    "push constant 1\n"
+    "return\n"
+    "function used 0\n"
+    "push argument 0\n"
+    "goto end\n"
+    "push constant 7\n"  // <- Dead after `goto`.
+    "label end\n"
+    "return\n"
+    "function Sys.init 0\n"
+    "push constant 3\n"
+    "call used 1\n"
+    "return\n"
+    "push constant 9\n");  // <- Dead after `return`.
+  const char* argv[] = {fn};
+  Program* prog = make_prog(1, argv);
+  assert_ptr_not_null(prog);
+
+  LinkStats stats;
+  strip_prog(prog, &stats);
+  assert_int(stats.ninsts_before - stats.ninsts_after, >=, 4);
+  assert_int(prog->files[1].insts.idx, ==, 6);
+
+  SymVal val;
+  SymKey unused = mk_key("unused", SBT_FUNC);
+  assert_int(get_st(prog->files[1].st, &unused, &val), ==, GTRES_ERR);
+  SymKey used = mk_key("used", SBT_FUNC);
+  assert_int(get_st(prog->files[1].st, &used, &val), ==, GTRES_OK);
+  assert_int(val.inst_addr, ==, 0);
+  SymKey end = mk_key("end", SBT_LABEL);
+  assert_int(get_st(prog->files[1].st, &end, &val), ==, GTRES_OK);
+  assert_int(prog->files[1].insts.cell[val.inst_addr].code, ==, RET);
+
+  /* The stripped program still runs. */
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 3);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(keep_multiple_definitions) {
+  /* A call to a function which is defined in two other files
+   * must still fail with an error about multiple definitions. */
+  char fn1[] = "/tmp/XXXXXX";
+  setup_tmp(fn1, "function f 0\npush constant 1\nreturn\n");
+  char fn2[] = "/tmp/XXXXXX";
+  setup_tmp(fn2, "function f 0\npush constant 2\nreturn\n");
+  char fn3[] = "/tmp/XXXXXX";
+  setup_tmp(fn3, "function Sys.init 0\ncall f 0\nreturn\n");
+  const char* argv[] = { fn1, fn2, fn3 };
+  Program* prog = make_prog(3, argv);
+  assert_ptr_not_null(prog);
+
+  strip_prog(prog, NULL);
+  assert_int(prog->files[1].insts.idx, ==, 2);
+  assert_int(prog->files[2].insts.idx, ==, 2);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream("defined multiple times", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(bind_builtin_calls) {
+  char fn1[] = "/tmp/XXXXXX";
+  setup_tmp(fn1,
+    "function Sys.init 0\n"
+    "push constant 7\n"
+    "push constant 8\n"
+    "call Sys.print_char 2\n"  // <- Passes one argument too many.
+    "call Sys.read_num 0\n"
+    "add\n"
+    "return\n");
+  char fn2[] = "/tmp/XXXXXX";
+  setup_tmp(fn2,
+    "function Sys.read_num 0\n"  // <- Shadows the builtin.
+    "push constant 1\n"
+    "return\n");
+  const char* argv[] = { fn1, fn2 };
+  Program* prog = make_prog(2, argv);
+  assert_ptr_not_null(prog);
+
+  assert_int(bind_builtins(prog), ==, 1);
+  const Inst* call = &prog->files[1].insts.cell[2];
+  assert_int(call->code, ==, CALL_BUILTIN);
+  assert_string_equal(get_native(call->builtin.index)->name, "Sys.print_char");
+  assert_int(call->builtin.nargs, ==, 1);
+  assert_int(prog->files[1].insts.cell[3].code, ==, CALL);
+
+  /* The builtin's wrapper isn't called anymore. */
+  strip_prog(prog, NULL);
+  SymKey key = mk_key("Sys.print_char", SBT_FUNC);
+  SymVal val;
+  assert_int(get_st(prog->files[0].st, &key, &val), ==, GTRES_ERR);
+
+  /* `Sys.read_num` of the program is called instead. */
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 1);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+MunitTest link_tests[] = {
+  REG_TEST(strip_unreachable_code),
+  REG_TEST(keep_multiple_definitions),
+  REG_TEST(bind_builtin_calls),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
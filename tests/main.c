@@ -7,6 +7,19 @@ extern MunitTest parse_tests[];
 extern MunitTest exec_tests[];
 extern MunitTest st_tests[];
 extern MunitTest prog_tests[];
+extern MunitTest pos_tests[];
+extern MunitTest link_tests[];
+extern MunitTest opt_tests[];
+extern MunitTest ir_tests[];
+extern MunitTest reg_tests[];
+extern MunitTest inline_tests[];
+extern MunitTest native_tests[];
+extern MunitTest jack_tests[];
+extern MunitTest libhvme_tests[];
+extern MunitTest batch_tests[];
+extern MunitTest serve_tests[];
+extern MunitTest fork_server_tests[];
+extern MunitTest snapshot_tests[];
 
 static MunitSuite suites[] = {
   {
@@ -44,6 +57,97 @@ static MunitSuite suites[] = {
     1,
     MUNIT_SUITE_OPTION_NONE
   },
+  {
+    "/pos",
+    pos_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/link",
+    link_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/opt",
+    opt_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/ir",
+    ir_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/reg",
+    reg_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/inline",
+    inline_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/native",
+    native_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/jack",
+    jack_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/libhvme",
+    libhvme_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/batch",
+    batch_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/serve",
+    serve_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/fork_server",
+    fork_server_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
+  {
+    "/snapshot",
+    snapshot_tests,
+    NULL,
+    1,
+    MUNIT_SUITE_OPTION_NONE
+  },
   { NULL, NULL, NULL, 0, MUNIT_SUITE_OPTION_NONE }
 };
 
@@ -0,0 +1,152 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <stdio.h>
+
+#include "../src/native.h"
+#include "../src/link.h"
+#include "../src/exec.h"
+#include "utils.h"
+
+/* `Test.sum3 (a, b, c) -> a + b + c` */
+static int test_sum3(NativeCtx* ctx, const Word* args, Word* ret) {
+  *ret = args[0] + args[1] + args[2] + *(Word*) ctx->data;
+  return NATIVE_OK;
+}
+
+/* `Test.peek (addr) -> heap[addr]` */
+static int test_peek(NativeCtx* ctx, const Word* args, Word* ret) {
+  if (args[0] >= MEM_HEAP_SIZE)
+    return native_error(ctx, "can't peek at %d", args[0]);
+  *ret = ctx->heap->mem[args[0]];
+  return NATIVE_OK;
+}
+
+static Program* setup_native_prog(char* fn, const char* cnt) {
+  setup_tmp(fn, cnt);
+  const char* argv[] = {fn};
+  Program* prog = make_prog(1, argv);
+  assert(prog != NULL);
+  return prog;
+}
+
+TEST(call_natives) {
+  Word bias = 100;
+  assert_int(add_native("Test.sum3", 3, test_sum3, &bias), >=, 0);
+  assert_int(add_native("Test.peek", 1, test_peek, NULL), >=, 0);
+
+  const char* src =
+    "function Sys.init 0\n"
+    "push constant 7\n"
+    "pop pointer 0\n"
+    "push constant 5\n"
+    "pop this 0\n"
+    "push constant 1\n"
+    "push constant 2\n"
+    "push constant 3\n"
+    "call Test.sum3 3\n"
+    "push constant 7\n"
+    "call Test.peek 1\n"
+    "add\n"
+    "return\n";
+
+  /* Through the wrapper in the system file and directly. */
+  for (int bind = 0; bind <= 1; bind++) {
+    char fn[] = "/tmp/XXXXXX";
+    Program* prog = setup_native_prog(fn, src);
+    if (bind) assert_int(bind_builtins(prog), ==, 2);
+    assert_int(exec_prog(prog), ==, 0);
+    assert_int(prog->stack.ops[0], ==, 111);
+    del_prog(prog);
+  }
+
+  reset_natives();
+  return MUNIT_OK;
+}
+
+TEST(report_native_errors) {
+  assert_int(add_native("Test.peek", 1, test_peek, NULL), >=, 0);
+
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_native_prog(fn,
+    "function Sys.init 0\n"
+    "push constant 9999\n"
+    "call Test.peek 1\n"
+    "return\n");
+  bind_builtins(prog);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream("can't peek at 9999", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  char fn_str[] = "/tmp/XXXXXX";
+  prog = setup_native_prog(fn_str,
+    "function Sys.init 0\n"
+    "push constant 5\n"
+    "push constant 4094\n"
+    "call Sys.print_str 2\n"
+    "return\n");
+  bind_builtins(prog);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream("`Sys.print_str` tries to access heap at 4096", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  reset_natives();
+  return MUNIT_OK;
+}
+
+TEST(reject_invalid_natives) {
+  unsigned int n = count_natives();
+  assert_int(add_native("Sys.print_num", 1, test_peek, NULL), ==, -1);
+  assert_int(add_native("Test.many", NATIVE_MAX_ARGS + 1, test_peek, NULL), ==, -1);
+  assert_int(add_native("", 0, test_peek, NULL), ==, -1);
+  assert_int(add_native("Test.null", 0, NULL, NULL), ==, -1);
+  assert_int(count_natives(), ==, n);
+
+  assert_int(load_plugin("/tmp/does-not-exist.so"), ==, NATIVE_ERR);
+  assert_int(count_natives(), ==, n);
+
+  return MUNIT_OK;
+}
+
+TEST(load_plugins) {
+  unsigned int n = count_natives();
+  assert_int(load_plugin("tests/build/plugin_old.so"), ==, NATIVE_ERR);
+  assert_int(check_stream("built for version 0", 400, stderr), ==, 1);
+  assert_int(count_natives(), ==, n);
+
+  assert_int(load_plugin("tests/build/plugin.so"), ==, NATIVE_OK);
+  assert_int(count_natives(), ==, n + 1);
+
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_native_prog(fn,
+    "function Sys.init 0\n"
+    "push constant 7\n"
+    "pop pointer 0\n"
+    "push constant 21\n"
+    "pop this 0\n"
+    "push constant 7\n"
+    "call Test.double 1\n"
+    "push this 0\n"
+    "add\n"
+    "push constant 9999\n"
+    "call Test.double 1\n"
+    "return\n");
+  bind_builtins(prog);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(prog->heap.mem[7], ==, 42);
+  assert_int(prog->stack.ops[prog->stack.sp - 2], ==, 63);
+  assert_int(check_stream("tries to access heap at 9999", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  reset_natives();
+  assert_int(count_natives(), ==, n);
+  return MUNIT_OK;
+}
+
+MunitTest native_tests[] = {
+  REG_TEST(call_natives),
+  REG_TEST(report_native_errors),
+  REG_TEST(reject_invalid_natives),
+  REG_TEST(load_plugins),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
@@ -0,0 +1,199 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <stdio.h>
+
+#include "../src/opt.h"
+#include "../src/exec.h"
+#include "utils.h"
+
+static Program* setup_opt_prog(char* fn, const char* cnt) {
+  setup_tmp(fn, cnt);
+  const char* argv[] = {fn};
+  Program* prog = make_prog(1, argv);
+  assert(prog != NULL);
+  return prog;
+}
+
+TEST(fold_constants) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_opt_prog(fn,
+    "function Sys.init 0\n"
+    "push constant 2\n"
+    "push constant 3\n"
+    "add\n"
+    "push constant 4\n"
+    "add\n"
+    "neg\n"
+    "push constant 7\n"
+    "push constant 7\n"
+    "eq\n"
+    "and\n"
+    "return\n");
+  assert_int(opt_prog(prog, OPT_PEEPHOLE), ==, 9);
+  assert_int(prog->files[1].insts.idx, ==, 2);
+  assert_int(prog->files[1].insts.cell[0].code, ==, PUSH);
+  assert_int(prog->files[1].insts.cell[0].mem.seg, ==, CONST);
+  assert_int(prog->files[1].insts.cell[0].mem.offset, ==, (Word) -9);
+  assert_int(prog->files[1].insts.cell[1].code, ==, RET);
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, (Word) -9);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(keep_runtime_errors) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_opt_prog(fn,
+    "function Sys.init 0\n"
+    "push constant 65535\n"
+    "push constant 1\n"
+    "add\n"
+    "push constant 0\n"
+    "push constant 1\n"
+    "sub\n"
+    "return\n");
+  assert_int(opt_prog(prog, OPT_PEEPHOLE), ==, 0);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream(":4:1):\033[0m addition overflow: 65535 + 1", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(respect_labels) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_opt_prog(fn,
+    "function Sys.init 0\n"
+    "push constant 2\n"
+    "label middle\n"  // <- `add` can be jumped to.
+    "push constant 3\n"
+    "add\n"
+    "return\n");
+  assert_int(opt_prog(prog, OPT_PEEPHOLE), ==, 0);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(simplify_jumps) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_opt_prog(fn,
+    "function Sys.init 0\n"
+    "push static 1\n"
+    "pop static 1\n"
+    "goto first\n"
+    "label first\n"
+    "goto second\n"
+    "label yes\n"
+    "push constant 1\n"
+    "return\n"
+    "label second\n"
+    "push argument 0\n"
+    "push constant 2\n"
+    "lt\n"
+    "not\n"
+    "if-goto yes\n"
+    "push constant 0\n"
+    "return\n");
+  assert_int(opt_prog(prog, OPT_PEEPHOLE), ==, 3);
+  const Insts* insts = &prog->files[1].insts;
+  assert_int(insts->cell[0].code, ==, GOTO);
+  assert_string_equal(insts->cell[0].ident, "second");
+  assert_int(insts->cell[7].code, ==, IF_NOT_GOTO);
+  /* `Sys.init` receives `0` as its argument. */
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 0);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(use_tail_calls) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_opt_prog(fn,
+    "function Main.count 0\n"
+    "push argument 0\n"
+    "push constant 0\n"
+    "eq\n"
+    "if-goto done\n"
+    "push argument 0\n"
+    "push constant 1\n"
+    "sub\n"
+    "push argument 1\n"
+    "push constant 1\n"
+    "add\n"
+    "call Main.count 2\n"
+    "return\n"
+    "label done\n"
+    "push argument 1\n"
+    "return\n"
+    "function Sys.init 0\n"
+    "push constant 3000\n"
+    "push constant 0\n"
+    "call Main.count 2\n"
+    "return\n");
+  assert_int(opt_prog(prog, OPT_PEEPHOLE), ==, 0);
+  const Insts* insts = &prog->files[1].insts;
+  assert_int(insts->cell[10].code, ==, TAIL_CALL);
+  assert_int(insts->cell[11].code, ==, RET);
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.sp, ==, 1);
+  assert_int(prog->stack.ops[0], ==, 3000);
+  /* The recursion ran in constant stack space. */
+  assert_int(prog->stack.len, <, 64);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(keep_return_after_tail_call) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_opt_prog(fn,
+    "function Main.id 0\n"
+    "push argument 0\n"
+    "return\n"
+    "function Main.f 0\n"
+    "push constant 5\n"
+    "call Main.id 2\n"  // <- Takes a value from below the frame.
+    "return\n"
+    "function Sys.init 0\n"
+    "push constant 7\n"
+    "call Main.f 1\n"
+    "return\n");
+  assert_int(opt_prog(prog, OPT_PEEPHOLE), ==, 0);
+  assert_int(prog->files[1].insts.cell[3].code, ==, TAIL_CALL);
+  /* The frame can't be reused and `return` fails like before. */
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream(":7:1):\033[0m stack underflow", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(opt_none_changes_nothing) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_opt_prog(fn,
+    "function Sys.init 0\n"
+    "push constant 2\n"
+    "push constant 3\n"
+    "add\n"
+    "return\n");
+  assert_int(opt_prog(prog, OPT_NONE), ==, 0);
+  assert_int(prog->files[1].insts.idx, ==, 4);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+MunitTest opt_tests[] = {
+  REG_TEST(fold_constants),
+  REG_TEST(keep_runtime_errors),
+  REG_TEST(respect_labels),
+  REG_TEST(simplify_jumps),
+  REG_TEST(use_tail_calls),
+  REG_TEST(keep_return_after_tail_call),
+  REG_TEST(opt_none_changes_nothing),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
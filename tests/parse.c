@@ -16,7 +16,7 @@ static inline Tokens setup_tokens(Token* token_arr, size_t len) {
 
 TEST(correct_parse_errors) {
   {
-    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_CONST, .pos={.ln=0, .cl=5}}};
+    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_CONST, .off=5}};
     Tokens tokens = setup_tokens(tk_arr, 2);
     Insts insts = new_insts(NULL);
     int parse_res = parse(&tokens, &insts, NULL);
@@ -27,7 +27,7 @@ TEST(correct_parse_errors) {
  " | push constant ???\n"
  " |               ^^^",  36, stderr), ==, 1);
   } {
-    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_LOC}, {.t=TK_ARG, .pos={.ln=0, .cl=11}}};
+    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_LOC}, {.t=TK_ARG, .off=11}};
     Tokens tokens = setup_tokens(tk_arr, 3);
     Insts insts = new_insts(NULL);
     int parse_res = parse(&tokens, &insts, NULL);
@@ -38,7 +38,7 @@ TEST(correct_parse_errors) {
  " | push local argument\n"
  " |            ^^^^^^^^",  36, stderr), ==, 1);
   } {
-    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_LOC}, {.t=TK_ARG, .pos={.ln=0, .cl=11}}, {.t=TK_CONST}, {.t=TK_LOC}};
+    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_LOC}, {.t=TK_ARG, .off=11}, {.t=TK_CONST}, {.t=TK_LOC}};
     Tokens tokens = setup_tokens(tk_arr, 3);
     Insts insts = new_insts(NULL);
     int parse_res = parse(&tokens, &insts, NULL);
@@ -60,7 +60,7 @@ TEST(correct_parse_errors) {
  " | push ??? ???\n"
  " |      ^^^",  36, stderr), ==, 1);
   } {
-    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_POP, .pos={.ln=0, .cl=5}}, {.t=TK_PUSH}};
+    Token tk_arr[] = {{.t=TK_PUSH}, {.t=TK_POP, .off=5}, {.t=TK_PUSH}};
     Tokens tokens = setup_tokens(tk_arr, 3);
     Insts insts = new_insts(NULL);
     int parse_res = parse(&tokens, &insts, NULL);
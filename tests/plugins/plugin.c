@@ -0,0 +1,24 @@
+/* Plugin loaded by the tests in `native.c`. */
+#include "native.h"
+
+#ifndef TEST_PLUGIN_VERSION
+#define TEST_PLUGIN_VERSION NATIVE_ABI_VERSION
+#endif  // TEST_PLUGIN_VERSION
+
+const unsigned int hvme_plugin_version = TEST_PLUGIN_VERSION;
+
+static const NativeApi* hvme;
+
+/* `Test.double (addr) -> heap[addr]` doubles `heap[addr]`. */
+static int test_double(NativeCtx* ctx, const Word* args, Word* ret) {
+  Word val;
+  if (!hvme->peek(ctx, args[0], &val)) return NATIVE_ERR;
+  *ret = val;
+  return hvme->poke(ctx, args[0], 2 * val);
+}
+
+int hvme_plugin_init(const NativeApi* api) {
+  hvme = api;
+  return api->add_native("Test.double", 1, test_double, NULL) >= 0
+    ? NATIVE_OK : NATIVE_ERR;
+}
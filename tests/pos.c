@@ -0,0 +1,85 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <string.h>
+
+#include "../src/pos.h"
+#include "../src/scan.h"
+#include "utils.h"
+
+/* Internal scan function */
+extern ssize_t scan_blk(Tokens* tokens, const char* blk, size_t len);
+
+TEST(pos_from_buffer) {
+  Source* src = new_src("buffer");
+  const char* text = "push\n\tpop\n\nadd\n";
+  src_append(src, text, strlen(text));
+
+  Pos pos = src_pos(src, 0);  // `push`
+  assert_int(pos.ln, ==, 0);
+  assert_int(pos.cl, ==, 0);
+  pos = src_pos(src, 6);  // `pop`
+  assert_int(pos.ln, ==, 1);
+  assert_int(pos.cl, ==, 1);
+  pos = src_pos(src, 11);  // `add`
+  assert_int(pos.ln, ==, 3);
+  assert_int(pos.cl, ==, 0);
+  assert_string_equal(pos.filename, "buffer");
+
+  del_src(src);
+  return MUNIT_OK;
+}
+
+TEST(pos_from_file) {
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn, "label a\n  goto a\n");
+  Source* src = new_src(fn);
+  assert_int(src->indexed, ==, 0);
+
+  Pos pos = src_pos(src, 10);  // `goto`
+  assert_int(src->indexed, ==, 1);
+  assert_int(pos.ln, ==, 1);
+  assert_int(pos.cl, ==, 2);
+  assert_string_equal(pos.filename, fn);
+
+  del_src(src);
+  return MUNIT_OK;
+}
+
+TEST(tokens_store_offsets) {
+  Tokens tokens = new_tokens(NULL);
+  char* blk = "push constant 1\n  // comment\n  add\n";
+  ssize_t res = scan_blk(&tokens, blk, strlen(blk));
+  assert_int(res, ==, 0);
+  assert_int(tokens.cell[0].off, ==, 0);
+  assert_int(tokens.cell[1].off, ==, 5);
+  assert_int(tokens.cell[2].off, ==, 14);
+  assert_int(tokens.cell[3].off, ==, 31);
+  del_tokens(tokens);
+  return MUNIT_OK;
+}
+
+TEST(offsets_across_blocks) {
+  char fn[] = "/tmp/XXXXXX";
+  // Longer than `SCAN_BLOCK_SIZE` in unit tests.
+  setup_tmp(fn, "push constant 12345\npop local 1\npush that 7\n");
+  Tokens tokens = new_tokens(fn);
+  assert_int(scan(&tokens), ==, SCAN_OK);
+  assert_int(tokens.idx, ==, 9);
+  assert_int(tokens.cell[3].off, ==, 20);  // `pop`
+  assert_int(tokens.cell[6].off, ==, 32);  // `push`
+  assert_int(tokens.cell[8].off, ==, 42);  // `7`
+  Pos pos = src_pos(tokens.src, tokens.cell[8].off);
+  assert_int(pos.ln, ==, 2);
+  assert_int(pos.cl, ==, 10);
+  del_tokens(tokens);
+  return MUNIT_OK;
+}
+
+MunitTest pos_tests[] = {
+  REG_TEST(pos_from_buffer),
+  REG_TEST(pos_from_file),
+  REG_TEST(tokens_store_offsets),
+  REG_TEST(offsets_across_blocks),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
@@ -4,6 +4,7 @@
 #include <stdio.h>
 
 #include "../src/prog.h"
+#include "../src/exec.h"
 #include "utils.h"
 
 TEST(system_is_initialized) {
@@ -106,10 +107,116 @@ TEST(abort_all_on_error) {
   return MUNIT_OK;
 }
 
+TEST(prog_from_buffers) {
+  const char* main_vm =
+    "function Sys.init 0\n"
+    "push constant 2\n"
+    "return";
+  const char* bad_vm = "push constant 1\nlabll cool\n";
+  SourceBuf bufs[] = {
+    { "Main.vm", main_vm, strlen(main_vm) },
+    { "Bad.vm", bad_vm, strlen(bad_vm) },
+  };
+
+  Program* prog = make_prog_bufs(1, bufs);
+  assert_ptr_not_null(prog);
+  assert_int(prog->nfiles, ==, 2);
+  assert_string_equal(prog->files[1].filename, "Main.vm");
+  assert_int(prog->files[1].insts.idx, ==, 2);
+  assert_int(prog->files[1].insts.cell[1].code, ==, RET);
+  /* Positions refer to the buffer's name. */
+  Loc loc = { prog->files[1].insts.src, prog->files[1].insts.cell[1].off };
+  Pos pos = LOC_POS(loc);
+  assert_string_equal(pos.filename, "Main.vm");
+  assert_int(pos.ln, ==, 2);
+  del_prog(prog);
+
+  assert_ptr_equal(make_prog_bufs(2, bufs), NULL);
+  assert_int(check_stream("Bad.vm:2:1", 400, stderr), ==, 1);
+
+  return MUNIT_OK;
+}
+
+TEST(unified_ram) {
+  char fn1[] = "/tmp/XXXXXX";
+  setup_tmp(fn1,
+    "function Sys.init 0\n"
+    "push constant 7\npop static 1\n"
+    "push constant 3\npop temp 2\n"
+    "push constant 4096\npop pointer 1\n"
+    "push constant 9\npop that 0\n"
+    "push constant 3\npop pointer 0\npush this 1\npop static 0\n"
+    "call B.f 0\n"
+    "return\n");
+  char fn2[] = "/tmp/XXXXXX";
+  setup_tmp(fn2, "function B.f 0\npush constant 5\npop static 0\npush constant 0\nreturn\n");
+  const char* argv[] = { fn1, fn2 };
+  Program* prog = make_prog(2, argv);
+  assert_ptr_not_null(prog);
+  assert_int(use_ram(prog, 0x8000), ==, 1);
+  assert_int(exec_prog(prog), ==, 0);
+
+  /* The second file's statics follow the first file's. */
+  const Word* ram = prog->heap.mem;
+  assert_int(ram[RAM_STATIC + 1], ==, 7);
+  assert_int(ram[RAM_STATIC + 2], ==, 5);
+  assert_int(ram[RAM_TEMP + 2], ==, 3);
+  /* `this 1` is `that`. */
+  assert_int(ram[RAM_STATIC], ==, 4096);
+  assert_int(ram[4096], ==, 9);
+  assert_int(in_heap(&prog->heap, 0x7FFF), ==, 1);
+  assert_int(in_heap(&prog->heap, 0x8000), ==, 0);
+  del_prog(prog);
+
+  /* `temp` has 8 words like on the Hack platform. */
+  char fn3[] = "/tmp/XXXXXX";
+  setup_tmp(fn3, "function Sys.init 0\npush temp 8\nreturn\n");
+  argv[0] = fn3;
+  prog = make_prog(1, argv);
+  assert_ptr_not_null(prog);
+  assert_int(use_ram(prog, 0x10000), ==, 0);
+  assert_int(check_stream("segment has 8 entries in the RAM", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  /* Addresses beyond the RAM hit the guard pages. */
+  char fn4[] = "/tmp/XXXXXX";
+  setup_tmp(fn4,
+    "function Sys.init 0\n"
+    "push constant 32767\npop pointer 1\n"
+    "push constant 1\npop that 0\n"
+    "push constant 2\npop that 1\n"
+    "return\n");
+  argv[0] = fn4;
+  prog = make_prog(1, argv);
+  assert_ptr_not_null(prog);
+  assert_int(use_ram(prog, 0x8000), ==, 1);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream("`pop that 1` tries to access heap at 32768", 400, stderr), ==, 1);
+  assert_int(prog->heap.mem[0x7FFF], ==, 1);
+  del_prog(prog);
+
+  char fn5[] = "/tmp/XXXXXX";
+  setup_tmp(fn5,
+    "function Sys.init 0\n"
+    "push constant 32767\npush constant 32767\nadd\npop pointer 0\n"
+    "push this 2\nreturn\n");
+  argv[0] = fn5;
+  prog = make_prog(1, argv);
+  assert_ptr_not_null(prog);
+  assert_int(use_ram(prog, 0x10000), ==, 1);
+  assert_int(exec_prog(prog), ==, EXEC_ERR);
+  assert_int(check_stream("`push this 2` tries to access heap at 65536", 400, stderr), ==, 1);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
 MunitTest prog_tests[] = {
   REG_TEST(system_is_initialized),
   REG_TEST(single_file_prog_is_correct),
   REG_TEST(multi_file_prog_is_correct),
   REG_TEST(abort_all_on_error),
+  REG_TEST(prog_from_buffers),
+  REG_TEST(unified_ram),
   { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
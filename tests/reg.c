@@ -0,0 +1,124 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include <stdio.h>
+
+#include "../src/reg.h"
+#include "../src/exec.h"
+#include "utils.h"
+
+static Program* setup_reg_prog(char* fn, const char* cnt) {
+  setup_tmp(fn, cnt);
+  const char* argv[] = {fn};
+  Program* prog = make_prog(1, argv);
+  assert(prog != NULL);
+  return prog;
+}
+
+TEST(fuse_instructions) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_reg_prog(fn,
+    "function Sys.init 1\n"
+    "label loop\n"
+    "push local 0\n"
+    "push constant 1\n"
+    "add\n"
+    "pop local 0\n"
+    "push local 0\n"
+    "push constant 5\n"
+    "lt\n"
+    "if-goto loop\n"
+    "push local 0\n"
+    "return\n");
+  Regs* regs = make_regs(prog);
+  const RegFile* file = &regs->files[1];
+  assert_int(file->ninsts, ==, 5);
+
+  assert_int(file->insts[0].code, ==, REG_BINARY);
+  assert_int(file->insts[0].op, ==, ADD);
+  assert_int(file->insts[0].dst.kind, ==, OPD_LOC);
+  assert_int(file->insts[0].a.kind, ==, OPD_LOC);
+  assert_int(file->insts[0].b.kind, ==, OPD_CONST);
+  assert_int(file->insts[0].b.index, ==, 1);
+
+  assert_int(file->insts[1].code, ==, REG_BRANCH);
+  assert_int(file->insts[1].op, ==, LT);
+  assert_int(file->insts[1].target, ==, 0);
+  assert_int(file->insts[2].code, ==, REG_MOVE);
+  assert_int(file->insts[3].code, ==, REG_RET);
+  assert_int(file->insts[4].code, ==, REG_HALT);
+
+  assert_int(exec_regs(prog, regs), ==, 0);
+  assert_int(prog->stack.sp, ==, 1);
+  assert_int(prog->stack.ops[0], ==, 5);
+  del_regs(regs);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(call_functions) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_reg_prog(fn,
+    "function Main.fib 0\n"
+    "push argument 0\n"
+    "push constant 2\n"
+    "lt\n"
+    "if-goto base\n"
+    "push argument 0\n"
+    "push constant 1\n"
+    "sub\n"
+    "call Main.fib 1\n"
+    "push argument 0\n"
+    "push constant 2\n"
+    "sub\n"
+    "call Main.fib 1\n"
+    "add\n"
+    "return\n"
+    "label base\n"
+    "push argument 0\n"
+    "return\n"
+    "function Sys.init 0\n"
+    "push constant 16\n"
+    "call Main.fib 1\n"
+    "return\n");
+  Regs* regs = make_regs(prog);
+  assert_int(exec_regs(prog, regs), ==, 0);
+  assert_int(prog->stack.sp, ==, 1);
+  assert_int(prog->stack.ops[0], ==, 987);
+  del_regs(regs);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+TEST(keep_error_positions) {
+  char fn[] = "/tmp/XXXXXX";
+  Program* prog = setup_reg_prog(fn,
+    "function Sys.init 1\n"
+    "push constant 1\n"
+    "pop local 0\n"
+    "push local 0\n"
+    "push constant 65535\n"
+    "add\n"  // <- Covered by a register instruction.
+    "pop local 0\n"
+    "push local 0\n"
+    "return\n");
+  Regs* regs = make_regs(prog);
+  assert_int(exec_regs(prog, regs), ==, EXEC_ERR);
+  assert_int(check_stream(":6:1):\033[0m addition overflow: 1 + 65535", 400, stderr), ==, 1);
+  /* The operands are on the stack like without registers. */
+  assert_int(prog->stack.ops[prog->stack.sp - 1], ==, 65535);
+  assert_int(prog->stack.ops[prog->stack.sp - 2], ==, 1);
+  del_regs(regs);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+MunitTest reg_tests[] = {
+  REG_TEST(fuse_instructions),
+  REG_TEST(call_functions),
+  REG_TEST(keep_error_positions),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
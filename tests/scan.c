@@ -112,6 +112,49 @@ TEST(eat_comments) {
   return MUNIT_OK;
 }
 
+TEST(comments_dont_leak_into_other_tokens) {
+  /* The first block ends inside a comment. */
+  Tokens first = new_tokens(NULL);
+  char* blk = "push // comment";
+  assert_int(scan_blk(&first, blk, strlen(blk)), ==, 0);
+  assert_int(first.idx, ==, 1);
+
+  Tokens second = new_tokens(NULL);
+  blk = "pop\n";
+  assert_int(scan_blk(&second, blk, strlen(blk)), ==, 0);
+  assert_int(second.idx, ==, 1);
+  assert_int(second.cell[0].t, ==, TK_POP);
+
+  /* The comment continues in the next block of `first`. */
+  blk = " still a comment\npop\n";
+  assert_int(scan_blk(&first, blk, strlen(blk)), ==, 0);
+  assert_int(first.idx, ==, 2);
+  assert_int(first.cell[1].t, ==, TK_POP);
+  del_tokens(first);
+  del_tokens(second);
+
+  return MUNIT_OK;
+}
+
+TEST(scan_text_in_memory) {
+  /* The last token isn't followed by a newline. */
+  const char* text = "push constant 1 // one\npop";
+  Tokens tokens = new_buf_tokens("buf.vm", text, strlen(text));
+  assert_int(scan_buf(&tokens, text, strlen(text)), ==, SCAN_OK);
+  assert_int(tokens.idx, ==, 4);
+  assert_int(tokens.cell[2].t, ==, TK_UINT);
+  assert_int(tokens.cell[3].t, ==, TK_POP);
+  assert_int(tokens.cell[3].off, ==, 23);
+
+  Pos pos = src_pos(tokens.src, tokens.cell[3].off);
+  assert_string_equal(pos.filename, "buf.vm");
+  assert_int(pos.ln, ==, 1);
+  assert_int(pos.cl, ==, 0);
+  del_tokens(tokens);
+
+  return MUNIT_OK;
+}
+
 TEST(find_num_remaining) {
   Tokens tokens = new_tokens(NULL);
   // `scan` should return `2` to signal that the last
@@ -293,6 +336,8 @@ MunitTest scan_tests[] = {
   REG_TEST(scan_each_num),
   REG_TEST(eat_ws),
   REG_TEST(eat_comments),
+  REG_TEST(comments_dont_leak_into_other_tokens),
+  REG_TEST(scan_text_in_memory),
   REG_TEST(find_num_remaining),
   REG_TEST(scan_along_block_borders),
   REG_TEST(eat_comments_with_blocks),
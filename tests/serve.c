@@ -0,0 +1,144 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include "utils.h"
+#include "../src/serve.h"
+
+#include <string.h>
+#include <unistd.h>
+
+/* Output of a request. */
+typedef struct {
+  char out[256];
+  char err[1024];
+} Reply;
+
+static void reply_out(void* data, const char* s) {
+  Reply* reply = (Reply*) data;
+  strncat(reply->out, s, sizeof(reply->out) - strlen(reply->out) - 1);
+}
+
+static void reply_err(void* data, const char* s) {
+  Reply* reply = (Reply*) data;
+  strncat(reply->err, s, sizeof(reply->err) - strlen(reply->err) - 1);
+}
+
+static int request(int fd, ServeRequest* req, Reply* reply, uint64_t* id) {
+  memset(reply, 0, sizeof(Reply));
+  HvmeIo io = { .data=reply, .out=reply_out, .err=reply_err, .in=NULL };
+  return serve_request(fd, req, &io, id);
+}
+
+/* Name for a socket which doesn't exist yet. */
+static void socket_path(char path[]) {
+  setup_tmp(path, "");
+  unlink(path);
+}
+
+TEST(serves_requests) {
+  const char* text =
+    "function Sys.init 0\n"
+    "call Sys.read_num 0\n"
+    "push constant 2\n"
+    "call Math.multiply 2\n"
+    "call Sys.print_num 1\n"
+    "return\n";
+  SourceBuf buf = { "Main.vm", text, strlen(text) };
+  const char* loop = "function Sys.init 0\nlabel l\ngoto l\n";
+  SourceBuf loop_buf = { "Loop.vm", loop, strlen(loop) };
+  const char* bad = "function Sys.init 0\nadd\nreturn\n";
+  SourceBuf bad_buf = { "Bad.vm", bad, strlen(bad) };
+
+  char path[] = "/tmp/XXXXXX";
+  socket_path(path);
+  Server* server = new_server(path, 2, SERVE_CACHE_SIZE, NULL);
+  assert_not_null(server);
+  int fd = connect_server(path);
+  assert_int(fd, >=, 0);
+
+  /* The program is made by the first request and
+   * used again by later ones on the same connection. */
+  Reply reply;
+  uint64_t id = 0;
+  ServeRequest req = { .nbufs=1, .bufs=&buf, .input="21\n", .input_len=3,
+    .budget=HVME_UNLIMITED };
+  assert_int(request(fd, &req, &reply, &id), ==, SERVE_FINISHED);
+  assert_string_equal(reply.out, "42");
+
+  uint64_t same_id = 0;
+  req = (ServeRequest) { .nbufs=0, .id=id, .input="4", .input_len=1, .budget=HVME_UNLIMITED };
+  assert_int(request(fd, &req, &reply, &same_id), ==, SERVE_FINISHED);
+  assert_string_equal(reply.out, "8");
+  assert_true(same_id == id);
+
+  req = (ServeRequest) { .nbufs=0, .id=id + 1, .budget=HVME_UNLIMITED };
+  assert_int(request(fd, &req, &reply, &same_id), ==, SERVE_UNKNOWN);
+
+  req = (ServeRequest) { .nbufs=1, .bufs=&loop_buf, .budget=3 * 1000 * 1000 };
+  assert_int(request(fd, &req, &reply, &same_id), ==, SERVE_BUDGET);
+
+  req = (ServeRequest) { .nbufs=1, .bufs=&bad_buf, .budget=HVME_UNLIMITED };
+  assert_int(request(fd, &req, &reply, &same_id), ==, SERVE_ERROR);
+  assert_not_null(strstr(reply.err, "Bad.vm:2:1"));
+  close(fd);
+
+  /* Another client can run the cached program. */
+  fd = connect_server(path);
+  assert_int(fd, >=, 0);
+  req = (ServeRequest) { .nbufs=0, .id=id, .input="13", .input_len=2, .budget=HVME_UNLIMITED };
+  assert_int(request(fd, &req, &reply, &same_id), ==, SERVE_FINISHED);
+  assert_string_equal(reply.out, "26");
+  close(fd);
+
+  del_server(server);
+  assert_int(access(path, F_OK), !=, 0);
+  return MUNIT_OK;
+}
+
+TEST(evicts_programs) {
+  const char* texts[] = {
+    "function Sys.init 0\npush constant 1\ncall Sys.print_num 1\nreturn\n",
+    "function Sys.init 0\npush constant 2\ncall Sys.print_num 1\nreturn\n",
+  };
+
+  /* The cache only has room for one program. */
+  SourceBuf first = { "Main.vm", texts[0], strlen(texts[0]) };
+  HvmeConfig config = hvme_config();
+  Hvme* vm = hvme_new_bufs(1, &first, &config);
+  size_t size = hvme_size(vm);
+  hvme_del(vm);
+
+  char path[] = "/tmp/XXXXXX";
+  socket_path(path);
+  Server* server = new_server(path, 1, size + size / 2, &config);
+  assert_not_null(server);
+  int fd = connect_server(path);
+  assert_int(fd, >=, 0);
+
+  uint64_t ids[2];
+  Reply reply;
+  for (int i = 0; i < 2; i++) {
+    SourceBuf buf = { "Main.vm", texts[i], strlen(texts[i]) };
+    ServeRequest req = { .nbufs=1, .bufs=&buf, .budget=HVME_UNLIMITED };
+    assert_int(request(fd, &req, &reply, &ids[i]), ==, SERVE_FINISHED);
+  }
+  assert_true(ids[0] != ids[1]);
+
+  /* The first one was used least recently. */
+  uint64_t id;
+  ServeRequest req = { .nbufs=0, .id=ids[1], .budget=HVME_UNLIMITED };
+  assert_int(request(fd, &req, &reply, &id), ==, SERVE_FINISHED);
+  assert_string_equal(reply.out, "2");
+  req.id = ids[0];
+  assert_int(request(fd, &req, &reply, &id), ==, SERVE_UNKNOWN);
+  close(fd);
+
+  del_server(server);
+  return MUNIT_OK;
+}
+
+MunitTest serve_tests[] = {
+  REG_TEST(serves_requests),
+  REG_TEST(evicts_programs),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
@@ -0,0 +1,115 @@
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include "munit.h"
+
+#include "utils.h"
+#include "../src/snapshot.h"
+#include "../src/link.h"
+#include "../src/exec.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static const char* snapshot_src =
+  "function Sys.init 1\n"
+  "push constant 3\n"
+  "pop static 0\n"
+  "push constant 9\n"
+  "pop pointer 1\n"
+  "push constant 11\n"
+  "pop that 0\n"
+  "push constant 4\n"
+  "pop local 0\n"
+  "call Sys.snapshot 0\n"
+  "pop temp 1\n"
+  "push static 0\n"
+  "push local 0\n"
+  "add\n"
+  "push that 0\n"
+  "add\n"
+  "push temp 1\n"
+  "add\n"
+  "return\n";
+
+static Program* new_prog(const char* fn, int bind) {
+  const char* files[] = { fn };
+  Program* prog = make_prog(1, files);
+  assert(prog != NULL);
+  if (bind) bind_builtins(prog);
+  return prog;
+}
+
+TEST(restores_calls) {
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn, snapshot_src);
+  char snap[] = "/tmp/XXXXXX";
+  setup_tmp(snap, "");
+
+  /* Through the wrapper in the system file and directly. */
+  for (int bind = 0; bind <= 1; bind++) {
+    set_snapshot_file(snap);
+    Program* prog = new_prog(fn, bind);
+    assert_int(exec_prog(prog), ==, 0);
+    assert_int(prog->stack.ops[0], ==, 18);
+    del_prog(prog);
+    set_snapshot_file(NULL);
+
+    /* The run continues after the call, so it sees the
+     * change of the static instead of setting it again. */
+    prog = new_prog(fn, bind);
+    assert_int(load_snapshot(prog, snap), ==, SNAP_OK);
+    assert_int(prog->files[1].mem._static[0], ==, 3);
+    prog->files[1].mem._static[0] = 10;
+    assert_int(exec_prog(prog), ==, 0);
+    assert_int(prog->stack.ops[0], ==, 25);
+    del_prog(prog);
+  }
+  return MUNIT_OK;
+}
+
+TEST(restores_instruction_counts) {
+  char fn[] = "/tmp/XXXXXX";
+  setup_tmp(fn, snapshot_src);
+  char snap[] = "/tmp/XXXXXX";
+  setup_tmp(snap, "");
+
+  /* Stop after `pop pointer 1`. */
+  Program* prog = new_prog(fn, 1);
+  size_t budget = 2 + 4;
+  assert_int(exec_budget(prog, &budget), ==, EXEC_BUDGET);
+  assert_int(save_snapshot(prog, snap), ==, SNAP_OK);
+  del_prog(prog);
+
+  prog = new_prog(fn, 1);
+  assert_int(load_snapshot(prog, snap), ==, SNAP_OK);
+  assert_int(*prog->heap.that, ==, 9);
+  assert_int(exec_prog(prog), ==, 0);
+  assert_int(prog->stack.ops[0], ==, 18);
+  del_prog(prog);
+
+  /* Snapshots only fit the program they were taken from. */
+  char other[] = "/tmp/XXXXXX";
+  setup_tmp(other, "function Sys.init 0\nreturn\n");
+  prog = new_prog(other, 1);
+  assert_int(load_snapshot(prog, snap), ==, SNAP_MISMATCH);
+  assert_int(load_snapshot(prog, fn), ==, SNAP_INVALID);
+  assert_int(load_snapshot(prog, "/tmp/missing/snapshot"), ==, SNAP_ERR);
+  del_prog(prog);
+
+  /* Truncated snapshots are invalid. */
+  FILE* f = fopen(snap, "r+");
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fclose(f);
+  assert_int(truncate(snap, len - 1), ==, 0);
+  prog = new_prog(fn, 1);
+  assert_int(load_snapshot(prog, snap), ==, SNAP_INVALID);
+  del_prog(prog);
+
+  return MUNIT_OK;
+}
+
+MunitTest snapshot_tests[] = {
+  REG_TEST(restores_calls),
+  REG_TEST(restores_instruction_counts),
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};